@@ -1,33 +1,130 @@
 #include "casterreader.h"
-#include "crc24q.h"
+#include "rtcmframer.h"
+#include "rtcmquality.h"
+#include "fixrecord.h"
+#include "metrics.h"
+#include "trace.h"
+#include "logger.h"
 #include <QDebug>
-#include <QThread>
 #include <QRegularExpression>
+#include <algorithm>
+
+// An idle sourcetable connection is closed when no stream reuses it within this time
+static const int TABLE_IDLE_MS = 10000;
+// A stream response header longer than this is not waited for
+static const int MAX_RESPONSE_HEADER = 4096;
+
+// Sourcetable response: true once complete, with the body (chunks joined). The caster keeps the connection
+// open after it only with HTTP/1.1, a Content-Length or chunked body, and without "Connection: close": the
+// end of an NTRIP 1 sourcetable is only known from the closed connection.
+static bool parseSourcetable(const QByteArray& response, QByteArray& body, bool& keepAlive)
+{
+    int headerEnd = response.indexOf("\r\n\r\n");
+    if (headerEnd < 0) return false;
+    qsizetype length = -1;
+    bool chunked = false;
+    bool close = false;
+    const QList<QByteArray> lines = response.left(headerEnd).split('\n');
+    for (const QByteArray& line : lines) {
+        int colon = line.indexOf(':');
+        if (colon < 0) continue;
+        QByteArray name = line.left(colon).trimmed().toLower();
+        QByteArray value = line.mid(colon + 1).trimmed().toLower();
+        if (name == "content-length") length = value.toLongLong();
+        else if (name == "transfer-encoding") chunked = value.contains("chunked");
+        else if (name == "connection") close = value.contains("close");
+    }
+    keepAlive = lines.first().startsWith("HTTP/1.1") && !close && (chunked || length >= 0);
+
+    qsizetype pos = headerEnd + 4;
+    if (chunked) {
+        body.clear();
+        for (;;) {
+            qsizetype lineEnd = response.indexOf("\r\n", pos);
+            if (lineEnd < 0) return false;
+            bool ok;
+            qsizetype size = response.mid(pos, lineEnd - pos).split(';').first().trimmed().toLongLong(&ok, 16);
+            if (!ok) {
+                keepAlive = false;
+                body = response.mid(headerEnd + 4);
+                return true;
+            }
+            pos = lineEnd + 2;
+            if (size == 0) return response.indexOf("\r\n", pos) >= 0;   // Empty trailer
+            if (response.size() < pos + size + 2) return false;
+            body += response.mid(pos, size);
+            pos += size + 2;
+        }
+    }
+    if (length >= 0) {
+        body = response.mid(pos, length);
+        return response.size() >= pos + length;
+    }
+    body = response.mid(pos);
+    return body.contains("ENDSOURCETABLE");
+}
+
+// Start of the stream after the response header, -1 while incomplete. An NTRIP 1 caster may send the frames
+// right after "ICY 200 OK\r\n", without an empty line.
+static int streamStart(const QByteArray& buffer)
+{
+    int pos = 0;
+    for (;;) {
+        int eol = buffer.indexOf("\r\n", pos);
+        if (eol < 0) return -1;
+        if (eol == pos && pos > 0) return eol + 2;
+        pos = eol + 2;
+        if (pos < buffer.size() && static_cast<unsigned char>(buffer.at(pos)) == 0xD3) return pos;
+    }
+}
 
 CasterReader::CasterReader(QObject *parent)
     : QObject(parent),
     m_port(0),
-    m_socket(nullptr)
+    m_socket(nullptr),
+    m_tableSocket(nullptr),
+    m_tableIdle(false),
+    m_staticReplay(true),
+    m_replayPending(false),
+    m_compression(false),
+    m_decoder(nullptr),
+    m_headerPending(false),
+    m_tls(new CasterTlsSession(this)),
+    m_reuse(true),
+    m_startNs(0),
+    m_ticketOffered(false),
+    m_reused(false),
+    m_firstFrame(false),
+    m_monitorTimer(new QTimer(this))
 {
     m_connected = false;
+    m_monitor.setEventHandler([this](const RtcmStreamMonitor::Event& event) { onMonitorEvent(event); });
+    m_monitorTimer->setInterval(1000);
+    connect(m_monitorTimer, &QTimer::timeout, this, &CasterReader::onMonitorTick);
 }
 
 CasterReader::~CasterReader()
 {
     stop();
+    delete m_decoder;
 }
 
 void CasterReader::init(const QString &host, int port, const QString &user, const QString &password)
 {
+    // The TLS session and an idle connection belong to the previous caster
+    if (host != m_host || port != m_port) {
+        m_tls->clear();
+        if (m_tableSocket) m_tableSocket->abort();
+        m_tableIdle = false;
+    }
     m_host = host;
     m_port = port;
     m_user = user;
     m_password = password;
 
     if (!m_socket) {
-        m_socket = new QTcpSocket(this);
+        setStreamSocket(new QSslSocket(this));
     }
-    connect(m_socket, &QTcpSocket::connected, this, &CasterReader::onConnected);
 
     qDebug() << "NTRIP: Connecting to" << m_host << ":" << m_port;
     m_buffer.reserve(4096);
@@ -35,23 +132,75 @@ void CasterReader::init(const QString &host, int port, const QString &user, cons
 
 void CasterReader::start(const QString &mountpoint)
 {
-    m_socket->connectToHost(m_host, m_port);
-    m_socket->waitForConnected();
-    qDebug()<<"NTRIP: Starting communication with caster";
-    QThread::sleep(10);
+    stop();
+    m_buffer.clear();
+    delete m_decoder;
+    m_decoder = nullptr;
+    // The receiver still has the static messages of the previous station
+    if (mountpoint != m_mountpoint && !m_mountpoint.isEmpty()) {
+        scheduleStaticReplay();
+    }
     m_mountpoint = mountpoint;
-    connect(m_socket, &QTcpSocket::readyRead, this, &CasterReader::onReadyRead);
+    m_monitor.reset(monotonicNsecs());
+    m_monitor.setAdvertisedBitrate(advertisedBitrate(m_sourcetable, m_mountpoint));
+    m_monitorTotals = RtcmStreamMonitor::Stats();
+    m_monitorTimer->start();
+    m_startNs = monotonicNsecs();
+    m_firstFrame = false;
+    m_headerPending = true;
+    qDebug()<<"NTRIP: Starting communication with caster, mount point" << m_mountpoint;
+
+    // The connection of the sourcetable, still open
+    m_reused = m_reuse && m_tableIdle && m_tableSocket && m_tableSocket->state() == QAbstractSocket::ConnectedState;
+    m_ticketOffered = !m_reused && m_tls->isEnabled() && m_tls->hasTicket();
+    if (m_reused) {
+        QSslSocket* socket = m_tableSocket;
+        m_tableSocket = nullptr;
+        m_tableIdle = false;
+        setStreamSocket(socket);
+        Metrics::registry().ntripReusedConnections.add();
+        onConnected();
+        return;
+    }
+    m_tls->connectToHost(m_socket, m_host, m_port);
+}
+
+// The socket keeps its TLS and ticket connections, the ones of a sourcetable socket are dropped
+void CasterReader::setStreamSocket(QSslSocket* socket)
+{
+    if (m_socket) {
+        m_socket->disconnect(this);
+        m_socket->abort();
+        m_socket->deleteLater();
+    }
+    m_socket = socket;
+    m_socket->disconnect(this);
+    m_tls->onReady(m_socket, this, [this]() { onConnected(); });
+    connect(m_socket, &QSslSocket::readyRead, this, &CasterReader::onReadyRead);
     connect(m_socket, &QAbstractSocket::errorOccurred, this, &CasterReader::onErrorOccurred);
+}
 
-    QString auth = QByteArray(QString("%1:%2").arg(m_user).arg(m_password).toUtf8()).toBase64();
-    QString request = "GET /" + m_mountpoint + " HTTP/1.1\r\n";
-    request += "Host: " + m_host + ":" + QString::number(m_port) + "\r\n";
+QByteArray CasterReader::request(const QString& path, bool keepAlive) const
+{
+    QByteArray headers;
+    if (m_compression) {
+        headers = rtcmDeflateAvailable() ? "X-Rtcm-Compression: delta-deflate, delta\r\n" : "X-Rtcm-Compression: delta\r\n";
+    }
+    return ntripRequest(m_host, m_port, m_user, m_password, path, headers, keepAlive);
+}
+
+QByteArray CasterReader::ntripRequest(const QString& host, int port, const QString& user, const QString& password,
+                                      const QString& path, const QByteArray& extraHeaders, bool keepAlive)
+{
+    QByteArray auth = QString("%1:%2").arg(user, password).toUtf8().toBase64();
+    QByteArray request = "GET " + path.toUtf8() + " HTTP/1.1\r\n";
+    request += "Host: " + host.toUtf8() + ":" + QByteArray::number(port) + "\r\n";
     request += "User-Agent: QtNtripClient/1.0\r\n";
     request += "Authorization: Basic " + auth + "\r\n";
     request += "Ntrip-Version: Ntrip/2.0\r\n";
-    request += "Connection: close\r\n\r\n";
-    m_socket->write(request.toUtf8());
-
+    request += extraHeaders;
+    request += keepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+    return request;
 }
 
 void CasterReader::stop()
@@ -59,114 +208,324 @@ void CasterReader::stop()
     if (m_socket && m_socket->isOpen()) {
         m_socket->abort();
     }
+    m_monitorTimer->stop();
 }
 
 void CasterReader::onConnected()
 {
-    qDebug() << "NTRIP: Connected.";
+    Metrics::Registry& metrics = Metrics::registry();
+    qint64 connectNs = m_reused ? 0 : monotonicNsecs() - m_startNs;
+    RTK_LOG_INFO("ntrip", "Connected to the caster", {"mountpoint", m_mountpoint}, {"tls", m_tls->isEnabled()},
+                 {"ticket", m_ticketOffered}, {"resumed", CasterTlsSession::isResumed(m_socket)}, {"reused", m_reused},
+                 {"ms", connectNs / 1e6});
     m_connected = true;
+    metrics.ntripConnections.add();
+    metrics.ntripConnectUs.set(connectNs / 1000);
+    m_socket->write(request("/" + m_mountpoint));
 }
 
 void CasterReader::onReadyRead()
 {
+    RTK_TRACE_SCOPE("CasterReader::onReadyRead");
     m_buffer.append(m_socket->readAll());
 
-    // Check for the initial HTTP response
-    if (m_buffer.startsWith("ICY 200 OK") || m_buffer.startsWith("HTTP/1.1 200 OK")) {
-        qDebug() << "NTRIP: " << m_buffer.split('\r').first();
-        qDebug() << "NTRIP: Starting to receive data...";
-        // Find the end of the header and remove it
-        int headerEnd = m_buffer.indexOf("\r\n\r\n");
-        if (headerEnd != -1) {
-            m_buffer.remove(0, headerEnd + 4);
+    // The response header, possibly split over several reads, comes before any frame
+    if (m_headerPending && !m_buffer.isEmpty()) {
+        // A stream without header starts with a frame
+        if (static_cast<unsigned char>(m_buffer.at(0)) == 0xD3) {
+            m_headerPending = false;
+        } else {
+            int headerEnd = streamStart(m_buffer);
+            if (headerEnd == -1) {
+                if (m_buffer.size() < MAX_RESPONSE_HEADER) return;
+                qWarning() << "NTRIP: no end of the response header in" << m_buffer.size() << "bytes";
+                m_headerPending = false;
+            } else {
+                QByteArray header = m_buffer.left(headerEnd);
+                QByteArray status = header.left(header.indexOf('\r'));
+                m_buffer.remove(0, headerEnd);
+                m_headerPending = false;
+                if (status.startsWith("ICY 200 OK") || status.startsWith("HTTP/1.1 200 OK")
+                    || status.startsWith("HTTP/1.0 200 OK")) {
+                    qDebug() << "NTRIP: " << status;
+                    qDebug() << "NTRIP: Starting to receive data...";
+                    startDecoder(header);
+                } else {
+                    qWarning() << "NTRIP: unexpected response" << status;
+                }
+            }
         }
     }
+    if (m_buffer.isEmpty() || !m_socket->isOpen()) return;
+
+    if (m_decoder) {
+        decode_compressed(m_buffer);
+    } else {
+        extract_rtcm_packets(m_buffer);
+    }
+}
 
-    extract_rtcm_packets(m_buffer);
+// A relay answering with X-Rtcm-Compression sends the compressed stream
+void CasterReader::startDecoder(const QByteArray& header)
+{
+    delete m_decoder;
+    m_decoder = nullptr;
+    for (const QByteArray& line : header.split('\n')) {
+        int colon = line.indexOf(':');
+        if (colon < 0 || line.left(colon).trimmed().toLower() != "x-rtcm-compression") continue;
+        RtcmCompression method;
+        QByteArray name = line.mid(colon + 1).trimmed().toLower();
+        if (!rtcmCompressionFromName(name.toStdString(), method)) {
+            qCritical() << "NTRIP: unsupported stream compression" << name;
+            stop();
+            return;
+        }
+        m_decoder = new RtcmStreamDecoder(method);
+        qDebug() << "NTRIP: compressed stream," << name;
+    }
 }
 
 void CasterReader::onErrorOccurred(QAbstractSocket::SocketError socketError)
 {
     Q_UNUSED(socketError);
+    // The caster closed the kept connection before the stream: it is requested again on a new one
+    if (m_reused && !m_firstFrame) {
+        RTK_LOG_INFO("ntrip", "Reused connection closed by the caster", {"mountpoint", m_mountpoint},
+                     {"error", m_socket->errorString()});
+        Metrics::registry().ntripReuseFallbacks.add();
+        m_reused = false;
+        m_buffer.clear();
+        delete m_decoder;
+        m_decoder = nullptr;
+        m_headerPending = true;
+        setStreamSocket(new QSslSocket(this));
+        m_startNs = monotonicNsecs();
+        m_ticketOffered = m_tls->isEnabled() && m_tls->hasTicket();
+        m_tls->connectToHost(m_socket, m_host, m_port);
+        return;
+    }
     qCritical() << "NTRIP Socket Error:" << m_socket->errorString();
     stop();
+    emit streamFailed(m_mountpoint);
 }
 
 void CasterReader::extract_rtcm_packets(QByteArray &buffer)
 {
-    int offset = 0;
-    while (offset <= buffer.size() - 8) { // Minimum RTCM packet size is 8 bytes
-        if (static_cast<unsigned char>(buffer.at(offset)) != 0xD3) {
-            offset++;
-            continue;
-        }
+    RTK_TRACE_SCOPE("CasterReader::extract_rtcm_packets");
+    Metrics::Registry& metrics = Metrics::registry();
+    RtcmFrameStats stats;
+    size_t consumed = rtcmExtractFrames(reinterpret_cast<const unsigned char*>(buffer.constData()), buffer.size(),
+        [this](const unsigned char* frame, size_t length, int type) { handleFrame(frame, length, type); }, &stats);
 
-        if (buffer.size() - offset < 3) {
-            break; // Not enough data for header
-        }
+    if (stats.crcFailures > 0) {
+        m_monitor.addCrcFailures(stats.crcFailures, monotonicNsecs());
+        RTK_LOG_SUMMARY(Log::Warning, 10000, "rtcm", "RTCM packets with an invalid CRC discarded", stats.crcFailures);
+        metrics.rtcmCrcFailures.add(stats.crcFailures);
+    }
+    metrics.rtcmResyncBytes.add(stats.resyncBytes);
+    buffer.remove(0, consumed);
+}
 
-        size_t length = ((static_cast<unsigned char>(buffer.at(offset + 1)) & 0x03) << 8) | static_cast<unsigned char>(buffer.at(offset + 2));
-        size_t total_length = length + 6; // 3 header bytes + payload + 3 crc bytes
+// The frames come out of the decoder as sent by the caster of the relay, CRC included
+void CasterReader::decode_compressed(QByteArray &buffer)
+{
+    RTK_TRACE_SCOPE("CasterReader::decode_compressed");
+    size_t consumed = m_decoder->addData(reinterpret_cast<const unsigned char*>(buffer.constData()), buffer.size(),
+        [this](const unsigned char* frame, size_t length, int type) { handleFrame(frame, length, type); });
+    Metrics::registry().ntripCompressedBytes.add(consumed);
+    buffer.remove(0, consumed);
+    if (m_decoder->failed()) {
+        qCritical() << "NTRIP: corrupted compressed stream, disconnecting";
+        buffer.clear();
+        stop();
+    }
+}
 
-        if (buffer.size() - offset < static_cast<long>(total_length)) {
-            break; // Incomplete packet
-        }
+void CasterReader::handleFrame(const unsigned char* frame, size_t length, int type)
+{
+    Metrics::Registry& metrics = Metrics::registry();
+    RTK_LOG_RATE(Log::Debug, 10000, "rtcm", "RTCM packet received", {"type", type}, {"length", static_cast<int>(length)});
+    qint64 now = monotonicNsecs();
+    metrics.rtcmFrames[type].add();
+    metrics.rtcmBytes[type].add(length);
+    metrics.lastRtcmNs.set(now);
+    m_monitor.addFrame(frame, length, type, now);
+    if (!m_firstFrame) {
+        m_firstFrame = true;
+        metrics.ntripFirstFrameUs.set((now - m_startNs) / 1000);
+        RTK_LOG_INFO("ntrip", "First RTCM frame", {"mountpoint", m_mountpoint}, {"reused", m_reused},
+                     {"ms", (now - m_startNs) / 1e6});
+    }
+    Packet packet(reinterpret_cast<const char*>(frame), length);
+    if (isStaticMessage(type)) {
+        m_staticMessages[m_mountpoint].insert(type, packet);
+    } else if (m_replayPending && rtcmObservationSystem(type)) {
+        replayStaticMessages();
+    }
+    emit rtcmPacketReady(packet);
+}
 
-        Packet packet = buffer.mid(offset, total_length);
-        Packet payload = buffer.mid(offset, total_length - 3);
+bool CasterReader::isStaticMessage(int type)
+{
+    switch (type) {
+    case 1005: case 1006:               // Station coordinates
+    case 1007: case 1008: case 1033:    // Antenna and receiver descriptors
+    case 1230:                          // GLONASS code-phase biases
+        return true;
+    default:
+        return false;
+    }
+}
 
-        uint32_t crc_received = (static_cast<unsigned char>(packet.at(total_length - 3)) << 16) |
-                                (static_cast<unsigned char>(packet.at(total_length - 2)) << 8) |
-                                 static_cast<unsigned char>(packet.at(total_length - 1));
+void CasterReader::scheduleStaticReplay()
+{
+    if (m_staticReplay) {
+        m_replayPending = true;
+    }
+}
 
-        std::vector<unsigned char> payload_vec(payload.begin(), payload.end());
-        uint32_t crc_computed = rtcm_crc(payload_vec);
+// Sends the cached static messages of the current mount point, ahead of the epoch being received
+void CasterReader::replayStaticMessages()
+{
+    m_replayPending = false;
+    const QMap<int, Packet> messages = m_staticMessages.value(m_mountpoint);
+    if (messages.isEmpty()) {
+        return;
+    }
+    QStringList types;
+    for (auto it = messages.cbegin(); it != messages.cend(); ++it) {
+        types.append(QString::number(it.key()));
+        emit rtcmPacketReady(it.value());
+    }
+    Metrics::registry().rtcmStaticReplays.add();
+    RTK_LOG_INFO("rtcm", "Static messages replayed", {"mountpoint", m_mountpoint}, {"types", types.join(',')});
+}
 
-        if (crc_received == crc_computed) {
-            uint32_t type = (static_cast<unsigned char>(payload.at(3)) << 4) | ((static_cast<unsigned char>(payload.at(4)) & 240) >> 4);
-            qDebug() << "RTCM packet received (CRC OK), type:" << type << "length" << total_length;
-            emit rtcmPacketReady(packet);
-            offset += total_length;
-        } else {
-            qWarning() << "Invalid CRC for packet. Discarding.";
-            offset++; // Skip the 0xD3 byte and search again
-        }
+void CasterReader::requestSourcetable()
+{
+    // Another request on the idle connection
+    if (m_tableIdle && m_tableSocket && m_tableSocket->state() == QAbstractSocket::ConnectedState) {
+        qDebug() << "NTRIP: *** Fetching the sourcetable (same connection) ***";
+        m_tableIdle = false;
+        m_table.clear();
+        onSourcetableConnected();
+        return;
     }
-    buffer.remove(0, offset);
+    m_tableIdle = false;
+    if (!m_tableSocket) {
+        m_tableSocket = new QSslSocket(this);
+        m_tls->onReady(m_tableSocket, this, [this]() { onSourcetableConnected(); });
+        connect(m_tableSocket, &QSslSocket::readyRead, this, &CasterReader::onSourcetableData);
+        connect(m_tableSocket, &QSslSocket::disconnected, this, &CasterReader::onSourcetableFinished);
+        connect(m_tableSocket, &QAbstractSocket::errorOccurred, this, [this](QAbstractSocket::SocketError error) {
+            if (error == QAbstractSocket::RemoteHostClosedError) return; // End of the sourcetable
+            qWarning() << "NTRIP: Sourcetable request failed:" << m_tableSocket->errorString();
+            m_table.clear();
+            m_tableSocket->abort();
+        });
+    }
+    if (m_tableSocket->state() != QAbstractSocket::UnconnectedState) {
+        return; // Already in progress
+    }
+    qDebug() << "NTRIP: *** Fetching the sourcetable ***";
+    m_table.clear();
+    m_tls->connectToHost(m_tableSocket, m_host, m_port);
 }
 
+void CasterReader::onSourcetableConnected()
+{
+    m_tableSocket->write(request("/", m_reuse));
+}
 
-QString CasterReader::getAutoMountPoint(double lat, double lon)
+// Without reuse the sourcetable ends with the connection, otherwise with the end of the response
+void CasterReader::onSourcetableData()
 {
-    m_socket->connectToHost(m_host, m_port);
-    m_socket->waitForConnected();
-    m_mountpoint="";
-    qDebug() << "NTRIP: *** Detecting closest caster ***";
-    QString auth = QByteArray(QString("%1:%2").arg(m_user).arg(m_password).toUtf8()).toBase64();
-    QString request = "GET / HTTP/1.1\r\n";
-    request += "Host: " + m_host + ":" + QString::number(m_port) + "\r\n";
-    request += "User-Agent: QtNtripClient/1.0\r\n";
-    request += "Authorization: Basic " + auth + "\r\n";
-    request += "Ntrip-Version: Ntrip/2.0\r\n";
-    request += "Connection: close\r\n\r\n";
-    m_socket->write(request.toLocal8Bit());
-    m_socket->waitForBytesWritten();
+    m_table.append(m_tableSocket->readAll());
+    QByteArray body;
+    bool keepAlive;
+    if (!m_reuse || !parseSourcetable(m_table, body, keepAlive)) {
+        return;
+    }
+    if (keepAlive) {
+        m_tableIdle = true;
+        QSslSocket* socket = m_tableSocket;
+        QTimer::singleShot(TABLE_IDLE_MS, this, [this, socket]() {
+            if (m_tableSocket == socket && m_tableIdle) {
+                m_tableIdle = false;
+                m_tableSocket->disconnectFromHost();
+            }
+        });
+    }
+    onSourcetableFinished();
+}
+
+void CasterReader::onSourcetableFinished()
+{
+    m_table.append(m_tableSocket->readAll());
+    if (m_table.isEmpty()) return;
+    // Only the body, without the HTTP headers, also when the connection was closed before its end
+    QByteArray sourcetable;
+    bool keepAlive;
+    if (!parseSourcetable(m_table, sourcetable, keepAlive) && sourcetable.isEmpty()) {
+        int headerEnd = m_table.indexOf("\r\n\r\n");
+        sourcetable = headerEnd >= 0 ? m_table.mid(headerEnd + 4) : m_table;
+    }
+    m_table.clear();
+    m_sourcetable = sourcetable;
+    // The stream of a warm start was started without it
+    m_monitor.setAdvertisedBitrate(advertisedBitrate(m_sourcetable, m_mountpoint));
+    emit sourcetableReady(sourcetable);
+}
+
+void CasterReader::onMonitorTick()
+{
+    qint64 now = monotonicNsecs();
+    m_monitor.tick(now);
+
+    // The totals restart with each stream, the counters are increased by the difference
+    Metrics::Registry& metrics = Metrics::registry();
+    RtcmStreamMonitor::Stats stats = m_monitor.stats(now);
+    metrics.rtcmEpochs.add(stats.epochs - m_monitorTotals.epochs);
+    metrics.rtcmIncompleteEpochs.add(stats.incompleteEpochs - m_monitorTotals.incompleteEpochs);
+    metrics.rtcmMissingEpochs.add(stats.missingEpochs - m_monitorTotals.missingEpochs);
+    metrics.rtcmDuplicateEpochs.add(stats.duplicateEpochs - m_monitorTotals.duplicateEpochs);
+    m_monitorTotals = stats;
+    metrics.rtcmJitterUs.set(qRound64(stats.jitterMs * 1000));
+    metrics.rtcmBitrate.set(qRound64(stats.bitrate));
+    metrics.rtcmAdvertisedBitrate.set(stats.advertisedBitrate);
+    for (int i = 0; i < RtcmStreamMonitor::STATIC_TYPES; ++i) {
+        metrics.rtcmStaticAgeMs[i].set(stats.staticAgeSeconds[i] < 0 ? -1 : qRound64(stats.staticAgeSeconds[i] * 1000));
+    }
+    for (int condition = 0; condition < RtcmStreamMonitor::CONDITION_COUNT; ++condition) {
+        metrics.rtcmAlerts[condition].set(stats.active[condition] ? 1 : 0);
+    }
+}
 
-    QByteArray answer = m_socket->readAll();
-    while(m_socket->waitForReadyRead()){
-        answer.append(m_socket->readAll());
+void CasterReader::onMonitorEvent(const RtcmStreamMonitor::Event& event)
+{
+    QString condition = RtcmStreamMonitor::conditionName(event.condition);
+    if (event.active) {
+        RTK_LOG_WARNING("rtcm", "Correction stream alert raised", {"mountpoint", m_mountpoint}, {"condition", condition},
+                        {"value", event.value}, {"threshold", event.threshold}, {"type", event.type});
+    } else {
+        RTK_LOG_INFO("rtcm", "Correction stream alert cleared", {"mountpoint", m_mountpoint}, {"condition", condition});
     }
-    QStringList casterlist=QString::fromLocal8Bit(answer).split("\r\n");
+    emit streamAlert(m_mountpoint, condition, event.active, event.value, event.threshold, event.type);
+}
+
+QString CasterReader::closestMountPoint(const QByteArray& sourcetable, double lat, double lon)
+{
+    QStringList casterlist=QString::fromLocal8Bit(sourcetable).split("\r\n");
     if(casterlist.length()==0)
         qDebug() << " --> ERROR: Caster list empty!";
     else
-        qDebug() << " --> "<< m_host << "proposes" << casterlist.length()<<"mount points... Detecting the closest caster";
+        qDebug() << " --> Sourcetable proposes" << casterlist.length()<<"mount points... Detecting the closest caster";
     QString closestCaster, closestCountry, closestCity;
     float mindist=50;
     float cast_lat,cast_lon,dist;
-    for(QString casterdata:casterlist){
+    for(const QString& casterdata:casterlist){
         QStringList castersl = casterdata.split(";");
-        if(castersl[0]!="STR")continue;
+        if(castersl[0]!="STR" || castersl.size() < 11)continue;
         cast_lat = castersl[9].toFloat();
         cast_lon = castersl[10].toFloat();
         dist = haversine_distance(lat,lon,cast_lat,cast_lon);
@@ -182,10 +541,38 @@ QString CasterReader::getAutoMountPoint(double lat, double lon)
         qDebug()<<"ERROR: Closest caster too far ("<<mindist<<"km)";
     else
         qDebug()<<"*** Closest caster"<<closestCaster<<"in"<<closestCity<<"("<<closestCountry<<") at "<<mindist<<"km ***";
-    m_socket->disconnect();
     return closestCaster;
 }
 
+QList<CasterReader::MountPointInfo> CasterReader::nearestMountPoints(const QByteArray& sourcetable, double lat, double lon,
+                                                                    int count, double maxKm)
+{
+    QList<MountPointInfo> mountpoints;
+    for (const QByteArray& line : sourcetable.split('\n')) {
+        QList<QByteArray> fields = line.trimmed().split(';');
+        if (fields.size() < 11 || fields[0] != "STR") continue;
+        double distance = haversine_distance(lat, lon, fields[9].toDouble(), fields[10].toDouble());
+        if (distance >= maxKm) continue;
+        mountpoints.append(MountPointInfo{QString::fromUtf8(fields[1]), distance,
+                                          rtcmSystemsFromSourcetable(fields[6].toStdString(), fields[4].toStdString())});
+    }
+    std::sort(mountpoints.begin(), mountpoints.end(),
+              [](const MountPointInfo& a, const MountPointInfo& b) { return a.distanceKm < b.distanceKm; });
+    return mountpoints.mid(0, count);
+}
+
+int CasterReader::advertisedBitrate(const QByteArray& sourcetable, const QString& mountpoint)
+{
+    QByteArray name = mountpoint.toUtf8();
+    for (const QByteArray& line : sourcetable.split('\n')) {
+        QList<QByteArray> fields = line.trimmed().split(';');
+        if (fields.size() > 17 && fields[0] == "STR" && fields[1] == name) {
+            return fields[17].toInt();
+        }
+    }
+    return 0;
+}
+
 double CasterReader::haversine_distance(double lat1, double lon1, double lat2, double lon2)
 {
     lat1 = to_radians(lat1);
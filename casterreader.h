@@ -2,8 +2,15 @@
 #define CASTERREADER_H
 
 #include <QObject>
-#include <QTcpSocket>
+#include <QSslSocket>
 #include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <QTimer>
+#include "castertls.h"
+#include "rtcmcompress.h"
+#include "rtcmmonitor.h"
 
 const double EARTH_RADIUS_KM = 6371.0;
 #ifndef M_PI
@@ -22,20 +29,79 @@ public:
     void init(const QString& host, int port, const QString& user, const QString& password);
     void start(const QString& mountpoint);
     void stop();
+    QString mountpoint() const { return m_mountpoint; }
 
-    QString getAutoMountPoint(double lon, double lat);
+    // The latest station, antenna and GLONASS bias messages (1005/1006, 1007/1008/1033, 1230) of each
+    // mount point are cached. Once scheduled, they are sent again ahead of the next observation epoch.
+    void setStaticReplay(bool enabled) { m_staticReplay = enabled; }
+    static bool isStaticMessage(int type);
+
+    // Asks for the compressed stream (X-Rtcm-Compression header), only served by an rtkrover relay.
+    // The frames are decoded back to the original RTCM before being passed on.
+    void setCompression(bool enabled) { m_compression = enabled; }
+
+    // TLS of the caster connections, shared with the mount point probes for the session resumption
+    CasterTlsSession* tls() const { return m_tls; }
+    // The sourcetable is requested with keep-alive, and the stream request of the next start() is sent on
+    // the same connection if the caster kept it open (no TCP and TLS handshakes)
+    void setConnectionReuse(bool enabled) { m_reuse = enabled; }
+
+    // The stream is checked every second while connected (see RtcmStreamMonitor), the conditions
+    // crossing their threshold are signaled by streamAlert()
+    void setMonitorThresholds(const RtcmStreamMonitor::Thresholds& thresholds) { m_monitor.setThresholds(thresholds); }
+
+    // Fetches the sourcetable on a separate connection, the stream keeps running
+    void requestSourcetable();
+    // Closest mount point of the sourcetable within 50 km, empty if none
+    static QString closestMountPoint(const QByteArray& sourcetable, double lat, double lon);
+
+    struct MountPointInfo {
+        QString name;
+        double distanceKm;
+        unsigned systems;           // RtcmSystem bits announced by the sourcetable
+    };
+    // The count closest mount points within maxKm, closest first
+    static QList<MountPointInfo> nearestMountPoints(const QByteArray& sourcetable, double lat, double lon,
+                                                    int count, double maxKm = 50);
+    // Bitrate (bit/s) of the mount point in the sourcetable, 0 if unknown
+    static int advertisedBitrate(const QByteArray& sourcetable, const QString& mountpoint);
+    // NTRIP 2.0 request of path on the caster
+    static QByteArray ntripRequest(const QString& host, int port, const QString& user, const QString& password,
+                                   const QString& path, const QByteArray& extraHeaders = QByteArray(),
+                                   bool keepAlive = false);
+
+public slots:
+    // Called when the receiver lost the static messages (port reopened, receiver reset)
+    void scheduleStaticReplay();
 
 signals:
     void rtcmPacketReady(const Packet& packet);
+    void sourcetableReady(const QByteArray& sourcetable);
+    // The connection to the caster failed or was closed
+    void streamFailed(const QString& mountpoint);
+    // A condition of the stream was raised or cleared, type is the message type of stale_static
+    void streamAlert(const QString& mountpoint, const QString& condition, bool active, double value, double threshold,
+                     int type);
 
 private slots:
     void onConnected();
     void onReadyRead();
     void onErrorOccurred(QAbstractSocket::SocketError socketError);
+    void onSourcetableConnected();
+    void onSourcetableData();
+    void onSourcetableFinished();
+    void onMonitorTick();
 
 private:
     void extract_rtcm_packets(QByteArray& buffer);
-    double haversine_distance(double lat1, double lon1, double lat2, double lon2);
+    void decode_compressed(QByteArray& buffer);
+    void handleFrame(const unsigned char* frame, size_t length, int type);
+    void startDecoder(const QByteArray& header);
+    QByteArray request(const QString& path, bool keepAlive = false) const;
+    void setStreamSocket(QSslSocket* socket);
+    void replayStaticMessages();
+    void onMonitorEvent(const RtcmStreamMonitor::Event& event);
+    static double haversine_distance(double lat1, double lon1, double lat2, double lon2);
 
     QString m_host;
     int m_port;
@@ -43,10 +109,34 @@ private:
     QString m_user;
     QString m_password;
     QString m_mountpoint;
-    QTcpSocket* m_socket;
+    QSslSocket* m_socket;
     QByteArray m_buffer;
+    QSslSocket* m_tableSocket;
+    QByteArray m_table;
+    bool m_tableIdle;               // Sourcetable received, the caster kept the connection open
+    QByteArray m_sourcetable;       // Last one received, for the advertised bitrate
+
+    QHash<QString, QMap<int, Packet>> m_staticMessages; // By mount point, then message type
+    bool m_staticReplay;
+    bool m_replayPending;
+
+    bool m_compression;
+    RtcmStreamDecoder* m_decoder;   // Compressed stream of a relay, null for a plain stream
+    bool m_headerPending;           // Response header of the stream request not complete yet
+
+    CasterTlsSession* m_tls;
+    bool m_reuse;
+    // Reconnection latency: start(), connection ready, first valid frame
+    qint64 m_startNs;
+    bool m_ticketOffered;
+    bool m_reused;
+    bool m_firstFrame;
+
+    RtcmStreamMonitor m_monitor;
+    RtcmStreamMonitor::Stats m_monitorTotals;   // Already added to the metrics
+    QTimer* m_monitorTimer;
 
-    inline double to_radians(double degree) {
+    static inline double to_radians(double degree) {
         return degree * M_PI / 180.0;
     }
 };
@@ -0,0 +1,97 @@
+#include "castertls.h"
+#include "metrics.h"
+#include <QDebug>
+#include <QSslCertificate>
+#include <QSslError>
+
+// Socket property: a session ticket was offered in the handshake
+static const char* const TICKET_OFFERED = "casterTicketOffered";
+
+CasterTlsSession::CasterTlsSession(QObject *parent)
+    : QObject(parent),
+      _configuration(QSslConfiguration::defaultConfiguration())
+{
+    // Persistence keeps the ticket in the configuration of the socket
+    _configuration.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
+    _configuration.setSslOption(QSsl::SslOptionDisableSessionTickets, false);
+}
+
+void CasterTlsSession::setVerifyPeer(bool verify, const QString& caFile)
+{
+    _configuration.setPeerVerifyMode(verify ? QSslSocket::VerifyPeer : QSslSocket::VerifyNone);
+    QList<QSslCertificate> certificates = QSslConfiguration::systemCaCertificates();
+    if (!caFile.isEmpty()) {
+        QList<QSslCertificate> extra = QSslCertificate::fromPath(caFile, QSsl::Pem);
+        if (extra.isEmpty()) {
+            qWarning() << "NTRIP: no certificate in" << caFile;
+        }
+        certificates += extra;
+    }
+    _configuration.setCaCertificates(certificates);
+    _ticket.clear();
+}
+
+void CasterTlsSession::connectToHost(QSslSocket* socket, const QString& host, int port)
+{
+    if (!_enabled) {
+        socket->connectToHost(host, port);
+        return;
+    }
+    if (!QSslSocket::supportsSsl()) {
+        qCritical() << "NTRIP: TLS is not available (no TLS backend), connecting in plain TCP";
+        socket->connectToHost(host, port);
+        return;
+    }
+    QSslConfiguration configuration = _configuration;
+    if (!_ticket.isEmpty()) {
+        configuration.setSessionTicket(_ticket);
+        Metrics::registry().ntripTlsTicketOffers.add();
+    }
+    socket->setProperty(TICKET_OFFERED, !_ticket.isEmpty());
+    socket->setSslConfiguration(configuration);
+    // TLS 1.3 sends the tickets after the handshake
+    connect(socket, &QSslSocket::encrypted, this, &CasterTlsSession::onEncrypted, Qt::UniqueConnection);
+    connect(socket, &QSslSocket::newSessionTicketReceived, this, &CasterTlsSession::onSessionTicket, Qt::UniqueConnection);
+    connect(socket, &QSslSocket::sslErrors, this, &CasterTlsSession::onSslErrors, Qt::UniqueConnection);
+    socket->connectToHostEncrypted(host, port);
+}
+
+void CasterTlsSession::onReady(QSslSocket* socket, QObject* context, const std::function<void()>& callback) const
+{
+    connect(socket, &QSslSocket::connected, context, [socket, callback]() {
+        if (socket->mode() == QSslSocket::UnencryptedMode) callback();
+    });
+    connect(socket, &QSslSocket::encrypted, context, callback);
+}
+
+// Qt has no resumption flag. The OpenSSL backend takes the chain from SSL_get_peer_cert_chain(), empty when
+// the server sent no Certificate message, which only a resumed session allows, and keeps the certificate of
+// the session. Other backends may keep the chain: they are never counted.
+bool CasterTlsSession::isResumed(const QSslSocket* socket)
+{
+    return socket->isEncrypted() && socket->property(TICKET_OFFERED).toBool()
+           && QSslSocket::activeBackend() == QLatin1String("openssl")
+           && socket->peerCertificateChain().isEmpty() && !socket->peerCertificate().isNull();
+}
+
+void CasterTlsSession::onEncrypted()
+{
+    QSslSocket* socket = qobject_cast<QSslSocket*>(sender());
+    if (socket && isResumed(socket)) Metrics::registry().ntripTlsResumptions.add();
+    onSessionTicket();
+}
+
+void CasterTlsSession::onSessionTicket()
+{
+    QSslSocket* socket = qobject_cast<QSslSocket*>(sender());
+    if (!socket) return;
+    QByteArray ticket = socket->sslConfiguration().sessionTicket();
+    if (!ticket.isEmpty()) _ticket = ticket;
+}
+
+void CasterTlsSession::onSslErrors(const QList<QSslError>& errors)
+{
+    for (const QSslError& error : errors) {
+        qWarning() << "NTRIP: TLS error:" << error.errorString();
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef CASTERTLS_H
+#define CASTERTLS_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QSslConfiguration>
+#include <QSslSocket>
+#include <functional>
+
+/**
+ * TLS settings of the connections to a caster, and the session they share.
+ *
+ * The session ticket of the last handshake is offered by the next connection
+ * (stream, sourcetable, probes): the caster resumes the session without the
+ * certificate exchange and its signature, which saves a round trip with
+ * TLS 1.2 and most of the handshake time on a slow link. Plain TCP
+ * connections go through the same calls.
+ */
+class CasterTlsSession : public QObject
+{
+    Q_OBJECT
+public:
+    explicit CasterTlsSession(QObject *parent = nullptr);
+
+    void setEnabled(bool enabled) { _enabled = enabled; }
+    bool isEnabled() const { return _enabled; }
+    // Verification of the caster certificate, with the system CA and the certificates of caFile (PEM)
+    void setVerifyPeer(bool verify, const QString& caFile = QString());
+    // Another caster: the ticket is dropped
+    void clear() { _ticket.clear(); }
+    bool hasTicket() const { return !_ticket.isEmpty(); }
+    // The caster resumed the session offered by the socket. Only known with the OpenSSL backend, false with the others.
+    static bool isResumed(const QSslSocket* socket);
+
+    // Connects in plain TCP, or in TLS offering the ticket
+    void connectToHost(QSslSocket* socket, const QString& host, int port);
+    // Calls back when the request can be sent: connected in plain TCP, encrypted in TLS
+    void onReady(QSslSocket* socket, QObject* context, const std::function<void()>& callback) const;
+
+private slots:
+    void onEncrypted();
+    void onSessionTicket();
+    void onSslErrors(const QList<QSslError>& errors);
+
+private:
+    bool _enabled = false;
+    QSslConfiguration _configuration;
+    QByteArray _ticket;
+};
+
+#endif // CASTERTLS_H
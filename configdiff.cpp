@@ -0,0 +1,62 @@
+#include "configdiff.h"
+#include <algorithm>
+
+namespace ConfigDiff {
+
+static QString settingText(const QVariant& value)
+{
+    if (!value.isValid()) return "(unset)";
+    return value.toStringList().join(',');
+}
+
+// Passwords and credentials are not written to the log
+static bool isSecret(const QString& key)
+{
+    static const QStringList words = {"password", "passwd", "secret", "token", "credential"};
+    const QString name = key.toLower();
+    return std::any_of(words.begin(), words.end(), [&name](const QString& word) { return name.contains(word); });
+}
+
+Snapshot snapshot(const QSettings& settings)
+{
+    Snapshot snapshot;
+    for (const QString& key : settings.allKeys()) {
+        int slash = key.indexOf('/');
+        snapshot[slash >= 0 ? key.left(slash) : QString()].insert(key.mid(slash + 1), settings.value(key));
+    }
+    return snapshot;
+}
+
+Result diff(const Snapshot& before, const Snapshot& after)
+{
+    static const QStringList filterKeys = {"decimation", "interval", "fix_quality"};
+    Result result;
+    QSet<QString> groups(before.keyBegin(), before.keyEnd());
+    groups.unite(QSet<QString>(after.keyBegin(), after.keyEnd()));
+    QStringList sorted = groups.values();
+    sorted.sort();
+    for (const QString& group : std::as_const(sorted)) {
+        const QVariantMap oldValues = before.value(group);
+        const QVariantMap newValues = after.value(group);
+        QSet<QString> keySet(oldValues.keyBegin(), oldValues.keyEnd());
+        keySet.unite(QSet<QString>(newValues.keyBegin(), newValues.keyEnd()));
+        QStringList keys = keySet.values();
+        keys.sort();
+        bool onlyFilters = true;
+        for (const QString& key : std::as_const(keys)) {
+            QVariant oldValue = oldValues.value(key), newValue = newValues.value(key);
+            if (oldValue == newValue) continue;
+            bool secret = isSecret(key);
+            result.lines.append(QString("[%1] %2: %3 -> %4").arg(group, key,
+                                                                 secret && oldValue.isValid() ? "***" : settingText(oldValue),
+                                                                 secret && newValue.isValid() ? "***" : settingText(newValue)));
+            result.changed.insert(group);
+            if (!filterKeys.contains(key)) onlyFilters = false;
+        }
+        bool output = group == "output" || group.startsWith("output.");
+        if (result.changed.contains(group) && onlyFilters && output) result.filtersOnly.insert(group);
+    }
+    return result;
+}
+
+} // namespace ConfigDiff
@@ -0,0 +1,33 @@
+#ifndef CONFIGDIFF_H
+#define CONFIGDIFF_H
+
+#include <QMap>
+#include <QSet>
+#include <QSettings>
+#include <QStringList>
+#include <QVariantMap>
+
+/**
+ * Section by section diff of two configurations, for the reload.
+ *
+ * A snapshot holds the values of every section, keyed by section (the keys
+ * of the general section are under the empty name). The diff lists the
+ * changed sections, the output sections where only the epoch filters
+ * changed, and one line per changed key.
+ */
+namespace ConfigDiff {
+
+using Snapshot = QMap<QString, QVariantMap>;
+
+struct Result {
+    QSet<QString> changed;
+    QSet<QString> filtersOnly;  // Output sections where only decimation, interval or fix_quality changed
+    QStringList lines;          // "[section] key: old -> new", "***" for the values of passwords and credentials
+};
+
+Snapshot snapshot(const QSettings& settings);
+Result diff(const Snapshot& before, const Snapshot& after);
+
+} // namespace ConfigDiff
+
+#endif // CONFIGDIFF_H
@@ -1,6 +1,7 @@
 #ifndef CRC24Q_H
 #define CRC24Q_H
 
+#include <cstddef>
 #include <cstdint>
 #include <vector>
 
@@ -74,15 +75,25 @@ static const uint32_t crc24q_table[] = {
 
 /**
  * @brief Calculates the 24-bit CRC for RTCM messages.
- * @param data The byte vector containing the message payload (without the CRC).
+ * @param data The message bytes (header and payload, without the CRC).
+ * @param size Number of bytes.
  * @return The calculated 24-bit CRC value.
  */
-inline uint32_t rtcm_crc(const std::vector<unsigned char>& data) {
+inline uint32_t rtcm_crc(const unsigned char* data, size_t size) {
     uint32_t crc = 0;
-    for (unsigned char octet : data) {
-        crc = (crc << 8) ^ crc24q_table[(octet ^ (crc >> 16)) & 0xFF];
+    for (size_t i = 0; i < size; ++i) {
+        crc = (crc << 8) ^ crc24q_table[(data[i] ^ (crc >> 16)) & 0xFF];
     }
     return crc & 0xFFFFFF;
 }
 
+/**
+ * @brief Calculates the 24-bit CRC for RTCM messages.
+ * @param data The byte vector containing the message payload (without the CRC).
+ * @return The calculated 24-bit CRC value.
+ */
+inline uint32_t rtcm_crc(const std::vector<unsigned char>& data) {
+    return rtcm_crc(data.data(), data.size());
+}
+
 #endif // CRC24Q_H
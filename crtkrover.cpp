@@ -1,6 +1,25 @@
 #include "crtkrover.h"
-#include "outputhandler.h"
+#include "fixrecord.h"
+#include "metrics.h"
+#include "logger.h"
+#include <QDateTime>
 #include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QSet>
+#include <QSerialPortInfo>
+#include <QStandardPaths>
+#ifdef RTKROVER_HAVE_SIGNALS
+#include "unixsignal.h"
+#include <csignal>
+#endif
+
+// Pause before probing the mount points again when none of them has a usable stream
+static const int STREAM_RETRY_MS = 30000;
+// Receiver silence closing the current epoch: the sentences of an epoch come in one burst
+static const int EPOCH_IDLE_MS = 20;
+// Sections of the settings kept in members
+static const QStringList MEMBER_SECTIONS = {"log", "ntrip", "serial", "history", "state"};
 
 CRTKRover::CRTKRover(const QString &configFile, QObject *parent)
     : QObject{parent},
@@ -8,7 +27,6 @@ CRTKRover::CRTKRover(const QString &configFile, QObject *parent)
     m_settings(nullptr),
     m_casterReader(nullptr),
     m_serialCom(nullptr),
-    _outputHandler(nullptr),
     m_gpsData()
 {
     loadConfig();
@@ -18,95 +36,629 @@ CRTKRover::~CRTKRover()
 {
     stop();
     delete m_settings;
-    delete _outputHandler;
+    qDeleteAll(m_outputHandlers);
+    delete m_predictor;
+    delete m_rinexRecorder;
+    delete m_relayServer;
 }
 
 void CRTKRover::loadConfig()
 {
     m_settings = new QSettings(m_configFile, QSettings::IniFormat, this);
+    readSettings();
+    qDebug() << "Config loaded from" << m_configFile;
+}
+
+// Reads the settings kept in members, the other ones are read when the components are set up
+void CRTKRover::readSettings()
+{
+    for (const QString& section : MEMBER_SECTIONS) {
+        readSection(section);
+    }
+}
 
-    m_ntripHost = m_settings->value("ntrip/host", "crtk.net").toString();
-    m_ntripPort = m_settings->value("ntrip/port", 2101).toInt();
-    m_mountpoint = m_settings->value("ntrip/mountpoint", "auto").toString();
-    m_ntripUsername = m_settings->value("ntrip/username", "centipede").toString();
-    m_ntripPassword = m_settings->value("ntrip/password", "centipede").toString();
+// A reload only reads the changed sections: the mount point, port and baud rate detected
+// for "auto" are kept while their section is unchanged
+void CRTKRover::readSection(const QString& section)
+{
+    if (section == "log") {
+        Log::configure(Log::levelFromString(m_settings->value("log/level", "debug").toString()),
+                       Log::modeFromString(m_settings->value("log/mode", "text").toString()));
+    } else if (section == "ntrip") {
+        m_ntripHost = m_settings->value("ntrip/host", "crtk.net").toString();
+        m_ntripPort = m_settings->value("ntrip/port", 2101).toInt();
+        m_mountpoint = m_settings->value("ntrip/mountpoint", "auto").toString();
+        m_ntripUsername = m_settings->value("ntrip/username", "centipede").toString();
+        m_ntripPassword = m_settings->value("ntrip/password", "centipede").toString();
+        m_replayStatic = m_settings->value("ntrip/replay_static", true).toBool();
+        m_ntripCompression = m_settings->value("ntrip/compression", false).toBool();
+        m_ntripTls = m_settings->value("ntrip/tls", false).toBool();
+        m_ntripTlsVerify = m_settings->value("ntrip/tls_verify", true).toBool();
+        m_ntripTlsCa = m_settings->value("ntrip/tls_ca", "").toString();
+        m_ntripReuse = m_settings->value("ntrip/reuse_connection", true).toBool();
+        m_probeCount = m_settings->value("ntrip/probe_count", 3).toInt();
+        m_probeDurationMs = qRound(m_settings->value("ntrip/probe_duration", 5).toDouble() * 1000);
+        m_probeCacheMs = m_settings->value("ntrip/probe_cache", 600).toInt() * 1000;
+    } else if (section == "serial") {
+        m_serialPort = m_settings->value("serial/port", "/dev/ttyACM0").toString();
+        m_serialBaud = m_settings->value("serial/baud", 115200).toInt();    // 0 for auto
+        m_serialDetectTimeoutMs = qRound(m_settings->value("serial/detect_timeout", 10).toDouble() * 1000);
+        m_gpsRate = m_settings->value("serial/frequency", 10).toInt();
+    } else if (section == "history") {
+        int historyCapacity = m_settings->value("history/capacity", 3600).toInt();
+        if (historyCapacity != m_historyCapacity) {
+            m_historyCapacity = historyCapacity;
+            m_history = FixHistory(m_historyCapacity);
+        }
+        m_historyReportInterval = m_settings->value("history/report_interval", 0).toInt();
+    } else if (section == "state") {
+        m_stateEnabled = m_settings->value("state/enabled", true).toBool();
+        m_stateFile = m_settings->value("state/file", QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation)
+                                                      + "/state.json").toString();
+        m_stateSaveInterval = m_settings->value("state/save_interval", 60).toInt();
+    }
+}
 
-    m_serialPort = m_settings->value("serial/port", "/dev/ttyACM0").toString();
-    m_serialBaud = m_settings->value("serial/baud", 115200).toInt();
-    m_gpsRate = m_settings->value("serial/frequency", 10).toInt();
+OutputHandler::Options CRTKRover::readOutputOptions(const QString& group)
+{
+    auto value = [this, &group](const QString& key, const QVariant& defaultValue) {
+        return m_settings->value(group + "/" + key, defaultValue);
+    };
 
-    qDebug() << "Config loaded from" << m_configFile;
+    OutputHandler::Options options;
+    QString method = value("output", "false").toString().toLower();
+    QString type = value("output_type", "nmea").toString().toLower();
+
+    if (method == "socket") options.method = OutputHandler::OutputMethod::Socket;
+    else if (method == "file") options.method = OutputHandler::OutputMethod::File;
+    else if (method == "stdout") options.method = OutputHandler::OutputMethod::Stdout;
+    else if (method == "multicast") options.method = OutputHandler::OutputMethod::Multicast;
+    else if (method == "track") options.method = OutputHandler::OutputMethod::Track;
+    else options.method = OutputHandler::OutputMethod::False;
+
+    if (type == "csv") options.type = OutputHandler::OutputType::CSV;
+    else if (type == "json") options.type = OutputHandler::OutputType::JSON;
+    else if (type == "binary") options.type = OutputHandler::OutputType::Binary;
+    else options.type = OutputHandler::OutputType::NMEA;
+
+    // "output_file" and "output_port" are accepted as aliases of "filename" and "port"
+    options.file.fileName = value("filename", value("output_file", "output.txt")).toString();
+    options.file.rotateSize = value("rotate_size", 0).toLongLong() * 1024 * 1024;
+    options.file.rotateInterval = value("rotate_interval", 0).toInt() * 60;
+    options.file.compression = FileSink::compressionFromString(value("compress", "none").toString());
+    options.file.fsyncInterval = value("fsync_interval", 1000).toInt();
+
+    options.socket.port = value("port", value("output_port", 1298)).toInt();
+    options.socket.highWaterMark = value("client_buffer", 64).toLongLong() * 1024;
+    options.socket.disconnectSlowClients = value("slow_clients", "drop").toString().toLower() == "disconnect";
+    options.socket.multicastGroup = value("multicast_group", "239.255.12.98").toString();
+    options.socket.multicastTtl = value("multicast_ttl", 1).toInt();
+
+    options.decimation = qMax(1, value("decimation", 1).toInt());
+    options.interval = value("interval", 0).toInt();
+    options.fields = FixFormatter::fieldsFromString(value("fields", "").toStringList().join(','));
+    options.predicted = value("source", "receiver").toString().toLower() == "predicted";
+    // Text records stay on stderr unless asked, binary records have never been written there
+    QString stream = value("stream", type == "binary" ? "stdout" : "stderr").toString().toLower();
+    options.standardOutput = stream == "stdout";
+    for (const QString& quality : value("fix_quality", "").toStringList()) {
+        bool ok;
+        int q = quality.trimmed().toInt(&ok);
+        if (ok) options.fixQualities.append(q);
+    }
+
+    return options;
 }
 
 void CRTKRover::start()
 {
     qDebug() << "Starting services...";
 
-    // Setup OutputHandler
-    QString outputMethodStr = m_settings->value("output/output", "false").toString().toLower();
-    QString outputTypeStr = m_settings->value("output/output_type", "nmea").toString().toLower();
-    OutputHandler::OutputMethod method;
-    OutputHandler::OutputType type;
-
-    if (outputMethodStr == "socket") method = OutputHandler::OutputMethod::Socket;
-    else if (outputMethodStr == "file") method = OutputHandler::OutputMethod::File;
-    else if (outputMethodStr == "stdout") method = OutputHandler::OutputMethod::Stdout;
-    else method = OutputHandler::OutputMethod::False;
+    // Setup the outputs: the legacy [output] section and the [output.N] sections
+    for (const QString& group : outputGroups()) {
+        setupOutput(group);
+    }
 
-    if (outputTypeStr == "csv") type = OutputHandler::OutputType::CSV;
-    else if (outputTypeStr == "json") type = OutputHandler::OutputType::JSON;
-    else type = OutputHandler::OutputType::NMEA;
+    m_clock.start();
 
-    if (method != OutputHandler::OutputMethod::False) {
-        QString outFile = m_settings->value("output/filename", "output.txt").toString();
-        int outPort = m_settings->value("output/port", 1298).toInt();
-        _outputHandler = new OutputHandler(method, type, outFile, outPort, this);
-    }
+    setupMetrics();
+#ifdef RTKROVER_HAVE_SHM
+    setupShm();
+#endif
+    setupPredictor();
 
     m_casterReader = new CasterReader(this);
     m_serialCom = new SerialCom(this);
-
-    // Autodetect serial port if set to auto.
-    if(m_serialPort=="auto")
-        m_serialPort = SerialCom::autodetect();
+    m_serialProber = new SerialPortProber(this);
+    connect(m_serialProber, &SerialPortProber::finished, this, &CRTKRover::onReceiverDetected);
 
     // Connect the data pipeline: Caster -> Serial
     connect(m_casterReader, &CasterReader::rtcmPacketReady, m_serialCom, &SerialCom::writeRtcmPacket);
+    setupRinex();
+    setupRelay();
 
     // Connect the NMEA output from serial to our handler
     connect(m_serialCom, &SerialCom::got_NMEA, this, &CRTKRover::onNmeaMessage);
+    m_epochTimer = new QTimer(this);
+    m_epochTimer->setSingleShot(true);
+    m_epochTimer->setInterval(EPOCH_IDLE_MS);
+    connect(m_epochTimer, &QTimer::timeout, this, &CRTKRover::closeEpoch);
 
-    if (_outputHandler) {
-        connect(m_serialCom, &SerialCom::got_NMEA, _outputHandler, &OutputHandler::processNmeaData);
+    // A receiver that lost the static messages gets the cached ones ahead of the next epoch
+    connect(m_serialCom, &SerialCom::receiverLinkEstablished, m_casterReader, &CasterReader::scheduleStaticReplay);
+    connect(m_serialCom, &SerialCom::receiverLinkEstablished, this, &CRTKRover::onReceiverLinkEstablished);
+
+    // The state has the receiver port of the last run
+    if (m_stateEnabled) {
+        QDir().mkpath(QFileInfo(m_stateFile).absolutePath());
+        if (m_state.load(m_stateFile)) {
+            qDebug() << "State loaded from" << m_stateFile;
+            m_previousTimeToRtkFixMs = m_state.timeToRtkFixMs;
+            m_previousWarmStart = m_state.warmStart;
+        }
     }
 
     // Start serial communication
+    startSerial();
+
+    connect(m_casterReader, &CasterReader::sourcetableReady, this, &CRTKRover::onSourcetable);
+    connect(m_casterReader, &CasterReader::streamFailed, this, &CRTKRover::onStreamFailed);
+    connect(m_casterReader, &CasterReader::streamAlert, this, &CRTKRover::onStreamAlert);
+    setupMonitor();
+    m_prober = new MountPointProber(this);
+    m_prober->setTlsSession(m_casterReader->tls());
+    connect(m_prober, &MountPointProber::finished, this, &CRTKRover::selectMountPoint);
+
+    setupTimers();
+
+    //Start caster reader
+    startCaster();
+
+    // Reload the configuration on SIGHUP and, if enabled, when the file changes
+#ifdef RTKROVER_HAVE_SIGNALS
+    UnixSignalNotifier::instance()->watch(SIGHUP);
+    connect(UnixSignalNotifier::instance(), &UnixSignalNotifier::activated, this, [this](int signalNumber) {
+        if (signalNumber == SIGHUP) reloadConfig();
+    });
+#endif
+    m_reloadTimer = new QTimer(this);
+    m_reloadTimer->setSingleShot(true);
+    m_reloadTimer->setInterval(500); // Editors write the file in several steps
+    connect(m_reloadTimer, &QTimer::timeout, this, &CRTKRover::reloadConfig);
+    setupConfigWatcher();
+
+    qDebug() << "Services started.";
+}
+
+void CRTKRover::startSerial()
+{
+    // Autodetect the serial port and/or the baud rate if set to auto: the port is opened once detected
+    m_serialProber->stop();
+    if ((m_serialPort == "auto" || m_serialBaud <= 0) && detectReceiver()) {
+        return;
+    }
+    openSerial();
+}
+
+void CRTKRover::openSerial()
+{
     m_serialCom->init(m_serialPort, m_serialBaud, m_gpsRate);
     //setup GPS wuth UBS messages
     //m_serialCom->getGpsVersion();
     //m_serialCom->setRate(m_gpsRate);
     m_serialCom->start();
+}
 
-    //Start caster reader
+// The receiver of the last run if its USB device is still connected, otherwise the ports are probed:
+// true while probing, onReceiverDetected() follows
+bool CRTKRover::detectReceiver()
+{
+    bool autoPort = m_serialPort == "auto";
+    if (m_stateEnabled && !m_state.receiverPort.isEmpty()) {
+        QString port = m_state.receiverSerialNumber.isEmpty()
+                           ? m_state.receiverPort : SerialPortProber::portOfSerialNumber(m_state.receiverSerialNumber);
+        bool available = !port.isEmpty() && (!m_state.receiverSerialNumber.isEmpty()
+                                             || !QSerialPortInfo(port).isNull());
+        bool samePort = autoPort || QSerialPortInfo(port).portName() == QSerialPortInfo(m_serialPort).portName();
+        if (available && samePort && (m_serialBaud <= 0 || m_serialBaud == m_state.receiverBaud)) {
+            m_serialPort = port;
+            m_serialBaud = m_state.receiverBaud;
+            qDebug() << "Serial: receiver" << m_state.receiverName << "of the last run on" << m_serialPort
+                     << "at" << m_serialBaud << "baud";
+            return false;
+        }
+    }
+
+    QList<int> baudRates = SerialPortProber::defaultBaudRates();
+    if (m_serialBaud > 0) {
+        baudRates = {m_serialBaud};
+    }
+    m_serialProber->start(autoPort ? QStringList() : QStringList{m_serialPort}, baudRates, m_serialDetectTimeoutMs);
+    return true;
+}
+
+void CRTKRover::onReceiverDetected(const SerialPortProber::Result& receiver)
+{
+    if (!receiver.found()) {
+        // Description of the port, as a last resort
+        if (m_serialPort == "auto") m_serialPort = SerialCom::autodetect();
+        if (m_serialBaud <= 0) m_serialBaud = 115200;
+        openSerial();
+        return;
+    }
+    m_serialPort = receiver.portName;
+    m_serialBaud = receiver.baudRate;
+    if (m_stateEnabled) {
+        m_state.receiverSerialNumber = receiver.serialNumber;
+        m_state.receiverPort = receiver.portName;
+        m_state.receiverBaud = receiver.baudRate;
+        m_state.receiverName = receiver.receiver;
+        m_state.save(m_stateFile);
+    }
+    openSerial();
+}
+
+void CRTKRover::startCaster()
+{
+    m_casterReader->stop();
     m_casterReader->init(m_ntripHost,m_ntripPort,m_ntripUsername,m_ntripPassword);
+    m_casterReader->setStaticReplay(m_replayStatic);
+    m_casterReader->setCompression(m_ntripCompression);
+    m_casterReader->tls()->setEnabled(m_ntripTls);
+    m_casterReader->tls()->setVerifyPeer(m_ntripTlsVerify, m_ntripTlsCa);
+    m_casterReader->setConnectionReuse(m_ntripReuse);
+    m_prober->init(m_ntripHost, m_ntripPort, m_ntripUsername, m_ntripPassword);
+    m_prober->setDuration(m_probeDurationMs);
+    m_prober->setCacheLifetime(m_probeCacheMs);
+    m_candidates.clear();
+    m_streamFailed = false;
 
-    // Start CasterReader if mountpoint is defined. Other
+    // Start CasterReader if mountpoint is defined. Otherwise start on the last mount point
+    // and check it once the GNSS fix is acquired
     if(m_mountpoint=="auto"){
-        qDebug() << "Waiting for GPS fix to determine mount point...";
+        m_mountPointDetected = false;
+        QString mountpoint = warmStartMountPoint();
+        if (!mountpoint.isEmpty()) {
+            m_warmStart = true;
+            qDebug() << "Warm start on mount point" << mountpoint << ", checked once the GPS fix is acquired";
+            startStream(mountpoint);
+        } else {
+            qDebug() << "Waiting for GPS fix to determine mount point...";
+        }
     } else {
         m_mountPointDetected=true;
-        m_casterReader->start(m_mountpoint);
+        startStream(m_mountpoint);
+    }
+}
+
+QStringList CRTKRover::outputGroups() const
+{
+    QStringList groups = {"output"};
+    for (const QString& group : m_settings->childGroups()) {
+        if (group.startsWith("output.")) groups.append(group);
+    }
+    return groups;
+}
+
+// (Re)creates the output of a section
+void CRTKRover::setupOutput(const QString& group)
+{
+    delete m_outputHandlers.take(group);
+    OutputHandler::Options options = readOutputOptions(group);
+    if (options.method != OutputHandler::OutputMethod::False) {
+        qDebug() << "Output" << group << ":" << m_settings->value(group + "/output").toString()
+                 << m_settings->value(group + "/output_type", "nmea").toString();
+        m_outputHandlers.insert(group, new OutputHandler(options, this));
+    }
+}
+
+void CRTKRover::setupMetrics()
+{
+    delete m_metricsServer;
+    m_metricsServer = nullptr;
+    if (m_settings->value("metrics/enabled", false).toBool()) {
+        m_metricsServer = new MetricsServer(this);
+        m_metricsServer->listen(QHostAddress(m_settings->value("metrics/address", "127.0.0.1").toString()),
+                                m_settings->value("metrics/port", 9598).toInt());
+    }
+}
+
+#ifdef RTKROVER_HAVE_SHM
+void CRTKRover::setupShm()
+{
+    m_shmPublisher.close();
+    if (m_settings->value("shm/enabled", false).toBool()) {
+        m_shmPublisher.open(m_settings->value("shm/name", "/rtkrover").toString(),
+                            m_settings->value("shm/history", 64).toInt());
+    }
+}
+#endif
+
+void CRTKRover::setupTimers()
+{
+    if (!m_historyTimer) {
+        m_historyTimer = new QTimer(this);
+        connect(m_historyTimer, &QTimer::timeout, this, &CRTKRover::reportSurveyStatistics);
+    }
+    if (m_historyReportInterval > 0) {
+        m_historyTimer->start(m_historyReportInterval * 1000);
+    } else {
+        m_historyTimer->stop();
+    }
+
+    if (!m_stateTimer) {
+        m_stateTimer = new QTimer(this);
+        connect(m_stateTimer, &QTimer::timeout, this, &CRTKRover::saveState);
+    }
+    if (m_stateEnabled && m_stateSaveInterval > 0) {
+        m_stateTimer->start(m_stateSaveInterval * 1000);
+    } else {
+        m_stateTimer->stop();
+    }
+}
+
+void CRTKRover::setupConfigWatcher()
+{
+    bool watch = m_settings->value("config/watch", false).toBool();
+    if (watch && !m_configWatcher) {
+        m_configWatcher = new QFileSystemWatcher(QStringList{m_configFile}, this);
+        connect(m_configWatcher, &QFileSystemWatcher::fileChanged, this, [this]() {
+            // A file replaced by an editor is no longer watched
+            if (!m_configWatcher->files().contains(m_configFile)) m_configWatcher->addPath(m_configFile);
+            m_reloadTimer->start();
+        });
+    } else if (!watch && m_configWatcher) {
+        delete m_configWatcher;
+        m_configWatcher = nullptr;
+    }
+}
+
+void CRTKRover::setupPredictor()
+{
+    delete m_predictor;
+    m_predictor = nullptr;
+    if (!m_predictionTimer) {
+        m_predictionTimer = new QTimer(this);
+        m_predictionTimer->setSingleShot(true);
+        m_predictionTimer->setTimerType(Qt::PreciseTimer);
+        connect(m_predictionTimer, &QTimer::timeout, this, &CRTKRover::publishPrediction);
+    }
+    m_predictionTimer->stop();
+    if (!m_settings->value("predictor/enabled", false).toBool()) {
+        return;
+    }
+
+    PositionPredictor::Options options;
+    options.model = PositionPredictor::modelFromString(m_settings->value("predictor/model", "ca").toString());
+    options.processNoise = m_settings->value("predictor/process_noise", 1.0).toDouble();
+    options.useVelocity = m_settings->value("predictor/use_velocity", true).toBool();
+    m_predictor = new PositionPredictor(options);
+    m_predictionPeriodMs = qMax(1, 1000 / qMax(1, m_settings->value("predictor/rate", 50).toInt()));
+    m_predictionMaxAgeMs = m_settings->value("predictor/max_age", 500).toInt();
+    qDebug() << "Predictor: publishing every" << m_predictionPeriodMs << "ms";
+    m_predictionTimer->start(0);
+}
+
+void CRTKRover::setupRinex()
+{
+    delete m_rinexRecorder;
+    m_rinexRecorder = nullptr;
+    if (!m_settings->value("rinex/enabled", false).toBool()) {
+        return;
+    }
+
+    RinexRecorder::Options options;
+    options.fileName = m_settings->value("rinex/file", "rtkrover_%1.obs").toString();
+    options.markerName = m_settings->value("rinex/marker", "").toString();
+    options.headerDelay = m_settings->value("rinex/header_delay", 30).toInt();
+    m_rinexRecorder = new RinexRecorder(options);
+    connect(m_casterReader, &CasterReader::rtcmPacketReady, m_rinexRecorder, &RinexRecorder::addPacket);
+    // Recording starts with the stream, the mount point is resolved first in auto mode
+    m_rinexRecorder->setMountPoint(m_casterReader->mountpoint());
+}
+
+void CRTKRover::setupRelay()
+{
+    delete m_relayServer;
+    m_relayServer = nullptr;
+    if (!m_settings->value("relay/enabled", false).toBool()) {
+        return;
+    }
+
+    RelayServer::Options options;
+    options.address = QHostAddress(m_settings->value("relay/address", "127.0.0.1").toString());
+    options.port = m_settings->value("relay/port", 2102).toInt();
+    options.mountpoint = m_settings->value("relay/mountpoint", "RELAY").toString();
+    options.compression = m_settings->value("relay/compression", true).toBool();
+    options.highWaterMark = m_settings->value("relay/client_buffer", 256).toLongLong() * 1024;
+    m_relayServer = new RelayServer(options);
+    connect(m_casterReader, &CasterReader::rtcmPacketReady, m_relayServer, &RelayServer::addPacket);
+}
+
+void CRTKRover::setupMonitor()
+{
+    RtcmStreamMonitor::Thresholds thresholds;
+    thresholds.stalledSeconds = m_settings->value("monitor/stalled", thresholds.stalledSeconds).toDouble();
+    thresholds.incompleteEpochRate = m_settings->value("monitor/incomplete_epochs", thresholds.incompleteEpochRate).toDouble();
+    thresholds.missingEpochs = m_settings->value("monitor/missing_epochs", thresholds.missingEpochs).toInt();
+    thresholds.duplicateEpochs = m_settings->value("monitor/duplicate_epochs", thresholds.duplicateEpochs).toInt();
+    thresholds.jitterMs = m_settings->value("monitor/jitter", thresholds.jitterMs).toDouble();
+    thresholds.bitrateRatio = m_settings->value("monitor/bitrate_ratio", thresholds.bitrateRatio).toDouble();
+    thresholds.staticMaxAgeSeconds = m_settings->value("monitor/static_age", thresholds.staticMaxAgeSeconds).toDouble();
+    thresholds.crcErrorRate = m_settings->value("monitor/crc_errors", thresholds.crcErrorRate).toDouble();
+    m_casterReader->setMonitorThresholds(thresholds);
+
+    m_monitorAction = m_settings->value("monitor/action", "log").toString().toLower();
+    m_monitorConditions.clear();
+    for (const QString& condition : m_settings->value("monitor/action_on", QStringList{"stalled", "missing_epochs"}).toStringList()) {
+        m_monitorConditions.append(condition.trimmed().toLower());
+    }
+    m_monitorActionClock.invalidate();
+}
+
+// The alerts are logged by the caster reader, the action is taken at most once per STREAM_RETRY_MS
+void CRTKRover::onStreamAlert(const QString& mountpoint, const QString& condition, bool active)
+{
+    if (!active || m_monitorAction == "log" || !m_monitorConditions.contains(condition)) {
+        return;
+    }
+    if (m_monitorActionClock.isValid() && m_monitorActionClock.elapsed() < STREAM_RETRY_MS) {
+        return;
+    }
+    m_monitorActionClock.start();
+    // Reselection needs the candidates of an automatic mount point
+    if (m_monitorAction == "reselect" && m_candidates.size() > 1 && m_probeCount > 1) {
+        qWarning() << "NTRIP: stream of" << mountpoint << "degraded (" << condition << "), selecting another mount point";
+        m_casterReader->stop();
+        onStreamFailed(mountpoint);
+    } else if (m_monitorAction == "reconnect" || m_monitorAction == "reselect") {
+        qWarning() << "NTRIP: stream of" << mountpoint << "degraded (" << condition << "), reconnecting";
+        startRelinkMeasurement("stream reconnection");
+        startStream(mountpoint);
+    }
+}
+
+// Predictions are made for the ticks of the system clock (multiples of the period),
+// which is expected to be synchronized (NTP or PPS) like the consumer's clock
+void CRTKRover::publishPrediction()
+{
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    qint64 tick = now - now % m_predictionPeriodMs;
+    Prediction prediction;
+    if (m_predictor->predict(tick, prediction) && prediction.ageMs <= m_predictionMaxAgeMs) {
+        for (OutputHandler* output : std::as_const(m_outputHandlers)) {
+            output->processPrediction(prediction);
+        }
+    }
+    m_predictionTimer->start(qMax<qint64>(1, tick + m_predictionPeriodMs - QDateTime::currentMSecsSinceEpoch()));
+}
+
+// The watched file is being replaced: it is read again a few times, then a new write or SIGHUP is needed
+void CRTKRover::retryReload()
+{
+    if (!m_configWatcher || m_reloadRetries >= 4) {
+        m_reloadRetries = 0;
+        return;
+    }
+    ++m_reloadRetries;
+    m_reloadTimer->start();
+}
+
+void CRTKRover::reloadConfig()
+{
+    // A reload requested while one runs (SIGHUP during the receiver detection) is done after it
+    if (m_reloading) {
+        m_reloadPending = true;
+        return;
+    }
+    // An editor saving by rename leaves the file missing or empty for a moment: a reload without any key would
+    // reset every section to its defaults
+    if (!QFileInfo::exists(m_configFile)) {
+        qWarning() << "Config:" << m_configFile << "not found, keeping the running configuration";
+        retryReload();
+        return;
+    }
+    QSettings* settings = new QSettings(m_configFile, QSettings::IniFormat, this);
+    if (settings->status() != QSettings::NoError) {
+        qWarning() << "Config: failed to read" << m_configFile << ", keeping the running configuration";
+        delete settings;
+        return;
+    }
+    if (settings->allKeys().isEmpty()) {
+        qWarning() << "Config:" << m_configFile << "is empty, keeping the running configuration";
+        delete settings;
+        retryReload();
+        return;
+    }
+    m_reloadRetries = 0;
+    if (m_configWatcher && !m_configWatcher->files().contains(m_configFile)) m_configWatcher->addPath(m_configFile);
+
+    // Diff of the new configuration against the running one
+    ConfigDiff::Result diff = ConfigDiff::diff(ConfigDiff::snapshot(*m_settings), ConfigDiff::snapshot(*settings));
+    for (const QString& line : std::as_const(diff.lines)) {
+        qDebug().noquote() << "Config:" << line;
+    }
+    const QSet<QString>& changed = diff.changed;
+    if (changed.isEmpty()) {
+        qDebug() << "Config: no change in" << m_configFile;
+        delete settings;
+        return;
+    }
+
+    m_reloading = true;
+    delete m_settings;
+    m_settings = settings;
+    for (const QString& section : MEMBER_SECTIONS) {
+        if (changed.contains(section)) readSection(section);
+    }
+
+    // Only the components whose settings changed are restarted
+    for (const QString& group : std::as_const(changed)) {
+        if (group != "output" && !group.startsWith("output.")) continue;
+        OutputHandler* output = m_outputHandlers.value(group);
+        if (output && diff.filtersOnly.contains(group)) {
+            output->setFilters(readOutputOptions(group));
+        } else {
+            setupOutput(group);
+        }
+    }
+    if (changed.contains("ntrip")) {
+        qDebug() << "Config: restarting the caster connection";
+        startCaster();
+    }
+    if (changed.contains("serial")) {
+        qDebug() << "Config: restarting the serial port";
+        m_serialCom->stop();
+        startSerial();
+    }
+    if (changed.contains("metrics")) {
+        setupMetrics();
+    }
+#ifdef RTKROVER_HAVE_SHM
+    if (changed.contains("shm")) {
+        setupShm();
+    }
+#endif
+    if (changed.contains("history") || changed.contains("state")) {
+        setupTimers();
+    }
+    if (changed.contains("predictor")) {
+        setupPredictor();
+    }
+    if (changed.contains("rinex")) {
+        setupRinex();
+    }
+    if (changed.contains("relay")) {
+        setupRelay();
+    }
+    if (changed.contains("monitor")) {
+        setupMonitor();
+    }
+    if (changed.contains("config")) {
+        setupConfigWatcher();
+    }
+    qDebug() << "Config: reloaded from" << m_configFile;
+    m_reloading = false;
+    if (m_reloadPending) {
+        m_reloadPending = false;
+        m_reloadTimer->start();
     }
-    qDebug() << "Services started.";
 }
 
 void CRTKRover::stop()
 {
     qDebug() << "Stopping services...";
 
+    if (m_casterReader) {
+        saveState();
+    }
+
     if (m_casterReader) {
         m_casterReader->stop();
     }
+    if (m_serialProber) {
+        m_serialProber->stop();
+    }
     if (m_serialCom) {
         m_serialCom->stop();
     }
@@ -116,26 +668,268 @@ void CRTKRover::stop()
 
 void CRTKRover::onNmeaMessage(const QString &message)
 {
-    m_gpsData.parse_NMEA(message);
+    // The sentences of an epoch share their UTC time (GSA, GSV and VTG have none): a new time closes the
+    // previous epoch before the sentence is parsed. With the u-blox order (RMC, VTG, GGA, GSA, GSV, GLL,
+    // GST) the epoch keeps the RMC, GSA and GST of its GGA.
+    double time = GpsData::timeOfDay(message);
+    if (time >= 0 && m_epochTime >= 0 && time != m_epochTime) {
+        closeEpoch();
+    }
+    if (time >= 0) {
+        m_epochTime = time;
+    }
+
+    Metrics::Registry& metrics = Metrics::registry();
+    if (m_gpsData.parse_NMEA(message)) {
+        metrics.nmeaParsed.add();
+    } else {
+        metrics.nmeaRejected.add();
+    }
     // m_gpsData.print(); // This is now handled by OutputHandler if configured to stdout
 
+    if (message.mid(3, 3) == "GGA") {
+        m_epochHasGga = true;
+        m_epochReceiveNs = monotonicNsecs();
+    }
+
+    // Filtered NMEA outputs keep the sentences until the epoch is closed
+    for (OutputHandler* output : std::as_const(m_outputHandlers)) {
+        output->processNmeaData(message);
+    }
+    // The epoch is also closed when the receiver is silent after its last sentence
+    m_epochTimer->start();
+
     // Check if we have a fix and haven't detected the mount point yet
     if (m_gpsData.hasFix() && !m_mountPointDetected) {
         onGpsFixAcquired();
     }
 }
 
+// Once per epoch, with all its sentences parsed. An epoch without GGA has no fix to output.
+void CRTKRover::closeEpoch()
+{
+    m_epochTimer->stop();
+    m_epochTime = -1;
+    if (!m_epochHasGga) {
+        for (OutputHandler* output : std::as_const(m_outputHandlers)) {
+            output->discardEpoch();
+        }
+        return;
+    }
+    m_epochHasGga = false;
+
+    quint64 receiveTime = m_epochReceiveNs;
+    Metrics::Registry& metrics = Metrics::registry();
+    metrics.fixQuality.set(m_gpsData.fixQualityCode());
+    if (m_gpsData.hasFix()) {
+        m_state.hasPosition = true;
+        m_state.latitude = m_gpsData.latitude();
+        m_state.longitude = m_gpsData.longitude();
+        m_state.altitude = m_gpsData.altitude();
+        m_state.positionTimeMs = qMax<qint64>(0, m_gpsData.utcMsecs());
+    }
+    if (m_timeToRtkFixMs < 0 && m_gpsData.fixQualityCode() == 4) {
+        m_timeToRtkFixMs = m_clock.elapsed();
+        metrics.timeToRtkFixMs.set(m_timeToRtkFixMs);
+        qDebug().noquote() << QString("Time to RTK fix: %1 s (%2 start, previous run: %3)")
+                                .arg(m_timeToRtkFixMs / 1000.0, 0, 'f', 1)
+                                .arg(m_warmStart ? "warm" : "cold")
+                                .arg(m_previousTimeToRtkFixMs < 0 ? QString("no RTK fix")
+                                     : QString("%1 s, %2 start").arg(m_previousTimeToRtkFixMs / 1000.0, 0, 'f', 1)
+                                                              .arg(m_previousWarmStart ? "warm" : "cold"));
+    }
+    if (m_relinkClock.isValid() && m_gpsData.fixQualityCode() == 4) {
+        qint64 elapsed = m_relinkClock.elapsed();
+        metrics.relinkTimeToRtkFixMs.set(elapsed);
+        qDebug().noquote() << QString("Time to RTK fix after %1: %2 s (static messages %3)")
+                                .arg(m_relinkReason)
+                                .arg(elapsed / 1000.0, 0, 'f', 1)
+                                .arg(m_replayStatic ? "replayed" : "not replayed");
+        m_relinkClock.invalidate();
+    }
+    if (m_predictor) {
+        m_predictor->update(m_gpsData);
+        qint64 utcMs = m_gpsData.utcMsecs();
+        if (utcMs >= 0) {
+            RTK_LOG_RATE(Log::Info, 60000, "predictor", "Fix latency",
+                         {"ms", QDateTime::currentMSecsSinceEpoch() - utcMs});
+        }
+    }
+    m_history.add(m_gpsData, m_clock.elapsed());
+#ifdef RTKROVER_HAVE_SHM
+    m_shmPublisher.publish(m_gpsData, receiveTime);
+#endif
+    // All the outputs share the epoch parsed once here
+    for (OutputHandler* output : std::as_const(m_outputHandlers)) {
+        output->processEpoch(m_gpsData, receiveTime);
+    }
+}
+
 void CRTKRover::onGpsFixAcquired()
 {
     m_mountPointDetected = true;
     qDebug() << "GPS fix acquired. "<<m_gpsData.latitude()<<"/"<<m_gpsData.longitude()<<" Detecting closest mount point...";
-    m_mountpoint = detectMountPoint();
-    qDebug() << "Using mount point:" << m_mountpoint;
-    m_casterReader->start(m_mountpoint);
+    // The stream of a warm start keeps running during the request
+    m_casterReader->requestSourcetable();
+}
+
+void CRTKRover::onSourcetable(const QByteArray& sourcetable)
+{
+    QByteArray digest = RoverState::digest(sourcetable);
+    if (!m_state.sourcetableDigest.isEmpty() && digest != m_state.sourcetableDigest) {
+        qDebug() << "NTRIP: The sourcetable changed since the last run";
+    }
+    if (m_stateEnabled) {
+        m_state.saveSourcetable(m_stateFile, sourcetable);
+    }
+    m_state.sourcetableDigest = digest;
+
+    // The best stream of the closest mount points, or the closest one
+    m_candidates = CasterReader::nearestMountPoints(sourcetable, m_gpsData.latitude(), m_gpsData.longitude(), qMax(1, m_probeCount));
+    if (m_probeCount > 1 && m_candidates.size() > 1) {
+        selectMountPoint();
+        return;
+    }
+    useMountPoint(CasterReader::closestMountPoint(sourcetable, m_gpsData.latitude(), m_gpsData.longitude()));
+}
+
+// Probes the candidates missing from the cache, then takes the best one (called again when the probes end)
+void CRTKRover::selectMountPoint()
+{
+    if (m_candidates.isEmpty() || m_prober->isProbing()) {
+        return;
+    }
+    QList<MountPointProber::Candidate> missing = m_prober->uncached(m_candidates);
+    if (!missing.isEmpty()) {
+        m_prober->probe(missing);
+        return;
+    }
+    QString mountpoint = m_prober->best(m_candidates);
+    if (mountpoint.isEmpty()) {
+        qWarning() << "NTRIP: no usable stream among the" << m_candidates.size() << "closest mount points, using the closest one";
+        mountpoint = m_candidates.first().name;
+    }
+    useMountPoint(mountpoint);
+}
+
+// Another candidate is selected from the cache, all of them are probed again if none is usable
+void CRTKRover::onStreamFailed(const QString& mountpoint)
+{
+    m_streamFailed = true;
+    // Candidates are only known for an automatic mount point
+    if (m_candidates.size() < 2 || m_probeCount < 2) {
+        return;
+    }
+    m_prober->markFailed(mountpoint);
+    if (!m_prober->best(m_candidates).isEmpty()) {
+        qDebug() << "NTRIP: stream of" << mountpoint << "lost, selecting another mount point";
+        selectMountPoint();
+    } else {
+        qWarning() << "NTRIP: stream of" << mountpoint << "lost and no other usable mount point, probing again in"
+                   << STREAM_RETRY_MS / 1000 << "s";
+        QTimer::singleShot(STREAM_RETRY_MS, this, [this]() {
+            m_prober->clearCache();
+            selectMountPoint();
+        });
+    }
+}
+
+void CRTKRover::useMountPoint(const QString& mountpoint)
+{
+    if (mountpoint.isEmpty()) {
+        return;
+    }
+    if (mountpoint == m_casterReader->mountpoint() && !m_streamFailed) {
+        qDebug() << "Warm start mount point confirmed:" << mountpoint;
+    } else {
+        m_streamFailed = false;
+        if (m_warmStart) {
+            qDebug() << "Warm start mount point" << m_casterReader->mountpoint() << "replaced by" << mountpoint;
+        }
+        qDebug() << "Using mount point:" << mountpoint;
+        if (!m_casterReader->mountpoint().isEmpty()) {
+            startRelinkMeasurement("mount point switch");
+        }
+        m_mountpoint = mountpoint;
+        startStream(mountpoint);
+    }
+    saveState();
+}
+
+// A RINEX file holds the observations of a single base: another mount point starts a new one
+void CRTKRover::startStream(const QString& mountpoint)
+{
+    m_casterReader->start(mountpoint);
+    if (m_rinexRecorder) {
+        m_rinexRecorder->setMountPoint(mountpoint);
+    }
+}
+
+void CRTKRover::onReceiverLinkEstablished()
+{
+    startRelinkMeasurement("receiver link");
 }
 
-QString CRTKRover::detectMountPoint()
+// Measured once the first RTK fix was reached, the startup is measured by the time to RTK fix
+void CRTKRover::startRelinkMeasurement(const QString& reason)
 {
-    // This function now assumes m_gpsData has a valid fix
-    return m_casterReader->getAutoMountPoint(m_gpsData.latitude(), m_gpsData.longitude());
+    if (m_timeToRtkFixMs < 0) {
+        return;
+    }
+    m_relinkReason = reason;
+    m_relinkClock.start();
+}
+
+// The mount point of the last run on the same caster, or the closest one to the last
+// position in the cached sourcetable
+QString CRTKRover::warmStartMountPoint() const
+{
+    if (!m_stateEnabled) {
+        return QString();
+    }
+    if (m_state.host == m_ntripHost && !m_state.mountpoint.isEmpty()) {
+        return m_state.mountpoint;
+    }
+    if (m_state.hasPosition && m_state.host == m_ntripHost) {
+        QByteArray sourcetable = m_state.loadSourcetable(m_stateFile);
+        if (!sourcetable.isEmpty()) {
+            return CasterReader::closestMountPoint(sourcetable, m_state.latitude, m_state.longitude);
+        }
+    }
+    return QString();
+}
+
+void CRTKRover::saveState()
+{
+    if (!m_stateEnabled) {
+        return;
+    }
+    m_state.host = m_ntripHost;
+    m_state.mountpoint = m_casterReader->mountpoint();
+    // The time to RTK fix of the last run is kept until this run has its own
+    if (m_timeToRtkFixMs >= 0) {
+        m_state.timeToRtkFixMs = m_timeToRtkFixMs;
+        m_state.warmStart = m_warmStart;
+    }
+    m_state.save(m_stateFile);
+}
+
+void CRTKRover::reportSurveyStatistics()
+{
+    FixHistory::Statistics stats = m_history.statistics();
+    if (stats.count == 0) {
+        qDebug() << "Survey: no fix yet";
+        return;
+    }
+    qDebug().noquote() << QString("Survey: %1 fixes | Mean %2 / %3 / %4 m | Std E/N/U %5 / %6 / %7 m | CEP50 %8 m CEP95 %9 m | RTK fix %10%")
+                            .arg(stats.count)
+                            .arg(stats.meanLatitude, 0, 'f', 9)
+                            .arg(stats.meanLongitude, 0, 'f', 9)
+                            .arg(stats.meanAltitude, 0, 'f', 3)
+                            .arg(stats.stdEast, 0, 'f', 3)
+                            .arg(stats.stdNorth, 0, 'f', 3)
+                            .arg(stats.stdUp, 0, 'f', 3)
+                            .arg(stats.cep50, 0, 'f', 3)
+                            .arg(stats.cep95, 0, 'f', 3)
+                            .arg(stats.rtkFixPercent, 0, 'f', 1);
 }
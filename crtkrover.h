@@ -4,11 +4,26 @@
 #include <QObject>
 #include <QSettings>
 #include <QByteArray>
+#include <QElapsedTimer>
+#include <QFileSystemWatcher>
+#include <QMap>
+#include <QTimer>
 #include "casterreader.h"
+#include "configdiff.h"
 #include "serialcom.h"
+#include "serialportprober.h"
 #include "gpsdataparser.h"
-
-class OutputHandler; // Forward declaration
+#include "fixhistory.h"
+#include "outputhandler.h"
+#include "metricsserver.h"
+#include "roverstate.h"
+#include "predictor.h"
+#include "rinexrecorder.h"
+#include "relayserver.h"
+#include "mountpointprober.h"
+#ifdef RTKROVER_HAVE_SHM
+#include "shmpublisher.h"
+#endif
 
 class CRTKRover : public QObject
 {
@@ -22,13 +37,49 @@ public:
     void start();
     void stop();
 
+    const FixHistory& history() const { return m_history; }
+
 private slots:
     void onGpsFixAcquired();
     void onNmeaMessage(const QString& message);
+    void closeEpoch();
+    void onSourcetable(const QByteArray& sourcetable);
+    void selectMountPoint();
+    void onStreamFailed(const QString& mountpoint);
+    void onStreamAlert(const QString& mountpoint, const QString& condition, bool active);
+    void reportSurveyStatistics();
+    void saveState();
+    void onReceiverLinkEstablished();
+    void onReceiverDetected(const SerialPortProber::Result& receiver);
+    void publishPrediction();
+    void reloadConfig();
 
 private:
     void loadConfig();
-    QString detectMountPoint();
+    void readSettings();
+    void readSection(const QString& section);
+    OutputHandler::Options readOutputOptions(const QString& group);
+    QStringList outputGroups() const;
+    void setupOutput(const QString& group);
+    void setupMetrics();
+#ifdef RTKROVER_HAVE_SHM
+    void setupShm();
+#endif
+    void setupTimers();
+    void setupPredictor();
+    void setupRinex();
+    void setupRelay();
+    void setupMonitor();
+    void setupConfigWatcher();
+    void retryReload();
+    void startSerial();
+    bool detectReceiver();
+    void openSerial();
+    void startCaster();
+    QString warmStartMountPoint() const;
+    void useMountPoint(const QString& mountpoint);
+    void startStream(const QString& mountpoint);
+    void startRelinkMeasurement(const QString& reason);
 
     QSettings* m_settings;
     QString m_configFile;
@@ -39,19 +90,91 @@ private:
     QString m_mountpoint;
     QString m_ntripUsername;
     QString m_ntripPassword;
+    bool m_replayStatic;
+    bool m_ntripCompression;
+    bool m_ntripTls;
+    bool m_ntripTlsVerify;
+    QString m_ntripTlsCa;
+    bool m_ntripReuse;              // Stream requested on the connection of the sourcetable
+    int m_probeCount;               // Candidates probed before the selection, 1 for the closest one
+    int m_probeDurationMs;
+    int m_probeCacheMs;
 
     // Serial settings
     QString m_serialPort;
-    int m_serialBaud;
+    int m_serialBaud;               // 0 for auto
+    int m_serialDetectTimeoutMs;
     int m_gpsRate;
 
+    // History settings
+    int m_historyCapacity = 0;
+    int m_historyReportInterval;
+
     bool m_mountPointDetected = false;
+    // Mount point selection among the closest ones of the sourcetable
+    MountPointProber* m_prober = nullptr;
+    QList<MountPointProber::Candidate> m_candidates;
+    bool m_streamFailed = false;
+
+    // Action on the alerts of the correction stream: log, reconnect or reselect
+    QString m_monitorAction;
+    QStringList m_monitorConditions;    // Conditions triggering the action
+    QElapsedTimer m_monitorActionClock;
+
+    // Warm start
+    bool m_stateEnabled;
+    QString m_stateFile;
+    int m_stateSaveInterval;
+    RoverState m_state;
+    QTimer* m_stateTimer = nullptr;
+    bool m_warmStart = false;
+    qint64 m_timeToRtkFixMs = -1;
+    qint64 m_previousTimeToRtkFixMs = -1;   // Of the last run, as loaded
+    bool m_previousWarmStart = false;
+
+    // Time to RTK fix after a receiver relink or a mount point switch
+    QElapsedTimer m_relinkClock;
+    QString m_relinkReason;
 
     GpsData m_gpsData;
+    // Epoch being received: its UTC time of day (-1 before its first timed sentence), whether it has a GGA
+    // and when the GGA was received
+    double m_epochTime = -1;
+    bool m_epochHasGga = false;
+    quint64 m_epochReceiveNs = 0;
+    QTimer* m_epochTimer = nullptr;
+    FixHistory m_history;
+    QElapsedTimer m_clock;
+    QTimer* m_historyTimer = nullptr;
+
+#ifdef RTKROVER_HAVE_SHM
+    ShmPublisher m_shmPublisher;
+#endif
 
     CasterReader* m_casterReader;
     SerialCom* m_serialCom;
-    OutputHandler* _outputHandler = nullptr;
+    SerialPortProber* m_serialProber = nullptr;
+    QMap<QString, OutputHandler*> m_outputHandlers; // Keyed by section
+    MetricsServer* m_metricsServer = nullptr;
+
+    // Extrapolated fixes between the receiver epochs
+    PositionPredictor* m_predictor = nullptr;
+    QTimer* m_predictionTimer = nullptr;
+    int m_predictionPeriodMs = 0;
+    int m_predictionMaxAgeMs = 0;
+
+    // RINEX recording of the caster observations
+    RinexRecorder* m_rinexRecorder = nullptr;
+
+    // Relay of the caster stream to other rovers
+    RelayServer* m_relayServer = nullptr;
+
+    // Configuration reload
+    QFileSystemWatcher* m_configWatcher = nullptr;
+    QTimer* m_reloadTimer = nullptr;
+    bool m_reloading = false;
+    bool m_reloadPending = false;   // Requested during a reload
+    int m_reloadRetries = 0;        // Of a reload that found no configuration file
 };
 
 #endif // CRTKROVER_H
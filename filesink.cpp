@@ -0,0 +1,276 @@
+#include "filesink.h"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFileInfo>
+
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+#ifdef RTKROVER_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef RTKROVER_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+FileSink::FileSink(const Options& options)
+    : _options(options),
+      _pendingRecords(0),
+      _stop(false),
+      _dropped(0),
+      _thread(nullptr),
+      _lastSync(0),
+      _lastReopen(0),
+      _reportedDropped(0)
+{
+    _compressor.setMaxThreadCount(1);
+#ifndef RTKROVER_HAVE_ZLIB
+    if (_options.compression == Compression::Gzip) {
+        qWarning() << "File output: gzip support not built in, segments will not be compressed";
+        _options.compression = Compression::None;
+    }
+#endif
+#ifndef RTKROVER_HAVE_ZSTD
+    if (_options.compression == Compression::Zstd) {
+        qWarning() << "File output: zstd support not built in, segments will not be compressed";
+        _options.compression = Compression::None;
+    }
+#endif
+}
+
+FileSink::~FileSink()
+{
+    close();
+}
+
+FileSink::Compression FileSink::compressionFromString(const QString& name)
+{
+    QString n = name.toLower();
+    if (n == "gzip" || n == "gz") return Compression::Gzip;
+    if (n == "zstd" || n == "zst") return Compression::Zstd;
+    return Compression::None;
+}
+
+bool FileSink::open()
+{
+    if (_thread) return true;
+    if (!openFile()) return false;
+
+    _stop = false;
+    _pending.reserve(qMin(_options.bufferSize, 64 * 1024));
+    _thread = QThread::create([this] { run(); });
+    _thread->start();
+    return true;
+}
+
+void FileSink::close()
+{
+    if (!_thread) return;
+    {
+        QMutexLocker locker(&_mutex);
+        _stop = true;
+        _wakeUp.wakeOne();
+    }
+    _thread->wait();
+    delete _thread;
+    _thread = nullptr;
+    _file.close();
+    _compressor.waitForDone();
+}
+
+bool FileSink::write(const QByteArray& record)
+{
+    QMutexLocker locker(&_mutex);
+    if (_pending.size() + record.size() > _options.bufferSize) {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    _pending.append(record);
+    ++_pendingRecords;
+    return true;
+}
+
+bool FileSink::openFile()
+{
+    _file.setFileName(_options.fileName);
+    QIODevice::OpenMode mode = QIODevice::WriteOnly | QIODevice::Append;
+    if (!_options.binary) mode |= QIODevice::Text;
+    if (!_file.open(mode)) {
+        qWarning() << "Failed to open output file:" << _options.fileName << _file.errorString();
+        return false;
+    }
+    if (_file.size() == 0 && !_options.header.isEmpty()) {
+        _file.write(_options.header);
+    }
+    _fileOpened = QDateTime::currentDateTimeUtc();
+    return true;
+}
+
+void FileSink::run()
+{
+    QByteArray buffer;
+    buffer.reserve(qMin(_options.bufferSize, 64 * 1024));
+    quint64 records = 0;
+    QElapsedTimer clock;
+    clock.start();
+    qint64 lastDropReport = -1000;
+
+    bool stop = false;
+    while (!stop) {
+        {
+            // Records accumulate during the commit interval and are written in one go
+            QMutexLocker locker(&_mutex);
+            if (!_stop) {
+                _wakeUp.wait(&_mutex, _options.commitInterval);
+            }
+            // The two buffers are swapped and keep their capacity
+            buffer.swap(_pending);
+            records = _pendingRecords;
+            _pendingRecords = 0;
+            stop = _stop;
+        }
+
+        // The file could not be reopened after a rotation: try again every 5 s
+        if (!_file.isOpen() && clock.elapsed() - _lastReopen >= 5000) {
+            _lastReopen = clock.elapsed();
+            openFile();
+        }
+
+        if (!buffer.isEmpty()) {
+            commit(buffer, records);
+        }
+
+        if (stop || (_options.fsyncInterval > 0 && clock.elapsed() - _lastSync >= _options.fsyncInterval)) {
+            sync();
+            _lastSync = clock.elapsed();
+        }
+
+        // At most one report per second
+        quint64 dropped = droppedRecords();
+        if (dropped != _reportedDropped && (stop || clock.elapsed() - lastDropReport >= 1000)) {
+            lastDropReport = clock.elapsed();
+            qWarning() << "File output:" << dropped - _reportedDropped << "records dropped"
+                       << (_file.isOpen() ? "(disk stall or write error)," : "(file not open),") << dropped << "in total";
+            _reportedDropped = dropped;
+        }
+
+        if (!stop && _file.isOpen()
+            && ((_options.rotateSize > 0 && _file.size() >= _options.rotateSize)
+                || (_options.rotateInterval > 0 && _fileOpened.secsTo(QDateTime::currentDateTimeUtc()) >= _options.rotateInterval))) {
+            rotate();
+            _lastReopen = clock.elapsed();
+        }
+    }
+}
+
+void FileSink::commit(QByteArray& buffer, quint64 records)
+{
+    // A partial write loses an unknown part of the buffer, all its records are counted as dropped
+    if (!_file.isOpen()) {
+        _dropped.fetch_add(records, std::memory_order_relaxed);
+    } else if (_file.write(buffer) != buffer.size()) {
+        qWarning() << "File output: write error" << _file.errorString();
+        _dropped.fetch_add(records, std::memory_order_relaxed);
+    }
+    buffer.resize(0);
+}
+
+void FileSink::sync()
+{
+    if (!_file.isOpen()) return;
+    _file.flush();
+#ifdef Q_OS_UNIX
+    ::fsync(_file.handle());
+#endif
+}
+
+void FileSink::rotate()
+{
+    sync();
+    _file.close();
+
+    // Segments are named after the opening time, with a sequence number if it is already taken
+    QFileInfo info(_options.fileName);
+    QString base = info.path() + "/" + info.completeBaseName() + "." + _fileOpened.toString("yyyyMMdd-HHmmss");
+    QString suffix = info.suffix().isEmpty() ? QString() : "." + info.suffix();
+    QString segment = base + suffix;
+    for (int sequence = 1; QFile::exists(segment) || QFile::exists(segment + ".gz") || QFile::exists(segment + ".zst"); ++sequence) {
+        segment = base + "-" + QString::number(sequence) + suffix;
+    }
+    if (!QFile::rename(_options.fileName, segment)) {
+        qWarning() << "File output: failed to rotate" << _options.fileName << "to" << segment;
+    } else {
+        qDebug() << "File output: rotated to" << segment;
+        Compression compression = _options.compression;
+        if (compression != Compression::None) {
+            _compressor.start([segment, compression] {
+                if (compressFile(segment, compression)) {
+                    QFile::remove(segment);
+                }
+            });
+        }
+    }
+
+    if (!openFile()) {
+        qWarning() << "File output: records are dropped until" << _options.fileName << "can be reopened";
+    }
+}
+
+// Runs on the compressor thread
+bool FileSink::compressFile(const QString& fileName, Compression compression)
+{
+    QFile in(fileName);
+    if (!in.open(QIODevice::ReadOnly)) return false;
+
+    bool ok = false;
+    switch (compression) {
+#ifdef RTKROVER_HAVE_ZLIB
+    case Compression::Gzip: {
+        gzFile out = gzopen(QFile::encodeName(fileName + ".gz").constData(), "wb6");
+        if (!out) break;
+        ok = true;
+        while (!in.atEnd() && ok) {
+            QByteArray chunk = in.read(256 * 1024);
+            ok = gzwrite(out, chunk.constData(), static_cast<unsigned>(chunk.size())) == chunk.size();
+        }
+        ok = (gzclose(out) == Z_OK) && ok;
+        break;
+    }
+#endif
+#ifdef RTKROVER_HAVE_ZSTD
+    case Compression::Zstd: {
+        QFile out(fileName + ".zst");
+        if (!out.open(QIODevice::WriteOnly)) break;
+        ZSTD_CCtx* cctx = ZSTD_createCCtx();
+        QByteArray outBuffer(ZSTD_CStreamOutSize(), Qt::Uninitialized);
+        ok = true;
+        bool last = false;
+        while (ok && !last) {
+            QByteArray chunk = in.read(ZSTD_CStreamInSize());
+            last = in.atEnd();
+            ZSTD_inBuffer input = { chunk.constData(), static_cast<size_t>(chunk.size()), 0 };
+            bool finished = false;
+            while (ok && !finished) {
+                ZSTD_outBuffer output = { outBuffer.data(), static_cast<size_t>(outBuffer.size()), 0 };
+                size_t remaining = ZSTD_compressStream2(cctx, &output, &input, last ? ZSTD_e_end : ZSTD_e_continue);
+                ok = !ZSTD_isError(remaining)
+                     && out.write(outBuffer.constData(), output.pos) == static_cast<qint64>(output.pos);
+                finished = last ? (remaining == 0) : (input.pos == input.size);
+            }
+        }
+        ZSTD_freeCCtx(cctx);
+        ok = out.flush() && ok;
+        break;
+    }
+#endif
+    default:
+        break;
+    }
+
+    // A truncated archive would be taken for the segment by the next runs and the log collectors
+    if (!ok) {
+        qWarning() << "File output: failed to compress" << fileName;
+        QFile::remove(fileName + (compression == Compression::Gzip ? ".gz" : ".zst"));
+    }
+    return ok;
+}
@@ -0,0 +1,90 @@
+#ifndef FILESINK_H
+#define FILESINK_H
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QFile>
+#include <QMutex>
+#include <QString>
+#include <QThread>
+#include <QThreadPool>
+#include <QWaitCondition>
+#include <atomic>
+
+/**
+ * Buffered file writer running on a background thread.
+ *
+ * write() only appends the record to a bounded in-memory buffer; the writer
+ * thread commits everything pending in one write (group commit), calls fsync
+ * at a configurable interval and rotates the file by size or age. Closed
+ * segments can be compressed with gzip or zstd when the support was built in,
+ * on a separate thread so the commits go on during the compression.
+ * Records are dropped and counted when the buffer is full (disk stall) or
+ * the file cannot be written or reopened.
+ */
+class FileSink
+{
+public:
+    enum class Compression {
+        None,
+        Gzip,
+        Zstd
+    };
+
+    struct Options {
+        QString fileName;
+        bool binary = false;
+        QByteArray header;                          // Written at the start of every new file
+        qint64 rotateSize = 0;                      // Bytes, 0 to disable
+        int rotateInterval = 0;                     // Seconds, 0 to disable
+        Compression compression = Compression::None;
+        int commitInterval = 100;                   // Milliseconds between group commits
+        int fsyncInterval = 1000;                   // Milliseconds, 0 to disable
+        int bufferSize = 4 * 1024 * 1024;           // Maximum pending bytes
+    };
+
+    explicit FileSink(const Options& options);
+    ~FileSink();
+
+    bool open();
+    void close();
+    bool isOpen() const { return _thread != nullptr; }
+
+    // Queues a record, returns false if it was dropped
+    bool write(const QByteArray& record);
+
+    quint64 droppedRecords() const { return _dropped.load(std::memory_order_relaxed); }
+
+    static Compression compressionFromString(const QString& name);
+
+private:
+    void run();
+    bool openFile();
+    void commit(QByteArray& buffer, quint64 records);
+    void sync();
+    void rotate();
+    static bool compressFile(const QString& fileName, Compression compression);
+
+    Options _options;
+
+    // Shared with the writer thread
+    QMutex _mutex;
+    QWaitCondition _wakeUp;
+    QByteArray _pending;
+    quint64 _pendingRecords;
+    bool _stop;
+    std::atomic<quint64> _dropped;
+
+    // Writer thread only
+    QThread* _thread;
+    QFile _file;
+    QDateTime _fileOpened;
+    qint64 _lastSync;
+    qint64 _lastReopen;
+    quint64 _reportedDropped;
+
+    // Compression of the rotated segments, one at a time
+    QThreadPool _compressor;
+};
+
+#endif // FILESINK_H
@@ -0,0 +1,395 @@
+#include "fixformatter.h"
+#include <QDate>
+#include <QDebug>
+#include <QTime>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+
+struct FieldName {
+    FixFormatter::Field field;
+    const char* name;
+};
+
+// CSV column order
+static const FieldName csvFields[] = {
+    {FixFormatter::Timestamp, "timestamp"},
+    {FixFormatter::Latitude, "latitude"},
+    {FixFormatter::Longitude, "longitude"},
+    {FixFormatter::Altitude, "altitude"},
+    {FixFormatter::FixQuality, "fix_quality"},
+    {FixFormatter::FixMode, "fix_mode"},
+    {FixFormatter::SpeedMs, "speed_ms"},
+    {FixFormatter::Heading, "heading_degrees"},
+    {FixFormatter::Hdop, "hdop"}
+};
+
+// JSON key order, QJsonObject sorts its keys
+static const FieldName jsonFields[] = {
+    {FixFormatter::Altitude, "altitude"},
+    {FixFormatter::FixMode, "fix_mode"},
+    {FixFormatter::FixQuality, "fix_quality"},
+    {FixFormatter::Hdop, "hdop"},
+    {FixFormatter::Heading, "heading_degrees"},
+    {FixFormatter::Latitude, "latitude"},
+    {FixFormatter::Longitude, "longitude"},
+    {FixFormatter::SpeedMs, "speed_ms"},
+    {FixFormatter::Timestamp, "timestamp"}
+};
+
+// Prediction records
+static const char* const predictionCsvFields =
+    "timestamp,latitude,longitude,altitude,velocity_east,velocity_north,velocity_up,std_east,std_north,std_up,age_ms,fix_quality";
+
+static inline void twoDigits(char* out, int value)
+{
+    out[0] = static_cast<char>('0' + value / 10);
+    out[1] = static_cast<char>('0' + value % 10);
+}
+
+quint32 FixFormatter::fieldsFromString(const QString& names)
+{
+    if (names.trimmed().isEmpty()) return AllFields;
+    quint32 fields = 0;
+    for (const QString& name : names.split(',', Qt::SkipEmptyParts)) {
+        bool found = false;
+        for (const FieldName& f : csvFields) {
+            if (name.trimmed().compare(QLatin1String(f.name), Qt::CaseInsensitive) == 0) {
+                fields |= f.field;
+                found = true;
+            }
+        }
+        if (!found) qWarning() << "Output: unknown field" << name.trimmed();
+    }
+    return fields ? fields : AllFields;
+}
+
+QByteArray FixFormatter::csvHeader(quint32 fields)
+{
+    QByteArray header;
+    for (const FieldName& f : csvFields) {
+        if (!(fields & f.field)) continue;
+        if (!header.isEmpty()) header.append(',');
+        header.append(f.name);
+    }
+    header.append('\n');
+    return header;
+}
+
+FixFormatter::FixFormatter()
+    : _year(-1), _month(-1), _day(-1),
+      _dateValid(false)
+{
+    _buffer.reserve(256);
+}
+
+const QByteArray& FixFormatter::csv(const GpsData& gpsData, bool withHeader, quint32 fields)
+{
+    _buffer.resize(0);
+    if (withHeader) {
+        _buffer.append(csvHeader(fields));
+    }
+    bool first = true;
+    for (const FieldName& f : csvFields) {
+        if (!(fields & f.field)) continue;
+        if (!first) _buffer.append(',');
+        appendField(f.field, gpsData, false);
+        first = false;
+    }
+    _buffer.append('\n');
+    return _buffer;
+}
+
+const QByteArray& FixFormatter::json(const GpsData& gpsData, quint32 fields)
+{
+    _buffer.resize(0);
+    _buffer.append('{');
+    bool first = true;
+    for (const FieldName& f : jsonFields) {
+        if (!(fields & f.field)) continue;
+        if (!first) _buffer.append(',');
+        _buffer.append('"');
+        _buffer.append(f.name);
+        _buffer.append("\":");
+        appendField(f.field, gpsData, true);
+        first = false;
+    }
+    _buffer.append("}\n");
+    return _buffer;
+}
+
+QByteArray FixFormatter::predictionCsvHeader()
+{
+    return QByteArray(predictionCsvFields).append('\n');
+}
+
+const QByteArray& FixFormatter::csv(const Prediction& prediction, bool withHeader)
+{
+    _buffer.resize(0);
+    if (withHeader) {
+        _buffer.append(predictionCsvFields).append('\n');
+    }
+    appendTimestamp(prediction.utcMs);
+    _buffer.append(',');
+    appendFixed(prediction.latitude, 9);
+    _buffer.append(',');
+    appendFixed(prediction.longitude, 9);
+    _buffer.append(',');
+    appendFixed(prediction.altitude, 3);
+    for (double value : {prediction.velocityEast, prediction.velocityNorth, prediction.velocityUp,
+                         prediction.stdEast, prediction.stdNorth, prediction.stdUp}) {
+        _buffer.append(',');
+        appendFixed(value, 3);
+    }
+    _buffer.append(',').append(QByteArray::number(prediction.ageMs));
+    _buffer.append(',').append(QByteArray::number(prediction.fixQuality));
+    _buffer.append('\n');
+    return _buffer;
+}
+
+// Sorted keys, like the fix records
+const QByteArray& FixFormatter::json(const Prediction& prediction)
+{
+    _buffer.resize(0);
+    _buffer.append("{\"age_ms\":").append(QByteArray::number(prediction.ageMs));
+    _buffer.append(",\"altitude\":");
+    appendShortest(prediction.altitude);
+    _buffer.append(",\"fix_quality\":").append(QByteArray::number(prediction.fixQuality));
+    _buffer.append(",\"latitude\":");
+    appendShortest(prediction.latitude);
+    _buffer.append(",\"longitude\":");
+    appendShortest(prediction.longitude);
+    _buffer.append(",\"std_east\":");
+    appendShortest(prediction.stdEast);
+    _buffer.append(",\"std_north\":");
+    appendShortest(prediction.stdNorth);
+    _buffer.append(",\"std_up\":");
+    appendShortest(prediction.stdUp);
+    _buffer.append(",\"timestamp\":\"");
+    appendTimestamp(prediction.utcMs);
+    _buffer.append("\",\"velocity_east\":");
+    appendShortest(prediction.velocityEast);
+    _buffer.append(",\"velocity_north\":");
+    appendShortest(prediction.velocityNorth);
+    _buffer.append(",\"velocity_up\":");
+    appendShortest(prediction.velocityUp);
+    _buffer.append("}\n");
+    return _buffer;
+}
+
+// CSV numbers use fixed precisions, JSON numbers the shortest representation
+void FixFormatter::appendField(Field field, const GpsData& gpsData, bool json)
+{
+    switch (field) {
+    case Timestamp:
+        if (json) _buffer.append('"');
+        appendTimestamp(gpsData);
+        if (json) _buffer.append('"');
+        break;
+    case Latitude:
+        json ? appendShortest(gpsData.latitude()) : appendFixed(gpsData.latitude(), 8);
+        break;
+    case Longitude:
+        json ? appendShortest(gpsData.longitude()) : appendFixed(gpsData.longitude(), 8);
+        break;
+    case Altitude:
+        json ? appendShortest(gpsData.altitude()) : appendFixed(gpsData.altitude(), 3);
+        break;
+    case FixQuality:
+        if (json) _buffer.append('"');
+        appendLatin1(gpsData.fixQuality());
+        if (json) _buffer.append('"');
+        break;
+    case FixMode:
+        if (json) _buffer.append('"');
+        appendLatin1(gpsData.fixMode());
+        if (json) _buffer.append('"');
+        break;
+    case SpeedMs:
+        json ? appendShortest(gpsData.speedMs()) : appendFixed(gpsData.speedMs(), 3);
+        break;
+    case Heading:
+        json ? appendShortest(gpsData.headingDegrees()) : appendFixed(gpsData.headingDegrees(), 2);
+        break;
+    case Hdop:
+        json ? appendShortest(gpsData.hdop()) : appendFixed(gpsData.hdop(), 2);
+        break;
+    default:
+        break;
+    }
+}
+
+// Same as QString::number(value, 'f', precision)
+void FixFormatter::appendFixed(double value, int precision)
+{
+    char text[64];
+    std::to_chars_result result = std::to_chars(text, text + sizeof(text), value, std::chars_format::fixed, precision);
+    _buffer.append(text, result.ptr - text);
+}
+
+// Same as QByteArray::number(value, 'g', QLocale::FloatingPointShortest), used by QJsonDocument.
+// Non finite numbers are written as null, like QJsonDocument does.
+void FixFormatter::appendShortest(double value)
+{
+    if (!std::isfinite(value)) {
+        _buffer.append("null");
+        return;
+    }
+    if (value == 0.0) {
+        _buffer.append(std::signbit(value) ? "-0" : "0");
+        return;
+    }
+
+    // Shortest round-trip digits, in the form [-]d[.ddd]e<sign><exp>
+    char sci[64];
+    std::to_chars_result result = std::to_chars(sci, sci + sizeof(sci), value, std::chars_format::scientific);
+    const char* end = result.ptr;
+    const char* p = sci;
+    bool negative = (*p == '-');
+    if (negative) ++p;
+    char digits[32];
+    int digitCount = 0;
+    while (p < end && *p != 'e') {
+        if (*p != '.') digits[digitCount++] = *p;
+        ++p;
+    }
+    int exponent = 0;
+    std::from_chars(p + 1 + (p[1] == '+'), end, exponent);
+    const int decpt = exponent + 1; // Position of the decimal point relative to the digits
+
+    // Qt picks whichever of the decimal and exponent forms is shorter
+    int bias = 2 + 2; // Exponent separator, sign and at least two digits
+    if (digitCount <= decpt && digitCount > 1)
+        ++bias;
+    else if (digitCount == 1 && decpt <= 0)
+        --bias;
+    bool useDecimal = decpt <= 0 ? 1 - decpt <= bias
+                                 : (decpt <= digitCount ? true : decpt <= digitCount + bias);
+
+    char text[64];
+    char* out = text;
+    if (negative) *out++ = '-';
+    if (useDecimal) {
+        if (decpt <= 0) {
+            *out++ = '0';
+            *out++ = '.';
+            for (int i = 0; i < -decpt; ++i) *out++ = '0';
+            memcpy(out, digits, digitCount);
+            out += digitCount;
+        } else if (decpt >= digitCount) {
+            memcpy(out, digits, digitCount);
+            out += digitCount;
+            for (int i = digitCount; i < decpt; ++i) *out++ = '0';
+        } else {
+            memcpy(out, digits, decpt);
+            out += decpt;
+            *out++ = '.';
+            memcpy(out, digits + decpt, digitCount - decpt);
+            out += digitCount - decpt;
+        }
+    } else {
+        *out++ = digits[0];
+        if (digitCount > 1) {
+            *out++ = '.';
+            memcpy(out, digits + 1, digitCount - 1);
+            out += digitCount - 1;
+        }
+        int e = decpt - 1;
+        *out++ = 'e';
+        *out++ = e < 0 ? '-' : '+';
+        if (e < 0) e = -e;
+        if (e >= 100) {
+            *out++ = static_cast<char>('0' + e / 100);
+            e %= 100;
+        }
+        twoDigits(out, e);
+        out += 2;
+    }
+    _buffer.append(text, out - text);
+}
+
+void FixFormatter::appendLatin1(const QString& text)
+{
+    for (QChar c : text) {
+        _buffer.append(c.toLatin1());
+    }
+}
+
+// Same as QDateTime(date, time, QTimeZone::utc()).toString(Qt::ISODate): empty if the date or the time is invalid
+void FixFormatter::appendTimestamp(const GpsData& gpsData)
+{
+    if (gpsData.year() != _year || gpsData.month() != _month || gpsData.day() != _day) {
+        _year = gpsData.year();
+        _month = gpsData.month();
+        _day = gpsData.day();
+        _dateValid = QDate::isValid(_year, _month, _day) && _year > 0 && _year <= 9999;
+        if (_dateValid) {
+            twoDigits(_date, _year / 100);
+            twoDigits(_date + 2, _year % 100);
+            _date[4] = '-';
+            twoDigits(_date + 5, _month);
+            _date[7] = '-';
+            twoDigits(_date + 8, _day);
+        }
+    }
+
+    int seconds = static_cast<int>(gpsData.seconds());
+    int ms = static_cast<int>((gpsData.seconds() - seconds) * 1000);
+    if (!_dateValid || !QTime::isValid(gpsData.hours(), gpsData.minutes(), seconds, ms)) {
+        return;
+    }
+
+    char time[10];
+    time[0] = 'T';
+    twoDigits(time + 1, gpsData.hours());
+    time[3] = ':';
+    twoDigits(time + 4, gpsData.minutes());
+    time[6] = ':';
+    twoDigits(time + 7, seconds);
+    _buffer.append(_date, 10);
+    _buffer.append(time, 9);
+    _buffer.append('Z');
+}
+
+// ISO 8601 UTC time with milliseconds, e.g. 2025-08-12T10:15:30.250Z
+void FixFormatter::appendTimestamp(qint64 utcMs)
+{
+    if (utcMs < 0) {
+        return;
+    }
+    qint64 days = utcMs / 86400000;
+    int msOfDay = static_cast<int>(utcMs % 86400000);
+
+    // Civil date of a day number (H. Hinnant's days_from_civil inverse)
+    qint64 z = days + 719468;
+    qint64 era = z / 146097;
+    int doe = static_cast<int>(z - era * 146097);
+    int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int mp = (5 * doy + 2) / 153;
+    int day = doy - (153 * mp + 2) / 5 + 1;
+    int month = mp < 10 ? mp + 3 : mp - 9;
+    int year = static_cast<int>(yoe + era * 400) + (month <= 2);
+    if (year > 9999) {
+        return;
+    }
+
+    char text[24];
+    twoDigits(text, year / 100);
+    twoDigits(text + 2, year % 100);
+    text[4] = '-';
+    twoDigits(text + 5, month);
+    text[7] = '-';
+    twoDigits(text + 8, day);
+    text[10] = 'T';
+    twoDigits(text + 11, msOfDay / 3600000);
+    text[13] = ':';
+    twoDigits(text + 14, msOfDay / 60000 % 60);
+    text[16] = ':';
+    twoDigits(text + 17, msOfDay / 1000 % 60);
+    text[19] = '.';
+    text[20] = static_cast<char>('0' + msOfDay / 100 % 10);
+    twoDigits(text + 21, msOfDay % 100);
+    text[23] = 'Z';
+    _buffer.append(text, sizeof(text));
+}
@@ -0,0 +1,65 @@
+#ifndef FIXFORMATTER_H
+#define FIXFORMATTER_H
+
+#include <QByteArray>
+#include "gpsdataparser.h"
+#include "predictor.h"
+
+/**
+ * CSV and JSON formatting of fixes into a reusable byte buffer.
+ *
+ * The output is byte-identical to the QTextStream/QJsonDocument based
+ * formatting used before (same number formats, ISO timestamp and sorted
+ * JSON keys), but numbers are written with std::to_chars and the date part
+ * of the timestamp is only rebuilt when the date changes, so formatting a
+ * record does not allocate once the buffer has grown.
+ */
+class FixFormatter
+{
+public:
+    // Fields of the CSV and JSON records, in CSV column order
+    enum Field : quint32 {
+        Timestamp = 1 << 0,
+        Latitude = 1 << 1,
+        Longitude = 1 << 2,
+        Altitude = 1 << 3,
+        FixQuality = 1 << 4,
+        FixMode = 1 << 5,
+        SpeedMs = 1 << 6,
+        Heading = 1 << 7,
+        Hdop = 1 << 8,
+        AllFields = (1 << 9) - 1
+    };
+
+    // Comma-separated field names as in the CSV header, empty for all the fields
+    static quint32 fieldsFromString(const QString& names);
+    static QByteArray csvHeader(quint32 fields = AllFields);
+
+    FixFormatter();
+
+    // Both return a line terminated by '\n', valid until the next call
+    const QByteArray& csv(const GpsData& gpsData, bool withHeader = false, quint32 fields = AllFields);
+    const QByteArray& json(const GpsData& gpsData, quint32 fields = AllFields);
+
+    // Extrapolated fixes, with millisecond timestamps, velocity and standard deviations
+    static QByteArray predictionCsvHeader();
+    const QByteArray& csv(const Prediction& prediction, bool withHeader = false);
+    const QByteArray& json(const Prediction& prediction);
+
+private:
+    void appendField(Field field, const GpsData& gpsData, bool json);
+    void appendFixed(double value, int precision);
+    void appendShortest(double value);
+    void appendLatin1(const QString& text);
+    void appendTimestamp(const GpsData& gpsData);
+    void appendTimestamp(qint64 utcMs);
+
+    QByteArray _buffer;
+
+    // Cached "yyyy-MM-dd" of the last date
+    int _year, _month, _day;
+    bool _dateValid;
+    char _date[10];
+};
+
+#endif // FIXFORMATTER_H
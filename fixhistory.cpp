@@ -0,0 +1,188 @@
+#include "fixhistory.h"
+#include "geodesy.h"
+#include <cmath>
+
+// NMEA GGA fix quality for RTK fixed solutions
+static const int RTK_FIX_QUALITY = 4;
+
+// Time gaps longer than this are not counted in the fix quality ratio
+static const qint64 MAX_EPOCH_GAP_MS = 5000;
+
+FixHistory::FixHistory(int capacity, int bucketCapacity)
+    : _fixes(capacity),
+      _credits(capacity),
+      _downsamplers{{1000, Bucket(), RingBuffer<Bucket>(bucketCapacity)},
+                    {10000, Bucket(), RingBuffer<Bucket>(bucketCapacity)},
+                    {60000, Bucket(), RingBuffer<Bucket>(bucketCapacity)}}
+{
+    clear();
+}
+
+void FixHistory::clear()
+{
+    _fixes.clear();
+    _credits.clear();
+    for (Downsampler& ds : _downsamplers) {
+        ds.current = Bucket();
+        ds.buckets.clear();
+    }
+    _count = 0;
+    _meanLat = _meanLon = _meanAlt = 0.0;
+    _m2Lat = _m2Lon = _m2Alt = 0.0;
+    _evictions = 0;
+    _lastTimestampMs = -1;
+    _lastFixQuality = 0;
+    _totalTimeMs = 0;
+    _rtkFixTimeMs = 0;
+}
+
+void FixHistory::add(const GpsData& fix, qint64 timestampMs)
+{
+    if (_fixes.isFull())
+        evictOldest();
+
+    // Time in RTK fix: the interval since the previous epoch is credited to the previous quality
+    Credit credit;
+    if (_lastTimestampMs >= 0) {
+        qint64 dt = timestampMs - _lastTimestampMs;
+        if (dt > 0 && dt <= MAX_EPOCH_GAP_MS) {
+            credit.timeMs = dt;
+            credit.rtkFix = _lastFixQuality == RTK_FIX_QUALITY;
+            _totalTimeMs += dt;
+            if (credit.rtkFix)
+                _rtkFixTimeMs += dt;
+        }
+    }
+    _lastTimestampMs = timestampMs;
+    _lastFixQuality = fix.fixQualityCode();
+    _fixes.push(fix);
+    _credits.push(credit);
+
+    if (!fix.hasFix())
+        return;
+
+    addPosition(fix);
+    for (Downsampler& ds : _downsamplers)
+        addToBucket(ds, fix, timestampMs);
+}
+
+void FixHistory::addPosition(const GpsData& fix)
+{
+    // Welford's online mean and variance
+    ++_count;
+    double d;
+    d = fix.latitude() - _meanLat;
+    _meanLat += d / _count;
+    _m2Lat += d * (fix.latitude() - _meanLat);
+    d = fix.longitude() - _meanLon;
+    _meanLon += d / _count;
+    _m2Lon += d * (fix.longitude() - _meanLon);
+    d = fix.altitude() - _meanAlt;
+    _meanAlt += d / _count;
+    _m2Alt += d * (fix.altitude() - _meanAlt);
+}
+
+// Removes the contribution of the oldest fix, about to be overwritten
+void FixHistory::evictOldest()
+{
+    const Credit& credit = _credits.at(0);
+    _totalTimeMs -= credit.timeMs;
+    if (credit.rtkFix)
+        _rtkFixTimeMs -= credit.timeMs;
+
+    const GpsData& fix = _fixes.at(0);
+    if (!fix.hasFix())
+        return;
+
+    // Each removal adds rounding error: start again from the window once it has been replaced
+    if (++_evictions >= _fixes.capacity()) {
+        recomputePositions();
+        return;
+    }
+
+    // Welford's update in reverse
+    if (--_count == 0) {
+        _meanLat = _meanLon = _meanAlt = 0.0;
+        _m2Lat = _m2Lon = _m2Alt = 0.0;
+        return;
+    }
+    double d;
+    d = fix.latitude() - _meanLat;
+    _meanLat -= d / _count;
+    _m2Lat -= d * (fix.latitude() - _meanLat);
+    d = fix.longitude() - _meanLon;
+    _meanLon -= d / _count;
+    _m2Lon -= d * (fix.longitude() - _meanLon);
+    d = fix.altitude() - _meanAlt;
+    _meanAlt -= d / _count;
+    _m2Alt -= d * (fix.altitude() - _meanAlt);
+    _m2Lat = qMax(_m2Lat, 0.0);
+    _m2Lon = qMax(_m2Lon, 0.0);
+    _m2Alt = qMax(_m2Alt, 0.0);
+}
+
+// Statistics of the fixes in the ring except the oldest one, which is being evicted
+void FixHistory::recomputePositions()
+{
+    _evictions = 0;
+    _count = 0;
+    _meanLat = _meanLon = _meanAlt = 0.0;
+    _m2Lat = _m2Lon = _m2Alt = 0.0;
+    for (int i = 1; i < _fixes.size(); ++i) {
+        if (_fixes.at(i).hasFix())
+            addPosition(_fixes.at(i));
+    }
+}
+
+void FixHistory::addToBucket(Downsampler& ds, const GpsData& fix, qint64 timestampMs)
+{
+    qint64 start = timestampMs - timestampMs % ds.periodMs;
+    if (ds.current.count > 0 && ds.current.startMs != start) {
+        ds.buckets.push(ds.current);
+        ds.current = Bucket();
+    }
+    Bucket& b = ds.current;
+    b.startMs = start;
+    ++b.count;
+    b.latitude += (fix.latitude() - b.latitude) / b.count;
+    b.longitude += (fix.longitude() - b.longitude) / b.count;
+    b.altitude += (fix.altitude() - b.altitude) / b.count;
+    if (fix.fixQualityCode() == RTK_FIX_QUALITY || (b.bestFixQuality != RTK_FIX_QUALITY && fix.fixQualityCode() > b.bestFixQuality))
+        b.bestFixQuality = fix.fixQualityCode();
+}
+
+const RingBuffer<FixHistory::Bucket>& FixHistory::buckets(Resolution resolution) const
+{
+    return _downsamplers[static_cast<int>(resolution)].buckets;
+}
+
+FixHistory::Statistics FixHistory::statistics() const
+{
+    Statistics stats;
+    stats.count = _count;
+    stats.rtkFixPercent = _totalTimeMs > 0 ? 100.0 * _rtkFixTimeMs / _totalTimeMs : 0.0;
+    if (_count == 0)
+        return stats;
+
+    stats.meanLatitude = _meanLat;
+    stats.meanLongitude = _meanLon;
+    stats.meanAltitude = _meanAlt;
+    if (_count < 2)
+        return stats;
+
+    // Degrees to meters with the radii of curvature at the mean latitude
+    const double phi = _meanLat * M_PI / 180.0;
+    const double w = 1.0 - Geodesy::WGS84_E2 * sin(phi) * sin(phi);
+    const double meridianRadius = Geodesy::WGS84_A * (1.0 - Geodesy::WGS84_E2) / (w * sqrt(w));
+    const double normalRadius = Geodesy::WGS84_A / sqrt(w);
+
+    stats.stdNorth = sqrt(_m2Lat / (_count - 1)) * M_PI / 180.0 * meridianRadius;
+    stats.stdEast = sqrt(_m2Lon / (_count - 1)) * M_PI / 180.0 * normalRadius * cos(phi);
+    stats.stdUp = sqrt(_m2Alt / (_count - 1));
+
+    // Circular normal approximation, good when stdEast and stdNorth are of the same order
+    stats.cep50 = 0.5887 * (stats.stdEast + stats.stdNorth);
+    stats.cep95 = 1.2239 * (stats.stdEast + stats.stdNorth);
+
+    return stats;
+}
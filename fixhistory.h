@@ -0,0 +1,119 @@
+#ifndef FIXHISTORY_H
+#define FIXHISTORY_H
+
+#include <QVector>
+#include "gpsdataparser.h"
+
+/**
+ * Fixed-capacity ring buffer. Once full, pushing overwrites the oldest element.
+ * Index 0 is the oldest element, size()-1 the newest.
+ */
+template <typename T>
+class RingBuffer
+{
+public:
+    explicit RingBuffer(int capacity = 0) : _data(capacity > 0 ? capacity : 1), _head(0), _size(0) {}
+
+    void push(const T& value) {
+        _data[_head] = value;
+        _head = (_head + 1) % _data.size();
+        if (_size < _data.size()) ++_size;
+    }
+    void clear() { _head = 0; _size = 0; }
+
+    int size() const { return _size; }
+    int capacity() const { return _data.size(); }
+    bool isEmpty() const { return _size == 0; }
+    bool isFull() const { return _size == _data.size(); }
+    const T& at(int i) const { return _data[(_head - _size + i + _data.size()) % _data.size()]; }
+    const T& last() const { return at(_size - 1); }
+
+private:
+    QVector<T> _data;
+    int _head;
+    int _size;
+};
+
+/**
+ * History of the latest fixes with survey statistics.
+ *
+ * Statistics cover the fixes in the ring: they are updated incrementally
+ * (Welford) on every fix, and the contribution of the oldest fix is removed
+ * when it is overwritten. The position is also averaged into 1 s, 10 s and
+ * 1 min buckets, so memory is bounded and queries never scan the history.
+ */
+class FixHistory
+{
+public:
+    enum class Resolution {
+        OneSecond,
+        TenSeconds,
+        OneMinute
+    };
+
+    struct Statistics {
+        qint64 count = 0;           // Number of fixes in the statistics
+        double meanLatitude = 0.0;  // Degrees
+        double meanLongitude = 0.0; // Degrees
+        double meanAltitude = 0.0;  // Meters
+        double stdEast = 0.0;       // Standard deviations, in meters
+        double stdNorth = 0.0;
+        double stdUp = 0.0;
+        double cep50 = 0.0;         // Circular error probable, in meters
+        double cep95 = 0.0;
+        double rtkFixPercent = 0.0; // Time spent in RTK fixed mode
+    };
+
+    struct Bucket {
+        qint64 startMs = 0;         // Start of the bucket (monotonic time)
+        int count = 0;
+        double latitude = 0.0;      // Mean position in the bucket
+        double longitude = 0.0;
+        double altitude = 0.0;
+        int bestFixQuality = 0;
+    };
+
+    explicit FixHistory(int capacity = 3600, int bucketCapacity = 1440);
+
+    // Adds a fix received at timestampMs (monotonic clock)
+    void add(const GpsData& fix, qint64 timestampMs);
+    void clear();
+
+    const RingBuffer<GpsData>& fixes() const { return _fixes; }
+    const RingBuffer<Bucket>& buckets(Resolution resolution) const;
+    Statistics statistics() const;
+
+private:
+    struct Downsampler {
+        qint64 periodMs;
+        Bucket current;
+        RingBuffer<Bucket> buckets;
+    };
+    // Time credited to the previous epoch when a fix was added
+    struct Credit {
+        qint64 timeMs = 0;
+        bool rtkFix = false;
+    };
+    void addToBucket(Downsampler& ds, const GpsData& fix, qint64 timestampMs);
+    void evictOldest();
+    void addPosition(const GpsData& fix);
+    void recomputePositions();
+
+    RingBuffer<GpsData> _fixes;
+    RingBuffer<Credit> _credits;
+    Downsampler _downsamplers[3];
+
+    // Welford accumulators
+    qint64 _count;
+    double _meanLat, _meanLon, _meanAlt;
+    double _m2Lat, _m2Lon, _m2Alt;
+    int _evictions;                 // Since the last recomputation, which bounds the rounding drift
+
+    // Time in each fix quality
+    qint64 _lastTimestampMs;
+    int _lastFixQuality;
+    qint64 _totalTimeMs;
+    qint64 _rtkFixTimeMs;
+};
+
+#endif // FIXHISTORY_H
@@ -0,0 +1,69 @@
+#include "fixrecord.h"
+#include <QtEndian>
+#include <QtMath>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+quint64 monotonicNsecs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void encodeFixRecord(const GpsData& gpsData, quint32 sequence, quint64 receiveTimeNs, char* out)
+{
+    memset(out, 0, sizeof(rtk_fix_record));
+    qToLittleEndian<quint32>(RTK_FIX_MAGIC, out + offsetof(rtk_fix_record, magic));
+    qToLittleEndian<quint16>(RTK_FIX_VERSION, out + offsetof(rtk_fix_record, version));
+    qToLittleEndian<quint16>(sizeof(rtk_fix_record), out + offsetof(rtk_fix_record, size));
+    qToLittleEndian<quint32>(sequence, out + offsetof(rtk_fix_record, sequence));
+    qToLittleEndian<quint64>(receiveTimeNs, out + offsetof(rtk_fix_record, recv_time_ns));
+    qToLittleEndian<qint64>(gpsData.utcMsecs(), out + offsetof(rtk_fix_record, utc_time_ms));
+    qToLittleEndian<double>(gpsData.latitude(), out + offsetof(rtk_fix_record, latitude));
+    qToLittleEndian<double>(gpsData.longitude(), out + offsetof(rtk_fix_record, longitude));
+    qToLittleEndian<double>(gpsData.altitude(), out + offsetof(rtk_fix_record, altitude));
+    qToLittleEndian<float>(gpsData.speedMs(), out + offsetof(rtk_fix_record, speed_ms));
+    qToLittleEndian<float>(gpsData.headingDegrees(), out + offsetof(rtk_fix_record, heading_deg));
+    qToLittleEndian<float>(gpsData.hdop(), out + offsetof(rtk_fix_record, hdop));
+    qToLittleEndian<float>(gpsData.stdLatitude(), out + offsetof(rtk_fix_record, std_lat));
+    qToLittleEndian<float>(gpsData.stdLongitude(), out + offsetof(rtk_fix_record, std_lon));
+    qToLittleEndian<float>(gpsData.stdAltitude(), out + offsetof(rtk_fix_record, std_alt));
+    out[offsetof(rtk_fix_record, fix_quality)] = static_cast<char>(gpsData.fixQualityCode());
+    out[offsetof(rtk_fix_record, fix_mode)] = static_cast<char>(gpsData.fixModeCode());
+    out[offsetof(rtk_fix_record, satellites)] = static_cast<char>(qMin(gpsData.satellites(), 255));
+}
+
+void encodeFixRecord(const Prediction& prediction, quint32 sequence, quint64 predictionTimeNs, char* out)
+{
+    memset(out, 0, sizeof(rtk_fix_record));
+    qToLittleEndian<quint32>(RTK_FIX_MAGIC, out + offsetof(rtk_fix_record, magic));
+    qToLittleEndian<quint16>(RTK_FIX_VERSION, out + offsetof(rtk_fix_record, version));
+    qToLittleEndian<quint16>(sizeof(rtk_fix_record), out + offsetof(rtk_fix_record, size));
+    qToLittleEndian<quint32>(sequence, out + offsetof(rtk_fix_record, sequence));
+    qToLittleEndian<quint32>(RTK_FIX_PREDICTED, out + offsetof(rtk_fix_record, flags));
+    qToLittleEndian<quint64>(predictionTimeNs, out + offsetof(rtk_fix_record, recv_time_ns));
+    qToLittleEndian<qint64>(prediction.utcMs, out + offsetof(rtk_fix_record, utc_time_ms));
+    qToLittleEndian<double>(prediction.latitude, out + offsetof(rtk_fix_record, latitude));
+    qToLittleEndian<double>(prediction.longitude, out + offsetof(rtk_fix_record, longitude));
+    qToLittleEndian<double>(prediction.altitude, out + offsetof(rtk_fix_record, altitude));
+    double speed = std::hypot(prediction.velocityEast, prediction.velocityNorth);
+    double heading = qRadiansToDegrees(std::atan2(prediction.velocityEast, prediction.velocityNorth));
+    qToLittleEndian<float>(speed, out + offsetof(rtk_fix_record, speed_ms));
+    qToLittleEndian<float>(heading < 0 ? heading + 360.0 : heading, out + offsetof(rtk_fix_record, heading_deg));
+    qToLittleEndian<float>(std::numeric_limits<float>::quiet_NaN(), out + offsetof(rtk_fix_record, hdop));
+    qToLittleEndian<float>(prediction.stdNorth, out + offsetof(rtk_fix_record, std_lat));
+    qToLittleEndian<float>(prediction.stdEast, out + offsetof(rtk_fix_record, std_lon));
+    qToLittleEndian<float>(prediction.stdUp, out + offsetof(rtk_fix_record, std_alt));
+    out[offsetof(rtk_fix_record, fix_quality)] = static_cast<char>(prediction.fixQuality);
+    out[offsetof(rtk_fix_record, fix_mode)] = static_cast<char>(prediction.fixMode);
+    out[offsetof(rtk_fix_record, satellites)] = static_cast<char>(qMin(prediction.satellites, 255));
+}
+
+QByteArray encodeFixRecord(const GpsData& gpsData, quint32 sequence, quint64 receiveTimeNs)
+{
+    QByteArray record(sizeof(rtk_fix_record), Qt::Uninitialized);
+    encodeFixRecord(gpsData, sequence, receiveTimeNs, record.data());
+    return record;
+}
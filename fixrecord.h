@@ -0,0 +1,18 @@
+#ifndef FIXRECORD_H
+#define FIXRECORD_H
+
+#include <QByteArray>
+#include "gpsdataparser.h"
+#include "predictor.h"
+#include "rtkfix.h"
+
+// Monotonic clock (CLOCK_MONOTONIC on Linux), in nanoseconds
+quint64 monotonicNsecs();
+
+// Serializes a fix as a little-endian rtk_fix_record (see rtkfix.h)
+void encodeFixRecord(const GpsData& gpsData, quint32 sequence, quint64 receiveTimeNs, char* out);
+QByteArray encodeFixRecord(const GpsData& gpsData, quint32 sequence, quint64 receiveTimeNs);
+// Same record for an extrapolated fix, with the RTK_FIX_PREDICTED flag
+void encodeFixRecord(const Prediction& prediction, quint32 sequence, quint64 predictionTimeNs, char* out);
+
+#endif // FIXRECORD_H
@@ -0,0 +1,275 @@
+#include "geodesy.h"
+#include <algorithm>
+#include <cmath>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+namespace Geodesy {
+
+namespace {
+
+constexpr double DEG_TO_RAD = M_PI / 180.0;
+
+// Third flattening and its powers
+constexpr double N1 = WGS84_F / (2 - WGS84_F);
+constexpr double N2 = N1 * N1;
+constexpr double N3 = N2 * N1;
+constexpr double N4 = N3 * N1;
+constexpr double N5 = N4 * N1;
+constexpr double N6 = N5 * N1;
+
+// Rectifying radius, pre-multiplied by the UTM scale factor
+constexpr double K0A = UTM_K0 * WGS84_A / (1 + N1) * (1 + N2 / 4 + N4 / 64 + N6 / 256);
+
+// Krüger series coefficients (Karney 2011, eq. 35)
+constexpr double ALPHA[6] = {
+    N1 / 2 - 2 * N2 / 3 + 5 * N3 / 16 + 41 * N4 / 180 - 127 * N5 / 288 + 7891 * N6 / 37800,
+    13 * N2 / 48 - 3 * N3 / 5 + 557 * N4 / 1440 + 281 * N5 / 630 - 1983433 * N6 / 1935360,
+    61 * N3 / 240 - 103 * N4 / 140 + 15061 * N5 / 26880 + 167603 * N6 / 181440,
+    49561 * N4 / 161280 - 179 * N5 / 168 + 6601661 * N6 / 7257600,
+    34729 * N5 / 80640 - 3418889 * N6 / 1995840,
+    212378941 * N6 / 319334400
+};
+
+// Inverse series coefficients (Karney 2011, eq. 36)
+constexpr double BETA[6] = {
+    N1 / 2 - 2 * N2 / 3 + 37 * N3 / 96 - N4 / 360 - 81 * N5 / 512 + 96199 * N6 / 604800,
+    N2 / 48 + N3 / 15 - 437 * N4 / 1440 + 46 * N5 / 105 - 1118711 * N6 / 3870720,
+    17 * N3 / 480 - 37 * N4 / 840 - 209 * N5 / 4480 + 5569 * N6 / 90720,
+    4397 * N4 / 161280 - 11 * N5 / 504 - 830251 * N6 / 7257600,
+    4583 * N5 / 161280 - 108847 * N6 / 3991680,
+    20648693 * N6 / 638668800
+};
+
+const double ECC = std::sqrt(WGS84_E2);
+
+// Central meridians of the 60 UTM zones, index 0 is unused
+struct ZoneTable {
+    double lon0[61];
+    ZoneTable() {
+        lon0[0] = 0.0;
+        for (int zone = 1; zone <= 60; ++zone)
+            lon0[zone] = (zone * 6 - 183) * DEG_TO_RAD;
+    }
+};
+const ZoneTable zoneTable;
+
+// Transverse Mercator of one point, lam is the longitude relative to the central meridian.
+// Returns the scaled (x, y) before false easting/northing.
+inline void transverseMercator(double phi, double lam, double& x, double& y)
+{
+    const double sphi = std::sin(phi);
+    const double cphi = std::cos(phi);
+    const double tau = sphi / cphi;
+    const double sigma = std::sinh(ECC * std::atanh(ECC * sphi));
+    const double taup = tau * std::sqrt(1 + sigma * sigma) - sigma / cphi;
+
+    const double clam = std::cos(lam);
+    const double slam = std::sin(lam);
+    const double xip = std::atan2(taup, clam);
+    const double etap = std::asinh(slam / std::sqrt(taup * taup + clam * clam));
+
+    // Multiple angle terms sin/cos(2j xi') and sinh/cosh(2j eta') by recurrence
+    const double s2 = std::sin(2 * xip);
+    const double c2 = std::cos(2 * xip);
+    const double ex = std::exp(2 * etap);
+    const double sh2 = (ex - 1 / ex) / 2;
+    const double ch2 = (ex + 1 / ex) / 2;
+
+    double s = s2, c = c2, sh = sh2, ch = ch2;
+    double xi = xip, eta = etap;
+    for (int j = 0; j < 6; ++j) {
+        xi += ALPHA[j] * s * ch;
+        eta += ALPHA[j] * c * sh;
+        const double sn = s * c2 + c * s2;
+        const double cn = c * c2 - s * s2;
+        const double shn = sh * ch2 + ch * sh2;
+        const double chn = ch * ch2 + sh * sh2;
+        s = sn; c = cn; sh = shn; ch = chn;
+    }
+
+    x = K0A * eta;
+    y = K0A * xi;
+}
+
+// Inverse of transverseMercator: latitude and longitude relative to the central meridian, in radians
+inline void inverseTransverseMercator(double x, double y, double& phi, double& lam)
+{
+    const double xi = y / K0A;
+    const double eta = x / K0A;
+
+    const double s2 = std::sin(2 * xi);
+    const double c2 = std::cos(2 * xi);
+    const double ex = std::exp(2 * eta);
+    const double sh2 = (ex - 1 / ex) / 2;
+    const double ch2 = (ex + 1 / ex) / 2;
+
+    double s = s2, c = c2, sh = sh2, ch = ch2;
+    double xip = xi, etap = eta;
+    for (int j = 0; j < 6; ++j) {
+        xip -= BETA[j] * s * ch;
+        etap -= BETA[j] * c * sh;
+        const double sn = s * c2 + c * s2;
+        const double cn = c * c2 - s * s2;
+        const double shn = sh * ch2 + ch * sh2;
+        const double chn = ch * ch2 + sh * sh2;
+        s = sn; c = cn; sh = shn; ch = chn;
+    }
+
+    const double sxip = std::sin(xip);
+    const double cxip = std::cos(xip);
+    const double shetap = std::sinh(etap);
+    const double taup = sxip / std::sqrt(shetap * shetap + cxip * cxip);
+
+    // Newton iterations for tau = tan(phi) from the conformal tau' (Karney 2011, eqs. 19-21)
+    double tau = taup / (1 - WGS84_E2);
+    for (int i = 0; i < 5; ++i) {
+        const double tau1 = std::sqrt(1 + tau * tau);
+        const double sigma = std::sinh(ECC * std::atanh(ECC * tau / tau1));
+        const double taupa = std::sqrt(1 + sigma * sigma) * tau - sigma * tau1;
+        const double dtau = (taup - taupa) / std::sqrt(1 + taupa * taupa)
+            * (1 + (1 - WGS84_E2) * tau * tau) / ((1 - WGS84_E2) * tau1);
+        tau += dtau;
+        if (!(std::abs(dtau) >= 1e-14 * std::max(1.0, std::abs(tau))))
+            break;
+    }
+
+    phi = std::atan(tau);
+    lam = std::atan2(shetap, cxip);
+}
+
+} // namespace
+
+int utmZone(double lonDeg)
+{
+    int zone = static_cast<int>(std::floor((lonDeg + 180.0) / 6.0)) + 1;
+    if (zone < 1) zone = 1;
+    if (zone > 60) zone = 60;
+    return zone;
+}
+
+double utmCentralMeridian(int zone)
+{
+    return zoneTable.lon0[(zone >= 1 && zone <= 60) ? zone : 0];
+}
+
+void latLonToUtm(double latDeg, double lonDeg, double& easting, double& northing, int& zone)
+{
+    latLonToUtm(&latDeg, &lonDeg, 1, &easting, &northing, &zone);
+}
+
+void latLonToUtm(const double* latDeg, const double* lonDeg, std::size_t count,
+                 double* easting, double* northing, int* zone)
+{
+    for (std::size_t i = 0; i < count; ++i) {
+        const int z = utmZone(lonDeg[i]);
+        double x, y;
+        transverseMercator(latDeg[i] * DEG_TO_RAD, lonDeg[i] * DEG_TO_RAD - zoneTable.lon0[z], x, y);
+        easting[i] = x + UTM_FALSE_EASTING;
+        northing[i] = y + (latDeg[i] < 0 ? UTM_FALSE_NORTHING_SOUTH : 0.0);
+        zone[i] = z;
+    }
+}
+
+void latLonToUtmZone(const double* latDeg, const double* lonDeg, std::size_t count, int zone,
+                     double* easting, double* northing)
+{
+    const double lon0 = utmCentralMeridian(zone);
+    for (std::size_t i = 0; i < count; ++i) {
+        double x, y;
+        transverseMercator(latDeg[i] * DEG_TO_RAD, lonDeg[i] * DEG_TO_RAD - lon0, x, y);
+        easting[i] = x + UTM_FALSE_EASTING;
+        northing[i] = y + (latDeg[i] < 0 ? UTM_FALSE_NORTHING_SOUTH : 0.0);
+    }
+}
+
+void utmToLatLon(double easting, double northing, int zone, bool north, double& latDeg, double& lonDeg)
+{
+    double phi, lam;
+    inverseTransverseMercator(easting - UTM_FALSE_EASTING,
+                              northing - (north ? 0.0 : UTM_FALSE_NORTHING_SOUTH), phi, lam);
+    latDeg = phi / DEG_TO_RAD;
+    lonDeg = (lam + utmCentralMeridian(zone)) / DEG_TO_RAD;
+    if (lonDeg > 180.0) lonDeg -= 360.0;
+    if (lonDeg < -180.0) lonDeg += 360.0;
+}
+
+void geodeticToEcef(const double* latDeg, const double* lonDeg, const double* height, std::size_t count,
+                    double* x, double* y, double* z)
+{
+    for (std::size_t i = 0; i < count; ++i) {
+        const double phi = latDeg[i] * DEG_TO_RAD;
+        const double lam = lonDeg[i] * DEG_TO_RAD;
+        const double sphi = std::sin(phi);
+        const double cphi = std::cos(phi);
+        const double N = WGS84_A / std::sqrt(1 - WGS84_E2 * sphi * sphi);
+        x[i] = (N + height[i]) * cphi * std::cos(lam);
+        y[i] = (N + height[i]) * cphi * std::sin(lam);
+        z[i] = (N * (1 - WGS84_E2) + height[i]) * sphi;
+    }
+}
+
+EnuFrame::EnuFrame(double baseLatDeg, double baseLonDeg, double baseHeight)
+    : _baseLat(baseLatDeg), _baseLon(baseLonDeg), _baseHeight(baseHeight)
+{
+    geodeticToEcef(&_baseLat, &_baseLon, &_baseHeight, 1, &_x0, &_y0, &_z0);
+    _sinLat = std::sin(baseLatDeg * DEG_TO_RAD);
+    _cosLat = std::cos(baseLatDeg * DEG_TO_RAD);
+    _sinLon = std::sin(baseLonDeg * DEG_TO_RAD);
+    _cosLon = std::cos(baseLonDeg * DEG_TO_RAD);
+}
+
+void EnuFrame::toEnu(double latDeg, double lonDeg, double height, double& east, double& north, double& up) const
+{
+    toEnu(&latDeg, &lonDeg, &height, 1, &east, &north, &up);
+}
+
+void EnuFrame::toEnu(const double* latDeg, const double* lonDeg, const double* height, std::size_t count,
+                     double* east, double* north, double* up) const
+{
+    for (std::size_t i = 0; i < count; ++i) {
+        const double phi = latDeg[i] * DEG_TO_RAD;
+        const double lam = lonDeg[i] * DEG_TO_RAD;
+        const double sphi = std::sin(phi);
+        const double cphi = std::cos(phi);
+        const double N = WGS84_A / std::sqrt(1 - WGS84_E2 * sphi * sphi);
+        const double dx = (N + height[i]) * cphi * std::cos(lam) - _x0;
+        const double dy = (N + height[i]) * cphi * std::sin(lam) - _y0;
+        const double dz = (N * (1 - WGS84_E2) + height[i]) * sphi - _z0;
+        east[i] = -_sinLon * dx + _cosLon * dy;
+        north[i] = -_sinLat * _cosLon * dx - _sinLat * _sinLon * dy + _cosLat * dz;
+        up[i] = _cosLat * _cosLon * dx + _cosLat * _sinLon * dy + _sinLat * dz;
+    }
+}
+
+void EnuFrame::toGeodetic(double east, double north, double up, double& latDeg, double& lonDeg, double& height) const
+{
+    const double x = _x0 - _sinLon * east - _sinLat * _cosLon * north + _cosLat * _cosLon * up;
+    const double y = _y0 + _cosLon * east - _sinLat * _sinLon * north + _cosLat * _sinLon * up;
+    const double z = _z0 + _cosLat * north + _sinLat * up;
+
+    // Fixed point iteration on the latitude, starting from the base latitude. Each step divides the
+    // error by about 1/e2 (150), so a point 1 degree away needs 5 steps to reach 1e-12 rad.
+    const double p = std::sqrt(x * x + y * y);
+    double phi = _baseLat * DEG_TO_RAD;
+    double N = WGS84_A;
+    for (int i = 0; i < 10; ++i) {
+        const double sphi = std::sin(phi);
+        N = WGS84_A / std::sqrt(1 - WGS84_E2 * sphi * sphi);
+        const double next = std::atan2(z + WGS84_E2 * N * sphi, p);
+        const bool converged = std::abs(next - phi) < 1e-12;
+        phi = next;
+        if (converged)
+            break;
+    }
+    const double sphi = std::sin(phi);
+    const double cphi = std::cos(phi);
+    N = WGS84_A / std::sqrt(1 - WGS84_E2 * sphi * sphi);
+    height = std::abs(cphi) > 1e-3 ? p / cphi - N : z / sphi - N * (1 - WGS84_E2);
+    latDeg = phi / DEG_TO_RAD;
+    lonDeg = std::atan2(y, x) / DEG_TO_RAD;
+}
+
+} // namespace Geodesy
@@ -0,0 +1,99 @@
+#ifndef GEODESY_H
+#define GEODESY_H
+
+#include <cstddef>
+
+/**
+ * Batch geodetic conversions on the WGS84 ellipsoid.
+ *
+ * All batch functions take structure-of-arrays inputs (one array per
+ * coordinate, angles in decimal degrees) and write into caller-provided
+ * output arrays of the same length. The kernels are branch-light loops
+ * over plain arrays so the compiler can vectorize them.
+ *
+ * The UTM projection uses the 6th order Krüger series as given by
+ * Karney (2011), "Transverse Mercator with an accuracy of a few nanometers",
+ * which is accurate to a few nanometers inside a UTM zone.
+ */
+namespace Geodesy {
+
+// WGS84 ellipsoid
+constexpr double WGS84_A = 6378137.0;               // Semi-major axis
+constexpr double WGS84_F = 1.0 / 298.257223563;     // Flattening
+constexpr double WGS84_E2 = WGS84_F * (2 - WGS84_F); // First eccentricity squared
+
+// UTM parameters
+constexpr double UTM_K0 = 0.9996;
+constexpr double UTM_FALSE_EASTING = 500000.0;
+constexpr double UTM_FALSE_NORTHING_SOUTH = 10000000.0;
+
+/**
+ * @brief Returns the standard UTM zone (1..60) for a longitude in degrees.
+ */
+int utmZone(double lonDeg);
+
+/**
+ * @brief Returns the central meridian of a UTM zone, in radians.
+ * The values are precomputed for the 60 zones.
+ */
+double utmCentralMeridian(int zone);
+
+/**
+ * @brief Converts one position to UTM in its own zone.
+ * Southern hemisphere northings include the 10,000 km false northing.
+ */
+void latLonToUtm(double latDeg, double lonDeg, double& easting, double& northing, int& zone);
+
+/**
+ * @brief Converts a trajectory to UTM, each point in its own zone.
+ */
+void latLonToUtm(const double* latDeg, const double* lonDeg, std::size_t count,
+                 double* easting, double* northing, int* zone);
+
+/**
+ * @brief Converts a trajectory to UTM in a fixed zone.
+ * Use this to keep a track continuous when it crosses a zone boundary.
+ */
+void latLonToUtmZone(const double* latDeg, const double* lonDeg, std::size_t count, int zone,
+                     double* easting, double* northing);
+
+/**
+ * @brief Converts UTM coordinates of a zone back to latitude and longitude, in degrees.
+ * North is false for southern hemisphere northings (with the 10,000 km false northing).
+ */
+void utmToLatLon(double easting, double northing, int zone, bool north, double& latDeg, double& lonDeg);
+
+/**
+ * @brief Converts geodetic coordinates (height above the ellipsoid, in meters) to ECEF.
+ */
+void geodeticToEcef(const double* latDeg, const double* lonDeg, const double* height, std::size_t count,
+                    double* x, double* y, double* z);
+
+/**
+ * @brief Local East-North-Up frame tangent to the ellipsoid at a base position.
+ * The base ECEF position and the rotation are computed once at construction.
+ */
+class EnuFrame {
+public:
+    EnuFrame(double baseLatDeg, double baseLonDeg, double baseHeight);
+
+    double baseLatitude() const { return _baseLat; }
+    double baseLongitude() const { return _baseLon; }
+    double baseHeight() const { return _baseHeight; }
+
+    void toEnu(double latDeg, double lonDeg, double height, double& east, double& north, double& up) const;
+    void toEnu(const double* latDeg, const double* lonDeg, const double* height, std::size_t count,
+               double* east, double* north, double* up) const;
+
+    // Inverse of toEnu, accurate to well below a millimeter
+    void toGeodetic(double east, double north, double up, double& latDeg, double& lonDeg, double& height) const;
+
+private:
+    double _baseLat, _baseLon, _baseHeight;
+    double _x0, _y0, _z0;
+    double _sinLat, _cosLat, _sinLon, _cosLon;
+};
+
+} // namespace Geodesy
+
+#endif // GEODESY_H
@@ -5,6 +5,7 @@
 #include <QVector>
 #include <QDebug>
 #include <cmath>
+#include "nmeaparser.h"
 
 struct UtmCoords {
     double easting;
@@ -13,30 +14,44 @@ struct UtmCoords {
     char hemisphere; // 'N' for Northern, 'S' for Southern
 };
 
+// Qt adapter of the rtkcore NMEA parser (nmeaparser.h)
 class GpsData {
 public:
     GpsData();
 
     // --- Public API for NMEA parsing ---
-    void parse_NMEA(const QString& sentence);
+    // Returns false if the sentence is rejected (bad checksum)
+    bool parse_NMEA(const QString& sentence);
+    bool parse_NMEA(const char* sentence, size_t length);
+    // UTC time of day in seconds of a sentence, -1 if it has none (see NmeaParser::timeOfDay)
+    static double timeOfDay(const QString& sentence);
 
     // --- Getters for GPS data ---
-    int year() const;
-    int month() const;
-    int day() const;
-    int hours() const;
-    int minutes() const;
-    double seconds() const;
-    double latitude() const;
-    double longitude() const;
-    double altitude() const;
+    int year() const { return _parser.fix().year; }
+    int month() const { return _parser.fix().month; }
+    int day() const { return _parser.fix().day; }
+    int hours() const { return _parser.fix().hours; }
+    int minutes() const { return _parser.fix().minutes; }
+    double seconds() const { return _parser.fix().seconds; }
+    double latitude() const { return _parser.fix().latitude; }
+    double longitude() const { return _parser.fix().longitude; }
+    double altitude() const { return _parser.fix().altitude; }
     QString fixQuality() const;
+    int fixQualityCode() const { return _parser.fix().fixQuality; }
     QString fixMode() const;
-    bool hasFix() const;
-    double speedKnots() const;
-    double speedMs() const;
-    double headingDegrees() const;
-    double hdop() const;
+    int fixModeCode() const { return _parser.fix().fixMode; }
+    bool hasFix() const { return _parser.fix().hasFix(); }
+    double speedKnots() const { return _parser.fix().speedKnots; }
+    double speedMs() const { return _parser.fix().speedMs; }
+    double headingDegrees() const { return _parser.fix().headingDegrees; }
+    bool hasVelocity() const { return _parser.fix().hasVelocity(); }
+    double hdop() const { return _parser.fix().hdop; }
+    int satellites() const { return _parser.fix().satellites; }
+    double stdLatitude() const { return _parser.fix().stdLatitude; }
+    double stdLongitude() const { return _parser.fix().stdLongitude; }
+    double stdAltitude() const { return _parser.fix().stdAltitude; }
+    qint64 utcMsecs() const { return _parser.fix().utcMsecs(); }
+    const NmeaFix& fix() const { return _parser.fix(); }
 
     // --- UTM Conversion ---
     UtmCoords convertToUtm() const;
@@ -45,29 +60,10 @@ public:
     void print() const;
 
 private:
-    // --- Data members (from GpsData struct) ---
-    int _year, _month, _day;
-    int _hours, _minutes;
-    double _seconds;
-    double _latitude;
-    double _longitude;
-    double _altitude;
-    int _fix_quality;
-    int _fix_mode;
-    double _speed_knots;
-    double _speed_ms;
-    double _heading_degrees;
-    double _hdop;
+    NmeaParser _parser;
 
     static const QStringList fixmodelist;
     static const QStringList fixquallist;
-
-    // --- Private parsing methods (from NMEA namespace) ---
-    bool validate_checksum(const QString& sentence);
-    double parse_lat_lon(const QString& value, const QString& direction);
-    void parse_gga(const QStringList& fields);
-    void parse_rmc(const QStringList& fields);
-    void parse_gsa(const QStringList& fields);
 };
 
 #endif // GPSDATAPARSER_H
@@ -0,0 +1,318 @@
+#include "logger.h"
+#include <QDateTime>
+#include <QMutex>
+#include <QThread>
+#include <QTimeZone>
+#include <QWaitCondition>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace Log {
+
+std::atomic<int> currentLevel{Debug};
+
+static const int MAX_FIELDS = 6;
+static const int QUEUE_SIZE = 4096;     // Messages queued before new ones are dropped
+static const int FLUSH_INTERVAL_MS = 1000;
+
+struct Record {
+    qint64 timeMs;
+    Level level;
+    const char* category;
+    QString message;
+    int fieldCount;
+    const char* keys[MAX_FIELDS];
+    QVariant values[MAX_FIELDS];
+    quint64 suppressed;
+};
+
+static QMutex mutex;
+static QWaitCondition wakeUp;
+static std::vector<Record> queue;
+static std::vector<Summary*> summaries;
+static quint64 dropped = 0;
+static bool running = false;
+static QThread* thread = nullptr;
+static std::atomic<int> currentMode{static_cast<int>(Mode::Text)};
+
+static quint64 nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static const char* levelName(Level level)
+{
+    switch (level) {
+    case Debug: return "DEBUG";
+    case Info: return "INFO";
+    case Warning: return "WARNING";
+    default: return "ERROR";
+    }
+}
+
+// Syslog priorities understood by journald as a line prefix
+static int syslogPriority(Level level)
+{
+    switch (level) {
+    case Debug: return 7;
+    case Info: return 6;
+    case Warning: return 4;
+    default: return 3;
+    }
+}
+
+static void appendValue(QByteArray& line, const QVariant& value)
+{
+    QByteArray text = value.toString().toUtf8();
+    bool quote = text.isEmpty() || text.contains(' ') || text.contains('"') || text.contains('=');
+    if (!quote) {
+        line.append(text);
+        return;
+    }
+    line.append('"');
+    for (char c : text) {
+        if (c == '"' || c == '\\') line.append('\\');
+        line.append(c);
+    }
+    line.append('"');
+}
+
+static void format(QByteArray& line, const Record& record, Mode mode)
+{
+    if (mode == Mode::Journald) {
+        line.append('<').append(QByteArray::number(syslogPriority(record.level))).append('>');
+    } else {
+        line.append(QDateTime::fromMSecsSinceEpoch(record.timeMs, QTimeZone::utc()).toString(Qt::ISODateWithMs).toLatin1());
+        line.append(' ').append(levelName(record.level)).append(' ');
+    }
+    line.append(record.category).append(": ").append(record.message.toUtf8());
+    for (int i = 0; i < record.fieldCount; ++i) {
+        line.append(' ').append(record.keys[i]).append('=');
+        appendValue(line, record.values[i]);
+    }
+    if (record.suppressed > 0) {
+        line.append(" (").append(QByteArray::number(record.suppressed)).append(" similar messages suppressed)");
+    }
+    line.append('\n');
+}
+
+static void enqueue(Record&& record)
+{
+    QMutexLocker locker(&mutex);
+    if (!running) {
+        // Before start() or after stop(): write directly
+        QByteArray line;
+        format(line, record, static_cast<Mode>(currentMode.load()));
+        fwrite(line.constData(), 1, line.size(), stderr);
+        fflush(stderr);
+        return;
+    }
+    if (queue.size() >= static_cast<size_t>(QUEUE_SIZE)) {
+        ++dropped;
+        return;
+    }
+    queue.push_back(std::move(record));
+    wakeUp.wakeOne();
+}
+
+static void writerLoop()
+{
+    std::vector<Record> records;
+    QByteArray lines;
+    QMutexLocker locker(&mutex);
+    for (;;) {
+        if (queue.empty() && running) {
+            wakeUp.wait(&mutex, FLUSH_INTERVAL_MS);
+        }
+        records.swap(queue);
+        quint64 lost = dropped;
+        dropped = 0;
+        bool stopping = !running;
+        std::vector<Summary*> sites = summaries;
+        locker.unlock();
+
+        // The summaries are written from this thread, once per interval
+        quint64 now = nowNs();
+        for (Summary* summary : sites) {
+            summary->flush(now, stopping);
+        }
+
+        Mode mode = static_cast<Mode>(currentMode.load());
+        lines.resize(0);
+        for (const Record& record : records) {
+            format(lines, record, mode);
+        }
+        if (lost > 0) {
+            Record record{QDateTime::currentMSecsSinceEpoch(), Warning, "log",
+                          QString("%1 log messages dropped").arg(lost), 0, {}, {}, 0};
+            format(lines, record, mode);
+        }
+        if (!lines.isEmpty()) {
+            fwrite(lines.constData(), 1, lines.size(), stderr);
+            fflush(stderr);
+        }
+        records.clear();
+
+        locker.relock();
+        if (stopping && queue.empty()) break;
+    }
+}
+
+// Writes the queued messages from the calling thread. A fatal message of the writer thread cannot
+// wait for it in stop(): the messages are written here before the abort.
+static void writeQueued()
+{
+    std::vector<Record> records;
+    {
+        QMutexLocker locker(&mutex);
+        records.swap(queue);
+        running = false;
+    }
+    Mode mode = static_cast<Mode>(currentMode.load());
+    QByteArray lines;
+    for (const Record& record : records) {
+        format(lines, record, mode);
+    }
+    fwrite(lines.constData(), 1, lines.size(), stderr);
+    fflush(stderr);
+}
+
+static void messageHandler(QtMsgType type, const QMessageLogContext& context, const QString& message)
+{
+    Level level = Debug;
+    switch (type) {
+    case QtDebugMsg: level = Debug; break;
+    case QtInfoMsg: level = Info; break;
+    case QtWarningMsg: level = Warning; break;
+    default: level = Error; break;
+    }
+    if (type == QtFatalMsg) {
+        if (thread && QThread::currentThread() == thread) {
+            writeQueued();
+        } else {
+            stop();
+        }
+        fprintf(stderr, "%s\n", qPrintable(message));
+        abort();
+    }
+    if (!enabled(level)) return;
+    // qDebug() uses the "default" category
+    const char* category = context.category && strcmp(context.category, "default") != 0 ? context.category : "main";
+    write(level, category, message);
+}
+
+void start()
+{
+    QMutexLocker locker(&mutex);
+    if (running) return;
+    running = true;
+    queue.reserve(QUEUE_SIZE);
+    thread = QThread::create(writerLoop);
+    thread->start();
+    qInstallMessageHandler(messageHandler);
+}
+
+void stop()
+{
+    {
+        QMutexLocker locker(&mutex);
+        if (!running) return;
+        running = false;
+        wakeUp.wakeOne();
+    }
+    qInstallMessageHandler(nullptr);
+    thread->wait();
+    delete thread;
+    thread = nullptr;
+}
+
+void configure(Level level, Mode mode)
+{
+    currentLevel.store(level);
+    currentMode.store(static_cast<int>(mode));
+}
+
+Level levelFromString(const QString& name)
+{
+    QString n = name.trimmed().toLower();
+    if (n == "debug") return Debug;
+    if (n == "warning") return Warning;
+    if (n == "error") return Error;
+    return Info;
+}
+
+Mode modeFromString(const QString& name)
+{
+    return name.trimmed().toLower() == "journald" ? Mode::Journald : Mode::Text;
+}
+
+void write(Level level, const char* category, const QString& message,
+           std::initializer_list<Field> fields, quint64 suppressed)
+{
+    Record record;
+    record.timeMs = QDateTime::currentMSecsSinceEpoch();
+    record.level = level;
+    record.category = category;
+    record.message = message;
+    record.fieldCount = 0;
+    for (const Field& field : fields) {
+        if (record.fieldCount == MAX_FIELDS) break;
+        record.keys[record.fieldCount] = field.key;
+        record.values[record.fieldCount] = field.value;
+        ++record.fieldCount;
+    }
+    record.suppressed = suppressed;
+    enqueue(std::move(record));
+}
+
+// --- Rate limiting ---
+
+CallSite::CallSite(int intervalMs)
+    : _intervalNs(static_cast<quint64>(intervalMs) * 1000000),
+      _nextNs(0),
+      _suppressed(0)
+{
+}
+
+bool CallSite::acquire(quint64& suppressed)
+{
+    quint64 now = nowNs();
+    quint64 next = _nextNs.load(std::memory_order_relaxed);
+    if (now < next || !_nextNs.compare_exchange_strong(next, now + _intervalNs, std::memory_order_relaxed)) {
+        _suppressed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    suppressed = _suppressed.exchange(0, std::memory_order_relaxed);
+    return true;
+}
+
+Summary::Summary(Level level, const char* category, const char* message, int intervalMs)
+    : _level(level),
+      _category(category),
+      _message(message),
+      _intervalNs(static_cast<quint64>(intervalMs) * 1000000),
+      _lastFlushNs(nowNs()),
+      _count(0)
+{
+    QMutexLocker locker(&mutex);
+    summaries.push_back(this);
+}
+
+void Summary::flush(quint64 nowNs, bool force)
+{
+    if (!force && nowNs - _lastFlushNs < _intervalNs) return;
+    quint64 count = _count.exchange(0, std::memory_order_relaxed);
+    quint64 elapsedNs = nowNs - _lastFlushNs;
+    _lastFlushNs = nowNs;
+    if (count == 0) return;
+    Record record{QDateTime::currentMSecsSinceEpoch(), _level, _category,
+                  QString("%1 %2 in the last %3 s").arg(count).arg(QLatin1String(_message)).arg(qRound(elapsedNs / 1e9)),
+                  1, {"count"}, {QVariant(count)}, 0};
+    enqueue(std::move(record));
+}
+
+} // namespace Log
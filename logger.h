@@ -0,0 +1,131 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <QString>
+#include <QVariant>
+#include <atomic>
+#include <initializer_list>
+
+/**
+ * Asynchronous structured logger.
+ *
+ * A log call only checks the level and queues the message with its fields;
+ * timestamps, formatting and writing are done by a background thread. The
+ * qDebug/qWarning messages are routed through it as well.
+ *
+ *     RTK_LOG_INFO("ntrip", "Connected", {"host", host}, {"port", port});
+ *
+ * Messages below RTKROVER_MIN_LOG_LEVEL are removed at compile time, the
+ * others are filtered at run time by the [log] level. RTK_LOG_RATE limits a
+ * call site to one message per interval and RTK_LOG_SUMMARY turns a frequent
+ * event into one message per interval with its count
+ * ("12 CRC failures in the last 10 s").
+ *
+ * Output modes: "text" (timestamped lines on stderr) and "journald"
+ * (syslog priority prefix, no timestamp, for systemd services).
+ */
+
+#ifndef RTKROVER_MIN_LOG_LEVEL
+#define RTKROVER_MIN_LOG_LEVEL 0
+#endif
+
+namespace Log {
+
+enum Level {
+    Debug = 0,
+    Info = 1,
+    Warning = 2,
+    Error = 3
+};
+
+enum class Mode {
+    Text,
+    Journald
+};
+
+struct Field {
+    Field(const char* key, const QVariant& value) : key(key), value(value) {}
+    const char* key;
+    QVariant value;
+};
+
+// Starts the writer thread and installs the Qt message handler
+void start();
+// Writes the queued messages and stops the writer thread
+void stop();
+
+void configure(Level level, Mode mode);
+Level levelFromString(const QString& name);
+Mode modeFromString(const QString& name);
+
+extern std::atomic<int> currentLevel;
+inline bool enabled(Level level) { return level >= currentLevel.load(std::memory_order_relaxed); }
+
+// Category must be a string literal
+void write(Level level, const char* category, const QString& message,
+           std::initializer_list<Field> fields = {}, quint64 suppressed = 0);
+
+// Rate limit of one call site
+class CallSite
+{
+public:
+    explicit CallSite(int intervalMs);
+    // True if a message can be written now, suppressed is set to the number of messages skipped before
+    bool acquire(quint64& suppressed);
+
+private:
+    const quint64 _intervalNs;
+    std::atomic<quint64> _nextNs;
+    std::atomic<quint64> _suppressed;
+};
+
+// Event counter written once per interval by the writer thread
+class Summary
+{
+public:
+    Summary(Level level, const char* category, const char* message, int intervalMs);
+    void add(quint64 count = 1) { _count.fetch_add(count, std::memory_order_relaxed); }
+    // Called by the writer thread
+    void flush(quint64 nowNs, bool force);
+
+private:
+    const Level _level;
+    const char* _category;
+    const char* _message;
+    const quint64 _intervalNs;
+    quint64 _lastFlushNs;
+    std::atomic<quint64> _count;
+};
+
+} // namespace Log
+
+#define RTK_LOG(level, category, message, ...)                                       \
+    do {                                                                             \
+        if ((level) >= RTKROVER_MIN_LOG_LEVEL && Log::enabled(level))                \
+            Log::write(level, category, message, {__VA_ARGS__});                     \
+    } while (0)
+
+#define RTK_LOG_DEBUG(category, message, ...) RTK_LOG(Log::Debug, category, message, __VA_ARGS__)
+#define RTK_LOG_INFO(category, message, ...) RTK_LOG(Log::Info, category, message, __VA_ARGS__)
+#define RTK_LOG_WARNING(category, message, ...) RTK_LOG(Log::Warning, category, message, __VA_ARGS__)
+#define RTK_LOG_ERROR(category, message, ...) RTK_LOG(Log::Error, category, message, __VA_ARGS__)
+
+#define RTK_LOG_RATE(level, intervalMs, category, message, ...)                      \
+    do {                                                                             \
+        if ((level) >= RTKROVER_MIN_LOG_LEVEL && Log::enabled(level)) {              \
+            static Log::CallSite _logSite(intervalMs);                               \
+            quint64 _logSuppressed;                                                  \
+            if (_logSite.acquire(_logSuppressed))                                    \
+                Log::write(level, category, message, {__VA_ARGS__}, _logSuppressed); \
+        }                                                                            \
+    } while (0)
+
+#define RTK_LOG_SUMMARY(level, intervalMs, category, message, count)                 \
+    do {                                                                             \
+        if ((level) >= RTKROVER_MIN_LOG_LEVEL && Log::enabled(level)) {              \
+            static Log::Summary _logSummary(level, category, message, intervalMs);   \
+            _logSummary.add(count);                                                  \
+        }                                                                            \
+    } while (0)
+
+#endif // LOGGER_H
@@ -2,6 +2,12 @@
 #include <QCommandLineParser>
 #include <QDebug>
 #include "crtkrover.h"
+#include "trace.h"
+#include "logger.h"
+#ifdef RTKROVER_HAVE_SIGNALS
+#include "unixsignal.h"
+#include <csignal>
+#endif
 
 int main(int argc, char *argv[])
 {
@@ -15,8 +21,35 @@ int main(int argc, char *argv[])
     parser.addVersionOption();
     QCommandLineOption configFileOption("c", "Configuration file.", "file", "config.ini");
     parser.addOption(configFileOption);
+#ifdef RTKROVER_TRACE
+    QCommandLineOption traceFileOption("trace", "Trace file, written on SIGUSR1 and on exit.", "file", "rtkrover-trace.json");
+    parser.addOption(traceFileOption);
+#endif
     parser.process(a);
 
+    // Log messages are written by a background thread from now on
+    Log::start();
+
+#ifdef RTKROVER_HAVE_SIGNALS
+    // Quit cleanly on SIGINT/SIGTERM, so that the outputs are flushed
+    UnixSignalNotifier* signalNotifier = UnixSignalNotifier::instance();
+    signalNotifier->watch(SIGINT);
+    signalNotifier->watch(SIGTERM);
+    QObject::connect(signalNotifier, &UnixSignalNotifier::activated, &a, [](int signal) {
+        if (signal == SIGINT || signal == SIGTERM) QCoreApplication::quit();
+    });
+#endif
+#ifdef RTKROVER_TRACE
+    const QString traceFile = parser.value(traceFileOption);
+    QObject::connect(&a, &QCoreApplication::aboutToQuit, [traceFile]() { Trace::dump(traceFile); });
+#ifdef RTKROVER_HAVE_SIGNALS
+    signalNotifier->watch(SIGUSR1);
+    QObject::connect(signalNotifier, &UnixSignalNotifier::activated, &a, [traceFile](int signal) {
+        if (signal == SIGUSR1) Trace::dump(traceFile);
+    });
+#endif
+#endif
+
     QString configFile = parser.value(configFileOption);
     qDebug() << "Using configuration file:" << configFile;
 
@@ -27,5 +60,7 @@ int main(int argc, char *argv[])
     // For now, we can just run the event loop. A signal from CRTKRover could stop it.
     // QObject::connect(&rover, &CRTKRover::finished, &a, &QCoreApplication::quit);
 
-    return a.exec();
+    int result = a.exec();
+    Log::stop();
+    return result;
 }
@@ -0,0 +1,133 @@
+#include "metrics.h"
+#include "fixrecord.h"
+
+namespace Metrics {
+
+Registry& registry()
+{
+    static Registry instance;
+    return instance;
+}
+
+static void appendHeader(QByteArray& out, const char* name, const char* type, const char* help)
+{
+    out.append("# HELP ").append(name).append(' ').append(help).append('\n');
+    out.append("# TYPE ").append(name).append(' ').append(type).append('\n');
+}
+
+static void appendValue(QByteArray& out, const char* name, qint64 value)
+{
+    out.append(name).append(' ').append(QByteArray::number(value)).append('\n');
+}
+
+static void appendCounter(QByteArray& out, const char* name, const char* help, const Counter& counter)
+{
+    appendHeader(out, name, "counter", help);
+    appendValue(out, name, static_cast<qint64>(counter.value()));
+}
+
+static void appendGauge(QByteArray& out, const char* name, const char* help, qint64 value)
+{
+    appendHeader(out, name, "gauge", help);
+    appendValue(out, name, value);
+}
+
+// One sample per RTCM message type seen so far
+static void appendPerType(QByteArray& out, const char* name, const char* help, const Counter* counters)
+{
+    appendHeader(out, name, "counter", help);
+    for (int type = 0; type < RTCM_TYPES; ++type) {
+        quint64 value = counters[type].value();
+        if (value == 0) continue;
+        out.append(name).append("{type=\"").append(QByteArray::number(type)).append("\"} ")
+           .append(QByteArray::number(value)).append('\n');
+    }
+}
+
+QByteArray exposition()
+{
+    const Registry& r = registry();
+    QByteArray out;
+    out.reserve(4096);
+
+    appendPerType(out, "rtkrover_rtcm_frames_total", "RTCM frames received with a valid CRC.", r.rtcmFrames);
+    appendPerType(out, "rtkrover_rtcm_bytes_total", "Bytes of the valid RTCM frames.", r.rtcmBytes);
+    appendCounter(out, "rtkrover_rtcm_crc_failures_total", "RTCM frames discarded because of a bad CRC.", r.rtcmCrcFailures);
+    appendCounter(out, "rtkrover_rtcm_resync_bytes_total", "Bytes skipped while searching for an RTCM frame.", r.rtcmResyncBytes);
+    appendCounter(out, "rtkrover_ntrip_connections_total", "Connections to the NTRIP caster.", r.ntripConnections);
+    appendCounter(out, "rtkrover_rtcm_static_replays_total", "Replays of the cached static RTCM messages to the receiver.", r.rtcmStaticReplays);
+    appendCounter(out, "rtkrover_ntrip_compressed_bytes_total", "Bytes of the compressed stream received from a relay.", r.ntripCompressedBytes);
+    appendCounter(out, "rtkrover_ntrip_tls_ticket_offers_total", "TLS connections offering the session ticket of the previous one.", r.ntripTlsTicketOffers);
+    appendCounter(out, "rtkrover_ntrip_tls_resumed_sessions_total", "TLS sessions resumed by the caster.", r.ntripTlsResumptions);
+    appendCounter(out, "rtkrover_ntrip_reused_connections_total", "Streams requested on the connection of the sourcetable.", r.ntripReusedConnections);
+    appendCounter(out, "rtkrover_ntrip_reuse_fallbacks_total", "Reused connections closed before the stream, requested again on a new connection.", r.ntripReuseFallbacks);
+    appendHeader(out, "rtkrover_ntrip_connect_seconds", "gauge", "TCP connection and TLS handshake of the last stream (0 if reused).");
+    out.append("rtkrover_ntrip_connect_seconds ").append(QByteArray::number(r.ntripConnectUs.value() / 1e6, 'f', 6)).append('\n');
+    appendHeader(out, "rtkrover_ntrip_first_frame_seconds", "gauge", "Time from the last stream start to its first valid RTCM frame.");
+    out.append("rtkrover_ntrip_first_frame_seconds ").append(QByteArray::number(r.ntripFirstFrameUs.value() / 1e6, 'f', 6)).append('\n');
+
+    appendCounter(out, "rtkrover_rtcm_epochs_total", "Observation epochs of the correction stream.", r.rtcmEpochs);
+    appendCounter(out, "rtkrover_rtcm_incomplete_epochs_total", "Epochs missing an expected observation message.", r.rtcmIncompleteEpochs);
+    appendCounter(out, "rtkrover_rtcm_missing_epochs_total", "Epochs missing from the correction stream.", r.rtcmMissingEpochs);
+    appendCounter(out, "rtkrover_rtcm_duplicate_epochs_total", "Observation messages received twice.", r.rtcmDuplicateEpochs);
+    appendHeader(out, "rtkrover_rtcm_jitter_seconds", "gauge", "Mean deviation of the receive interval from the epoch interval, last minute.");
+    out.append("rtkrover_rtcm_jitter_seconds ").append(QByteArray::number(r.rtcmJitterUs.value() / 1e6, 'f', 6)).append('\n');
+    appendGauge(out, "rtkrover_rtcm_bitrate", "Bitrate of the correction stream over the last minute (bit/s).", r.rtcmBitrate.value());
+    appendGauge(out, "rtkrover_rtcm_advertised_bitrate", "Bitrate of the mount point in the sourcetable (bit/s), 0 if unknown.",
+                r.rtcmAdvertisedBitrate.value());
+    appendHeader(out, "rtkrover_rtcm_static_age_seconds", "gauge", "Time since the last static RTCM message of each type.");
+    for (int i = 0; i < RtcmStreamMonitor::STATIC_TYPES; ++i) {
+        qint64 age = r.rtcmStaticAgeMs[i].value();
+        if (age < 0) continue;
+        out.append("rtkrover_rtcm_static_age_seconds{type=\"").append(QByteArray::number(RtcmStreamMonitor::STATIC_TYPE_LIST[i]))
+           .append("\"} ").append(QByteArray::number(age / 1e3, 'f', 3)).append('\n');
+    }
+    appendHeader(out, "rtkrover_rtcm_alert", "gauge", "Conditions of the correction stream beyond their threshold.");
+    for (int condition = 0; condition < RtcmStreamMonitor::CONDITION_COUNT; ++condition) {
+        out.append("rtkrover_rtcm_alert{condition=\"")
+           .append(RtcmStreamMonitor::conditionName(static_cast<RtcmStreamMonitor::Condition>(condition)))
+           .append("\"} ").append(QByteArray::number(r.rtcmAlerts[condition].value())).append('\n');
+    }
+
+    qint64 last = r.lastRtcmNs.value();
+    appendHeader(out, "rtkrover_correction_age_seconds", "gauge", "Time since the last valid RTCM frame.");
+    out.append("rtkrover_correction_age_seconds ");
+    if (last > 0) {
+        out.append(QByteArray::number((monotonicNsecs() - static_cast<quint64>(last)) / 1e9, 'f', 3));
+    } else {
+        out.append("NaN");
+    }
+    out.append('\n');
+
+    appendCounter(out, "rtkrover_serial_bytes_in_total", "Bytes read from the receiver.", r.serialBytesIn);
+    appendCounter(out, "rtkrover_serial_bytes_out_total", "Bytes written to the receiver.", r.serialBytesOut);
+    appendCounter(out, "rtkrover_nmea_sentences_total", "NMEA sentences parsed.", r.nmeaParsed);
+    appendCounter(out, "rtkrover_nmea_rejected_total", "NMEA sentences rejected (bad checksum).", r.nmeaRejected);
+    appendGauge(out, "rtkrover_fix_quality", "GGA fix quality of the last epoch.", r.fixQuality.value());
+
+    qint64 timeToFix = r.timeToRtkFixMs.value();
+    appendHeader(out, "rtkrover_time_to_rtk_fix_seconds", "gauge", "Time from the start to the first RTK fixed epoch.");
+    out.append("rtkrover_time_to_rtk_fix_seconds ");
+    out.append(timeToFix > 0 ? QByteArray::number(timeToFix / 1e3, 'f', 3) : QByteArray("NaN"));
+    out.append('\n');
+
+    qint64 relinkTimeToFix = r.relinkTimeToRtkFixMs.value();
+    appendHeader(out, "rtkrover_relink_time_to_rtk_fix_seconds", "gauge",
+                 "Time from the last receiver relink or mount point switch to the next RTK fixed epoch.");
+    out.append("rtkrover_relink_time_to_rtk_fix_seconds ");
+    out.append(relinkTimeToFix > 0 ? QByteArray::number(relinkTimeToFix / 1e3, 'f', 3) : QByteArray("NaN"));
+    out.append('\n');
+
+    appendGauge(out, "rtkrover_output_clients", "Clients connected to the socket outputs.", r.outputClients.value());
+    appendCounter(out, "rtkrover_output_dropped_records_total", "Records dropped by slow clients or a full file buffer.", r.droppedRecords);
+
+    appendGauge(out, "rtkrover_relay_clients", "Rovers connected to the relay.", r.relayClients.value());
+    appendCounter(out, "rtkrover_relay_rtcm_bytes_total", "Bytes of the RTCM frames relayed.", r.relayRtcmBytes);
+    appendCounter(out, "rtkrover_relay_sent_bytes_total", "Bytes sent to the relay clients.", r.relaySentBytes);
+    appendCounter(out, "rtkrover_relay_blocks_total", "Compressed blocks sent by the relay.", r.relayBlocks);
+    appendCounter(out, "rtkrover_relay_hold_nanoseconds_total", "Time the frames of the compressed blocks were held for the end of their epoch.", r.relayHoldNs);
+
+    return out;
+}
+
+} // namespace Metrics
@@ -0,0 +1,98 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QByteArray>
+#include <atomic>
+#include "rtcmmonitor.h"
+
+/**
+ * Process-wide counters and gauges of the rover.
+ *
+ * Updating a metric is a single relaxed atomic operation, so they can be
+ * used on the hot paths (RTCM framing, serial I/O, NMEA parsing) from any
+ * thread. The Prometheus text exposition is only built when the metrics
+ * endpoint is scraped (see MetricsServer).
+ */
+namespace Metrics {
+
+class Counter
+{
+public:
+    void add(quint64 n = 1) { _value.fetch_add(n, std::memory_order_relaxed); }
+    quint64 value() const { return _value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<quint64> _value{0};
+};
+
+class Gauge
+{
+public:
+    void set(qint64 value) { _value.store(value, std::memory_order_relaxed); }
+    void add(qint64 n) { _value.fetch_add(n, std::memory_order_relaxed); }
+    qint64 value() const { return _value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<qint64> _value{0};
+};
+
+// RTCM message numbers are 12 bits
+const int RTCM_TYPES = 4096;
+
+struct Registry {
+    // NTRIP corrections
+    Counter rtcmFrames[RTCM_TYPES];
+    Counter rtcmBytes[RTCM_TYPES];
+    Counter rtcmCrcFailures;
+    Counter rtcmResyncBytes;        // Bytes skipped while searching for a frame
+    Counter ntripConnections;
+    Counter rtcmStaticReplays;      // Cached static messages sent again to the receiver
+    Counter ntripCompressedBytes;   // Bytes of the compressed stream of a relay
+    Counter ntripTlsTicketOffers;   // TLS connections offering the ticket of the previous session
+    Counter ntripTlsResumptions;    // TLS sessions resumed by the caster
+    Counter ntripReusedConnections; // Streams requested on the connection of the sourcetable
+    Counter ntripReuseFallbacks;    // Reused connections closed before the stream, requested again on a new one
+    Gauge ntripConnectUs;           // TCP connection and TLS handshake of the last stream, 0 if reused
+    Gauge ntripFirstFrameUs;        // From the last stream start to its first valid frame
+    Gauge lastRtcmNs;               // Monotonic receive time of the last valid frame, 0 if none
+
+    // Monitoring of the correction stream (see RtcmStreamMonitor)
+    Counter rtcmEpochs;
+    Counter rtcmIncompleteEpochs;   // Missing an expected observation message
+    Counter rtcmMissingEpochs;
+    Counter rtcmDuplicateEpochs;
+    Gauge rtcmJitterUs;             // Over the last minute
+    Gauge rtcmBitrate;              // bit/s over the last minute
+    Gauge rtcmAdvertisedBitrate;    // bit/s of the sourcetable, 0 if unknown
+    Gauge rtcmStaticAgeMs[RtcmStreamMonitor::STATIC_TYPES];    // -1 if never received
+    Gauge rtcmAlerts[RtcmStreamMonitor::CONDITION_COUNT];      // 1 while raised
+
+    // Receiver
+    Counter serialBytesIn;
+    Counter serialBytesOut;
+    Counter nmeaParsed;
+    Counter nmeaRejected;           // Bad checksum
+    Gauge fixQuality;               // GGA fix quality of the last epoch
+    Gauge timeToRtkFixMs;           // Time from the start to the first RTK fixed epoch, 0 until then
+    Gauge relinkTimeToRtkFixMs;     // Time from the last receiver relink or mount point switch to RTK fixed, 0 until then
+
+    // Outputs
+    Gauge outputClients;
+    Counter droppedRecords;
+
+    // Relay of the corrections to other rovers
+    Gauge relayClients;
+    Counter relayRtcmBytes;         // RTCM frames received for the relay
+    Counter relaySentBytes;         // Bytes sent to all the clients
+    Counter relayBlocks;            // Compressed blocks
+    Counter relayHoldNs;            // Time from the first frame of each block to its sending
+};
+
+Registry& registry();
+
+// Prometheus text format (version 0.0.4) of the current values
+QByteArray exposition();
+
+} // namespace Metrics
+
+#endif // METRICS_H
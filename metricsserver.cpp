@@ -0,0 +1,62 @@
+#include "metricsserver.h"
+#include "metrics.h"
+#include <QDebug>
+#include <QTcpSocket>
+
+static const qint64 MAX_REQUEST_SIZE = 8192;
+
+MetricsServer::MetricsServer(QObject *parent)
+    : QObject(parent),
+      _server(new QTcpServer(this))
+{
+    connect(_server, &QTcpServer::newConnection, this, &MetricsServer::onNewConnection);
+}
+
+bool MetricsServer::listen(const QHostAddress& address, int port)
+{
+    if (!_server->listen(address, port)) {
+        qWarning() << "Metrics: failed to listen on" << address.toString() << ":" << port << _server->errorString();
+        return false;
+    }
+    qDebug() << "Metrics: serving http://" + address.toString() + ":" + QString::number(port) + "/metrics";
+    return true;
+}
+
+void MetricsServer::onNewConnection()
+{
+    while (QTcpSocket* socket = _server->nextPendingConnection()) {
+        connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+        connect(socket, &QTcpSocket::readyRead, this, [this, socket]() { handleRequest(socket); });
+    }
+}
+
+void MetricsServer::handleRequest(QTcpSocket* socket)
+{
+    // Wait for the end of the request headers
+    QByteArray request = socket->peek(MAX_REQUEST_SIZE);
+    if (!request.contains("\r\n\r\n")) {
+        if (request.size() >= MAX_REQUEST_SIZE) socket->abort();
+        return;
+    }
+    socket->readAll();
+    disconnect(socket, &QTcpSocket::readyRead, this, nullptr);
+
+    QList<QByteArray> requestLine = request.left(request.indexOf("\r\n")).split(' ');
+    QByteArray status = "200 OK";
+    QByteArray body;
+    if (requestLine.size() < 2 || (requestLine[0] != "GET" && requestLine[0] != "HEAD")) {
+        status = "405 Method Not Allowed";
+    } else if (requestLine[1] != "/metrics" && !requestLine[1].startsWith("/metrics?")) {
+        status = "404 Not Found";
+    } else {
+        body = Metrics::exposition();
+    }
+
+    QByteArray response = "HTTP/1.1 " + status + "\r\n"
+                          "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                          "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+                          "Connection: close\r\n\r\n";
+    if (requestLine.value(0) != "HEAD") response.append(body);
+    socket->write(response);
+    socket->disconnectFromHost();
+}
@@ -0,0 +1,29 @@
+#ifndef METRICSSERVER_H
+#define METRICSSERVER_H
+
+#include <QObject>
+#include <QTcpServer>
+#include <QHostAddress>
+
+/**
+ * Minimal HTTP listener serving the metrics registry on GET /metrics,
+ * in the Prometheus text format. One response per connection.
+ */
+class MetricsServer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit MetricsServer(QObject *parent = nullptr);
+
+    bool listen(const QHostAddress& address, int port);
+
+private slots:
+    void onNewConnection();
+
+private:
+    void handleRequest(QTcpSocket* socket);
+
+    QTcpServer* _server;
+};
+
+#endif // METRICSSERVER_H
@@ -0,0 +1,169 @@
+#include "mountpointprober.h"
+#include "fixrecord.h"
+#include "logger.h"
+#include <QDebug>
+
+static const int MAX_HEADER_SIZE = 8192;
+
+MountPointProber::MountPointProber(QObject *parent)
+    : QObject(parent),
+      _timer(new QTimer(this))
+{
+    _timer->setSingleShot(true);
+    connect(_timer, &QTimer::timeout, this, &MountPointProber::finishProbes);
+}
+
+MountPointProber::~MountPointProber()
+{
+    for (Session* session : std::as_const(_sessions)) {
+        session->socket->disconnect(this);
+        delete session;
+    }
+}
+
+void MountPointProber::init(const QString& host, int port, const QString& user, const QString& password)
+{
+    if (host != _host || port != _port) {
+        _cache.clear();
+    }
+    _host = host;
+    _port = port;
+    _user = user;
+    _password = password;
+}
+
+void MountPointProber::probe(const QList<Candidate>& candidates)
+{
+    if (isProbing()) {
+        qWarning() << "NTRIP: mount point probes already running";
+        return;
+    }
+    QStringList names;
+    for (const Candidate& candidate : candidates) {
+        Session* session = new Session;
+        session->candidate = candidate;
+        session->socket = new QSslSocket(this);
+        session->quality.begin(monotonicNsecs(), candidate.systems);
+        _sessions.append(session);
+        names.append(candidate.name);
+
+        QSslSocket* socket = session->socket;
+        auto sendRequest = [this, socket, candidate]() {
+            socket->write(CasterReader::ntripRequest(_host, _port, _user, _password, "/" + candidate.name));
+        };
+        connect(socket, &QSslSocket::readyRead, this, [this, session]() { onReadyRead(session); });
+        connect(socket, &QAbstractSocket::errorOccurred, this, [this, session]() { endSession(session); });
+        if (_tls) {
+            _tls->onReady(socket, this, sendRequest);
+            _tls->connectToHost(socket, _host, _port);
+        } else {
+            connect(socket, &QSslSocket::connected, this, sendRequest);
+            socket->connectToHost(_host, _port);
+        }
+    }
+    if (_sessions.isEmpty()) {
+        emit finished();
+        return;
+    }
+    qDebug() << "NTRIP: probing" << names.join(", ") << "for" << _durationMs / 1000.0 << "s";
+    _timer->start(_durationMs);
+}
+
+void MountPointProber::onReadyRead(Session* session)
+{
+    QByteArray data = session->socket->readAll();
+    if (!session->streaming) {
+        session->header.append(data);
+        int headerEnd = session->header.indexOf("\r\n\r\n");
+        if (headerEnd < 0) {
+            if (session->header.size() > MAX_HEADER_SIZE) endSession(session);
+            return;
+        }
+        // A caster answers an unknown mount point with its sourcetable
+        if (!session->header.startsWith("ICY 200 OK") && !session->header.startsWith("HTTP/1.1 200 OK")) {
+            qWarning() << "NTRIP: probe of" << session->candidate.name << "refused:" << session->header.left(session->header.indexOf('\r'));
+            endSession(session);
+            return;
+        }
+        session->streaming = true;
+        data = session->header.mid(headerEnd + 4);
+        session->header.clear();
+    }
+    session->quality.addData(reinterpret_cast<const unsigned char*>(data.constData()), data.size(), monotonicNsecs());
+}
+
+void MountPointProber::endSession(Session* session)
+{
+    if (!_sessions.removeOne(session)) return;
+    session->socket->disconnect(this);
+    session->socket->abort();
+    session->socket->deleteLater();
+
+    Probe probe;
+    probe.candidate = session->candidate;
+    probe.result = session->quality.result();
+    probe.score = rtcmQualityScore(probe.result, probe.candidate.distanceKm);
+    probe.probedMs = static_cast<qint64>(monotonicNsecs() / 1000000);
+    _cache.insert(probe.candidate.name, probe);
+    delete session;
+
+    const RtcmQualityResult& r = probe.result;
+    RTK_LOG_INFO("ntrip", "Mount point probed", {"mountpoint", probe.candidate.name},
+                 {"distance_km", qRound(probe.candidate.distanceKm * 10) / 10.0}, {"first_byte_ms", qRound(r.firstByteMs)},
+                 {"epochs", r.epochs}, {"interval_ms", qRound(r.intervalMs)}, {"jitter_ms", qRound(r.jitterMs)},
+                 {"crc_error_rate", r.crcErrorRate}, {"completeness", r.completeness}, {"score", qRound(probe.score)});
+
+    if (_sessions.isEmpty()) {
+        _timer->stop();
+        emit finished();
+    }
+}
+
+void MountPointProber::finishProbes()
+{
+    // endSession emits finished() with the last one
+    const QList<Session*> sessions = _sessions;
+    for (Session* session : sessions) {
+        endSession(session);
+    }
+}
+
+bool MountPointProber::isFresh(const Probe& probe) const
+{
+    return static_cast<qint64>(monotonicNsecs() / 1000000) - probe.probedMs < _cacheLifetimeMs;
+}
+
+QList<MountPointProber::Candidate> MountPointProber::uncached(const QList<Candidate>& candidates) const
+{
+    QList<Candidate> result;
+    for (const Candidate& candidate : candidates) {
+        auto it = _cache.constFind(candidate.name);
+        if (it == _cache.constEnd() || !isFresh(*it)) result.append(candidate);
+    }
+    return result;
+}
+
+QString MountPointProber::best(const QList<Candidate>& candidates) const
+{
+    QString best;
+    double bestScore = -1;
+    for (const Candidate& candidate : candidates) {
+        auto it = _cache.constFind(candidate.name);
+        if (it == _cache.constEnd() || !isFresh(*it) || it->score < 0) continue;
+        // The distance is part of the score: the one of the cached probe is replaced by the current one
+        double score = rtcmQualityScore(it->result, candidate.distanceKm);
+        if (score > bestScore) {
+            bestScore = score;
+            best = candidate.name;
+        }
+    }
+    return best;
+}
+
+void MountPointProber::markFailed(const QString& mountpoint)
+{
+    auto it = _cache.find(mountpoint);
+    if (it != _cache.end()) {
+        it->score = -1;
+    }
+}
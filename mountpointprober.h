@@ -0,0 +1,89 @@
+#ifndef MOUNTPOINTPROBER_H
+#define MOUNTPOINTPROBER_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QSslSocket>
+#include <QTimer>
+#include "casterreader.h"
+#include "rtcmquality.h"
+
+/**
+ * Short concurrent sessions to candidate mount points, to pick the best
+ * stream rather than the closest one (offline, lagging or incomplete bases).
+ *
+ * Each probe measures the delay to the first byte of data, the constellations
+ * received against the ones of the sourcetable, the epoch interval jitter and
+ * the CRC error rate (see RtcmStreamQuality). The results are cached for the
+ * cache lifetime, so a new selection among probed candidates is immediate.
+ */
+class MountPointProber : public QObject
+{
+    Q_OBJECT
+public:
+    using Candidate = CasterReader::MountPointInfo;
+
+    struct Probe {
+        Candidate candidate;
+        RtcmQualityResult result;
+        double score = -1;          // rtcmQualityScore, negative if unusable
+        qint64 probedMs = 0;        // Monotonic time of the end of the probe
+    };
+
+    explicit MountPointProber(QObject *parent = nullptr);
+    ~MountPointProber();
+
+    // The cache is cleared when the caster changes
+    void init(const QString& host, int port, const QString& user, const QString& password);
+    void setDuration(int ms) { _durationMs = ms; }
+    void setCacheLifetime(int ms) { _cacheLifetimeMs = ms; }
+    // TLS of the caster connections (see CasterReader::tls()), plain TCP if null
+    void setTlsSession(CasterTlsSession* tls) { _tls = tls; }
+
+    // Probes the candidates at the same time, finished() is emitted at the end
+    void probe(const QList<Candidate>& candidates);
+    bool isProbing() const { return !_sessions.isEmpty(); }
+
+    // Candidates without a result in the cache
+    QList<Candidate> uncached(const QList<Candidate>& candidates) const;
+    // Best usable candidate of the cache, empty if none
+    QString best(const QList<Candidate>& candidates) const;
+    // The stream failed after its selection: unusable until probed again
+    void markFailed(const QString& mountpoint);
+    void clearCache() { _cache.clear(); }
+
+signals:
+    void finished();
+
+private slots:
+    void finishProbes();
+
+private:
+    struct Session {
+        Candidate candidate;
+        QSslSocket* socket;
+        QByteArray header;          // Response, until its end
+        bool streaming = false;
+        RtcmStreamQuality quality;
+    };
+
+    void onReadyRead(Session* session);
+    void endSession(Session* session);
+    bool isFresh(const Probe& probe) const;
+
+    QString _host;
+    int _port = 0;
+    QString _user;
+    QString _password;
+    int _durationMs = 5000;
+    int _cacheLifetimeMs = 600000;
+    CasterTlsSession* _tls = nullptr;
+
+    QList<Session*> _sessions;
+    QTimer* _timer;
+    QHash<QString, Probe> _cache;   // By mount point
+};
+
+#endif // MOUNTPOINTPROBER_H
@@ -0,0 +1,227 @@
+#include "nmeaparser.h"
+#include <charconv>
+
+static const int MAX_FIELDS = 32;  // Fields kept per sentence, the parsed ones are within the first 17
+
+static std::string_view trimmed(std::string_view text)
+{
+    while (!text.empty() && (text.front() == ' ' || text.front() == '\t' || text.front() == '\r' || text.front() == '\n')) {
+        text.remove_prefix(1);
+    }
+    while (!text.empty() && (text.back() == ' ' || text.back() == '\t' || text.back() == '\r' || text.back() == '\n')) {
+        text.remove_suffix(1);
+    }
+    return text;
+}
+
+// Same results as QString::toDouble: 0 unless the whole field is a number
+static double toDouble(std::string_view text)
+{
+    text = trimmed(text);
+    if (!text.empty() && text.front() == '+') text.remove_prefix(1);
+    double value = 0.0;
+    std::from_chars_result result = std::from_chars(text.data(), text.data() + text.size(), value);
+    return result.ec == std::errc() && result.ptr == text.data() + text.size() ? value : 0.0;
+}
+
+// Same results as QString::toInt
+static int toInt(std::string_view text)
+{
+    text = trimmed(text);
+    if (!text.empty() && text.front() == '+') text.remove_prefix(1);
+    int value = 0;
+    std::from_chars_result result = std::from_chars(text.data(), text.data() + text.size(), value);
+    return result.ec == std::errc() && result.ptr == text.data() + text.size() ? value : 0;
+}
+
+static bool endsWith(std::string_view text, std::string_view suffix)
+{
+    return text.size() >= suffix.size() && text.substr(text.size() - suffix.size()) == suffix;
+}
+
+static double parseLatLon(std::string_view value, std::string_view direction)
+{
+    if (value.empty()) return 0.0;
+    double raw_value = toDouble(value);
+    int degrees = static_cast<int>(raw_value / 100.0);
+    double minutes = raw_value - (degrees * 100.0);
+    double decimal_degrees = degrees + minutes / 60.0;
+    if (direction == "S" || direction == "W") {
+        decimal_degrees = -decimal_degrees;
+    }
+    return decimal_degrees;
+}
+
+// Days since 1970-01-01 (proleptic Gregorian calendar)
+static int64_t daysFromCivil(int year, int month, int day)
+{
+    int y = year - (month <= 2);
+    int era = (y >= 0 ? y : y - 399) / 400;
+    int yoe = y - era * 400;
+    int doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return static_cast<int64_t>(era) * 146097 + doe - 719468;
+}
+
+static void civilFromDays(int64_t days, int& year, int& month, int& day)
+{
+    days += 719468;
+    int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    int doe = static_cast<int>(days - era * 146097);
+    int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int mp = (5 * doy + 2) / 153;
+    day = doy - (153 * mp + 2) / 5 + 1;
+    month = mp < 10 ? mp + 3 : mp - 9;
+    year = static_cast<int>(yoe + era * 400) + (month <= 2);
+}
+
+int64_t NmeaFix::utcMsecs() const
+{
+    if (year == 0) return -1;
+    int64_t days = daysFromCivil(year, month, day);
+    return ((days * 24 + hours) * 60 + minutes) * 60000 + static_cast<int64_t>(seconds * 1000.0 + 0.5);
+}
+
+bool NmeaParser::validateChecksum(std::string_view sentence)
+{
+    size_t star_pos = sentence.find('*');
+    if (star_pos == std::string_view::npos || star_pos + 3 > sentence.size()) {
+        return false;
+    }
+    unsigned char checksum = 0;
+    for (size_t i = 1; i < star_pos; ++i) {
+        checksum ^= static_cast<unsigned char>(sentence[i]);
+    }
+    std::string_view text = trimmed(sentence.substr(star_pos + 1));
+    if (text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) text.remove_prefix(2);
+    unsigned int received_checksum = 0;
+    std::from_chars_result result = std::from_chars(text.data(), text.data() + text.size(), received_checksum, 16);
+    return result.ec == std::errc() && result.ptr == text.data() + text.size() && checksum == received_checksum;
+}
+
+double NmeaParser::timeOfDay(std::string_view sentence)
+{
+    size_t comma = sentence.find(',');
+    if (comma == std::string_view::npos || comma < 4) return -1;
+    std::string_view type = sentence.substr(comma - 3, 3);
+    int index;
+    if (type == "GGA" || type == "RMC" || type == "GST" || type == "GNS" || type == "ZDA") {
+        index = 1;
+    } else if (type == "GLL") {
+        index = 5;
+    } else {
+        return -1;
+    }
+    std::string_view s = sentence.substr(comma + 1);
+    for (int i = 1; i < index; ++i) {
+        size_t next = s.find(',');
+        if (next == std::string_view::npos) return -1;
+        s.remove_prefix(next + 1);
+    }
+    std::string_view field = s.substr(0, s.find_first_of(",*"));
+    if (field.size() < 6) return -1;
+    double time_val = toDouble(field);
+    return static_cast<int>(time_val / 10000) * 3600 + static_cast<int>(std::fmod(time_val, 10000) / 100) * 60
+           + std::fmod(time_val, 100);
+}
+
+bool NmeaParser::parse(std::string_view sentence)
+{
+    if (!validateChecksum(sentence)) {
+        return false;
+    }
+
+    // Fields between the '$' and the '*'
+    std::string_view s = sentence.substr(1, sentence.find('*') - 1);
+    std::string_view fields[MAX_FIELDS];
+    int count = 0;
+    for (;;) {
+        size_t comma = s.find(',');
+        if (count < MAX_FIELDS) fields[count] = s.substr(0, comma);
+        ++count;
+        if (comma == std::string_view::npos) break;
+        s.remove_prefix(comma + 1);
+    }
+    int kept = count < MAX_FIELDS ? count : MAX_FIELDS;
+
+    std::string_view type = fields[0];
+    if (type.size() > 2 && endsWith(type, "GGA")) {
+        parseGga(fields, kept);
+    } else if (type.size() > 2 && endsWith(type, "RMC")) {
+        parseRmc(fields, kept);
+    } else if (type.size() > 2 && endsWith(type, "GSA")) {
+        parseGsa(fields, kept);
+    } else if (type.size() > 2 && endsWith(type, "GST")) {
+        parseGst(fields, kept);
+    }
+    return true;
+}
+
+// UTC time of day (hhmmss.ss) of GGA and RMC. The date of the last RMC is carried over midnight,
+// so a receiver sending GGA before RMC does not date the first epoch of a day one day back.
+void NmeaParser::parseTime(std::string_view field)
+{
+    double time_val = toDouble(field);
+    int hours = static_cast<int>(time_val / 10000);
+    int minutes = static_cast<int>(std::fmod(time_val, 10000) / 100);
+    double seconds = std::fmod(time_val, 100);
+    double previous = (_fix.hours * 60 + _fix.minutes) * 60 + _fix.seconds;
+    double current = (hours * 60 + minutes) * 60 + seconds;
+    if (_fix.year != 0 && current + 43200 < previous) {
+        civilFromDays(daysFromCivil(_fix.year, _fix.month, _fix.day) + 1, _fix.year, _fix.month, _fix.day);
+    }
+    _fix.hours = hours;
+    _fix.minutes = minutes;
+    _fix.seconds = seconds;
+}
+
+void NmeaParser::parseGga(const std::string_view* fields, int count)
+{
+    if (count < 10) return;
+    if (!fields[1].empty()) parseTime(fields[1]);
+    if (!fields[2].empty()) _fix.latitude = parseLatLon(fields[2], fields[3]);
+    if (!fields[4].empty()) _fix.longitude = parseLatLon(fields[4], fields[5]);
+    if (!fields[6].empty()) _fix.fixQuality = toInt(fields[6]);
+    if (!fields[7].empty()) _fix.satellites = toInt(fields[7]);
+    if (!fields[8].empty()) _fix.hdop = toDouble(fields[8]);
+    if (!fields[9].empty()) _fix.altitude = toDouble(fields[9]);
+}
+
+void NmeaParser::parseRmc(const std::string_view* fields, int count)
+{
+    if (count < 10) return;
+    if (!fields[1].empty()) parseTime(fields[1]);
+    if (fields[2] != "A") {
+        _fix.fixQuality = 0;
+    }
+    if (!fields[3].empty()) _fix.latitude = parseLatLon(fields[3], fields[4]);
+    if (!fields[5].empty()) _fix.longitude = parseLatLon(fields[5], fields[6]);
+    if (!fields[7].empty()) {
+        _fix.speedKnots = toDouble(fields[7]);
+        _fix.speedMs = _fix.speedKnots * 0.5144;
+        _fix.velocityTime = (_fix.hours * 60 + _fix.minutes) * 60 + _fix.seconds;
+    }
+    if (!fields[8].empty()) _fix.headingDegrees = toDouble(fields[8]);
+    if (!fields[9].empty()) {
+        int date_val = toInt(fields[9]);
+        _fix.day = date_val / 10000;
+        _fix.month = (date_val / 100) % 100;
+        _fix.year = date_val % 100 + 2000;
+    }
+}
+
+void NmeaParser::parseGsa(const std::string_view* fields, int count)
+{
+    if (count < 17) return;
+    if (!fields[2].empty()) _fix.fixMode = toInt(fields[2]);
+    if (!fields[15].empty()) _fix.hdop = toDouble(fields[15]);
+}
+
+void NmeaParser::parseGst(const std::string_view* fields, int count)
+{
+    if (count < 9) return;
+    if (!fields[6].empty()) _fix.stdLatitude = toDouble(fields[6]);
+    if (!fields[7].empty()) _fix.stdLongitude = toDouble(fields[7]);
+    if (!fields[8].empty()) _fix.stdAltitude = toDouble(fields[8]);
+}
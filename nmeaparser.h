@@ -0,0 +1,71 @@
+#ifndef NMEAPARSER_H
+#define NMEAPARSER_H
+
+#include <cmath>
+#include <cstdint>
+#include <string_view>
+
+/**
+ * Qt-free NMEA 0183 parser (part of rtkcore).
+ *
+ * The fix is accumulated from the GGA, RMC, GSA and GST sentences of an
+ * epoch; the other sentences only have their checksum validated. Parsing
+ * works on the sentence text in place and never allocates.
+ */
+struct NmeaFix {
+    int year = 0;                   // 0 until an RMC sentence with a date
+    int month = 0;
+    int day = 0;
+    int hours = 0;
+    int minutes = 0;
+    double seconds = 0.0;
+    double latitude = 0.0;          // Degrees, positive north
+    double longitude = 0.0;         // Degrees, positive east
+    double altitude = 0.0;          // Meters above mean sea level
+    int fixQuality = 0;             // GGA: 0 no fix, 1 GPS, 2 DGPS, 4 RTK fixed, 5 RTK float
+    int fixMode = 0;                // GSA: 1 no fix, 2 2D, 3 3D
+    double speedKnots = 0.0;
+    double speedMs = 0.0;
+    double headingDegrees = 0.0;
+    double velocityTime = -1.0;     // Time of day in seconds of the RMC that gave the speed, -1 if none
+    double hdop = 0.0;
+    int satellites = 0;
+    double stdLatitude = NAN;       // GST standard deviations in meters, NaN if unknown
+    double stdLongitude = NAN;
+    double stdAltitude = NAN;
+
+    bool hasFix() const { return fixQuality > 0; }
+    // Speed and heading were given by an RMC of the current epoch, not carried over from an earlier one
+    bool hasVelocity() const
+    {
+        return velocityTime >= 0 && std::abs(velocityTime - ((hours * 60 + minutes) * 60 + seconds)) < 0.0005;
+    }
+    // UTC time in milliseconds since 1970-01-01, -1 without a date
+    int64_t utcMsecs() const;
+};
+
+class NmeaParser
+{
+public:
+    // Parses one sentence ("$..*hh", without the line terminator).
+    // Returns false if it is rejected (bad checksum or no fields).
+    bool parse(std::string_view sentence);
+
+    const NmeaFix& fix() const { return _fix; }
+
+    static bool validateChecksum(std::string_view sentence);
+    // UTC time of day in seconds of the sentences that have one (GGA, RMC, GLL, GST, GNS, ZDA),
+    // -1 for the others (GSA, GSV, VTG...). The sentences of an epoch share it.
+    static double timeOfDay(std::string_view sentence);
+
+private:
+    void parseTime(std::string_view field);
+    void parseGga(const std::string_view* fields, int count);
+    void parseRmc(const std::string_view* fields, int count);
+    void parseGsa(const std::string_view* fields, int count);
+    void parseGst(const std::string_view* fields, int count);
+
+    NmeaFix _fix;
+};
+
+#endif // NMEAPARSER_H
@@ -1,87 +1,241 @@
 #include "outputhandler.h"
+#include "fixrecord.h"
+#include "metrics.h"
+#include "trace.h"
 #include <QDebug>
-#include <QJsonDocument>
-#include <QJsonObject>
-#include <QDateTime>
-#include <QTextStream>
-#include <QTimeZone>
+#include <QTimer>
 
-OutputHandler::OutputHandler(OutputMethod method, OutputType type, const QString& file, int port, QObject *parent)
+OutputHandler::OutputHandler(const Options& options, QObject *parent)
     : QObject(parent),
-      _method(method),
-      _type(type),
+      _options(options),
+      _method(options.method),
+      _type(options.type),
+      _epochCount(0),
+      _lastEpochNs(0),
+      _fileSink(nullptr),
+      _trackWriter(nullptr),
       _server(nullptr),
-      _port(port),
-      _isCsvHeaderWritten(false)
+      _droppedRecords(0),
+      _udpSocket(nullptr),
+      _isCsvHeaderWritten(false),
+      _sequence(0),
+      _binaryRecord(sizeof(rtk_fix_record), Qt::Uninitialized)
 {
-    if (_method == OutputMethod::File) {
-        _file.setFileName(file);
-        if (!_file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text)) {
-            qWarning() << "Failed to open output file:" << file;
+    if (_options.predicted && _type == OutputType::NMEA && _method != OutputMethod::Track) {
+        qWarning() << "Output: predicted fixes are not available as NMEA, use csv, json or binary";
+        _method = OutputMethod::False;
+    } else if (_method == OutputMethod::File) {
+        FileSink::Options fileOptions = _options.file;
+        fileOptions.binary = (_type == OutputType::Binary);
+        if (_type == OutputType::CSV) {
+            // The sink writes the header at the start of every new file
+            fileOptions.header = _options.predicted ? FixFormatter::predictionCsvHeader()
+                                                    : FixFormatter::csvHeader(_options.fields);
+            _isCsvHeaderWritten = true;
+        }
+        _fileSink = new FileSink(fileOptions);
+        if (!_fileSink->open()) {
             _method = OutputMethod::False; // Disable output if file can't be opened
         }
+    } else if (_method == OutputMethod::Track) {
+        _trackWriter = new TrackStore::Writer();
+        if (!_trackWriter->open(_options.file.fileName)) {
+            _method = OutputMethod::False;
+        } else {
+            // The pending points are also written when the fixes stop (no new point completes the block)
+            QTimer* flushTimer = new QTimer(this);
+            connect(flushTimer, &QTimer::timeout, this, [this]() { _trackWriter->flush(); });
+            flushTimer->start(TrackStore::BLOCK_SPAN_MS);
+        }
+    } else if (_method == OutputMethod::Stdout) {
+        // Records go to stderr with the log messages, as before, or alone to stdout
+        if (!_file.open(_options.standardOutput ? stdout : stderr, QIODevice::WriteOnly | QIODevice::Unbuffered)) {
+            qWarning() << "Failed to open" << (_options.standardOutput ? "stdout" : "stderr") << "for output";
+            _method = OutputMethod::False;
+        }
     } else if (_method == OutputMethod::Socket) {
         _server = new QTcpServer(this);
         connect(_server, &QTcpServer::newConnection, this, &OutputHandler::onNewConnection);
-        if (!_server->listen(QHostAddress::Any, _port)) {
-            qWarning() << "Failed to start TCP server on port" << _port;
+        if (!_server->listen(QHostAddress::Any, _options.socket.port)) {
+            qWarning() << "Failed to start TCP server on port" << _options.socket.port;
             _method = OutputMethod::False; // Disable output if server can't start
         } else {
-            qDebug() << "TCP server listening on port" << _port;
+            qDebug() << "TCP server listening on port" << _options.socket.port;
+        }
+    } else if (_method == OutputMethod::Multicast) {
+        _multicastGroup = QHostAddress(_options.socket.multicastGroup);
+        if (!_multicastGroup.isMulticast()) {
+            qWarning() << "Invalid multicast group:" << _options.socket.multicastGroup;
+            _method = OutputMethod::False;
+        } else {
+            _udpSocket = new QUdpSocket(this);
+            _udpSocket->bind(_multicastGroup.protocol() == QAbstractSocket::IPv6Protocol ? QHostAddress::AnyIPv6 : QHostAddress::AnyIPv4, 0);
+            _udpSocket->setSocketOption(QAbstractSocket::MulticastTtlOption, _options.socket.multicastTtl);
+            qDebug() << "Sending UDP multicast to" << _multicastGroup.toString() << ":" << _options.socket.port;
         }
     }
 }
 
 OutputHandler::~OutputHandler()
 {
+    delete _fileSink;
+    delete _trackWriter;
     if (_file.isOpen()) {
         _file.close();
     }
     if (_server) {
         _server->close();
     }
+    // The clients are deleted with the server, without their disconnected signal
+    for (QTcpSocket* client : std::as_const(_clients)) {
+        disconnect(client, nullptr, this, nullptr);
+    }
+    Metrics::registry().outputClients.add(-_clients.size());
+    _clients.clear();
 }
 
 void OutputHandler::processNmeaData(const QString& nmeaSentence)
 {
-    if (_method == OutputMethod::False) {
+    if (_method == OutputMethod::False || _type != OutputType::NMEA || _options.predicted) {
         return;
     }
 
-    QString outputData;
-
-    if (_type == OutputType::NMEA) {
-        outputData = nmeaSentence;
-    } else {
-        GpsData gpsData;
-        gpsData.parse_NMEA(nmeaSentence);
-
-        if (gpsData.hasFix()) {
-            if (_type == OutputType::CSV) {
-                if (!_isCsvHeaderWritten) {
-                    outputData = formatCsv(gpsData);
-                     _isCsvHeaderWritten = true;
-                }
-                else
-                {
-                    outputData = formatCsv(gpsData).split('\n').last();
-                }
-            } else if (_type == OutputType::JSON) {
-                outputData = formatJson(gpsData);
-            }
+    if (!isFiltered()) {
+        QByteArray line = nmeaSentence.toLatin1();
+        line.append('\n');
+        writeData(line);
+        return;
+    }
+
+    // Keep the sentences until the end of the epoch (all its sentences parsed) decides if they are written
+    _nmeaEpoch.append(nmeaSentence.toLatin1());
+    _nmeaEpoch.append('\n');
+}
+
+void OutputHandler::processEpoch(const GpsData& gpsData, quint64 receiveTimeNs)
+{
+    if (_method == OutputMethod::False || _options.predicted) {
+        return;
+    }
+
+    bool accepted = acceptEpoch(gpsData, receiveTimeNs);
+
+    // The track store keeps positions only, whatever the output type
+    if (_method == OutputMethod::Track) {
+        qint64 utcMs = gpsData.utcMsecs();
+        if (accepted && gpsData.hasFix() && utcMs >= 0) {
+            _trackWriter->append({utcMs, gpsData.latitude(), gpsData.longitude(), gpsData.altitude(), gpsData.fixQualityCode()});
         }
+        return;
     }
 
-    if (!outputData.isEmpty()) {
-        writeData(outputData);
+    switch (_type) {
+    case OutputType::NMEA:
+        if (accepted && !_nmeaEpoch.isEmpty()) {
+            writeData(_nmeaEpoch);
+        }
+        _nmeaEpoch.resize(0);
+        break;
+    case OutputType::CSV:
+        if (accepted) {
+            writeData(_formatter.csv(gpsData, !_isCsvHeaderWritten, _options.fields));
+            _isCsvHeaderWritten = true;
+        }
+        break;
+    case OutputType::JSON:
+        if (accepted) {
+            writeData(_formatter.json(gpsData, _options.fields));
+        }
+        break;
+    case OutputType::Binary:
+        if (accepted) {
+            encodeFixRecord(gpsData, _sequence++, receiveTimeNs, _binaryRecord.data());
+            writeData(_binaryRecord);
+        }
+        break;
+    default:
+        break;
     }
 }
 
+void OutputHandler::discardEpoch()
+{
+    _nmeaEpoch.resize(0);
+}
+
+void OutputHandler::processPrediction(const Prediction& prediction)
+{
+    if (_method == OutputMethod::False || !_options.predicted) {
+        return;
+    }
+    // The rate is set by the predictor, only the fix quality filter applies
+    if (!_options.fixQualities.isEmpty() && !_options.fixQualities.contains(prediction.fixQuality)) {
+        return;
+    }
+
+    if (_method == OutputMethod::Track) {
+        _trackWriter->append({prediction.utcMs, prediction.latitude, prediction.longitude, prediction.altitude, prediction.fixQuality});
+        return;
+    }
+
+    switch (_type) {
+    case OutputType::CSV:
+        writeData(_formatter.csv(prediction, !_isCsvHeaderWritten));
+        _isCsvHeaderWritten = true;
+        break;
+    case OutputType::JSON:
+        writeData(_formatter.json(prediction));
+        break;
+    case OutputType::Binary:
+        encodeFixRecord(prediction, _sequence++, monotonicNsecs(), _binaryRecord.data());
+        writeData(_binaryRecord);
+        break;
+    default:
+        break;
+    }
+}
+
+void OutputHandler::setFilters(const Options& options)
+{
+    _options.decimation = options.decimation;
+    _options.interval = options.interval;
+    _options.fixQualities = options.fixQualities;
+    _epochCount = 0;
+    qDebug() << "Output: filters updated, decimation" << _options.decimation << "interval" << _options.interval
+             << "ms, fix qualities" << _options.fixQualities;
+}
+
+bool OutputHandler::isFiltered() const
+{
+    return _options.decimation > 1 || _options.interval > 0 || !_options.fixQualities.isEmpty();
+}
+
+bool OutputHandler::acceptEpoch(const GpsData& gpsData, quint64 receiveTimeNs)
+{
+    // NMEA outputs without filter pass everything through, the others need a fix
+    if (_type == OutputType::NMEA && !isFiltered()) {
+        return true;
+    }
+    if (_options.fixQualities.isEmpty() ? !gpsData.hasFix() : !_options.fixQualities.contains(gpsData.fixQualityCode())) {
+        return false;
+    }
+    if (_options.decimation > 1 && (_epochCount++ % _options.decimation) != 0) {
+        return false;
+    }
+    if (_options.interval > 0 && _lastEpochNs != 0
+        && receiveTimeNs - _lastEpochNs < static_cast<quint64>(_options.interval) * 1000000) {
+        return false;
+    }
+    _lastEpochNs = receiveTimeNs;
+    return true;
+}
+
 void OutputHandler::onNewConnection()
 {
     QTcpSocket *clientSocket = _server->nextPendingConnection();
     connect(clientSocket, &QTcpSocket::disconnected, this, &OutputHandler::onSocketDisconnected);
     _clients.append(clientSocket);
+    Metrics::registry().outputClients.add(1);
     qDebug() << "Client connected:" << clientSocket->peerAddress().toString();
 }
 
@@ -90,28 +244,28 @@ void OutputHandler::onSocketDisconnected()
     QTcpSocket *clientSocket = qobject_cast<QTcpSocket *>(sender());
     if (clientSocket) {
         _clients.removeAll(clientSocket);
+        Metrics::registry().outputClients.add(-1);
+        _slowClients.remove(clientSocket);
         clientSocket->deleteLater();
         qDebug() << "Client disconnected";
     }
 }
 
-void OutputHandler::writeData(const QString& data)
+void OutputHandler::writeData(const QByteArray& data)
 {
+    RTK_TRACE_SCOPE("OutputHandler::writeData");
     switch (_method) {
     case OutputMethod::Stdout:
-        qDebug().noquote() << data;
+        _file.write(data);
         break;
     case OutputMethod::File:
-        if (_file.isOpen()) {
-            QTextStream stream(&_file);
-            stream << data << "\n";
+        if (!_fileSink->write(data)) {
+            Metrics::registry().droppedRecords.add();
         }
         break;
     case OutputMethod::Socket:
-        for (QTcpSocket* socket : _clients) {
-            socket->write(data.toUtf8());
-            socket->write("\n");
-        }
+    case OutputMethod::Multicast:
+        broadcast(data);
         break;
     case OutputMethod::False:
     default:
@@ -119,53 +273,31 @@ void OutputHandler::writeData(const QString& data)
     }
 }
 
-QString OutputHandler::formatCsv(const GpsData& gpsData)
+void OutputHandler::broadcast(const QByteArray& payload)
 {
-    QString csv;
-    QTextStream stream(&csv);
-
-    if (!_isCsvHeaderWritten) {
-        stream << "timestamp,latitude,longitude,altitude,fix_quality,fix_mode,speed_ms,heading_degrees,hdop\n";
-    }
-
-    QDate date(gpsData.year(), gpsData.month(), gpsData.day());
-    int seconds = static_cast<int>(gpsData.seconds());
-    int ms = static_cast<int>((gpsData.seconds() - seconds) * 1000);
-    QTime time(gpsData.hours(), gpsData.minutes(), seconds, ms);
-    QDateTime dateTime(date, time, QTimeZone::utc());
-
-    stream << dateTime.toString(Qt::ISODate) << ","
-           << QString::number(gpsData.latitude(), 'f', 8) << ","
-           << QString::number(gpsData.longitude(), 'f', 8) << ","
-           << QString::number(gpsData.altitude(), 'f', 3) << ","
-           << gpsData.fixQuality() << ","
-           << gpsData.fixMode() << ","
-           << QString::number(gpsData.speedMs(), 'f', 3) << ","
-           << QString::number(gpsData.headingDegrees(), 'f', 2) << ","
-           << QString::number(gpsData.hdop(), 'f', 2);
-
-    return csv;
-}
+    // The payload is encoded once and shared by all the clients
+    if (_method == OutputMethod::Multicast) {
+        _udpSocket->writeDatagram(payload, _multicastGroup, _options.socket.port);
+        return;
+    }
 
-QString OutputHandler::formatJson(const GpsData& gpsData)
-{
-    QJsonObject json;
-
-    QDate date(gpsData.year(), gpsData.month(), gpsData.day());
-    int seconds = static_cast<int>(gpsData.seconds());
-    int ms = static_cast<int>((gpsData.seconds() - seconds) * 1000);
-    QTime time(gpsData.hours(), gpsData.minutes(), seconds, ms);
-    QDateTime dateTime(date, time, QTimeZone::utc());
-
-    json["timestamp"] = dateTime.toString(Qt::ISODate);
-    json["latitude"] = gpsData.latitude();
-    json["longitude"] = gpsData.longitude();
-    json["altitude"] = gpsData.altitude();
-    json["fix_quality"] = gpsData.fixQuality();
-    json["fix_mode"] = gpsData.fixMode();
-    json["speed_ms"] = gpsData.speedMs();
-    json["heading_degrees"] = gpsData.headingDegrees();
-    json["hdop"] = gpsData.hdop();
-
-    return QJsonDocument(json).toJson(QJsonDocument::Compact);
+    const QList<QTcpSocket*> clients = _clients;
+    for (QTcpSocket* socket : clients) {
+        if (socket->bytesToWrite() + payload.size() > _options.socket.highWaterMark) {
+            ++_droppedRecords;
+            Metrics::registry().droppedRecords.add();
+            if (_options.socket.disconnectSlowClients) {
+                qWarning() << "Client" << socket->peerAddress().toString() << "too slow, disconnecting";
+                socket->abort();
+            } else if (!_slowClients.contains(socket)) {
+                qWarning() << "Client" << socket->peerAddress().toString() << "too slow, dropping records";
+                _slowClients.insert(socket);
+            }
+            continue;
+        }
+        if (_slowClients.remove(socket)) {
+            qDebug() << "Client" << socket->peerAddress().toString() << "caught up," << _droppedRecords << "records dropped in total";
+        }
+        socket->write(payload);
+    }
 }
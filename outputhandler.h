@@ -6,7 +6,13 @@
 #include <QFile>
 #include <QTcpServer>
 #include <QTcpSocket>
+#include <QUdpSocket>
+#include <QHostAddress>
+#include <QSet>
 #include "gpsdataparser.h"
+#include "filesink.h"
+#include "fixformatter.h"
+#include "trackstore.h"
 
 class OutputHandler : public QObject
 {
@@ -17,42 +23,99 @@ public:
         False,
         Socket,
         File,
-        Stdout
+        Stdout,
+        Multicast,
+        Track
     };
 
     enum class OutputType {
         NMEA,
         CSV,
-        JSON
+        JSON,
+        Binary
     };
 
-    explicit OutputHandler(OutputMethod method, OutputType type, const QString& file = "", int port = 0, QObject *parent = nullptr);
+    struct SocketOptions {
+        int port = 0;
+        qint64 highWaterMark = 64 * 1024;   // Bytes queued for a client before records are dropped
+        bool disconnectSlowClients = false; // Disconnect instead of dropping
+        QString multicastGroup;             // For multicast output
+        int multicastTtl = 1;
+    };
+
+    struct Options {
+        OutputMethod method = OutputMethod::False;
+        OutputType type = OutputType::NMEA;
+        FileSink::Options file;
+        SocketOptions socket;
+        int decimation = 1;                             // Output every Nth epoch
+        int interval = 0;                               // Minimum time between two epochs, in ms
+        quint32 fields = FixFormatter::AllFields;       // CSV/JSON fields
+        QList<int> fixQualities;                        // Accepted GGA fix qualities, empty for any fix
+        bool predicted = false;                         // Extrapolated fixes of the predictor instead of the epochs
+        bool standardOutput = false;                    // Stdout method: records on stdout instead of stderr
+    };
+
+    explicit OutputHandler(const Options& options, QObject *parent = nullptr);
     ~OutputHandler();
 
+    const Options& options() const { return _options; }
+    // Applies the epoch filters (decimation, interval, fix qualities) of options, the output keeps running
+    void setFilters(const Options& options);
+
 public slots:
+    // Raw NMEA sentences, used by the NMEA output type
     void processNmeaData(const QString& nmeaSentence);
+    // Called once per epoch with the fix parsed by the rover, after all the sentences of the epoch
+    void processEpoch(const GpsData& gpsData, quint64 receiveTimeNs);
+    // Called instead of processEpoch for an epoch without GGA: its sentences are not written
+    void discardEpoch();
+    // Called at the predictor rate, for the outputs of predicted fixes
+    void processPrediction(const Prediction& prediction);
 
 private slots:
     void onNewConnection();
     void onSocketDisconnected();
 
 private:
-    void writeData(const QString& data);
-    QString formatCsv(const GpsData& gpsData);
-    QString formatJson(const GpsData& gpsData);
+    // Writes one record: a line terminated by '\n', or a binary record
+    void writeData(const QByteArray& data);
+    void broadcast(const QByteArray& payload);
+    bool acceptEpoch(const GpsData& gpsData, quint64 receiveTimeNs);
+    bool isFiltered() const;
 
+    Options _options;
     OutputMethod _method;
     OutputType _type;
 
+    // Epoch filtering
+    quint64 _epochCount;
+    quint64 _lastEpochNs;
+    QByteArray _nmeaEpoch;      // Sentences of the current epoch, for filtered NMEA outputs
+
     // For file output
+    FileSink* _fileSink;
+    // For binary output on stdout
     QFile _file;
+    // For track store output
+    TrackStore::Writer* _trackWriter;
 
     // For socket output
     QTcpServer* _server;
     QList<QTcpSocket*> _clients;
-    int _port;
+    QSet<QTcpSocket*> _slowClients;
+    quint64 _droppedRecords;
 
+    // For multicast output
+    QUdpSocket* _udpSocket;
+    QHostAddress _multicastGroup;
+
+    FixFormatter _formatter;
     bool _isCsvHeaderWritten;
+
+    // For binary output
+    quint32 _sequence;
+    QByteArray _binaryRecord;
 };
 
 #endif // OUTPUTHANDLER_H
@@ -0,0 +1,241 @@
+#include "predictor.h"
+#include <cmath>
+#include <cstring>
+
+static const double MAX_ORIGIN_DISTANCE = 1000.0;  // m
+static const double GATE_MIN = 10.0;               // m, larger innovations restart the filter
+static const double GATE_SIGMAS = 10.0;
+static const double DEG_TO_RAD = 3.14159265358979323846 / 180.0;
+
+// Horizontal standard deviation of a fix when the receiver sends no GST sentence
+static double defaultStd(int fixQuality)
+{
+    switch (fixQuality) {
+    case 4: return 0.02;    // RTK fixed
+    case 5: return 0.3;     // RTK float
+    case 2: return 0.7;     // DGPS
+    case 1: return 2.5;     // GPS
+    default: return 5.0;
+    }
+}
+
+static double measuredStd(double std, double fallback)
+{
+    return std::isfinite(std) && std > 0 ? std::max(std, 0.005) : fallback;
+}
+
+PositionPredictor::Model PositionPredictor::modelFromString(const QString& name)
+{
+    return name.trimmed().toLower() == "cv" ? Model::ConstantVelocity : Model::ConstantAcceleration;
+}
+
+PositionPredictor::PositionPredictor(const Options& options)
+    : _options(options),
+      _valid(false),
+      _timeMs(-1),
+      _fixQuality(0),
+      _fixMode(0),
+      _satellites(0)
+{
+    memset(_axes, 0, sizeof(_axes));
+}
+
+void PositionPredictor::reset()
+{
+    _valid = false;
+    _timeMs = -1;
+    _frame.reset();
+}
+
+void PositionPredictor::initialize(const GpsData& gpsData, double east, double north, double up)
+{
+    double stdH = defaultStd(gpsData.fixQualityCode());
+    double std[3] = {measuredStd(gpsData.stdLongitude(), stdH), measuredStd(gpsData.stdLatitude(), stdH),
+                     measuredStd(gpsData.stdAltitude(), 2 * stdH)};
+    double position[3] = {east, north, up};
+    double heading = gpsData.headingDegrees() * DEG_TO_RAD;
+    double velocity[3] = {0.0, 0.0, 0.0};
+    if (_options.useVelocity && gpsData.hasVelocity()) {
+        velocity[0] = gpsData.speedMs() * std::sin(heading);
+        velocity[1] = gpsData.speedMs() * std::cos(heading);
+    }
+    memset(_axes, 0, sizeof(_axes));
+    for (int i = 0; i < 3; ++i) {
+        Axis& axis = _axes[i];
+        axis.x[0] = position[i];
+        axis.x[1] = velocity[i];
+        axis.P[0][0] = std[i] * std[i];
+        axis.P[1][1] = 10.0 * 10.0;
+        axis.P[2][2] = _options.model == Model::ConstantAcceleration ? 5.0 * 5.0 : 0.0;
+    }
+    _valid = true;
+}
+
+void PositionPredictor::update(const GpsData& gpsData)
+{
+    qint64 timeMs = gpsData.utcMsecs();
+    if (!gpsData.hasFix() || timeMs < 0) {
+        return;
+    }
+    _fixQuality = gpsData.fixQualityCode();
+    _fixMode = gpsData.fixModeCode();
+    _satellites = gpsData.satellites();
+
+    if (!_frame) {
+        _frame.emplace(gpsData.latitude(), gpsData.longitude(), gpsData.altitude());
+    }
+    double position[3];
+    _frame->toEnu(gpsData.latitude(), gpsData.longitude(), gpsData.altitude(), position[0], position[1], position[2]);
+
+    if (!_valid || timeMs <= _timeMs || timeMs - _timeMs > _options.maxGapMs) {
+        initialize(gpsData, position[0], position[1], position[2]);
+        _timeMs = timeMs;
+        moveOrigin();
+        return;
+    }
+
+    double dt = (timeMs - _timeMs) / 1000.0;
+    for (Axis& axis : _axes) {
+        propagate(axis, dt);
+    }
+    _timeMs = timeMs;
+
+    double stdH = defaultStd(_fixQuality);
+    double std[3] = {measuredStd(gpsData.stdLongitude(), stdH), measuredStd(gpsData.stdLatitude(), stdH),
+                     measuredStd(gpsData.stdAltitude(), 2 * stdH)};
+
+    // A position jump (fix lost and recovered, new base station) restarts the filter
+    for (int i = 0; i < 3; ++i) {
+        double innovation = std::abs(position[i] - _axes[i].x[0]);
+        double sigma = std::sqrt(_axes[i].P[0][0] + std[i] * std[i]);
+        if (innovation > std::max(GATE_MIN, GATE_SIGMAS * sigma)) {
+            initialize(gpsData, position[0], position[1], position[2]);
+            moveOrigin();
+            return;
+        }
+    }
+
+    for (int i = 0; i < 3; ++i) {
+        correct(_axes[i], 0, position[i], std[i] * std[i]);
+    }
+    if (_options.useVelocity && gpsData.hasVelocity()) {
+        double heading = gpsData.headingDegrees() * DEG_TO_RAD;
+        double stdV = _fixQuality == 4 || _fixQuality == 5 ? 0.05 : 0.2;
+        correct(_axes[0], 1, gpsData.speedMs() * std::sin(heading), stdV * stdV);
+        correct(_axes[1], 1, gpsData.speedMs() * std::cos(heading), stdV * stdV);
+    }
+    moveOrigin();
+}
+
+// x = F x, P = F P F' + Q
+void PositionPredictor::propagate(Axis& axis, double dt) const
+{
+    bool ca = _options.model == Model::ConstantAcceleration;
+    double F[3][3] = {{1.0, dt, ca ? dt * dt / 2 : 0.0},
+                      {0.0, 1.0, ca ? dt : 0.0},
+                      {0.0, 0.0, ca ? 1.0 : 0.0}};
+
+    double x[3];
+    for (int i = 0; i < 3; ++i) {
+        x[i] = F[i][0] * axis.x[0] + F[i][1] * axis.x[1] + F[i][2] * axis.x[2];
+    }
+    memcpy(axis.x, x, sizeof(x));
+
+    double FP[3][3];
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            FP[i][j] = F[i][0] * axis.P[0][j] + F[i][1] * axis.P[1][j] + F[i][2] * axis.P[2][j];
+        }
+    }
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            axis.P[i][j] = FP[i][0] * F[j][0] + FP[i][1] * F[j][1] + FP[i][2] * F[j][2];
+        }
+    }
+
+    // Discretized white acceleration (CV) or white jerk (CA) noise
+    double q = _options.processNoise;
+    double t = std::abs(dt);
+    double t2 = t * t, t3 = t2 * t;
+    if (ca) {
+        double t4 = t3 * t, t5 = t4 * t;
+        double Q[3][3] = {{t5 / 20, t4 / 8, t3 / 6},
+                          {t4 / 8, t3 / 3, t2 / 2},
+                          {t3 / 6, t2 / 2, t}};
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 3; ++j) {
+                axis.P[i][j] += q * Q[i][j];
+            }
+        }
+    } else {
+        axis.P[0][0] += q * t3 / 3;
+        axis.P[0][1] += q * t2 / 2;
+        axis.P[1][0] += q * t2 / 2;
+        axis.P[1][1] += q * t;
+    }
+}
+
+// Scalar measurement of one state
+void PositionPredictor::correct(Axis& axis, int state, double measurement, double variance)
+{
+    double s = axis.P[state][state] + variance;
+    if (s <= 0) {
+        return;
+    }
+    double k[3] = {axis.P[0][state] / s, axis.P[1][state] / s, axis.P[2][state] / s};
+    double innovation = measurement - axis.x[state];
+    for (int i = 0; i < 3; ++i) {
+        axis.x[i] += k[i] * innovation;
+    }
+    double row[3] = {axis.P[state][0], axis.P[state][1], axis.P[state][2]};
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            axis.P[i][j] -= k[i] * row[j];
+        }
+    }
+}
+
+// Keeps the frame origin close to the rover
+void PositionPredictor::moveOrigin()
+{
+    double east = _axes[0].x[0], north = _axes[1].x[0], up = _axes[2].x[0];
+    if (std::sqrt(east * east + north * north) < MAX_ORIGIN_DISTANCE) {
+        return;
+    }
+    double lat, lon, height;
+    _frame->toGeodetic(east, north, up, lat, lon, height);
+    _frame.emplace(lat, lon, height);
+    for (Axis& axis : _axes) {
+        axis.x[0] = 0.0;
+    }
+}
+
+bool PositionPredictor::predict(qint64 utcMs, Prediction& prediction) const
+{
+    if (!_valid) {
+        return false;
+    }
+    double dt = (utcMs - _timeMs) / 1000.0;
+    double position[3], velocity[3], std[3];
+    for (int i = 0; i < 3; ++i) {
+        Axis axis = _axes[i];
+        propagate(axis, dt);
+        position[i] = axis.x[0];
+        velocity[i] = axis.x[1];
+        std[i] = std::sqrt(std::max(axis.P[0][0], 0.0));
+    }
+    _frame->toGeodetic(position[0], position[1], position[2],
+                       prediction.latitude, prediction.longitude, prediction.altitude);
+    prediction.utcMs = utcMs;
+    prediction.ageMs = utcMs - _timeMs;
+    prediction.velocityEast = velocity[0];
+    prediction.velocityNorth = velocity[1];
+    prediction.velocityUp = velocity[2];
+    prediction.stdEast = std[0];
+    prediction.stdNorth = std[1];
+    prediction.stdUp = std[2];
+    prediction.fixQuality = _fixQuality;
+    prediction.fixMode = _fixMode;
+    prediction.satellites = _satellites;
+    return true;
+}
@@ -0,0 +1,91 @@
+#ifndef PREDICTOR_H
+#define PREDICTOR_H
+
+#include <QtGlobal>
+#include <optional>
+#include "geodesy.h"
+#include "gpsdataparser.h"
+
+// Fix extrapolated to a given time by PositionPredictor
+struct Prediction {
+    qint64 utcMs = -1;              // Time of the predicted position
+    qint64 ageMs = 0;               // Time since the last receiver epoch
+    double latitude = 0.0;
+    double longitude = 0.0;
+    double altitude = 0.0;
+    double velocityEast = 0.0;      // m/s
+    double velocityNorth = 0.0;
+    double velocityUp = 0.0;
+    double stdEast = 0.0;           // Position standard deviations, m
+    double stdNorth = 0.0;
+    double stdUp = 0.0;
+    int fixQuality = 0;             // Of the last receiver epoch
+    int fixMode = 0;
+    int satellites = 0;
+};
+
+/**
+ * Position prediction between receiver epochs.
+ *
+ * A Kalman filter in a local East-North-Up frame, with an independent
+ * constant velocity or constant acceleration model on each axis. Each
+ * epoch updates it with the GGA position (weighted by the GST standard
+ * deviations when available) and the RMC ground speed and course of the
+ * same epoch (a receiver without RMC gets no velocity measurement). The
+ * filtered state is then extrapolated to any UTC time with its covariance,
+ * so that a consumer running at a higher rate gets a position for its own
+ * clock instead of a fix that is already 50-150 ms old.
+ *
+ * The frame origin follows the rover (it is moved when the rover is more
+ * than 1 km away from it), so the local frame approximation stays exact.
+ */
+class PositionPredictor
+{
+public:
+    enum class Model {
+        ConstantVelocity,
+        ConstantAcceleration
+    };
+
+    struct Options {
+        Model model = Model::ConstantAcceleration;
+        double processNoise = 1.0;  // Spectral density of the white acceleration (m²/s³) or jerk (m²/s⁵)
+        bool useVelocity = true;    // Update with the RMC speed and course
+        qint64 maxGapMs = 2000;     // The filter restarts after a longer gap between two epochs
+    };
+
+    static Model modelFromString(const QString& name);
+
+    explicit PositionPredictor(const Options& options);
+
+    // Epochs without a fix or without a time are ignored
+    void update(const GpsData& gpsData);
+    void reset();
+    bool isValid() const { return _valid; }
+    qint64 lastEpochMs() const { return _timeMs; }
+
+    // Extrapolates the filtered state to utcMs, the filter itself is unchanged
+    bool predict(qint64 utcMs, Prediction& prediction) const;
+
+private:
+    struct Axis {
+        double x[3];        // Position, velocity, acceleration
+        double P[3][3];
+    };
+
+    void initialize(const GpsData& gpsData, double east, double north, double up);
+    void propagate(Axis& axis, double dt) const;
+    static void correct(Axis& axis, int state, double measurement, double variance);
+    void moveOrigin();
+
+    Options _options;
+    bool _valid;
+    qint64 _timeMs;
+    std::optional<Geodesy::EnuFrame> _frame;
+    Axis _axes[3];          // East, North, Up
+    int _fixQuality;
+    int _fixMode;
+    int _satellites;
+};
+
+#endif // PREDICTOR_H
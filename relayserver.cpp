@@ -0,0 +1,192 @@
+#include "relayserver.h"
+#include "metrics.h"
+#include "logger.h"
+#include "trace.h"
+#include <QDebug>
+
+static const qint64 MAX_REQUEST_SIZE = 8192;
+// Frames of an epoch are sent together: the block is only held this long waiting for its end
+static const int MAX_HOLD_MS = 50;
+
+RelayServer::RelayServer(const Options& options, QObject *parent)
+    : QObject(parent),
+      _options(options),
+      _server(new QTcpServer(this)),
+      _encoder(rtcmDeflateAvailable() ? RtcmCompression::DeltaDeflate : RtcmCompression::Delta),
+      _flushTimer(new QTimer(this))
+{
+    _flushTimer->setSingleShot(true);
+    _flushTimer->setInterval(MAX_HOLD_MS);
+    connect(_flushTimer, &QTimer::timeout, this, &RelayServer::flushBlock);
+    connect(_server, &QTcpServer::newConnection, this, &RelayServer::onNewConnection);
+    if (!_server->listen(_options.address, _options.port)) {
+        qWarning() << "Relay: failed to listen on" << _options.address.toString() << ":" << _options.port << _server->errorString();
+    } else {
+        qDebug() << "Relay: serving the corrections on" << _options.address.toString() << ":" << _options.port
+                 << (_options.compression ? QString("(compression %1)").arg(rtcmCompressionName(_encoder.method())) : QString());
+    }
+}
+
+RelayServer::~RelayServer()
+{
+    const RtcmStreamEncoder::Stats& stats = _encoder.stats();
+    if (stats.outputBytes > 0) {
+        RTK_LOG_INFO("relay", "Compressed relay stream closed", {"method", rtcmCompressionName(_encoder.method())},
+                     {"rtcm_bytes", static_cast<qint64>(stats.inputBytes)}, {"sent_bytes", static_cast<qint64>(stats.outputBytes)},
+                     {"ratio", static_cast<double>(stats.inputBytes) / stats.outputBytes});
+    }
+    const QList<QTcpSocket*> sockets = _clients.keys();
+    for (QTcpSocket* socket : sockets) {
+        removeClient(socket);
+    }
+}
+
+void RelayServer::onNewConnection()
+{
+    while (QTcpSocket* socket = _server->nextPendingConnection()) {
+        _clients.insert(socket, Client());
+        _clients[socket].connected.start();
+        connect(socket, &QTcpSocket::disconnected, this, [this, socket]() { removeClient(socket); });
+        connect(socket, &QTcpSocket::readyRead, this, [this, socket]() { handleRequest(socket); });
+    }
+}
+
+void RelayServer::handleRequest(QTcpSocket* socket)
+{
+    // Wait for the end of the request headers, nothing is expected afterwards
+    QByteArray request = socket->peek(MAX_REQUEST_SIZE);
+    if (!request.contains("\r\n\r\n")) {
+        if (request.size() >= MAX_REQUEST_SIZE) socket->abort();
+        return;
+    }
+    socket->readAll();
+    disconnect(socket, &QTcpSocket::readyRead, this, nullptr);
+
+    QList<QByteArray> lines = request.left(request.indexOf("\r\n\r\n")).split('\n');
+    QList<QByteArray> requestLine = lines.takeFirst().trimmed().split(' ');
+    bool ntrip2 = false;
+    QList<QByteArray> methods;
+    for (const QByteArray& line : std::as_const(lines)) {
+        int colon = line.indexOf(':');
+        QByteArray name = line.left(colon).trimmed().toLower();
+        QByteArray value = line.mid(colon + 1).trimmed();
+        if (name == "ntrip-version") {
+            ntrip2 = value.toLower() == "ntrip/2.0";
+        } else if (name == "x-rtcm-compression") {
+            for (const QByteArray& method : value.split(',')) methods.append(method.trimmed().toLower());
+        }
+    }
+
+    if (requestLine.size() < 2 || requestLine[0] != "GET") {
+        socket->write("HTTP/1.1 405 Method Not Allowed\r\nConnection: close\r\n\r\n");
+        socket->disconnectFromHost();
+        return;
+    }
+    if (requestLine[1] == "/") {
+        QByteArray table = "STR;" + _options.mountpoint.toUtf8() + ";;RTCM 3;;;;;;0.00;0.00;0;0;rtkrover;none;N;N;0;\r\n"
+                           "ENDSOURCETABLE\r\n";
+        socket->write((ntrip2 ? "HTTP/1.1 200 OK\r\nNtrip-Version: Ntrip/2.0\r\nContent-Type: gnss/sourcetable\r\n"
+                              : "SOURCETABLE 200 OK\r\nContent-Type: text/plain\r\n")
+                      + QByteArray("Content-Length: ") + QByteArray::number(table.size()) + "\r\nConnection: close\r\n\r\n" + table);
+        socket->disconnectFromHost();
+        return;
+    }
+
+    Client& client = _clients[socket];
+    client.streaming = true;
+    QByteArray method = rtcmCompressionName(_encoder.method());
+    client.compressed = _options.compression && methods.contains(method);
+    if (client.compressed || ntrip2) {
+        QByteArray response = "HTTP/1.1 200 OK\r\n"
+                              "Ntrip-Version: Ntrip/2.0\r\n"
+                              "Content-Type: gnss/data\r\n"
+                              "Cache-Control: no-store, no-cache, max-age=0\r\n"
+                              "Connection: close\r\n";
+        if (client.compressed) response += "X-Rtcm-Compression: " + method + "\r\n";
+        socket->write(response + "\r\n");
+    } else {
+        socket->write("ICY 200 OK\r\n\r\n");
+    }
+    if (client.compressed) {
+        ++_compressedClients;
+        _encoder.requestKeyframe();
+    }
+    Metrics::registry().relayClients.add(1);
+    RTK_LOG_INFO("relay", "Relay client connected", {"address", socket->peerAddress().toString()},
+                 {"mountpoint", QString::fromUtf8(requestLine[1].mid(1))},
+                 {"compression", client.compressed ? QString(method) : QString("none")});
+}
+
+void RelayServer::removeClient(QTcpSocket* socket)
+{
+    auto it = _clients.find(socket);
+    if (it == _clients.end()) return;
+    if (it->streaming) {
+        if (it->compressed) --_compressedClients;
+        Metrics::registry().relayClients.add(-1);
+        RTK_LOG_INFO("relay", "Relay client disconnected", {"address", socket->peerAddress().toString()},
+                     {"bytes", static_cast<qint64>(it->bytes)}, {"seconds", it->connected.elapsed() / 1000});
+    }
+    _clients.erase(it);
+    socket->disconnect(this);
+    socket->abort();
+    socket->deleteLater();
+}
+
+void RelayServer::send(QTcpSocket* socket, Client& client, const char* data, qsizetype size)
+{
+    // A gap in the stream would corrupt the compressed stream and the receiver's input: too slow clients are
+    // dropped, and the writes of the same event loop turn (other frames, the next block) are skipped
+    if (client.dead) {
+        return;
+    }
+    if (socket->bytesToWrite() + size > _options.highWaterMark) {
+        client.dead = true;
+        qWarning() << "Relay: client" << socket->peerAddress().toString() << "too slow, disconnecting";
+        QMetaObject::invokeMethod(this, [this, socket]() { removeClient(socket); }, Qt::QueuedConnection);
+        return;
+    }
+    socket->write(data, size);
+    client.bytes += size;
+    Metrics::registry().relaySentBytes.add(size);
+}
+
+void RelayServer::addPacket(const QByteArray& packet)
+{
+    RTK_TRACE_SCOPE("RelayServer::addPacket");
+    Metrics::registry().relayRtcmBytes.add(packet.size());
+    for (auto it = _clients.begin(); it != _clients.end(); ++it) {
+        if (it->streaming && !it->compressed) send(it.key(), *it, packet.constData(), packet.size());
+    }
+    if (_compressedClients == 0) {
+        return;
+    }
+
+    if (!_encoder.hasPending()) _blockStart.start();
+    if (_encoder.addFrame(reinterpret_cast<const unsigned char*>(packet.constData()), packet.size())) {
+        flushBlock();
+    } else if (!_flushTimer->isActive()) {
+        _flushTimer->start();
+    }
+}
+
+void RelayServer::flushBlock()
+{
+    RTK_TRACE_SCOPE("RelayServer::flushBlock");
+    _flushTimer->stop();
+    if (!_encoder.hasPending()) return;
+    bool keyframe;
+    _block.clear();
+    _encoder.flush(_block, keyframe);
+    Metrics::Registry& metrics = Metrics::registry();
+    metrics.relayBlocks.add();
+    metrics.relayHoldNs.add(_blockStart.nsecsElapsed());
+
+    const char* data = reinterpret_cast<const char*>(_block.data());
+    qsizetype size = static_cast<qsizetype>(_block.size());
+    for (auto it = _clients.begin(); it != _clients.end(); ++it) {
+        if (!it->compressed) continue;
+        if (keyframe) it->synchronized = true;
+        if (it->synchronized) send(it.key(), *it, data, size);
+    }
+}
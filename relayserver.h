@@ -0,0 +1,76 @@
+#ifndef RELAYSERVER_H
+#define RELAYSERVER_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QHostAddress>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+#include <vector>
+#include "rtcmcompress.h"
+
+/**
+ * Serves the caster stream of this rover to other rovers, as a single mount
+ * point NTRIP caster (any mount point name gives the stream).
+ *
+ * Clients whose request has an X-Rtcm-Compression header listing the method
+ * of the relay get the compressed stream (see RtcmStreamEncoder): the blocks
+ * are encoded once and shared by all of them. A new client asks for a
+ * keyframe and starts with it, the following block at the latest. The other
+ * clients get the RTCM frames as received.
+ */
+class RelayServer : public QObject
+{
+    Q_OBJECT
+public:
+    struct Options {
+        QHostAddress address = QHostAddress::LocalHost;   // Other hosts need an explicit address
+        int port = 2102;
+        QString mountpoint = "RELAY";       // Name given in the sourcetable
+        bool compression = true;            // Offer the compressed stream
+        qint64 highWaterMark = 256 * 1024;  // Bytes queued for a client before it is disconnected
+    };
+
+    explicit RelayServer(const Options& options, QObject *parent = nullptr);
+    ~RelayServer();
+
+    bool isListening() const { return _server->isListening(); }
+    QHostAddress serverAddress() const { return _server->serverAddress(); }
+    quint16 serverPort() const { return _server->serverPort(); }
+
+public slots:
+    void addPacket(const QByteArray& packet);
+
+private slots:
+    void onNewConnection();
+    void flushBlock();
+
+private:
+    struct Client {
+        bool streaming = false;         // Request answered
+        bool compressed = false;
+        bool synchronized = false;      // Compressed stream started with a keyframe
+        bool dead = false;              // Over the high-water mark: nothing more is written until it is removed
+        quint64 bytes = 0;
+        QElapsedTimer connected;
+    };
+
+    void handleRequest(QTcpSocket* socket);
+    void send(QTcpSocket* socket, Client& client, const char* data, qsizetype size);
+    void removeClient(QTcpSocket* socket);
+
+    Options _options;
+    QTcpServer* _server;
+    QHash<QTcpSocket*, Client> _clients;
+    int _compressedClients = 0;
+
+    RtcmStreamEncoder _encoder;
+    std::vector<unsigned char> _block;
+    QTimer* _flushTimer;
+    QElapsedTimer _blockStart;          // First frame of the block in progress
+};
+
+#endif // RELAYSERVER_H
@@ -0,0 +1,91 @@
+#include "rinexrecorder.h"
+#include "logger.h"
+#include <QDateTime>
+#include <QDebug>
+#include <QFileInfo>
+
+RinexRecorder::RinexRecorder(const Options& options, QObject *parent)
+    : QObject{parent},
+      _options(options)
+{
+}
+
+RinexRecorder::~RinexRecorder()
+{
+    closeFile();
+}
+
+void RinexRecorder::setMountPoint(const QString& mountpoint)
+{
+    if (mountpoint.isEmpty() || mountpoint == _mountpoint) {
+        return;
+    }
+    if (_writer) {
+        qDebug() << "RINEX: mount point changed from" << _mountpoint << "to" << mountpoint << ", starting a new file";
+    }
+    closeFile();
+    _mountpoint = mountpoint;
+    openFile();
+}
+
+void RinexRecorder::openFile()
+{
+    // Named after the start time, with a sequence number if the name is already taken
+    QString name = _options.fileName.contains("%1")
+                       ? _options.fileName.arg(QDateTime::currentDateTimeUtc().toString("yyyyMMdd_hhmmss"))
+                       : _options.fileName;
+    QFileInfo info(name);
+    QString base = info.path() + "/" + info.completeBaseName();
+    QString suffix = info.suffix().isEmpty() ? QString() : "." + info.suffix();
+    _fileName = name;
+    for (int sequence = 1; QFile::exists(_fileName); ++sequence) {
+        _fileName = base + "-" + QString::number(sequence) + suffix;
+    }
+
+    FileSink::Options fileOptions;
+    fileOptions.fileName = _fileName;
+    fileOptions.fsyncInterval = _options.fsyncInterval;
+    _sink = new FileSink(fileOptions);
+    if (!_sink->open()) {
+        qWarning() << "RINEX: can't open" << _fileName;
+    }
+
+    RinexObsWriter::Options writerOptions;
+    QString marker = _options.markerName.isEmpty() ? _mountpoint : _options.markerName;
+    writerOptions.markerName = marker.isEmpty() ? "UNKNOWN" : marker.toStdString();
+    writerOptions.headerDelay = _options.headerDelay;
+    _writer = new RinexObsWriter(writerOptions, [this](const char* data, size_t size) {
+        if (!_sink->isOpen()) return;
+        _sink->write(QByteArray(data, static_cast<qsizetype>(size)));
+    });
+    qDebug() << "RINEX: recording the observations of" << _mountpoint << "to" << _fileName;
+}
+
+void RinexRecorder::closeFile()
+{
+    if (!_writer) {
+        return;
+    }
+    _writer->flush();
+    const RinexObsWriter::Stats& stats = _writer->stats();
+    RTK_LOG_INFO("rinex", "RINEX file closed", {"file", _fileName}, {"epochs", static_cast<qint64>(stats.epochs)},
+                 {"observations", static_cast<qint64>(stats.observations)},
+                 {"skipped_signals", static_cast<qint64>(stats.skippedSignals)});
+    delete _writer;
+    _writer = nullptr;
+    delete _sink;
+    _sink = nullptr;
+}
+
+void RinexRecorder::addPacket(const QByteArray& packet)
+{
+    if (!_writer) {
+        return; // No stream yet
+    }
+    bool headerWritten = _writer->headerWritten();
+    _writer->addFrame(reinterpret_cast<const unsigned char*>(packet.constData()), packet.size(),
+                      QDateTime::currentMSecsSinceEpoch());
+    if (!headerWritten && _writer->headerWritten()) {
+        RTK_LOG_INFO("rinex", "RINEX header written", {"file", _fileName});
+    }
+}
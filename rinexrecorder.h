@@ -0,0 +1,50 @@
+#ifndef RINEXRECORDER_H
+#define RINEXRECORDER_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QString>
+#include "filesink.h"
+#include "rinexwriter.h"
+
+/**
+ * Records the observations of the caster stream as a RINEX 3 observation
+ * file (Qt adapter of RinexObsWriter). The file is written by a FileSink
+ * and holds a single header: it is not rotated. The observations of
+ * another mount point (another base) go to a new file with its own header,
+ * an existing file is never appended to.
+ */
+class RinexRecorder : public QObject
+{
+    Q_OBJECT
+public:
+    struct Options {
+        QString fileName;           // %1 is replaced by the UTC start time
+        QString markerName;         // Empty for the mount point
+        int headerDelay = 30;
+        int fsyncInterval = 1000;
+    };
+
+    explicit RinexRecorder(const Options& options, QObject *parent = nullptr);
+    ~RinexRecorder();
+
+    bool isOpen() const { return _sink && _sink->isOpen(); }
+
+    // Mount point of the stream: recording starts with the first one and a new file is started when it changes
+    void setMountPoint(const QString& mountpoint);
+
+public slots:
+    void addPacket(const QByteArray& packet);
+
+private:
+    void openFile();
+    void closeFile();
+
+    Options _options;
+    QString _mountpoint;
+    QString _fileName;
+    FileSink* _sink = nullptr;
+    RinexObsWriter* _writer = nullptr;
+};
+
+#endif // RINEXRECORDER_H
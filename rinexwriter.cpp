@@ -0,0 +1,374 @@
+#include "rinexwriter.h"
+#include "rtcmframer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+static const char SYSTEMS[4] = {'G', 'R', 'E', 'C'};
+static const int MAX_COLUMNS = 32 * 4;     // Signals × C, L, D, S
+static const int64_t DAY_MS = 86400000;
+
+static int systemIndex(char system)
+{
+    const char* p = static_cast<const char*>(memchr(SYSTEMS, system, sizeof(SYSTEMS)));
+    return p ? static_cast<int>(p - SYSTEMS) : -1;
+}
+
+// Calendar date of a number of days since 1970-01-01 (proleptic Gregorian calendar)
+static void civilFromDays(int64_t days, int& year, int& month, int& day)
+{
+    days += 719468;
+    int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    int64_t doe = days - era * 146097;
+    int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int64_t mp = (5 * doy + 2) / 153;
+    day = static_cast<int>(doy - (153 * mp + 2) / 5 + 1);
+    month = static_cast<int>(mp < 10 ? mp + 3 : mp - 9);
+    year = static_cast<int>(yoe + era * 400 + (month <= 2));
+}
+
+struct CalendarTime {
+    int year, month, day, hours, minutes;
+    double seconds;
+};
+
+// Calendar time of a time in ms since 1970-01-01 (in the same time scale)
+static CalendarTime calendarTime(int64_t unixMs)
+{
+    CalendarTime t;
+    int64_t days = (unixMs >= 0 ? unixMs : unixMs - DAY_MS + 1) / DAY_MS;
+    int64_t ms = unixMs - days * DAY_MS;
+    civilFromDays(days, t.year, t.month, t.day);
+    t.hours = static_cast<int>(ms / 3600000);
+    t.minutes = static_cast<int>(ms / 60000 % 60);
+    t.seconds = (ms % 60000) / 1000.0;
+    return t;
+}
+
+// GPS time in ms since 1980-01-06 to the same scale from 1970-01-01 (no leap seconds)
+static int64_t gpsToCalendarMs(int64_t gpsMs)
+{
+    return gpsMs + 315964800000;
+}
+
+static void appendHeaderLine(std::string& out, const char* content, const char* label)
+{
+    size_t start = out.size();
+    out += content;
+    out.resize(start + 60, ' ');
+    out += label;
+    out += '\n';
+}
+
+// Text field of a 1033 descriptor, truncated to 20 characters
+static std::string field20(const char* text)
+{
+    std::string s(text, strnlen(text, 20));
+    s.resize(20, ' ');
+    return s;
+}
+
+RinexObsWriter::RinexObsWriter(const Options& options, Sink sink)
+    : _options(options),
+    _sink(std::move(sink)),
+    _lockTime(4 * 64 * 33, -1),
+    _cells(RTCM_MSM_MAX_CELLS),
+    _values(4 * 64 * MAX_COLUMNS),
+    _flags(4 * 64 * MAX_COLUMNS * 2)
+{
+    for (int& channel : _glonassChannel) channel = RTCM_GLONASS_CHANNEL_UNKNOWN;
+    for (auto& columns : _column) {
+        for (int& column : columns) column = -1;
+    }
+    _data.reserve(16 * 1024);
+    _frames.reserve(64);
+    _out.reserve(16 * 1024);
+}
+
+void RinexObsWriter::addFrame(const unsigned char* frame, size_t length, int64_t receivedUnixMs)
+{
+    int type = rtcmMessageType(frame, length);
+    if (_createdUnixMs < 0) _createdUnixMs = receivedUnixMs;
+
+    if (type == 1005 || type == 1006) {
+        _haveStation = rtcmDecodeStation(frame, length, _station) || _haveStation;
+        return;
+    }
+    if (type == 1033) {
+        rtcmDecodeDescriptors(frame, length, _descriptors);
+        return;
+    }
+    if (!RtcmMsm::isSupported(type)) return;
+
+    // Only the header is read here, the observations are decoded when the epoch is written
+    RtcmMsm msm;
+    if (!msm.parse(frame, length)) return;
+    int64_t gpsMs = msm.gpsTimeMs(rtcmGpsTimeFromUnixMs(receivedUnixMs));
+    if (!_frames.empty() && !_frames.back().lastOfEpoch && _frames.back().gpsMs != gpsMs) {
+        // The end of the previous epoch was lost
+        _frames.back().lastOfEpoch = true;
+        endEpoch();
+    }
+    _frames.push_back(Frame{_data.size(), length, gpsMs, !msm.multipleMessage()});
+    _data.insert(_data.end(), frame, frame + length);
+    if (_frames.back().lastOfEpoch) endEpoch();
+}
+
+void RinexObsWriter::flush()
+{
+    if (!_frames.empty() && !_frames.back().lastOfEpoch) {
+        _frames.back().lastOfEpoch = true;
+        endEpoch();
+    }
+    if (!_headerWritten && !_frames.empty()) {
+        _heldEpochs = _options.headerDelay; // Write the held epochs without the station position
+        endEpoch();
+    }
+}
+
+void RinexObsWriter::endEpoch()
+{
+    if (!_headerWritten) {
+        if (!_frames.empty() && _frames.back().lastOfEpoch) ++_heldEpochs;
+        if (!_haveStation && _heldEpochs < _options.headerDelay) return;
+        writeHeader();
+    }
+    size_t first = 0;
+    for (size_t i = 0; i < _frames.size(); ++i) {
+        if (_frames[i].lastOfEpoch) {
+            writeEpoch(first, i + 1);
+            first = i + 1;
+        }
+    }
+    _frames.erase(_frames.begin(), _frames.begin() + first);
+    if (_frames.empty()) {
+        _data.clear();
+    }
+    output();
+}
+
+void RinexObsWriter::writeHeader()
+{
+    // Observation types: the signals of the held epochs
+    uint32_t signalMasks[4] = {};
+    for (const Frame& frame : _frames) {
+        RtcmMsm msm;
+        if (!msm.parse(_data.data() + frame.offset, frame.length)) continue;
+        int s = systemIndex(msm.system());
+        signalMasks[s] |= msm.signalMask();
+        _doppler[s] = _doppler[s] || msm.isMsm7();
+        if (msm.system() == 'R') {
+            for (int satellite = 1; satellite <= 64; ++satellite) {
+                int channel = msm.glonassChannel(satellite);
+                if (channel != RTCM_GLONASS_CHANNEL_UNKNOWN) _glonassChannel[satellite - 1] = channel;
+            }
+        }
+    }
+    int systemCount = 0;
+    for (int s = 0; s < 4; ++s) {
+        for (int signal = 1; signal <= 32; ++signal) {
+            if (((signalMasks[s] >> (32 - signal)) & 1u) && rtcmSignalCode(SYSTEMS[s], signal)) {
+                _column[s][signal] = _columnCount[s];
+                _columnCount[s] += _doppler[s] ? 4 : 3;
+            }
+        }
+        if (_columnCount[s]) ++systemCount;
+    }
+
+    char line[128];
+    char systemType = 'M';
+    for (int s = 0; systemCount == 1 && s < 4; ++s) {
+        if (_columnCount[s]) systemType = SYSTEMS[s];
+    }
+    snprintf(line, sizeof(line), "%9.2f%11s%-20s%c", 3.04, "", "OBSERVATION DATA", systemType);
+    appendHeaderLine(_out, line, "RINEX VERSION / TYPE");
+    CalendarTime created = calendarTime(_createdUnixMs);
+    snprintf(line, sizeof(line), "%-20.20s%-20.20s%04d%02d%02d %02d%02d%02d UTC ", _options.program.c_str(),
+             _options.runBy.c_str(), created.year, created.month, created.day, created.hours, created.minutes,
+             static_cast<int>(created.seconds));
+    appendHeaderLine(_out, line, "PGM / RUN BY / DATE");
+    appendHeaderLine(_out, _options.markerName.substr(0, 60).c_str(), "MARKER NAME");
+    appendHeaderLine(_out, "", "OBSERVER / AGENCY");
+    appendHeaderLine(_out, (field20(_descriptors.receiverSerial) + field20(_descriptors.receiver)
+                            + field20(_descriptors.firmware)).c_str(), "REC # / TYPE / VERS");
+    appendHeaderLine(_out, (field20(_descriptors.antennaSerial) + field20(_descriptors.antenna)).c_str(), "ANT # / TYPE");
+    snprintf(line, sizeof(line), "%14.4f%14.4f%14.4f", _station.x, _station.y, _station.z);
+    appendHeaderLine(_out, line, "APPROX POSITION XYZ");
+    snprintf(line, sizeof(line), "%14.4f%14.4f%14.4f", _station.antennaHeight, 0.0, 0.0);
+    appendHeaderLine(_out, line, "ANTENNA: DELTA H/E/N");
+
+    for (int s = 0; s < 4; ++s) {
+        if (!_columnCount[s]) continue;
+        snprintf(line, sizeof(line), "%c  %3d", SYSTEMS[s], _columnCount[s]);
+        std::string types = line;
+        int count = 0;
+        for (int signal = 1; signal <= 32; ++signal) {
+            if (_column[s][signal] < 0) continue;
+            const char* code = rtcmSignalCode(SYSTEMS[s], signal);
+            for (char observable : {'C', 'L', 'D', 'S'}) {
+                if (observable == 'D' && !_doppler[s]) continue;
+                if (count > 0 && count % 13 == 0) {
+                    appendHeaderLine(_out, types.c_str(), "SYS / # / OBS TYPES");
+                    types = "      ";
+                }
+                types += ' ';
+                types += observable;
+                types += code;
+                ++count;
+            }
+        }
+        appendHeaderLine(_out, types.c_str(), "SYS / # / OBS TYPES");
+    }
+    appendHeaderLine(_out, "DBHZ", "SIGNAL STRENGTH UNIT");
+
+    int64_t firstMs = _frames.empty() ? 0 : _frames.front().gpsMs;
+    CalendarTime first = calendarTime(gpsToCalendarMs(firstMs));
+    snprintf(line, sizeof(line), "%6d%6d%6d%6d%6d%13.7f     GPS", first.year, first.month, first.day, first.hours,
+             first.minutes, first.seconds);
+    appendHeaderLine(_out, line, "TIME OF FIRST OBS");
+
+    // Phase shifts and GLONASS biases are not known
+    for (int s = 0; s < 4; ++s) {
+        for (int signal = 1; signal <= 32; ++signal) {
+            if (_column[s][signal] < 0) continue;
+            snprintf(line, sizeof(line), "%c L%s", SYSTEMS[s], rtcmSignalCode(SYSTEMS[s], signal));
+            appendHeaderLine(_out, line, "SYS / PHASE SHIFT");
+        }
+    }
+    if (_columnCount[1]) {
+        int count = 0;
+        for (int channel : _glonassChannel) count += channel != RTCM_GLONASS_CHANNEL_UNKNOWN;
+        snprintf(line, sizeof(line), "%3d ", count);
+        std::string slots = line;
+        count = 0;
+        for (int slot = 1; slot <= 64; ++slot) {
+            if (_glonassChannel[slot - 1] == RTCM_GLONASS_CHANNEL_UNKNOWN) continue;
+            if (count > 0 && count % 8 == 0) {
+                appendHeaderLine(_out, slots.c_str(), "GLONASS SLOT / FRQ #");
+                slots = "    ";
+            }
+            snprintf(line, sizeof(line), "R%02d %2d ", slot, _glonassChannel[slot - 1]);
+            slots += line;
+            ++count;
+        }
+        appendHeaderLine(_out, slots.c_str(), "GLONASS SLOT / FRQ #");
+        snprintf(line, sizeof(line), " %-3s%9s %-3s%9s %-3s%9s %-3s%9s", "C1C", "", "C1P", "", "C2C", "", "C2P", "");
+        appendHeaderLine(_out, line, "GLONASS COD/PHS/BIS");
+    }
+    appendHeaderLine(_out, "", "END OF HEADER");
+    _headerWritten = true;
+}
+
+// F14.3 observation followed by the loss of lock and signal strength indicators, blank if unknown
+static void appendObservation(std::string& out, double value, char lli, char ssi)
+{
+    if (std::isnan(value) || std::fabs(value) >= 1e9) {
+        out.append(16, ' ');
+        return;
+    }
+    // Same text as %14.3f, without the cost of snprintf
+    int64_t scaled = std::llround(value * 1000.0);
+    uint64_t magnitude = static_cast<uint64_t>(scaled < 0 ? -scaled : scaled);
+    char text[16];
+    char* p = text + 14;
+    for (int i = 0; i < 3; ++i, magnitude /= 10) *--p = static_cast<char>('0' + magnitude % 10);
+    *--p = '.';
+    do {
+        *--p = static_cast<char>('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude);
+    if (scaled < 0) *--p = '-';
+    while (p > text) *--p = ' ';
+    text[14] = lli;
+    text[15] = ssi;
+    out.append(text, 16);
+}
+
+void RinexObsWriter::writeEpoch(size_t first, size_t last)
+{
+    for (auto& rows : _row) {
+        for (int& row : rows) row = -1;
+    }
+    int rowCount = 0;
+
+    for (size_t f = first; f < last; ++f) {
+        RtcmMsm msm;
+        if (!msm.parse(_data.data() + _frames[f].offset, _frames[f].length)) continue;
+        ++_stats.messages;
+        int s = systemIndex(msm.system());
+        int count = msm.decode(_cells.data());
+        for (int i = 0; i < count; ++i) {
+            const RtcmMsmCell& cell = _cells[i];
+            int column = _column[s][cell.signal];
+            if (column < 0) {
+                ++_stats.skippedSignals;
+                continue;
+            }
+            int& row = _row[s][cell.satellite - 1];
+            if (row < 0) {
+                row = rowCount++;
+                std::fill(_values.begin() + row * MAX_COLUMNS, _values.begin() + (row + 1) * MAX_COLUMNS, NAN);
+                std::fill(_flags.begin() + row * MAX_COLUMNS * 2, _flags.begin() + (row + 1) * MAX_COLUMNS * 2, ' ');
+            }
+            ++_stats.observations;
+
+            int glonassChannel = RTCM_GLONASS_CHANNEL_UNKNOWN;
+            if (msm.system() == 'R') {
+                int channel = msm.glonassChannel(cell.satellite);
+                if (channel != RTCM_GLONASS_CHANNEL_UNKNOWN) _glonassChannel[cell.satellite - 1] = channel;
+                glonassChannel = _glonassChannel[cell.satellite - 1];
+            }
+            double frequency = rtcmSignalFrequency(msm.system(), cell.signal, glonassChannel);
+            double wavelength = frequency > 0.0 ? RTCM_SPEED_OF_LIGHT / frequency : NAN;
+
+            // Loss of lock when the lock time went backwards, half-cycle ambiguity
+            int64_t& lockTime = _lockTime[((s * 64) + cell.satellite - 1) * 33 + cell.signal];
+            int lli = (lockTime >= 0 && cell.lockTimeMs < lockTime ? 1 : 0) | (cell.halfCycle ? 2 : 0);
+            lockTime = cell.lockTimeMs;
+            int ssi = cell.cnr > 0.0 ? std::min(9, std::max(1, static_cast<int>(cell.cnr / 6.0))) : 0;
+
+            double* values = &_values[row * MAX_COLUMNS + column];
+            char* flags = &_flags[(row * MAX_COLUMNS + column) * 2];
+            values[0] = cell.pseudorange;
+            values[1] = cell.phaseRange / wavelength;
+            flags[2] = lli ? static_cast<char>('0' + lli) : ' ';
+            flags[3] = ssi ? static_cast<char>('0' + ssi) : ' ';
+            if (_doppler[s]) values[2] = -cell.phaseRangeRate / wavelength;
+            values[_doppler[s] ? 3 : 2] = cell.cnr > 0.0 ? cell.cnr : NAN;
+        }
+    }
+    if (rowCount == 0) return;
+
+    CalendarTime t = calendarTime(gpsToCalendarMs(_frames[first].gpsMs));
+    char line[64];
+    snprintf(line, sizeof(line), "> %04d %02d %02d %02d %02d%11.7f  0%3d\n", t.year, t.month, t.day, t.hours,
+             t.minutes, t.seconds, rowCount);
+    _out += line;
+    for (int s = 0; s < 4; ++s) {
+        for (int satellite = 1; satellite <= 64; ++satellite) {
+            int row = _row[s][satellite - 1];
+            if (row < 0) continue;
+            snprintf(line, sizeof(line), "%c%02d", SYSTEMS[s], satellite);
+            _out += line;
+            for (int column = 0; column < _columnCount[s]; ++column) {
+                int index = row * MAX_COLUMNS + column;
+                appendObservation(_out, _values[index], _flags[index * 2], _flags[index * 2 + 1]);
+            }
+            // Trailing blanks are omitted
+            size_t end = _out.find_last_not_of(' ');
+            _out.resize(end + 1);
+            _out += '\n';
+        }
+    }
+    ++_stats.epochs;
+}
+
+void RinexObsWriter::output()
+{
+    if (!_out.empty()) {
+        _sink(_out.data(), _out.size());
+        _out.clear();
+    }
+}
@@ -0,0 +1,100 @@
+#ifndef RINEXWRITER_H
+#define RINEXWRITER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "rtcmdecoder.h"
+
+/**
+ * Streaming RINEX 3.04 observation writer fed with RTCM 3 frames.
+ *
+ * The MSM4/MSM7 messages of an epoch are kept as received and only decoded
+ * when the epoch is complete (multiple message bit cleared, or a message of
+ * a later epoch). The header needs the station position and the list of
+ * observation types, so the first epochs are held until a 1005/1006 message
+ * arrives (at most headerDelay epochs); the observation types are the
+ * signals seen in them. Signals that appear later are not written.
+ *
+ * All the times are GPS time. Pseudoranges, phases and Doppler need the
+ * carrier frequency: GLONASS phase and Doppler are only written for the
+ * satellites whose frequency channel was given by an MSM7 message.
+ */
+class RinexObsWriter
+{
+public:
+    using Sink = std::function<void(const char* data, size_t size)>;
+
+    struct Options {
+        std::string markerName = "UNKNOWN";
+        std::string program = "rtkrover";
+        std::string runBy;
+        int headerDelay = 30;       // Epochs held at most while waiting for the station position
+    };
+
+    struct Stats {
+        uint64_t epochs = 0;
+        uint64_t observations = 0;  // Signals written
+        uint64_t skippedSignals = 0; // Signals not in the header
+        uint64_t messages = 0;      // MSM messages decoded
+    };
+
+    RinexObsWriter(const Options& options, Sink sink);
+
+    // Frame as given by rtcmExtractFrames; the time of reception resolves the GPS week
+    void addFrame(const unsigned char* frame, size_t length, int64_t receivedUnixMs);
+    // Writes the epoch in progress (end of the stream)
+    void flush();
+
+    bool headerWritten() const { return _headerWritten; }
+    const Stats& stats() const { return _stats; }
+
+private:
+    struct Frame {
+        size_t offset;
+        size_t length;
+        int64_t gpsMs;
+        bool lastOfEpoch;           // The epoch ends with this frame
+    };
+
+    void endEpoch();
+    void writeHeader();
+    void writeEpoch(size_t first, size_t last);
+    void output();
+
+    Options _options;
+    Sink _sink;
+    Stats _stats;
+    bool _headerWritten = false;
+    int64_t _createdUnixMs = -1;
+
+    // Frames of the epochs not written yet (all the held epochs until the header is written)
+    std::vector<unsigned char> _data;
+    std::vector<Frame> _frames;
+    int _heldEpochs = 0;
+
+    // Header
+    bool _haveStation = false;
+    RtcmStation _station;
+    RtcmDescriptors _descriptors;
+    int _glonassChannel[64];
+
+    // Observation types per system (G, R, E, C): column of the first observation of each signal, -1 if not written
+    int _column[4][33];
+    int _columnCount[4] = {};
+    bool _doppler[4] = {};
+
+    // Last lock time of each satellite and signal, -1 if unknown
+    std::vector<int64_t> _lockTime;
+
+    // Epoch formatting, reused
+    std::vector<RtcmMsmCell> _cells;
+    std::vector<double> _values;
+    std::vector<char> _flags;       // Loss of lock and signal strength of each value
+    int _row[4][64];                // Row of each satellite in the epoch, -1 if none
+    std::string _out;
+};
+
+#endif // RINEXWRITER_H
@@ -0,0 +1,109 @@
+#include "roverstate.h"
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+
+bool RoverState::load(const QString& fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    QJsonParseError error;
+    QJsonObject root = QJsonDocument::fromJson(file.readAll(), &error).object();
+    if (error.error != QJsonParseError::NoError) {
+        qWarning() << "State: invalid state file" << fileName << error.errorString();
+        return false;
+    }
+
+    QJsonObject position = root.value("position").toObject();
+    hasPosition = !position.isEmpty();
+    latitude = position.value("latitude").toDouble();
+    longitude = position.value("longitude").toDouble();
+    altitude = position.value("altitude").toDouble();
+    positionTimeMs = static_cast<qint64>(position.value("time_ms").toDouble());
+
+    QJsonObject ntrip = root.value("ntrip").toObject();
+    host = ntrip.value("host").toString();
+    mountpoint = ntrip.value("mountpoint").toString();
+    sourcetableDigest = ntrip.value("sourcetable_sha1").toString().toLatin1();
+
+    QJsonObject receiver = root.value("receiver").toObject();
+    receiverSerialNumber = receiver.value("serial_number").toString();
+    receiverPort = receiver.value("port").toString();
+    receiverBaud = receiver.value("baud").toInt();
+    receiverName = receiver.value("name").toString();
+
+    timeToRtkFixMs = static_cast<qint64>(root.value("time_to_rtk_fix_ms").toDouble(-1));
+    warmStart = root.value("warm_start").toBool();
+    return true;
+}
+
+// Written to a temporary file then renamed, a crash never leaves a truncated state
+bool RoverState::save(const QString& fileName) const
+{
+    QJsonObject root;
+    if (hasPosition) {
+        root.insert("position", QJsonObject{
+            {"latitude", latitude},
+            {"longitude", longitude},
+            {"altitude", altitude},
+            {"time_ms", static_cast<double>(positionTimeMs)}
+        });
+    }
+    root.insert("ntrip", QJsonObject{
+        {"host", host},
+        {"mountpoint", mountpoint},
+        {"sourcetable_sha1", QString::fromLatin1(sourcetableDigest)}
+    });
+    if (!receiverPort.isEmpty()) {
+        root.insert("receiver", QJsonObject{
+            {"serial_number", receiverSerialNumber},
+            {"port", receiverPort},
+            {"baud", receiverBaud},
+            {"name", receiverName}
+        });
+    }
+    root.insert("time_to_rtk_fix_ms", static_cast<double>(timeToRtkFixMs));
+    root.insert("warm_start", warmStart);
+
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "State: failed to write" << fileName << file.errorString();
+        return false;
+    }
+    file.write(QJsonDocument(root).toJson());
+    return file.commit();
+}
+
+QByteArray RoverState::digest(const QByteArray& sourcetable)
+{
+    return QCryptographicHash::hash(sourcetable, QCryptographicHash::Sha1).toHex();
+}
+
+QByteArray RoverState::loadSourcetable(const QString& fileName) const
+{
+    QFile file(fileName + ".sourcetable");
+    if (sourcetableDigest.isEmpty() || !file.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+    QByteArray sourcetable = file.readAll();
+    return digest(sourcetable) == sourcetableDigest ? sourcetable : QByteArray();
+}
+
+bool RoverState::saveSourcetable(const QString& fileName, const QByteArray& sourcetable)
+{
+    QSaveFile file(fileName + ".sourcetable");
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    file.write(sourcetable);
+    if (!file.commit()) {
+        return false;
+    }
+    sourcetableDigest = digest(sourcetable);
+    return true;
+}
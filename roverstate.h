@@ -0,0 +1,42 @@
+#ifndef ROVERSTATE_H
+#define ROVERSTATE_H
+
+#include <QByteArray>
+#include <QString>
+
+/**
+ * State kept between two runs of the rover, for a warm start: the last
+ * good position, the mount point in use, the digest of the caster
+ * sourcetable and the detected receiver port. The sourcetable itself is cached next to the state file
+ * (<file>.sourcetable) and only used if its digest matches.
+ */
+struct RoverState {
+    bool hasPosition = false;
+    double latitude = 0.0;
+    double longitude = 0.0;
+    double altitude = 0.0;
+    qint64 positionTimeMs = 0;      // UTC, 0 if unknown
+
+    QString host;                   // Caster of the mount point
+    QString mountpoint;
+    QByteArray sourcetableDigest;   // SHA-1, hex
+
+    // Receiver found by the serial autodetection, reused while its USB device is connected
+    QString receiverSerialNumber;   // USB serial number, empty for another port
+    QString receiverPort;
+    int receiverBaud = 0;
+    QString receiverName;
+
+    qint64 timeToRtkFixMs = -1;     // Of the last run that reached an RTK fix, -1 if none did
+    bool warmStart = false;         // Whether that run started warm
+
+    bool load(const QString& fileName);
+    bool save(const QString& fileName) const;
+
+    static QByteArray digest(const QByteArray& sourcetable);
+    // The cached sourcetable, empty if missing or if it does not match the digest
+    QByteArray loadSourcetable(const QString& fileName) const;
+    bool saveSourcetable(const QString& fileName, const QByteArray& sourcetable);
+};
+
+#endif // ROVERSTATE_H
@@ -0,0 +1,141 @@
+#ifndef RTCMBITS_H
+#define RTCMBITS_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Bit field access of RTCM 3 messages.
+ *
+ * The fields are big-endian and not byte aligned. The width is a template
+ * argument, so each read is specialized for the number of bytes it can span
+ * and the loop is unrolled; the functions are constexpr. Positions are in
+ * bits from the start of the data given (the payload for a decoder, i.e.
+ * frame + 3).
+ */
+template <unsigned Width>
+constexpr uint64_t rtcmGetUnsigned(const unsigned char* data, size_t bitPos)
+{
+    static_assert(Width >= 1 && Width <= 64, "RTCM fields are 1 to 64 bits wide");
+    if constexpr (Width > 56) {
+        // Could span 9 bytes: two reads
+        return (rtcmGetUnsigned<Width - 32>(data, bitPos) << 32) | rtcmGetUnsigned<32>(data, bitPos + Width - 32);
+    } else {
+        constexpr unsigned MAX_BYTES = (Width + 7 + 7) / 8;
+        const unsigned char* p = data + bitPos / 8;
+        unsigned shift = static_cast<unsigned>(bitPos % 8);
+        unsigned bytes = (shift + Width + 7) / 8;
+        uint64_t value = 0;
+        for (unsigned i = 0; i < MAX_BYTES; ++i) {
+            if (i < bytes) value = (value << 8) | p[i];
+        }
+        value >>= bytes * 8 - shift - Width;
+        return value & ((uint64_t(1) << Width) - 1);
+    }
+}
+
+// Two's complement field
+template <unsigned Width>
+constexpr int64_t rtcmGetSigned(const unsigned char* data, size_t bitPos)
+{
+    uint64_t value = rtcmGetUnsigned<Width>(data, bitPos);
+    if constexpr (Width < 64) {
+        if (value & (uint64_t(1) << (Width - 1))) value |= ~uint64_t(0) << Width;
+    }
+    return static_cast<int64_t>(value);
+}
+
+// Field whose width is only known at run time (cell mask)
+inline uint64_t rtcmGetUnsigned(const unsigned char* data, size_t bitPos, unsigned width)
+{
+    uint64_t value = 0;
+    for (unsigned i = 0; i < width; ++i, ++bitPos) {
+        value = (value << 1) | ((data[bitPos / 8] >> (7 - bitPos % 8)) & 1u);
+    }
+    return value;
+}
+
+// Writes the width low bits of value, the other bits of the bytes are kept
+constexpr void rtcmSetUnsigned(unsigned char* data, size_t bitPos, unsigned width, uint64_t value)
+{
+    for (unsigned i = 0; i < width; ++i, ++bitPos) {
+        unsigned char mask = static_cast<unsigned char>(0x80u >> (bitPos % 8));
+        if ((value >> (width - 1 - i)) & 1u) {
+            data[bitPos / 8] |= mask;
+        } else {
+            data[bitPos / 8] &= static_cast<unsigned char>(~mask);
+        }
+    }
+}
+
+template <unsigned Width>
+constexpr void rtcmSetUnsigned(unsigned char* data, size_t bitPos, uint64_t value)
+{
+    static_assert(Width >= 1 && Width <= 64, "RTCM fields are 1 to 64 bits wide");
+    rtcmSetUnsigned(data, bitPos, Width, value);
+}
+
+// Sequential reader over a message payload
+class RtcmBitReader
+{
+public:
+    constexpr RtcmBitReader(const unsigned char* data, size_t sizeBytes, size_t bitPos = 0)
+        : _data(data), _sizeBits(sizeBytes * 8), _pos(bitPos) {}
+
+    template <unsigned Width>
+    constexpr uint64_t u()
+    {
+        uint64_t value = rtcmGetUnsigned<Width>(_data, _pos);
+        _pos += Width;
+        return value;
+    }
+
+    template <unsigned Width>
+    constexpr int64_t s()
+    {
+        int64_t value = rtcmGetSigned<Width>(_data, _pos);
+        _pos += Width;
+        return value;
+    }
+
+    constexpr void skip(size_t bits) { _pos += bits; }
+    constexpr size_t position() const { return _pos; }
+    // True if bits more bits can be read
+    constexpr bool has(size_t bits) const { return _pos + bits <= _sizeBits; }
+
+private:
+    const unsigned char* _data;
+    size_t _sizeBits;
+    size_t _pos;
+};
+
+// Sequential writer, the buffer must be large enough
+class RtcmBitWriter
+{
+public:
+    constexpr explicit RtcmBitWriter(unsigned char* data, size_t bitPos = 0) : _data(data), _pos(bitPos) {}
+
+    template <unsigned Width>
+    constexpr void u(uint64_t value)
+    {
+        rtcmSetUnsigned<Width>(_data, _pos, value);
+        _pos += Width;
+    }
+
+    template <unsigned Width>
+    constexpr void s(int64_t value) { u<Width>(static_cast<uint64_t>(value)); }
+
+    constexpr void u(uint64_t value, unsigned width)
+    {
+        rtcmSetUnsigned(_data, _pos, width, value);
+        _pos += width;
+    }
+
+    constexpr size_t position() const { return _pos; }
+
+private:
+    unsigned char* _data;
+    size_t _pos;
+};
+
+#endif // RTCMBITS_H
@@ -0,0 +1,835 @@
+#include "rtcmcompress.h"
+#include "rtcmbits.h"
+#include "rtcmdecoder.h"
+#include "crc24q.h"
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#ifdef RTKCORE_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+static const size_t RTCM_HEADER_SIZE = 3;
+static const size_t RTCM_CRC_SIZE = 3;
+static const size_t RTCM_MAX_PAYLOAD = 1023;
+static const size_t MSM_HEADER_BITS = 169;     // Up to the cell mask
+static const size_t MAX_BLOCK_SIZE = 1 << 20;
+static const unsigned char SYNC_FLUSH_TAIL[4] = {0x00, 0x00, 0xFF, 0xFF};
+
+// Phase-range rate (0.0001 m/s) of a phase change of one MSM7 unit (2^-31 ms) per ms, Q16
+static const int64_t PHASE_TO_RATE_Q16 = 91489396;
+
+enum RecordKind {
+    RecordRaw = 0,          // Header bytes and payload
+    RecordRepeat = 1,       // Same frame as the previous one of the type
+    RecordMsm = 2           // Residuals of the predictions
+};
+
+enum MsmFlag {
+    MasksChanged = 1,
+    IrregularPayload = 2,   // Padding bits set or payload longer than the observations
+    ReservedBits = 4        // Reserved bits of the frame header set
+};
+
+const char* rtcmCompressionName(RtcmCompression method)
+{
+    return method == RtcmCompression::DeltaDeflate ? "delta-deflate" : "delta";
+}
+
+bool rtcmCompressionFromName(const std::string& name, RtcmCompression& method)
+{
+    if (name == "delta") {
+        method = RtcmCompression::Delta;
+    } else if (name == "delta-deflate" && rtcmDeflateAvailable()) {
+        method = RtcmCompression::DeltaDeflate;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool rtcmDeflateAvailable()
+{
+#ifdef RTKCORE_HAVE_ZLIB
+    return true;
+#else
+    return false;
+#endif
+}
+
+static int popcount64(uint64_t value)
+{
+    int count = 0;
+    for (; value; value &= value - 1) ++count;
+    return count;
+}
+
+static bool fitsUnsigned(int64_t value, unsigned width)
+{
+    return value >= 0 && value < (int64_t(1) << width);
+}
+
+static bool fitsSigned(int64_t value, unsigned width)
+{
+    return value >= -(int64_t(1) << (width - 1)) && value < (int64_t(1) << (width - 1));
+}
+
+// Records: LEB128 values, signed ones zigzag coded
+class RecordWriter
+{
+public:
+    static constexpr bool encoding = true;
+
+    explicit RecordWriter(std::vector<unsigned char>& out) : _out(out) {}
+
+    void putUnsigned(uint64_t value)
+    {
+        while (value >= 0x80) {
+            _out.push_back(static_cast<unsigned char>(value | 0x80));
+            value >>= 7;
+        }
+        _out.push_back(static_cast<unsigned char>(value));
+    }
+
+    void put(int64_t value) { putUnsigned((static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63)); }
+    void putBytes(const unsigned char* data, size_t size) { _out.insert(_out.end(), data, data + size); }
+
+    // The value as its residual from the prediction
+    bool code(int64_t& value, int64_t prediction)
+    {
+        put(value - prediction);
+        return true;
+    }
+
+private:
+    std::vector<unsigned char>& _out;
+};
+
+class RecordReader
+{
+public:
+    static constexpr bool encoding = false;
+
+    RecordReader(const unsigned char* data, size_t size) : _pos(data), _end(data + size) {}
+
+    bool atEnd() const { return _pos == _end; }
+
+    bool getUnsigned(uint64_t& value)
+    {
+        value = 0;
+        for (unsigned shift = 0; shift < 64 && _pos != _end; shift += 7) {
+            unsigned char byte = *_pos++;
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) return true;
+        }
+        return false;
+    }
+
+    bool get(int64_t& value)
+    {
+        uint64_t zigzag;
+        if (!getUnsigned(zigzag)) return false;
+        value = static_cast<int64_t>(zigzag >> 1) ^ -static_cast<int64_t>(zigzag & 1);
+        return true;
+    }
+
+    bool getBytes(unsigned char* data, size_t size)
+    {
+        if (static_cast<size_t>(_end - _pos) < size) return false;
+        memcpy(data, _pos, size);
+        _pos += size;
+        return true;
+    }
+
+    bool code(int64_t& value, int64_t prediction)
+    {
+        int64_t residual;
+        if (!get(residual)) return false;
+        value = static_cast<int64_t>(static_cast<uint64_t>(prediction) + static_cast<uint64_t>(residual));
+        return true;
+    }
+
+private:
+    const unsigned char* _pos;
+    const unsigned char* _end;
+};
+
+// Fields of an MSM4/MSM7 message. The rough range (ms × 1024) and the rough rate are added to
+// the fine values of the cells, so that the values of a cell change smoothly.
+struct MsmFields {
+    int type;
+    bool msm7;
+    uint32_t header;            // Station (12 bits), IODS to smoothing interval (18), multiple message bit
+    uint32_t epoch;
+    uint64_t satelliteMask;
+    uint32_t signalMask;
+    uint64_t cellMask;
+    int satelliteCount;
+    int signalCount;
+    int cellCount;
+    size_t dataBits;            // End of the observations in the payload
+    int satellites[64];         // PRN of each satellite
+    int cellSatellite[64];      // Satellite index of each cell
+    int cellSignal[64];
+    int64_t rough[64];
+    int64_t extended[64];
+    int64_t roughRate[64];
+    int64_t range[64];
+    int64_t phase[64];
+    int64_t rate[64];
+    int64_t lock[64];
+    int64_t halfCycle[64];
+    int64_t cnr[64];
+
+    unsigned rangeShift() const { return msm7 ? 19 : 14; }     // Fine pseudorange units per rough range unit
+    unsigned phaseShift() const { return msm7 ? 21 : 19; }
+    unsigned rangeWidth() const { return msm7 ? 20 : 15; }
+    unsigned phaseWidth() const { return msm7 ? 24 : 22; }
+    unsigned lockWidth() const { return msm7 ? 10 : 4; }
+    unsigned cnrWidth() const { return msm7 ? 10 : 6; }
+};
+
+// Satellites and cells of the masks, false if there are too many cells
+static bool msmLayout(MsmFields& m)
+{
+    m.satelliteCount = popcount64(m.satelliteMask);
+    m.signalCount = popcount64(m.signalMask);
+    int maskBits = m.satelliteCount * m.signalCount;
+    if (maskBits > RTCM_MSM_MAX_CELLS) return false;
+    int signals[32];
+    for (int prn = 1, i = 0; prn <= 64; ++prn) {
+        if ((m.satelliteMask >> (64 - prn)) & 1u) m.satellites[i++] = prn;
+    }
+    for (int id = 1, i = 0; id <= 32; ++id) {
+        if ((m.signalMask >> (32 - id)) & 1u) signals[i++] = id;
+    }
+    m.cellCount = 0;
+    for (int i = 0, bit = maskBits - 1; i < m.satelliteCount; ++i) {
+        for (int j = 0; j < m.signalCount; ++j, --bit) {
+            if ((m.cellMask >> bit) & 1u) {
+                m.cellSatellite[m.cellCount] = i;
+                m.cellSignal[m.cellCount] = signals[j];
+                ++m.cellCount;
+            }
+        }
+    }
+    m.dataBits = MSM_HEADER_BITS + maskBits
+        + (m.msm7 ? m.satelliteCount * 36 + m.cellCount * 80 : m.satelliteCount * 18 + m.cellCount * 48);
+    return true;
+}
+
+static bool parseMsm(const unsigned char* frame, size_t length, MsmFields& m)
+{
+    if (length < RTCM_HEADER_SIZE + RTCM_CRC_SIZE + (MSM_HEADER_BITS + 7) / 8) return false;
+    const unsigned char* payload = frame + RTCM_HEADER_SIZE;
+    size_t payloadSize = length - RTCM_HEADER_SIZE - RTCM_CRC_SIZE;
+    RtcmBitReader bits(payload, payloadSize);
+    m.type = static_cast<int>(bits.u<12>());
+    if (!RtcmMsm::isSupported(m.type)) return false;
+    m.msm7 = m.type % 10 == 7;
+    uint32_t station = static_cast<uint32_t>(bits.u<12>());
+    m.epoch = static_cast<uint32_t>(bits.u<30>());
+    uint32_t more = static_cast<uint32_t>(bits.u<1>());
+    m.header = station << 19 | static_cast<uint32_t>(bits.u<18>()) << 1 | more;
+    m.satelliteMask = bits.u<64>();
+    m.signalMask = static_cast<uint32_t>(bits.u<32>());
+    int maskBits = popcount64(m.satelliteMask) * popcount64(m.signalMask);
+    if (maskBits > RTCM_MSM_MAX_CELLS || !bits.has(maskBits)) return false;
+    m.cellMask = rtcmGetUnsigned(payload, bits.position(), maskBits);
+    bits.skip(maskBits);
+    if (!msmLayout(m) || m.dataBits > payloadSize * 8) return false;
+
+    const int ns = m.satelliteCount, nc = m.cellCount;
+    if (m.msm7) {
+        for (int i = 0; i < ns; ++i) m.rough[i] = static_cast<int64_t>(bits.u<8>()) << 10;
+        for (int i = 0; i < ns; ++i) m.extended[i] = static_cast<int64_t>(bits.u<4>());
+        for (int i = 0; i < ns; ++i) m.rough[i] |= static_cast<int64_t>(bits.u<10>());
+        for (int i = 0; i < ns; ++i) m.roughRate[i] = bits.s<14>();
+        for (int c = 0; c < nc; ++c) m.range[c] = (m.rough[m.cellSatellite[c]] << 19) + bits.s<20>();
+        for (int c = 0; c < nc; ++c) m.phase[c] = (m.rough[m.cellSatellite[c]] << 21) + bits.s<24>();
+        for (int c = 0; c < nc; ++c) m.lock[c] = static_cast<int64_t>(bits.u<10>());
+        for (int c = 0; c < nc; ++c) m.halfCycle[c] = static_cast<int64_t>(bits.u<1>());
+        for (int c = 0; c < nc; ++c) m.cnr[c] = static_cast<int64_t>(bits.u<10>());
+        for (int c = 0; c < nc; ++c) m.rate[c] = m.roughRate[m.cellSatellite[c]] * 10000 + bits.s<15>();
+    } else {
+        for (int i = 0; i < ns; ++i) m.rough[i] = static_cast<int64_t>(bits.u<8>()) << 10;
+        for (int i = 0; i < ns; ++i) m.rough[i] |= static_cast<int64_t>(bits.u<10>());
+        for (int c = 0; c < nc; ++c) m.range[c] = (m.rough[m.cellSatellite[c]] << 14) + bits.s<15>();
+        for (int c = 0; c < nc; ++c) m.phase[c] = (m.rough[m.cellSatellite[c]] << 19) + bits.s<22>();
+        for (int c = 0; c < nc; ++c) m.lock[c] = static_cast<int64_t>(bits.u<4>());
+        for (int c = 0; c < nc; ++c) m.halfCycle[c] = static_cast<int64_t>(bits.u<1>());
+        for (int c = 0; c < nc; ++c) m.cnr[c] = static_cast<int64_t>(bits.u<6>());
+    }
+    return true;
+}
+
+// Writes the fields into a payload, the bits after the observations are kept
+static void writeMsm(const MsmFields& m, unsigned char* payload)
+{
+    RtcmBitWriter bits(payload);
+    bits.u<12>(m.type);
+    bits.u<12>(m.header >> 19);
+    bits.u<30>(m.epoch);
+    bits.u<1>(m.header & 1u);
+    bits.u<18>((m.header >> 1) & 0x3FFFF);
+    bits.u<64>(m.satelliteMask);
+    bits.u<32>(m.signalMask);
+    bits.u(m.cellMask, m.satelliteCount * m.signalCount);
+
+    const int ns = m.satelliteCount, nc = m.cellCount;
+    auto rough = [&m](int c) { return m.rough[m.cellSatellite[c]]; };
+    if (m.msm7) {
+        for (int i = 0; i < ns; ++i) bits.u<8>(m.rough[i] >> 10);
+        for (int i = 0; i < ns; ++i) bits.u<4>(m.extended[i]);
+        for (int i = 0; i < ns; ++i) bits.u<10>(m.rough[i] & 0x3FF);
+        for (int i = 0; i < ns; ++i) bits.s<14>(m.roughRate[i]);
+        for (int c = 0; c < nc; ++c) bits.s<20>(m.range[c] - (rough(c) << 19));
+        for (int c = 0; c < nc; ++c) bits.s<24>(m.phase[c] - (rough(c) << 21));
+        for (int c = 0; c < nc; ++c) bits.u<10>(m.lock[c]);
+        for (int c = 0; c < nc; ++c) bits.u<1>(m.halfCycle[c]);
+        for (int c = 0; c < nc; ++c) bits.u<10>(m.cnr[c]);
+        for (int c = 0; c < nc; ++c) bits.s<15>(m.rate[c] - m.roughRate[m.cellSatellite[c]] * 10000);
+    } else {
+        for (int i = 0; i < ns; ++i) bits.u<8>(m.rough[i] >> 10);
+        for (int i = 0; i < ns; ++i) bits.u<10>(m.rough[i] & 0x3FF);
+        for (int c = 0; c < nc; ++c) bits.s<15>(m.range[c] - (rough(c) << 14));
+        for (int c = 0; c < nc; ++c) bits.s<22>(m.phase[c] - (rough(c) << 19));
+        for (int c = 0; c < nc; ++c) bits.u<4>(m.lock[c]);
+        for (int c = 0; c < nc; ++c) bits.u<1>(m.halfCycle[c]);
+        for (int c = 0; c < nc; ++c) bits.u<6>(m.cnr[c]);
+    }
+}
+
+// Median of the residuals of the selected cells, 0 if none
+static int64_t commonTerm(const int64_t* values, const int64_t* predictions, const bool* selected, int count)
+{
+    int64_t residuals[64];
+    int n = 0;
+    for (int c = 0; c < count; ++c) {
+        if (selected[c]) residuals[n++] = values[c] - predictions[c];
+    }
+    if (n == 0) return 0;
+    std::nth_element(residuals, residuals + n / 2, residuals + n);
+    return residuals[n / 2];
+}
+
+// Observations of an MSM message, coded the same way in both directions. The decoder checks that
+// the values fit their fields, so that the history never holds values out of range.
+template <class Channel>
+static bool codeObservations(Channel& channel, MsmFields& m, RtcmDeltaState::Slot& slot)
+{
+    constexpr bool decoding = !Channel::encoding;
+    if (slot.cells.empty()) slot.cells.resize(64 * 32);
+    const int64_t invalidPhase = -(int64_t(1) << (m.phaseWidth() - 1));
+
+    for (int i = 0; i < m.satelliteCount; ++i) {
+        const RtcmDeltaState::Satellite& h = slot.satellites[m.satellites[i] - 1];
+        int64_t prediction = h.count >= 2 ? 2 * h.rough[0] - h.rough[1] : h.count == 1 ? h.rough[0] : 0;
+        if (!channel.code(m.rough[i], prediction)) return false;
+        if (decoding && !fitsUnsigned(m.rough[i], 18)) return false;
+        if (m.msm7) {
+            if (!channel.code(m.extended[i], h.count ? h.extended : 0)) return false;
+            if (!channel.code(m.roughRate[i], h.count ? h.roughRate : 0)) return false;
+            if (decoding && (!fitsUnsigned(m.extended[i], 4) || !fitsSigned(m.roughRate[i], 14))) return false;
+        } else {
+            m.extended[i] = 0;
+            m.roughRate[i] = 0;
+        }
+    }
+
+    const RtcmDeltaState::Cell* history[64];
+    int64_t prediction[64];
+    bool aided[64];
+    for (int c = 0; c < m.cellCount; ++c) {
+        history[c] = &slot.cells[(m.satellites[m.cellSatellite[c]] - 1) * 32 + m.cellSignal[c] - 1];
+    }
+    auto rough = [&m](int c) { return m.rough[m.cellSatellite[c]]; };
+
+    // Carrier phase: extrapolated from the last three epochs, the receiver clock is common to all the cells
+    for (int c = 0; c < m.cellCount; ++c) {
+        const RtcmDeltaState::Cell& h = *history[c];
+        const int64_t* p = h.phase;
+        prediction[c] = h.count >= 3 ? 3 * p[0] - 3 * p[1] + p[2]
+                      : h.count == 2 ? 2 * p[0] - p[1]
+                      : h.count == 1 ? p[0] : rough(c) << m.phaseShift();
+        aided[c] = h.count >= 3;
+    }
+    int64_t clock = 0;
+    if constexpr (Channel::encoding) clock = commonTerm(m.phase, prediction, aided, m.cellCount);
+    if (!channel.code(clock, 0)) return false;
+    for (int c = 0; c < m.cellCount; ++c) {
+        if (!channel.code(m.phase[c], prediction[c] + (aided[c] ? clock : 0))) return false;
+        if (decoding && !fitsSigned(m.phase[c] - (rough(c) << m.phaseShift()), m.phaseWidth())) return false;
+    }
+
+    // Pseudorange: follows the phase change (code and carrier move together)
+    bool phaseValid[64];
+    for (int c = 0; c < m.cellCount; ++c) {
+        const RtcmDeltaState::Cell& h = *history[c];
+        phaseValid[c] = m.phase[c] - (rough(c) << m.phaseShift()) != invalidPhase;
+        int64_t p;
+        if (h.count >= 1 && h.phaseValid && phaseValid[c]) {
+            p = h.range[0] + (m.phase[c] - h.phase[0]) / (int64_t(1) << (m.phaseShift() - m.rangeShift()));
+        } else {
+            p = h.count >= 2 ? 2 * h.range[0] - h.range[1] : h.count == 1 ? h.range[0] : rough(c) << m.rangeShift();
+        }
+        if (!channel.code(m.range[c], p)) return false;
+        if (decoding && !fitsSigned(m.range[c] - (rough(c) << m.rangeShift()), m.rangeWidth())) return false;
+    }
+
+    // Phase-range rate: the rate at the end of the phase change since the last epoch, with a common term
+    if (m.msm7) {
+        for (int c = 0; c < m.cellCount; ++c) {
+            const RtcmDeltaState::Cell& h = *history[c];
+            int64_t interval = static_cast<int64_t>(m.epoch) - h.epoch;
+            int64_t change = m.phase[c] - h.phase[0];
+            aided[c] = h.count >= 1 && h.phaseValid && phaseValid[c] && interval > 0 && interval <= 60000
+                    && change > -(int64_t(1) << 34) && change < (int64_t(1) << 34);
+            if (aided[c]) {
+                // The average rate is the rate at the middle of the interval, add half the change
+                // of the average rate since the previous interval (assumed of the same length)
+                int64_t average = change * PHASE_TO_RATE_Q16 / (interval << 16);
+                int64_t previousChange = h.phase[0] - h.phase[1];
+                if (h.count >= 2 && previousChange > -(int64_t(1) << 34) && previousChange < (int64_t(1) << 34)) {
+                    int64_t previousAverage = previousChange * PHASE_TO_RATE_Q16 / (interval << 16);
+                    prediction[c] = average + (average - previousAverage) / 2;
+                } else {
+                    prediction[c] = 2 * average - h.rate;
+                }
+            } else {
+                prediction[c] = h.count ? h.rate : m.roughRate[m.cellSatellite[c]] * 10000;
+            }
+        }
+        int64_t drift = 0;
+        if constexpr (Channel::encoding) drift = commonTerm(m.rate, prediction, aided, m.cellCount);
+        if (!channel.code(drift, 0)) return false;
+        for (int c = 0; c < m.cellCount; ++c) {
+            if (!channel.code(m.rate[c], prediction[c] + (aided[c] ? drift : 0))) return false;
+            if (decoding && !fitsSigned(m.rate[c] - m.roughRate[m.cellSatellite[c]] * 10000, 15)) return false;
+        }
+    }
+
+    // Lock time, half-cycle ambiguity and CNR: mostly unchanged
+    for (int c = 0; c < m.cellCount; ++c) {
+        if (!channel.code(m.lock[c], history[c]->count ? history[c]->lock : 0)) return false;
+        if (decoding && !fitsUnsigned(m.lock[c], m.lockWidth())) return false;
+    }
+    for (int c = 0; c < m.cellCount; ++c) {
+        if (!channel.code(m.halfCycle[c], history[c]->count ? history[c]->halfCycle : 0)) return false;
+        if (decoding && !fitsUnsigned(m.halfCycle[c], 1)) return false;
+    }
+    for (int c = 0; c < m.cellCount; ++c) {
+        if (!channel.code(m.cnr[c], history[c]->count ? history[c]->cnr : 0)) return false;
+        if (decoding && !fitsUnsigned(m.cnr[c], m.cnrWidth())) return false;
+    }
+    return true;
+}
+
+static int64_t predictedEpoch(const RtcmDeltaState::Slot& slot)
+{
+    return slot.initialized ? static_cast<int64_t>(slot.epoch) + slot.epochStep : 0;
+}
+
+static void updateSlot(const MsmFields& m, RtcmDeltaState::Slot& slot)
+{
+    if (slot.initialized && m.epoch != slot.epoch) {
+        slot.epochStep = static_cast<int64_t>(m.epoch) - slot.epoch;
+    }
+    slot.initialized = true;
+    slot.header = m.header;
+    slot.epoch = m.epoch;
+    slot.satelliteMask = m.satelliteMask;
+    slot.signalMask = m.signalMask;
+    slot.cellMask = m.cellMask;
+
+    for (int i = 0; i < m.satelliteCount; ++i) {
+        RtcmDeltaState::Satellite& h = slot.satellites[m.satellites[i] - 1];
+        h.rough[1] = h.rough[0];
+        h.rough[0] = m.rough[i];
+        h.extended = m.extended[i];
+        h.roughRate = m.roughRate[i];
+        h.count = std::min(h.count + 1, 2);
+    }
+    const int64_t invalidPhase = -(int64_t(1) << (m.phaseWidth() - 1));
+    for (int c = 0; c < m.cellCount; ++c) {
+        RtcmDeltaState::Cell& h = slot.cells[(m.satellites[m.cellSatellite[c]] - 1) * 32 + m.cellSignal[c] - 1];
+        int64_t rough = m.rough[m.cellSatellite[c]];
+        h.phase[2] = h.phase[1];
+        h.phase[1] = h.phase[0];
+        h.phase[0] = m.phase[c];
+        h.range[1] = h.range[0];
+        h.range[0] = m.range[c];
+        h.rate = m.msm7 ? m.rate[c] : 0;
+        h.lock = m.lock[c];
+        h.halfCycle = m.halfCycle[c];
+        h.cnr = m.cnr[c];
+        h.epoch = m.epoch;
+        h.phaseValid = m.phase[c] - (rough << m.phaseShift()) != invalidPhase;
+        h.count = std::min(h.count + 1, 3);
+    }
+}
+
+RtcmDeltaState::RtcmDeltaState()
+{
+    reset();
+}
+
+RtcmDeltaState::~RtcmDeltaState() = default;
+
+void RtcmDeltaState::reset()
+{
+    for (Slot& slot : _slots) {
+        slot.initialized = false;
+        slot.header = 0;
+        slot.epoch = 0;
+        slot.epochStep = 0;
+        slot.satelliteMask = 0;
+        slot.signalMask = 0;
+        slot.cellMask = 0;
+        std::fill(std::begin(slot.satellites), std::end(slot.satellites), Satellite{});
+        std::fill(slot.cells.begin(), slot.cells.end(), Cell{});
+    }
+    frames.clear();
+}
+
+RtcmDeltaState::Slot* RtcmDeltaState::slot(int type)
+{
+    if (!RtcmMsm::isSupported(type)) return nullptr;
+    static const char systems[] = "GREC";
+    int system = static_cast<int>(strchr(systems, RtcmMsm::systemOf(type)) - systems);
+    return &_slots[system * 2 + (type % 10 == 7)];
+}
+
+struct RtcmStreamEncoder::Deflater {
+#ifdef RTKCORE_HAVE_ZLIB
+    z_stream stream{};
+    bool ready = false;
+    Deflater() { ready = deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) == Z_OK; }
+    ~Deflater() { if (ready) deflateEnd(&stream); }
+#endif
+    std::vector<unsigned char> output;
+};
+
+RtcmStreamEncoder::RtcmStreamEncoder(RtcmCompression method)
+    : _method(rtcmDeflateAvailable() ? method : RtcmCompression::Delta),
+      _deflater(new Deflater)
+{
+    _records.reserve(16 * 1024);
+}
+
+RtcmStreamEncoder::~RtcmStreamEncoder() = default;
+
+bool RtcmStreamEncoder::addFrame(const unsigned char* frame, size_t length)
+{
+    if (_frameCount == 0) {
+        _keyframe = _keyframeRequested;
+        _keyframeRequested = false;
+        if (_keyframe) {
+            _state.reset();
+#ifdef RTKCORE_HAVE_ZLIB
+            if (_deflater->ready) deflateReset(&_deflater->stream);
+#endif
+        }
+    }
+    ++_frameCount;
+    ++_stats.frames;
+    _stats.inputBytes += length;
+
+    if (encodeMsm(frame, length)) {
+        _inEpoch = (_state.slot(rtcmMessageType(frame, length))->header & 1u) != 0;
+        return !_inEpoch;
+    }
+
+    int type = rtcmMessageType(frame, length);
+    size_t size = length - RTCM_CRC_SIZE;
+    std::vector<unsigned char>& last = _state.frames[type];
+    RecordWriter out(_records);
+    if (last.size() == size && std::equal(last.begin(), last.end(), frame)) {
+        out.putUnsigned(RecordRepeat);
+        out.putUnsigned(static_cast<uint64_t>(type));
+    } else {
+        out.putUnsigned(RecordRaw);
+        out.putBytes(frame + 1, size - 1);
+        last.assign(frame, frame + size);
+    }
+    return !_inEpoch;
+}
+
+bool RtcmStreamEncoder::encodeMsm(const unsigned char* frame, size_t length)
+{
+    MsmFields m;
+    if (!parseMsm(frame, length, m)) return false;
+    RtcmDeltaState::Slot& slot = *_state.slot(m.type);
+    const unsigned char* payload = frame + RTCM_HEADER_SIZE;
+    size_t payloadSize = length - RTCM_HEADER_SIZE - RTCM_CRC_SIZE;
+    size_t minimum = (m.dataBits + 7) / 8;
+    unsigned padding = static_cast<unsigned>(minimum * 8 - m.dataBits);
+    unsigned reserved = frame[1] >> 2;
+
+    unsigned flags = 0;
+    if (!slot.initialized || m.satelliteMask != slot.satelliteMask || m.signalMask != slot.signalMask
+        || m.cellMask != slot.cellMask) {
+        flags |= MasksChanged;
+    }
+    if (payloadSize != minimum || (padding && (payload[minimum - 1] & ((1u << padding) - 1)))) {
+        flags |= IrregularPayload;
+    }
+    if (reserved) flags |= ReservedBits;
+
+    RecordWriter out(_records);
+    out.putUnsigned(RecordMsm);
+    out.putUnsigned(static_cast<uint64_t>(m.type));
+    out.putUnsigned(flags);
+    out.putUnsigned(m.header ^ slot.header);
+    int64_t epoch = m.epoch;
+    out.code(epoch, predictedEpoch(slot));
+    if (flags & MasksChanged) {
+        out.putUnsigned(m.satelliteMask);
+        out.putUnsigned(m.signalMask);
+        out.putUnsigned(m.cellMask);
+    }
+    if (flags & ReservedBits) {
+        out.putUnsigned(reserved);
+    }
+    if (flags & IrregularPayload) {
+        out.putUnsigned(payloadSize);
+        out.putBytes(payload + m.dataBits / 8, payloadSize - m.dataBits / 8);
+    }
+    codeObservations(out, m, slot);
+    updateSlot(m, slot);
+    return true;
+}
+
+void RtcmStreamEncoder::flush(std::vector<unsigned char>& block, bool& keyframe)
+{
+    keyframe = _keyframe;
+    if (_frameCount == 0) return;
+
+    const unsigned char* data = _records.data();
+    size_t size = _records.size();
+#ifdef RTKCORE_HAVE_ZLIB
+    if (_method == RtcmCompression::DeltaDeflate) {
+        // Sync flush: the block ends on a byte boundary and can be inflated as soon as it is received.
+        // The empty stored block ending each flush is the same every time, the decoder adds it back.
+        z_stream& stream = _deflater->stream;
+        std::vector<unsigned char>& output = _deflater->output;
+        output.resize(std::max<size_t>(output.size(), deflateBound(&stream, size) + 16));
+        stream.next_in = const_cast<Bytef*>(data);
+        stream.avail_in = static_cast<uInt>(size);
+        size_t produced = 0;
+        do {
+            if (output.size() - produced < 64) output.resize(output.size() * 2);
+            stream.next_out = output.data() + produced;
+            stream.avail_out = static_cast<uInt>(output.size() - produced);
+            deflate(&stream, Z_SYNC_FLUSH);
+            produced = output.size() - stream.avail_out;
+        } while (stream.avail_out == 0);
+        if (produced >= 4 && memcmp(output.data() + produced - 4, SYNC_FLUSH_TAIL, 4) == 0) produced -= 4;
+        data = output.data();
+        size = produced;
+    }
+#endif
+
+    size_t start = block.size();
+    block.push_back(_keyframe ? 'K' : 'C');
+    RecordWriter(block).putUnsigned(size);
+    block.insert(block.end(), data, data + size);
+
+    ++_stats.blocks;
+    if (_keyframe) ++_stats.keyframes;
+    _stats.outputBytes += block.size() - start;
+    _records.clear();
+    _frameCount = 0;
+}
+
+struct RtcmStreamDecoder::Inflater {
+#ifdef RTKCORE_HAVE_ZLIB
+    z_stream stream{};
+    bool ready = false;
+    Inflater() { ready = inflateInit2(&stream, -15) == Z_OK; }
+    ~Inflater() { if (ready) inflateEnd(&stream); }
+#endif
+};
+
+RtcmStreamDecoder::RtcmStreamDecoder(RtcmCompression method)
+    : _method(method),
+      _inflater(new Inflater)
+{
+    _frame[0] = 0xD3;
+#ifdef RTKCORE_HAVE_ZLIB
+    _failed = _method == RtcmCompression::DeltaDeflate && !_inflater->ready;
+#else
+    _failed = _method == RtcmCompression::DeltaDeflate;
+#endif
+}
+
+RtcmStreamDecoder::~RtcmStreamDecoder() = default;
+
+size_t RtcmStreamDecoder::addData(const unsigned char* data, size_t size, const RtcmFrameCallback& onFrame)
+{
+    size_t consumed = 0;
+    while (!_failed && size - consumed >= 2) {
+        const unsigned char* block = data + consumed;
+        size_t available = size - consumed;
+        if (block[0] != 'K' && block[0] != 'C') {
+            _failed = true;
+            break;
+        }
+        RecordReader header(block + 1, std::min<size_t>(available - 1, 4));
+        uint64_t blockSize;
+        if (!header.getUnsigned(blockSize)) {
+            _failed = available >= 5;    // A size never takes more than 3 bytes
+            break;
+        }
+        size_t headerSize = 2;
+        for (uint64_t value = blockSize; value >= 0x80; value >>= 7) ++headerSize;
+        if (blockSize > MAX_BLOCK_SIZE) {
+            _failed = true;
+            break;
+        }
+        if (available - headerSize < blockSize) break;
+
+        bool keyframe = block[0] == 'K';
+        if (keyframe) _synchronized = true;
+        if (!_synchronized) {
+            ++_stats.skippedBlocks;
+        } else if (!decodeBlock(block + headerSize, static_cast<size_t>(blockSize), keyframe, onFrame)) {
+            _failed = true;
+            break;
+        }
+        ++_stats.blocks;
+        _stats.inputBytes += headerSize + blockSize;
+        consumed += headerSize + static_cast<size_t>(blockSize);
+    }
+    return consumed;
+}
+
+// Reads an MSM record and builds the frame payload, returns the payload size or 0 on error
+static size_t decodeMsm(RecordReader& in, RtcmDeltaState& state, unsigned char* frame)
+{
+    uint64_t type, flags, header;
+    if (!in.getUnsigned(type) || type > 4095) return 0;
+    RtcmDeltaState::Slot* slot = state.slot(static_cast<int>(type));
+    if (!slot || !in.getUnsigned(flags) || !in.getUnsigned(header)) return 0;
+    MsmFields m;
+    m.type = static_cast<int>(type);
+    m.msm7 = m.type % 10 == 7;
+    header ^= slot->header;
+    if (header >> 31) return 0;
+    m.header = static_cast<uint32_t>(header);
+    int64_t epoch;
+    if (!in.code(epoch, predictedEpoch(*slot)) || !fitsUnsigned(epoch, 30)) return 0;
+    m.epoch = static_cast<uint32_t>(epoch);
+    if (flags & MasksChanged) {
+        uint64_t signalMask;
+        if (!in.getUnsigned(m.satelliteMask) || !in.getUnsigned(signalMask) || !in.getUnsigned(m.cellMask)) return 0;
+        if (signalMask >> 32) return 0;
+        m.signalMask = static_cast<uint32_t>(signalMask);
+    } else if (slot->initialized) {
+        m.satelliteMask = slot->satelliteMask;
+        m.signalMask = slot->signalMask;
+        m.cellMask = slot->cellMask;
+    } else {
+        return 0;
+    }
+    if (!msmLayout(m)) return 0;
+    int maskBits = m.satelliteCount * m.signalCount;
+    if (maskBits < 64 && (m.cellMask >> maskBits)) return 0;
+
+    uint64_t reserved = 0;
+    if ((flags & ReservedBits) && (!in.getUnsigned(reserved) || reserved >= 64)) return 0;
+    unsigned char* payload = frame + RTCM_HEADER_SIZE;
+    size_t payloadSize = (m.dataBits + 7) / 8;
+    if (payloadSize > RTCM_MAX_PAYLOAD) return 0;
+    memset(payload, 0, payloadSize);
+    if (flags & IrregularPayload) {
+        uint64_t size;
+        if (!in.getUnsigned(size) || size < payloadSize || size > RTCM_MAX_PAYLOAD) return 0;
+        payloadSize = static_cast<size_t>(size);
+        if (!in.getBytes(payload + m.dataBits / 8, payloadSize - m.dataBits / 8)) return 0;
+    }
+    if (!codeObservations(in, m, *slot)) return 0;
+    updateSlot(m, *slot);
+    writeMsm(m, payload);
+    frame[1] = static_cast<unsigned char>(reserved << 2 | payloadSize >> 8);
+    frame[2] = static_cast<unsigned char>(payloadSize & 0xFF);
+    return payloadSize;
+}
+
+bool RtcmStreamDecoder::decodeBlock(const unsigned char* data, size_t size, bool keyframe, const RtcmFrameCallback& onFrame)
+{
+    if (keyframe) {
+        _state.reset();
+#ifdef RTKCORE_HAVE_ZLIB
+        if (_inflater->ready) inflateReset(&_inflater->stream);
+#endif
+    }
+
+#ifdef RTKCORE_HAVE_ZLIB
+    if (_method == RtcmCompression::DeltaDeflate) {
+        z_stream& stream = _inflater->stream;
+        size_t produced = 0;
+        auto inflateAll = [this, &stream, &produced](const unsigned char* input, size_t inputSize) {
+            stream.next_in = const_cast<Bytef*>(input);
+            stream.avail_in = static_cast<uInt>(inputSize);
+            for (;;) {
+                if (_records.size() - produced < 1024) {
+                    if (_records.size() >= MAX_BLOCK_SIZE) return false;
+                    _records.resize(std::max<size_t>(_records.size() * 2, 16 * 1024));
+                }
+                stream.next_out = _records.data() + produced;
+                stream.avail_out = static_cast<uInt>(_records.size() - produced);
+                int result = inflate(&stream, Z_SYNC_FLUSH);
+                produced = _records.size() - stream.avail_out;
+                if (result == Z_BUF_ERROR && stream.avail_in == 0) return true;
+                if (result != Z_OK) return false;
+                if (stream.avail_in == 0 && stream.avail_out > 0) return true;
+            }
+        };
+        if (!inflateAll(data, size) || !inflateAll(SYNC_FLUSH_TAIL, sizeof(SYNC_FLUSH_TAIL))) return false;
+        data = _records.data();
+        size = produced;
+    }
+#endif
+
+    RecordReader in(data, size);
+    while (!in.atEnd()) {
+        uint64_t kind;
+        if (!in.getUnsigned(kind)) return false;
+        if (kind == RecordRaw) {
+            if (!in.getBytes(_frame + 1, 2)) return false;
+            size_t payloadSize = static_cast<size_t>(_frame[1] & 0x03) << 8 | _frame[2];
+            if (!in.getBytes(_frame + RTCM_HEADER_SIZE, payloadSize)) return false;
+            int type = rtcmMessageType(_frame, RTCM_HEADER_SIZE + payloadSize + RTCM_CRC_SIZE);
+            _state.frames[type].assign(_frame, _frame + RTCM_HEADER_SIZE + payloadSize);
+            emitFrame(payloadSize, onFrame);
+        } else if (kind == RecordRepeat) {
+            uint64_t type;
+            if (!in.getUnsigned(type)) return false;
+            auto it = _state.frames.find(static_cast<int>(type));
+            if (type > 4095 || it == _state.frames.end() || it->second.size() < RTCM_HEADER_SIZE) return false;
+            memcpy(_frame, it->second.data(), it->second.size());
+            emitFrame(it->second.size() - RTCM_HEADER_SIZE, onFrame);
+        } else if (kind == RecordMsm) {
+            size_t payloadSize = decodeMsm(in, _state, _frame);
+            if (payloadSize == 0) return false;
+            emitFrame(payloadSize, onFrame);
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+void RtcmStreamDecoder::emitFrame(size_t payloadSize, const RtcmFrameCallback& onFrame)
+{
+    size_t length = RTCM_HEADER_SIZE + payloadSize;
+    uint32_t crc = rtcm_crc(_frame, length);
+    _frame[length] = static_cast<unsigned char>(crc >> 16);
+    _frame[length + 1] = static_cast<unsigned char>(crc >> 8);
+    _frame[length + 2] = static_cast<unsigned char>(crc);
+    length += RTCM_CRC_SIZE;
+    ++_stats.frames;
+    _stats.outputBytes += length;
+    onFrame(_frame, length, rtcmMessageType(_frame, length));
+}
@@ -0,0 +1,174 @@
+#ifndef RTCMCOMPRESS_H
+#define RTCMCOMPRESS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "rtcmframer.h"
+
+/**
+ * Compressed transport of an RTCM 3 stream, from a relay to its rovers.
+ *
+ * Each frame is coded as a record. MSM4/MSM7 observations are the residuals
+ * of a prediction from the previous epochs of the same satellite and signal:
+ * the carrier phase is extrapolated, the pseudorange and the phase-range
+ * rate follow the phase change, and a term common to the message absorbs the
+ * receiver clock. A message identical to the previous one of its type is a
+ * reference, the other messages are copied. The records of an epoch form a
+ * block, compressed with raw deflate when available (one stream for the
+ * connection, a sync flush per block).
+ *
+ * The decoder rebuilds the frames bit for bit, CRC included. The predictions
+ * only use integer arithmetic, so both ends agree on every platform. A
+ * keyframe block resets the predictions and the deflate stream: a decoder
+ * starts on a keyframe, and the encoder makes one when asked (new client).
+ *
+ * Block: kind ('K' keyframe, 'C' continuation), size (LEB128), data.
+ */
+enum class RtcmCompression {
+    Delta,          // Records only
+    DeltaDeflate    // Records compressed with deflate
+};
+
+// Name used in the X-Rtcm-Compression header: "delta" or "delta-deflate"
+const char* rtcmCompressionName(RtcmCompression method);
+bool rtcmCompressionFromName(const std::string& name, RtcmCompression& method);
+// Deflate is only available when the library is built with zlib
+bool rtcmDeflateAvailable();
+
+// Prediction state of the MSM observations, the same on both ends
+class RtcmDeltaState
+{
+public:
+    RtcmDeltaState();
+    ~RtcmDeltaState();
+    void reset();
+
+    struct Satellite {
+        int64_t rough[2];           // Rough range (ms × 1024), latest first
+        int64_t extended;
+        int64_t roughRate;
+        int count;                  // Epochs in the history, at most 2
+    };
+
+    struct Cell {
+        int64_t phase[3];           // Rough range + fine phase, in fine phase units, latest first
+        int64_t range[2];           // Rough range + fine pseudorange
+        int64_t rate;               // Rough rate + fine rate, 0.0001 m/s
+        int64_t lock;
+        int64_t halfCycle;
+        int64_t cnr;
+        uint32_t epoch;             // Epoch of the latest values
+        bool phaseValid;
+        int count;                  // Epochs in the history, at most 3
+    };
+
+    // One per constellation and MSM kind
+    struct Slot {
+        bool initialized = false;
+        uint32_t header = 0;        // Station, flags and multiple message bit
+        uint32_t epoch = 0;
+        int64_t epochStep = 0;      // Last non-zero epoch change
+        uint64_t satelliteMask = 0;
+        uint32_t signalMask = 0;
+        uint64_t cellMask = 0;
+        Satellite satellites[64];
+        std::vector<Cell> cells;    // By satellite and signal, allocated on first use
+    };
+
+    // Slot of an MSM4/MSM7 message type, nullptr if not supported
+    Slot* slot(int type);
+
+    // Latest frame (without the CRC) of each type that isn't coded as MSM
+    std::unordered_map<int, std::vector<unsigned char>> frames;
+
+private:
+    Slot _slots[8];
+};
+
+class RtcmStreamEncoder
+{
+public:
+    struct Stats {
+        uint64_t frames = 0;
+        uint64_t inputBytes = 0;    // RTCM frames
+        uint64_t outputBytes = 0;   // Blocks
+        uint64_t blocks = 0;
+        uint64_t keyframes = 0;
+    };
+
+    explicit RtcmStreamEncoder(RtcmCompression method);
+    ~RtcmStreamEncoder();
+
+    RtcmCompression method() const { return _method; }
+
+    // Adds a frame (as given by rtcmExtractFrames) to the block in progress. Returns true if the
+    // block should be sent now: end of an epoch, or a frame outside of an epoch.
+    bool addFrame(const unsigned char* frame, size_t length);
+    bool hasPending() const { return _frameCount > 0; }
+    // Appends the block in progress to block, nothing if there is none
+    void flush(std::vector<unsigned char>& block, bool& keyframe);
+
+    // The next block is a keyframe
+    void requestKeyframe() { _keyframeRequested = true; }
+
+    const Stats& stats() const { return _stats; }
+
+private:
+    bool encodeMsm(const unsigned char* frame, size_t length);
+
+    RtcmCompression _method;
+    Stats _stats;
+    RtcmDeltaState _state;
+    std::vector<unsigned char> _records;
+    int _frameCount = 0;
+    bool _inEpoch = false;          // MSM messages of the epoch follow
+    bool _keyframe = false;         // Block in progress
+    bool _keyframeRequested = true;
+
+    struct Deflater;
+    std::unique_ptr<Deflater> _deflater;
+};
+
+class RtcmStreamDecoder
+{
+public:
+    struct Stats {
+        uint64_t frames = 0;
+        uint64_t inputBytes = 0;    // Blocks
+        uint64_t outputBytes = 0;   // RTCM frames
+        uint64_t blocks = 0;
+        uint64_t skippedBlocks = 0; // Before the first keyframe
+    };
+
+    explicit RtcmStreamDecoder(RtcmCompression method);
+    ~RtcmStreamDecoder();
+
+    // Decodes the complete blocks of data and calls onFrame for each frame, returns the number
+    // of bytes consumed. Nothing is decoded once the stream is found corrupted.
+    size_t addData(const unsigned char* data, size_t size, const RtcmFrameCallback& onFrame);
+    bool failed() const { return _failed; }
+
+    const Stats& stats() const { return _stats; }
+
+private:
+    bool decodeBlock(const unsigned char* data, size_t size, bool keyframe, const RtcmFrameCallback& onFrame);
+    // Adds the CRC to the frame being built and passes it on
+    void emitFrame(size_t payloadSize, const RtcmFrameCallback& onFrame);
+
+    RtcmCompression _method;
+    Stats _stats;
+    RtcmDeltaState _state;
+    std::vector<unsigned char> _records;
+    unsigned char _frame[3 + 1023 + 3];
+    bool _synchronized = false;
+    bool _failed = false;
+
+    struct Inflater;
+    std::unique_ptr<Inflater> _inflater;
+};
+
+#endif // RTCMCOMPRESS_H
@@ -0,0 +1,319 @@
+#include "rtcmdecoder.h"
+#include "rtcmbits.h"
+#include <cmath>
+
+static const size_t RTCM_HEADER_SIZE = 3;
+static const size_t RTCM_CRC_SIZE = 3;
+static const size_t MSM_HEADER_BITS = 169;     // Up to the cell mask
+static const double RANGE_MS = RTCM_SPEED_OF_LIGHT / 1000.0; // Meters per millisecond of light travel
+static const int64_t DAY_MS = 86400000;
+static const int64_t WEEK_MS = 7 * DAY_MS;
+static const int64_t GPS_UTC_LEAP_MS = 18000;  // GPS - UTC since 2017-01-01
+static const int64_t BDT_GPS_MS = 14000;       // GPS - BDT
+static const int64_t GLONASS_UTC_MS = 3 * 3600000; // GLONASS time is UTC(SU) + 3 h
+
+static double pow2(int exponent)
+{
+    return std::ldexp(1.0, exponent);
+}
+
+bool rtcmDecodeStation(const unsigned char* frame, size_t length, RtcmStation& station)
+{
+    if (length < RTCM_HEADER_SIZE + 19 + RTCM_CRC_SIZE) return false;
+    const unsigned char* payload = frame + RTCM_HEADER_SIZE;
+    RtcmBitReader bits(payload, length - RTCM_HEADER_SIZE - RTCM_CRC_SIZE);
+    int type = static_cast<int>(bits.u<12>());
+    if (type != 1005 && type != 1006) return false;
+    if (type == 1006 && !bits.has(152 - 12 + 16)) return false;
+    station.stationId = static_cast<int>(bits.u<12>());
+    bits.skip(6 + 4);           // ITRF realization year, GPS/GLONASS/Galileo/reference station indicators
+    station.x = bits.s<38>() * 0.0001;
+    bits.skip(2);               // Single receiver oscillator, reserved
+    station.y = bits.s<38>() * 0.0001;
+    bits.skip(2);               // Quarter cycle indicator
+    station.z = bits.s<38>() * 0.0001;
+    station.antennaHeight = type == 1006 ? bits.u<16>() * 0.0001 : 0.0;
+    return true;
+}
+
+// Counted string of a 1033 message
+static bool readDescriptor(RtcmBitReader& bits, char* text)
+{
+    if (!bits.has(8)) return false;
+    int count = static_cast<int>(bits.u<8>());
+    if (!bits.has(count * 8)) return false;
+    int kept = 0;
+    for (int i = 0; i < count; ++i) {
+        char c = static_cast<char>(bits.u<8>());
+        if (kept < 31) text[kept++] = c;
+    }
+    text[kept] = '\0';
+    return true;
+}
+
+bool rtcmDecodeDescriptors(const unsigned char* frame, size_t length, RtcmDescriptors& descriptors)
+{
+    if (length < RTCM_HEADER_SIZE + 3 + RTCM_CRC_SIZE) return false;
+    RtcmBitReader bits(frame + RTCM_HEADER_SIZE, length - RTCM_HEADER_SIZE - RTCM_CRC_SIZE);
+    if (bits.u<12>() != 1033) return false;
+    descriptors.stationId = static_cast<int>(bits.u<12>());
+    if (!readDescriptor(bits, descriptors.antenna) || !bits.has(8)) return false;
+    descriptors.antennaSetupId = static_cast<int>(bits.u<8>());
+    return readDescriptor(bits, descriptors.antennaSerial) && readDescriptor(bits, descriptors.receiver)
+           && readDescriptor(bits, descriptors.firmware) && readDescriptor(bits, descriptors.receiverSerial);
+}
+
+char RtcmMsm::systemOf(int type)
+{
+    switch (type / 10) {
+    case 107: return 'G';
+    case 108: return 'R';
+    case 109: return 'E';
+    case 112: return 'C';
+    default: return 0;
+    }
+}
+
+bool RtcmMsm::isSupported(int type)
+{
+    return systemOf(type) != 0 && (type % 10 == 4 || type % 10 == 7);
+}
+
+static int popcount64(uint64_t value)
+{
+    int count = 0;
+    for (; value; value &= value - 1) ++count;
+    return count;
+}
+
+bool RtcmMsm::parse(const unsigned char* frame, size_t length)
+{
+    _type = 0;
+    if (length < RTCM_HEADER_SIZE + RTCM_CRC_SIZE + (MSM_HEADER_BITS + 7) / 8) return false;
+    _payload = frame + RTCM_HEADER_SIZE;
+    _payloadSize = length - RTCM_HEADER_SIZE - RTCM_CRC_SIZE;
+    RtcmBitReader bits(_payload, _payloadSize);
+
+    int type = static_cast<int>(bits.u<12>());
+    if (!isSupported(type)) return false;
+    _stationId = static_cast<int>(bits.u<12>());
+    _epoch = static_cast<uint32_t>(bits.u<30>());
+    _multipleMessage = bits.u<1>();
+    bits.skip(3 + 7 + 2 + 2 + 1 + 3);   // IODS, reserved, clock steering, external clock, smoothing
+    _satelliteMask = bits.u<64>();
+    _signalMask = static_cast<uint32_t>(bits.u<32>());
+    _satelliteCount = popcount64(_satelliteMask);
+    _signalCount = popcount64(_signalMask);
+    int cellMaskBits = _satelliteCount * _signalCount;
+    if (cellMaskBits > RTCM_MSM_MAX_CELLS || !bits.has(cellMaskBits)) return false;
+    _cellMask = rtcmGetUnsigned(_payload, bits.position(), cellMaskBits);
+    bits.skip(cellMaskBits);
+    _cellCount = popcount64(_cellMask);
+    _dataPos = bits.position();
+
+    _msm7 = type % 10 == 7;
+    size_t dataBits = _msm7 ? _satelliteCount * 36 + _cellCount * 80 : _satelliteCount * 18 + _cellCount * 48;
+    if (!bits.has(dataBits)) return false;
+    _type = type;
+    _system = systemOf(type);
+    return true;
+}
+
+int64_t RtcmMsm::gpsTimeMs(int64_t referenceGpsMs) const
+{
+    int64_t period = WEEK_MS;
+    int64_t offset;             // Time within the period, GPS time
+    if (_system == 'R') {
+        int64_t dayOfWeek = _epoch >> 27;
+        int64_t timeOfDay = _epoch & 0x7FFFFFF;
+        if (dayOfWeek == 7) {
+            // Unknown day
+            period = DAY_MS;
+            offset = timeOfDay;
+        } else {
+            offset = dayOfWeek * DAY_MS + timeOfDay;
+        }
+        offset += GPS_UTC_LEAP_MS - GLONASS_UTC_MS;
+    } else if (_system == 'C') {
+        offset = _epoch + BDT_GPS_MS;
+    } else {
+        offset = _epoch;
+    }
+    offset = ((offset % period) + period) % period;
+
+    int64_t periodStart = referenceGpsMs - ((referenceGpsMs % period) + period) % period;
+    int64_t time = periodStart + offset;
+    if (time - referenceGpsMs > period / 2) {
+        time -= period;
+    } else if (referenceGpsMs - time > period / 2) {
+        time += period;
+    }
+    return time;
+}
+
+// DF402 (MSM4) and DF407 (MSM7) lock time indicators, minimum lock time in ms
+static int64_t lockTimeMs(bool msm7, int indicator)
+{
+    if (!msm7) {
+        return indicator == 0 ? 0 : int64_t(32) << (indicator - 1);
+    }
+    if (indicator < 64) return indicator;
+    if (indicator > 704) indicator = 704;
+    int k = (indicator - 64) / 32 + 1;
+    return (int64_t(1) << k) * (indicator - (64 + 32 * (k - 1))) + (int64_t(1) << (k + 5));
+}
+
+int RtcmMsm::decode(RtcmMsmCell* cells) const
+{
+    if (_type == 0) return 0;
+    const int n = _satelliteCount;
+    const int c = _cellCount;
+
+    // Satellite data: rough ranges and rates
+    double roughRange[64];
+    double roughRate[64];
+    size_t pos = _dataPos;
+    for (int i = 0; i < n; ++i, pos += 8) {
+        uint64_t milliseconds = rtcmGetUnsigned<8>(_payload, pos);
+        roughRange[i] = milliseconds == 255 ? NAN : static_cast<double>(milliseconds);
+    }
+    if (_msm7) pos += 4 * n;    // Extended satellite information, see glonassChannel()
+    for (int i = 0; i < n; ++i, pos += 10) {
+        roughRange[i] += rtcmGetUnsigned<10>(_payload, pos) * pow2(-10);
+    }
+    if (_msm7) {
+        for (int i = 0; i < n; ++i, pos += 14) {
+            int64_t rate = rtcmGetSigned<14>(_payload, pos);
+            roughRate[i] = rate == -8192 ? NAN : static_cast<double>(rate);
+        }
+    }
+
+    // Satellite and signal of each cell
+    int satellites[64];
+    int signals[32];
+    for (int bit = 63, i = 0; bit >= 0; --bit) {
+        if ((_satelliteMask >> bit) & 1u) satellites[i++] = 64 - bit;
+    }
+    for (int bit = 31, i = 0; bit >= 0; --bit) {
+        if ((_signalMask >> bit) & 1u) signals[i++] = 32 - bit;
+    }
+    int cellSatellite[RTCM_MSM_MAX_CELLS];
+    int count = 0;
+    int maskBits = n * _signalCount;
+    for (int k = 0; k < maskBits; ++k) {
+        if ((_cellMask >> (maskBits - 1 - k)) & 1u) {
+            int satellite = k / _signalCount;
+            cellSatellite[count] = satellite;
+            cells[count].satellite = satellites[satellite];
+            cells[count].signal = signals[k % _signalCount];
+            ++count;
+        }
+    }
+
+    // Signal data, one field for all the cells after the other
+    if (_msm7) {
+        for (int i = 0; i < c; ++i, pos += 20) {
+            int64_t fine = rtcmGetSigned<20>(_payload, pos);
+            cells[i].pseudorange = fine == -524288 ? NAN : (roughRange[cellSatellite[i]] + fine * pow2(-29)) * RANGE_MS;
+        }
+        for (int i = 0; i < c; ++i, pos += 24) {
+            int64_t fine = rtcmGetSigned<24>(_payload, pos);
+            cells[i].phaseRange = fine == -8388608 ? NAN : (roughRange[cellSatellite[i]] + fine * pow2(-31)) * RANGE_MS;
+        }
+        for (int i = 0; i < c; ++i, pos += 10) {
+            cells[i].lockTimeMs = lockTimeMs(true, static_cast<int>(rtcmGetUnsigned<10>(_payload, pos)));
+        }
+        for (int i = 0; i < c; ++i, pos += 1) {
+            cells[i].halfCycle = rtcmGetUnsigned<1>(_payload, pos);
+        }
+        for (int i = 0; i < c; ++i, pos += 10) {
+            cells[i].cnr = rtcmGetUnsigned<10>(_payload, pos) * pow2(-4);
+        }
+        for (int i = 0; i < c; ++i, pos += 15) {
+            int64_t fine = rtcmGetSigned<15>(_payload, pos);
+            cells[i].phaseRangeRate = fine == -16384 ? NAN : roughRate[cellSatellite[i]] + fine * 0.0001;
+        }
+    } else {
+        for (int i = 0; i < c; ++i, pos += 15) {
+            int64_t fine = rtcmGetSigned<15>(_payload, pos);
+            cells[i].pseudorange = fine == -16384 ? NAN : (roughRange[cellSatellite[i]] + fine * pow2(-24)) * RANGE_MS;
+        }
+        for (int i = 0; i < c; ++i, pos += 22) {
+            int64_t fine = rtcmGetSigned<22>(_payload, pos);
+            cells[i].phaseRange = fine == -2097152 ? NAN : (roughRange[cellSatellite[i]] + fine * pow2(-29)) * RANGE_MS;
+        }
+        for (int i = 0; i < c; ++i, pos += 4) {
+            cells[i].lockTimeMs = lockTimeMs(false, static_cast<int>(rtcmGetUnsigned<4>(_payload, pos)));
+        }
+        for (int i = 0; i < c; ++i, pos += 1) {
+            cells[i].halfCycle = rtcmGetUnsigned<1>(_payload, pos);
+        }
+        for (int i = 0; i < c; ++i, pos += 6) {
+            cells[i].cnr = static_cast<double>(rtcmGetUnsigned<6>(_payload, pos));
+            cells[i].phaseRangeRate = NAN;
+        }
+    }
+    return count;
+}
+
+int RtcmMsm::glonassChannel(int satellite) const
+{
+    if (_type == 0 || _system != 'R' || !_msm7 || satellite < 1 || satellite > 64) return RTCM_GLONASS_CHANNEL_UNKNOWN;
+    if (!((_satelliteMask >> (64 - satellite)) & 1u)) return RTCM_GLONASS_CHANNEL_UNKNOWN;
+    int index = popcount64(_satelliteMask >> (64 - satellite)) - 1;
+    int info = static_cast<int>(rtcmGetUnsigned<4>(_payload, _dataPos + 8 * _satelliteCount + 4 * index));
+    return info <= 13 ? info - 7 : RTCM_GLONASS_CHANNEL_UNKNOWN;
+}
+
+const char* rtcmSignalCode(char system, int signal)
+{
+    // RTCM 10403.3 tables 3.5-91 (GPS), 3.5-96 (GLONASS), 3.5-99 (Galileo) and 3.5-108 (BeiDou)
+    static const char* const gps[33] = {
+        nullptr, nullptr, "1C", "1P", "1W", nullptr, nullptr, nullptr, "2C", "2P", "2W", nullptr, nullptr, nullptr,
+        nullptr, "2S", "2L", "2X", nullptr, nullptr, nullptr, nullptr, "5I", "5Q", "5X", nullptr, nullptr, nullptr,
+        nullptr, nullptr, "1S", "1L", "1X"};
+    static const char* const glonass[33] = {
+        nullptr, nullptr, "1C", "1P", nullptr, nullptr, nullptr, nullptr, "2C", "2P"};
+    static const char* const galileo[33] = {
+        nullptr, nullptr, "1C", "1A", "1B", "1X", "1Z", nullptr, "6C", "6A", "6B", "6X", "6Z", nullptr,
+        "7I", "7Q", "7X", nullptr, "8I", "8Q", "8X", nullptr, "5I", "5Q", "5X"};
+    static const char* const beidou[33] = {
+        nullptr, nullptr, "2I", "2Q", "2X", nullptr, nullptr, nullptr, "6I", "6Q", "6X", nullptr, nullptr, nullptr,
+        "7I", "7Q", "7X", nullptr, nullptr, nullptr, nullptr, nullptr, "5D", "5P", "5X", "7D", nullptr, nullptr,
+        nullptr, nullptr, "1D", "1P", "1X"};
+    if (signal < 1 || signal > 32) return nullptr;
+    switch (system) {
+    case 'G': return gps[signal];
+    case 'R': return glonass[signal];
+    case 'E': return galileo[signal];
+    case 'C': return beidou[signal];
+    default: return nullptr;
+    }
+}
+
+double rtcmSignalFrequency(char system, int signal, int glonassChannel)
+{
+    const char* code = rtcmSignalCode(system, signal);
+    if (!code) return 0.0;
+    char band = code[0];
+    switch (system) {
+    case 'G':
+        return band == '1' ? 1575.42e6 : band == '2' ? 1227.60e6 : band == '5' ? 1176.45e6 : 0.0;
+    case 'R':
+        if (glonassChannel == RTCM_GLONASS_CHANNEL_UNKNOWN) return 0.0;
+        return band == '1' ? 1602.0e6 + glonassChannel * 0.5625e6 : band == '2' ? 1246.0e6 + glonassChannel * 0.4375e6 : 0.0;
+    case 'E':
+        return band == '1' ? 1575.42e6 : band == '5' ? 1176.45e6 : band == '7' ? 1207.14e6
+             : band == '8' ? 1191.795e6 : band == '6' ? 1278.75e6 : 0.0;
+    case 'C':
+        return band == '2' ? 1561.098e6 : band == '1' ? 1575.42e6 : band == '5' ? 1176.45e6
+             : band == '7' ? 1207.14e6 : band == '6' ? 1268.52e6 : 0.0;
+    default:
+        return 0.0;
+    }
+}
+
+int64_t rtcmGpsTimeFromUnixMs(int64_t unixMs)
+{
+    return unixMs - 315964800000 + GPS_UTC_LEAP_MS;
+}
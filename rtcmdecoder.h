@@ -0,0 +1,118 @@
+#ifndef RTCMDECODER_H
+#define RTCMDECODER_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Decoding of the RTCM 3 messages of a reference station: MSM4 and MSM7
+ * observations (GPS, GLONASS, Galileo, BeiDou), station position
+ * (1005/1006) and descriptors (1033).
+ *
+ * The functions take a complete frame (preamble, payload and CRC, as given
+ * by rtcmExtractFrames) and never allocate. Decoding is lazy: RtcmMsm::parse
+ * only reads the header and the masks, the observations are decoded when
+ * RtcmMsm::decode is called.
+ */
+
+constexpr double RTCM_SPEED_OF_LIGHT = 299792458.0;
+constexpr int RTCM_MSM_MAX_CELLS = 64;
+constexpr int RTCM_GLONASS_CHANNEL_UNKNOWN = -100;
+
+// Station position of a 1005/1006 message, ECEF in meters
+struct RtcmStation {
+    int stationId = 0;
+    double x = 0.0;
+    double y = 0.0;
+    double z = 0.0;
+    double antennaHeight = 0.0;     // 1006 only
+};
+
+// Descriptors of a 1033 message, NUL-terminated (at most 31 characters each)
+struct RtcmDescriptors {
+    int stationId = 0;
+    int antennaSetupId = 0;
+    char antenna[32] = {};
+    char antennaSerial[32] = {};
+    char receiver[32] = {};
+    char firmware[32] = {};
+    char receiverSerial[32] = {};
+};
+
+bool rtcmDecodeStation(const unsigned char* frame, size_t length, RtcmStation& station);
+bool rtcmDecodeDescriptors(const unsigned char* frame, size_t length, RtcmDescriptors& descriptors);
+
+// One signal of one satellite
+struct RtcmMsmCell {
+    int satellite = 0;              // PRN (slot number for GLONASS), 1..64
+    int signal = 0;                 // MSM signal ID, 1..32
+    double pseudorange = 0.0;       // m, NaN if invalid
+    double phaseRange = 0.0;        // Carrier phase in m (phase × wavelength), NaN if invalid
+    double phaseRangeRate = 0.0;    // m/s, NaN if invalid or MSM4
+    double cnr = 0.0;               // dB-Hz, 0 if not given
+    int64_t lockTimeMs = 0;         // Minimum lock time
+    bool halfCycle = false;         // Half-cycle ambiguity unresolved
+};
+
+class RtcmMsm
+{
+public:
+    // Constellation letters of RINEX
+    static char systemOf(int type);
+    // MSM4 or MSM7 of GPS, GLONASS, Galileo or BeiDou
+    static bool isSupported(int type);
+
+    // Reads the header and the masks, false if the message is not supported or inconsistent
+    bool parse(const unsigned char* frame, size_t length);
+
+    int type() const { return _type; }
+    char system() const { return _system; }
+    bool isMsm7() const { return _msm7; }
+    int stationId() const { return _stationId; }
+    // More messages of the same epoch follow
+    bool multipleMessage() const { return _multipleMessage; }
+    int satelliteCount() const { return _satelliteCount; }
+    int signalCount() const { return _signalCount; }
+    int cellCount() const { return _cellCount; }
+    uint64_t satelliteMask() const { return _satelliteMask; }  // Bit 63 is satellite 1
+    uint32_t signalMask() const { return _signalMask; }        // Bit 31 is signal 1
+
+    // Epoch in GPS time (ms since 1980-01-06), the week (and the day for GLONASS)
+    // is the one closest to referenceGpsMs
+    int64_t gpsTimeMs(int64_t referenceGpsMs) const;
+
+    // Decodes the observations into cells (at least cellCount() elements), returns the count.
+    // The order is the cell order: by satellite, then by signal.
+    int decode(RtcmMsmCell* cells) const;
+
+    // GLONASS frequency channel (-7..6) of a satellite from the MSM7 extended
+    // satellite information, or RTCM_GLONASS_CHANNEL_UNKNOWN
+    int glonassChannel(int satellite) const;
+
+private:
+    const unsigned char* _payload = nullptr;
+    size_t _payloadSize = 0;
+    int _type = 0;
+    char _system = 0;
+    bool _msm7 = false;
+    int _stationId = 0;
+    uint32_t _epoch = 0;
+    bool _multipleMessage = false;
+    uint64_t _satelliteMask = 0;
+    uint32_t _signalMask = 0;
+    uint64_t _cellMask = 0;         // Bit 0 is the last cell
+    int _satelliteCount = 0;
+    int _signalCount = 0;
+    int _cellCount = 0;
+    size_t _dataPos = 0;            // Bit position of the satellite data
+};
+
+// RINEX 3 observation code (band and attribute, e.g. "1C") of an MSM signal, nullptr if unknown
+const char* rtcmSignalCode(char system, int signal);
+// Carrier frequency in Hz, 0 if unknown (GLONASS FDMA needs the channel)
+double rtcmSignalFrequency(char system, int signal, int glonassChannel = RTCM_GLONASS_CHANNEL_UNKNOWN);
+
+// GPS time (ms since 1980-01-06) of a UTC time (ms since 1970-01-01)
+int64_t rtcmGpsTimeFromUnixMs(int64_t unixMs);
+
+#endif // RTCMDECODER_H
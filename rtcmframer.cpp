@@ -0,0 +1,47 @@
+#include "rtcmframer.h"
+#include "crc24q.h"
+
+static const size_t RTCM_HEADER_SIZE = 3;
+static const size_t RTCM_CRC_SIZE = 3;
+static const size_t RTCM_MIN_FRAME = 8; // Smallest frame holding a message number
+
+int rtcmMessageType(const unsigned char* frame, size_t length)
+{
+    if (length < RTCM_HEADER_SIZE + 2 + RTCM_CRC_SIZE) return 0;
+    return (frame[3] << 4) | (frame[4] >> 4);
+}
+
+size_t rtcmExtractFrames(const unsigned char* data, size_t size, const RtcmFrameCallback& onFrame,
+                         RtcmFrameStats* stats)
+{
+    size_t offset = 0;
+    while (offset + RTCM_MIN_FRAME <= size) {
+        if (data[offset] != 0xD3) {
+            if (stats) ++stats->resyncBytes;
+            ++offset;
+            continue;
+        }
+
+        size_t length = ((data[offset + 1] & 0x03) << 8) | data[offset + 2];
+        size_t total = RTCM_HEADER_SIZE + length + RTCM_CRC_SIZE;
+        if (size - offset < total) {
+            break; // Incomplete frame
+        }
+
+        const unsigned char* frame = data + offset;
+        uint32_t received = (frame[total - 3] << 16) | (frame[total - 2] << 8) | frame[total - 1];
+        if (received == rtcm_crc(frame, total - RTCM_CRC_SIZE)) {
+            if (stats) ++stats->frames;
+            onFrame(frame, total, rtcmMessageType(frame, total));
+            offset += total;
+        } else {
+            // Skip the preamble and search again
+            if (stats) {
+                ++stats->crcFailures;
+                ++stats->resyncBytes;
+            }
+            ++offset;
+        }
+    }
+    return offset;
+}
@@ -0,0 +1,32 @@
+#ifndef RTCMFRAMER_H
+#define RTCMFRAMER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+/**
+ * RTCM 3 transport layer framing.
+ *
+ * A frame is the 0xD3 preamble, 6 reserved bits and a 10-bit length, the
+ * payload and a CRC-24Q over everything before it. Bytes that don't start
+ * a frame with a valid CRC are skipped one at a time (resynchronization).
+ */
+struct RtcmFrameStats {
+    uint64_t frames = 0;
+    uint64_t crcFailures = 0;
+    uint64_t resyncBytes = 0;
+};
+
+// Called for each frame with a valid CRC, frame points to the preamble
+using RtcmFrameCallback = std::function<void(const unsigned char* frame, size_t length, int type)>;
+
+// Message number of a frame, 0 if the payload is too short to hold one
+int rtcmMessageType(const unsigned char* frame, size_t length);
+
+// Extracts the complete frames of data, returns the number of bytes consumed.
+// The remaining bytes are the beginning of an incomplete frame.
+size_t rtcmExtractFrames(const unsigned char* data, size_t size, const RtcmFrameCallback& onFrame,
+                         RtcmFrameStats* stats = nullptr);
+
+#endif // RTCMFRAMER_H
@@ -0,0 +1,282 @@
+#include "rtcmmonitor.h"
+#include "rtcmbits.h"
+#include "rtcmquality.h"
+#include <algorithm>
+#include <bitset>
+#include <cmath>
+
+const int RtcmStreamMonitor::STATIC_TYPE_LIST[STATIC_TYPES] = {
+    1005, 1006,                 // Station coordinates
+    1007, 1008, 1033,           // Antenna and receiver descriptors
+    1230,                       // GLONASS code-phase biases
+    1019, 1020, 1042, 1045, 1046    // GPS, GLONASS, BeiDou, Galileo ephemerides
+};
+
+static const int64_t GPS_WEEK_MS = 604800000;
+static const int64_t DAY_MS = 86400000;
+static const int HISTORY_EPOCHS = 16;
+// Smallest samples of the window for the rates and the mean jitter
+static const uint32_t MIN_EPOCHS = 10;
+static const uint32_t MIN_FRAMES = 20;
+static const double MIN_BITRATE_SECONDS = 10;
+
+const char* RtcmStreamMonitor::conditionName(Condition condition)
+{
+    switch (condition) {
+    case Stalled: return "stalled";
+    case IncompleteEpochs: return "incomplete_epochs";
+    case MissingEpochs: return "missing_epochs";
+    case DuplicateEpochs: return "duplicate_epochs";
+    case Jitter: return "jitter";
+    case LowBitrate: return "low_bitrate";
+    case StaleStatic: return "stale_static";
+    case CrcErrors: return "crc_errors";
+    default: return "unknown";
+    }
+}
+
+RtcmStreamMonitor::RtcmStreamMonitor()
+{
+    reset(0);
+}
+
+void RtcmStreamMonitor::reset(int64_t nowNs)
+{
+    for (int condition = 0; condition < CONDITION_COUNT; ++condition) {
+        raise(static_cast<Condition>(condition), false, 0, 0);
+    }
+    _advertisedBitrate = 0;
+    _startNs = nowNs;
+    _lastFrameNs = 0;
+    std::fill(std::begin(_slots), std::end(_slots), Slot());
+    _slotCount = 0;
+    _epochSlots = 0;
+    _epochMissing = 0;
+    _epochsSeen = 0;
+    _endPendingNs = -1;
+    std::fill(std::begin(_staticNs), std::end(_staticNs), int64_t(-1));
+    std::fill(std::begin(_buckets), std::end(_buckets), Bucket());
+    _totals = Stats();
+}
+
+RtcmStreamMonitor::Bucket& RtcmStreamMonitor::bucket(int64_t nowNs)
+{
+    int64_t second = nowNs / 1000000000;
+    Bucket& b = _buckets[second % WINDOW_SECONDS];
+    if (b.second != second) {
+        b = Bucket();
+        b.second = second;
+    }
+    return b;
+}
+
+RtcmStreamMonitor::Bucket RtcmStreamMonitor::window(int64_t nowNs) const
+{
+    int64_t second = nowNs / 1000000000;
+    Bucket sum;
+    for (const Bucket& b : _buckets) {
+        if (b.second < 0 || b.second <= second - WINDOW_SECONDS || b.second > second) continue;
+        sum.frames += b.frames;
+        sum.bytes += b.bytes;
+        sum.crcFailures += b.crcFailures;
+        sum.epochs += b.epochs;
+        sum.incompleteEpochs += b.incompleteEpochs;
+        sum.missingEpochs += b.missingEpochs;
+        sum.duplicateEpochs += b.duplicateEpochs;
+        sum.jitterSamples += b.jitterSamples;
+        sum.jitterMs += b.jitterMs;
+    }
+    return sum;
+}
+
+RtcmStreamMonitor::Slot* RtcmStreamMonitor::slot(int type)
+{
+    for (int i = 0; i < _slotCount; ++i) {
+        if (_slots[i].type == type) return &_slots[i];
+    }
+    if (_slotCount == MAX_OBSERVATION_TYPES) return nullptr;
+    _slots[_slotCount].type = type;
+    return &_slots[_slotCount++];
+}
+
+void RtcmStreamMonitor::addFrame(const unsigned char* frame, size_t length, int type, int64_t nowNs)
+{
+    _lastFrameNs = nowNs;
+    Bucket& b = bucket(nowNs);
+    ++b.frames;
+    b.bytes += static_cast<uint32_t>(length);
+    ++_totals.frames;
+    _totals.bytes += length;
+    for (int i = 0; i < STATIC_TYPES; ++i) {
+        if (STATIC_TYPE_LIST[i] == type) _staticNs[i] = nowNs;
+    }
+
+    if (!rtcmObservationSystem(type) || length < 3 + 8) return;
+    const unsigned char* payload = frame + 3;
+    // Epoch time: GPS/Galileo/BeiDou time of week, GLONASS time of day (after the day of week in MSM)
+    bool legacyGlonass = type >= 1009 && type <= 1012;
+    bool glonass = legacyGlonass || type / 10 == 108;
+    int64_t epoch = legacyGlonass ? rtcmGetUnsigned<27>(payload, 24)
+                  : glonass ? rtcmGetUnsigned<27>(payload, 27) : rtcmGetUnsigned<30>(payload, 24);
+    int64_t period = glonass ? DAY_MS : GPS_WEEK_MS;
+    bool lastOfEpoch = !rtcmGetUnsigned<1>(payload, legacyGlonass ? 51 : 54);
+    uint32_t crc = (frame[length - 3] << 16) | (frame[length - 2] << 8) | frame[length - 1];
+
+    Slot* s = slot(type);
+    if (!s) return;
+    uint32_t bit = 1u << (s - _slots);
+    // Another group right after the end of an epoch, without a message type of it: the rest of the epoch
+    // (legacy then MSM observations, each group with its own last message)
+    if (_endPendingNs >= 0) {
+        if ((_epochSlots & bit) || nowNs - _endPendingNs >= mergeWindowNs()) endEpoch(_endPendingNs);
+        _endPendingNs = -1;
+    }
+    if (s->receivedNs) {
+        int64_t delta = ((epoch - s->epoch) % period + period) % period;
+        if (delta == 0 && crc == s->crc) {
+            ++b.duplicateEpochs;
+            ++_totals.duplicateEpochs;
+            return;
+        }
+        // Same epoch and another CRC: the satellites are split over several messages
+        if (delta > period / 2) {
+            // Back in time (base restart, replayed data): a new reference, nothing missing
+            if (_epochSlots & bit) endEpoch(nowNs);
+        } else if (delta > 0) {
+            // The last message of the previous epoch was lost
+            if (_epochSlots & bit) endEpoch(nowNs);
+            if (s->intervalMs == 0 || delta < s->intervalMs) s->intervalMs = delta;
+            int64_t missing = (delta + s->intervalMs / 2) / s->intervalMs - 1;
+            _epochMissing = std::max(_epochMissing, static_cast<uint32_t>(std::min<int64_t>(missing, 1000000)));
+            b.jitterMs += std::fabs((nowNs - s->receivedNs) / 1e6 - delta);
+            ++b.jitterSamples;
+        }
+    }
+    s->epoch = static_cast<uint32_t>(epoch);
+    s->crc = crc;
+    s->receivedNs = nowNs;
+    _epochSlots |= bit;
+    if (lastOfEpoch) _endPendingNs = nowNs;
+}
+
+// Half of the shortest epoch interval, at most 100 ms
+int64_t RtcmStreamMonitor::mergeWindowNs() const
+{
+    int64_t windowMs = 100;
+    for (int i = 0; i < _slotCount; ++i) {
+        if (_slots[i].intervalMs > 0) windowMs = std::min(windowMs, _slots[i].intervalMs / 2);
+    }
+    return windowMs * 1000000;
+}
+
+void RtcmStreamMonitor::addCrcFailures(uint64_t count, int64_t nowNs)
+{
+    bucket(nowNs).crcFailures += static_cast<uint32_t>(count);
+    _totals.crcFailures += count;
+}
+
+// A slot is expected once it was in 3/4 of the last epochs (at least 4), until it is missing from all of
+// the last 16: a lost constellation makes 16 incomplete epochs
+void RtcmStreamMonitor::endEpoch(int64_t nowNs)
+{
+    if (!_epochSlots) return;
+    bool incomplete = false;
+    ++_epochsSeen;
+    int history = static_cast<int>(std::min<uint32_t>(_epochsSeen, HISTORY_EPOCHS));
+    for (int i = 0; i < _slotCount; ++i) {
+        Slot& s = _slots[i];
+        bool present = _epochSlots & (1u << i);
+        if (s.expected && !present) incomplete = true;
+        s.presence = static_cast<uint16_t>((s.presence << 1) | (present ? 1 : 0));
+        int count = static_cast<int>(std::bitset<16>(s.presence).count());
+        if (history >= 4 && count * 4 >= history * 3) s.expected = true;
+        if (s.presence == 0) s.expected = false;
+    }
+
+    Bucket& b = bucket(nowNs);
+    ++b.epochs;
+    ++_totals.epochs;
+    if (incomplete) {
+        ++b.incompleteEpochs;
+        ++_totals.incompleteEpochs;
+    }
+    b.missingEpochs += _epochMissing;
+    _totals.missingEpochs += _epochMissing;
+    _epochMissing = 0;
+    _epochSlots = 0;
+}
+
+void RtcmStreamMonitor::raise(Condition condition, bool active, double value, double threshold, int type)
+{
+    if (_active[condition] == active) return;
+    _active[condition] = active;
+    if (_onEvent) _onEvent(Event{condition, active, value, threshold, type});
+}
+
+void RtcmStreamMonitor::tick(int64_t nowNs)
+{
+    const Thresholds& t = _thresholds;
+    if (_endPendingNs >= 0 && nowNs - _endPendingNs >= mergeWindowNs()) {
+        endEpoch(_endPendingNs);
+        _endPendingNs = -1;
+    }
+    Bucket w = window(nowNs);
+    double elapsed = (nowNs - _startNs) / 1e9;
+
+    double silence = _lastFrameNs ? (nowNs - _lastFrameNs) / 1e9 : elapsed;
+    raise(Stalled, silence > t.stalledSeconds, silence, t.stalledSeconds);
+
+    if (w.epochs >= MIN_EPOCHS) {
+        double rate = static_cast<double>(w.incompleteEpochs) / w.epochs;
+        raise(IncompleteEpochs, rate > t.incompleteEpochRate, rate, t.incompleteEpochRate);
+    }
+    raise(MissingEpochs, static_cast<int>(w.missingEpochs) > t.missingEpochs, w.missingEpochs, t.missingEpochs);
+    raise(DuplicateEpochs, static_cast<int>(w.duplicateEpochs) > t.duplicateEpochs, w.duplicateEpochs, t.duplicateEpochs);
+    if (w.jitterSamples >= MIN_EPOCHS) {
+        double jitter = w.jitterMs / w.jitterSamples;
+        raise(Jitter, jitter > t.jitterMs, jitter, t.jitterMs);
+    }
+
+    double seconds = std::min(elapsed, static_cast<double>(WINDOW_SECONDS));
+    if (_advertisedBitrate > 0 && seconds >= MIN_BITRATE_SECONDS) {
+        double bitrate = w.bytes * 8.0 / seconds;
+        double minimum = _advertisedBitrate * t.bitrateRatio;
+        raise(LowBitrate, bitrate < minimum, bitrate, minimum);
+    }
+
+    // Station position, the latest of 1005 and 1006, since the start if never received. The other static
+    // messages have their own rates (ephemerides on change, descriptors every few minutes): their ages are
+    // only reported.
+    double stationAge = -1;
+    int stationType = 1005;
+    for (int i = 0; i < 2; ++i) {
+        if (_staticNs[i] < 0) continue;
+        double age = (nowNs - _staticNs[i]) / 1e9;
+        if (stationAge < 0 || age < stationAge) {
+            stationAge = age;
+            stationType = STATIC_TYPE_LIST[i];
+        }
+    }
+    if (stationAge < 0) stationAge = elapsed;
+    raise(StaleStatic, stationAge > t.staticMaxAgeSeconds, stationAge, t.staticMaxAgeSeconds, stationType);
+
+    if (w.frames + w.crcFailures >= MIN_FRAMES) {
+        double rate = static_cast<double>(w.crcFailures) / (w.frames + w.crcFailures);
+        raise(CrcErrors, rate > t.crcErrorRate, rate, t.crcErrorRate);
+    }
+}
+
+RtcmStreamMonitor::Stats RtcmStreamMonitor::stats(int64_t nowNs) const
+{
+    Stats s = _totals;
+    Bucket w = window(nowNs);
+    s.jitterMs = w.jitterSamples ? w.jitterMs / w.jitterSamples : 0;
+    double seconds = std::min((nowNs - _startNs) / 1e9, static_cast<double>(WINDOW_SECONDS));
+    s.bitrate = seconds >= MIN_BITRATE_SECONDS ? w.bytes * 8.0 / seconds : 0;
+    s.advertisedBitrate = _advertisedBitrate;
+    for (int i = 0; i < STATIC_TYPES; ++i) {
+        s.staticAgeSeconds[i] = _staticNs[i] < 0 ? -1 : (nowNs - _staticNs[i]) / 1e9;
+    }
+    std::copy(std::begin(_active), std::end(_active), std::begin(s.active));
+    return s;
+}
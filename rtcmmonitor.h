@@ -0,0 +1,152 @@
+#ifndef RTCMMONITOR_H
+#define RTCMMONITOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+/**
+ * Integrity and completeness of an RTCM 3 correction stream, in constant
+ * memory.
+ *
+ * Fed with the framed messages and the CRC failures, with the monotonic
+ * receive time. Each observation message type has a slot: its epoch times
+ * give the missing epochs (gap larger than the nominal interval, learned as
+ * the smallest one; a step back in time is a restart) and the duplicates
+ * (same epoch and CRC), and the receive times compared with the epoch times
+ * give the jitter. The message types of each epoch are compared with the
+ * expected set, learned from the last 16 epochs (a type stays expected until
+ * it is missing from all of them). An epoch ends at the first message of the
+ * next one, or 100 ms (half of the interval at most) after its last message:
+ * a base sending the legacy and the MSM observations ends a group of messages
+ * for each. The age of each static message (station, antenna, biases,
+ * ephemerides) is kept, the one of the station position is checked. The
+ * counts are summed over the last 60 s in a ring of 1 s buckets.
+ *
+ * tick() evaluates the conditions, about once per second, and calls the
+ * event handler when one of them crosses its threshold (raised or cleared).
+ */
+class RtcmStreamMonitor
+{
+public:
+    static const int WINDOW_SECONDS = 60;
+    static const int MAX_OBSERVATION_TYPES = 16;
+    static const int STATIC_TYPES = 11;
+    static const int STATIC_TYPE_LIST[STATIC_TYPES];
+
+    enum Condition {
+        Stalled,            // No valid frame
+        IncompleteEpochs,   // Share of the epochs missing an expected message
+        MissingEpochs,      // Epochs missing in the window
+        DuplicateEpochs,    // Messages received twice in the window
+        Jitter,             // Mean deviation of the receive interval from the epoch interval (ms)
+        LowBitrate,         // Measured bitrate against the one of the sourcetable
+        StaleStatic,        // Age of the station position, 1005 or 1006 (s)
+        CrcErrors,          // Share of the frames with an invalid CRC
+        CONDITION_COUNT
+    };
+    static const char* conditionName(Condition condition);
+
+    struct Thresholds {
+        double stalledSeconds = 5;
+        double incompleteEpochRate = 0.05;
+        int missingEpochs = 3;
+        int duplicateEpochs = 3;
+        double jitterMs = 250;
+        double bitrateRatio = 0.5;      // Low below this share of the advertised bitrate
+        double staticMaxAgeSeconds = 60;
+        double crcErrorRate = 0.01;
+    };
+
+    struct Event {
+        Condition condition;
+        bool active;                    // Raised, or cleared
+        double value;
+        double threshold;
+        int type;                       // Station message type of StaleStatic, 0 otherwise
+    };
+    using EventHandler = std::function<void(const Event& event)>;
+
+    // Totals since the reset and values over the window
+    struct Stats {
+        uint64_t frames = 0;
+        uint64_t bytes = 0;
+        uint64_t crcFailures = 0;
+        uint64_t epochs = 0;
+        uint64_t incompleteEpochs = 0;
+        uint64_t missingEpochs = 0;
+        uint64_t duplicateEpochs = 0;
+        double jitterMs = 0;
+        double bitrate = 0;             // bit/s, 0 until 10 s of data
+        int advertisedBitrate = 0;
+        double staticAgeSeconds[STATIC_TYPES] = {};  // -1 if never received
+        bool active[CONDITION_COUNT] = {};
+    };
+
+    RtcmStreamMonitor();
+
+    void setThresholds(const Thresholds& thresholds) { _thresholds = thresholds; }
+    const Thresholds& thresholds() const { return _thresholds; }
+    // bit/s announced by the sourcetable, 0 if unknown (no bitrate check)
+    void setAdvertisedBitrate(int bitrate) { _advertisedBitrate = bitrate; }
+    void setEventHandler(EventHandler handler) { _onEvent = std::move(handler); }
+
+    // New stream (connection, mount point): the learned state is dropped, the conditions are cleared
+    void reset(int64_t nowNs);
+    void addFrame(const unsigned char* frame, size_t length, int type, int64_t nowNs);
+    void addCrcFailures(uint64_t count, int64_t nowNs);
+    void tick(int64_t nowNs);
+
+    Stats stats(int64_t nowNs) const;
+
+private:
+    struct Slot {
+        int type = 0;
+        uint32_t epoch = 0;             // Epoch time of the last message, ms
+        uint32_t crc = 0;
+        int64_t receivedNs = 0;
+        int64_t intervalMs = 0;         // Smallest epoch interval, 0 until known
+        uint16_t presence = 0;          // In each of the last 16 epochs, latest in bit 0
+        bool expected = false;          // In the message set of an epoch
+    };
+
+    struct Bucket {
+        int64_t second = -1;
+        uint32_t frames = 0;
+        uint32_t bytes = 0;
+        uint32_t crcFailures = 0;
+        uint32_t epochs = 0;
+        uint32_t incompleteEpochs = 0;
+        uint32_t missingEpochs = 0;
+        uint32_t duplicateEpochs = 0;
+        uint32_t jitterSamples = 0;
+        double jitterMs = 0;
+    };
+
+    Bucket& bucket(int64_t nowNs);
+    Bucket window(int64_t nowNs) const;     // Sum of the buckets of the last 60 s
+    Slot* slot(int type);
+    void endEpoch(int64_t nowNs);
+    int64_t mergeWindowNs() const;
+    void raise(Condition condition, bool active, double value, double threshold, int type = 0);
+
+    Thresholds _thresholds;
+    EventHandler _onEvent;
+    int _advertisedBitrate = 0;
+    int64_t _startNs = 0;
+    int64_t _lastFrameNs = 0;
+
+    Slot _slots[MAX_OBSERVATION_TYPES];
+    int _slotCount = 0;
+    uint32_t _epochSlots = 0;           // Slots received in the epoch in progress
+    uint32_t _epochMissing = 0;         // Epochs missing before it
+    uint32_t _epochsSeen = 0;
+    int64_t _endPendingNs = -1;         // Receive time of the last message of an epoch, until the next group
+
+    int64_t _staticNs[STATIC_TYPES];
+    Bucket _buckets[WINDOW_SECONDS];
+    Stats _totals;
+    bool _active[CONDITION_COUNT] = {};
+};
+
+#endif // RTCMMONITOR_H
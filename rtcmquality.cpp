@@ -0,0 +1,136 @@
+#include "rtcmquality.h"
+#include "rtcmbits.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <string>
+
+// Score weights, in points: 100 for a complete stream
+static const double DISTANCE_PENALTY_PER_KM = 1.0;     // About 1 ppm of baseline error per km
+static const double DELAY_PENALTY_PER_MS = 0.01;
+static const double JITTER_PENALTY_PER_MS = 0.05;
+static const double CRC_PENALTY = 200.0;               // For a 100 % error rate
+
+unsigned rtcmObservationSystem(int type)
+{
+    if (type >= 1001 && type <= 1004) return RTCM_SYSTEM_GPS;
+    if (type >= 1009 && type <= 1012) return RTCM_SYSTEM_GLONASS;
+    if (type < 1071 || type > 1137 || type % 10 < 1 || type % 10 > 7) return 0;
+    switch (type / 10) {
+    case 107: return RTCM_SYSTEM_GPS;
+    case 108: return RTCM_SYSTEM_GLONASS;
+    case 109: return RTCM_SYSTEM_GALILEO;
+    case 110: return RTCM_SYSTEM_SBAS;
+    case 111: return RTCM_SYSTEM_QZSS;
+    case 112: return RTCM_SYSTEM_BEIDOU;
+    case 113: return RTCM_SYSTEM_NAVIC;
+    default: return 0;
+    }
+}
+
+unsigned rtcmSystemsFromSourcetable(std::string_view navSystem, std::string_view formatDetails)
+{
+    unsigned systems = 0;
+    size_t start = 0;
+    while (start < navSystem.size()) {
+        size_t end = navSystem.find('+', start);
+        if (end == std::string_view::npos) end = navSystem.size();
+        std::string name;
+        for (char c : navSystem.substr(start, end - start)) {
+            if (!std::isspace(static_cast<unsigned char>(c))) name += static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+        }
+        if (name == "GPS") systems |= RTCM_SYSTEM_GPS;
+        else if (name.compare(0, 3, "GLO") == 0) systems |= RTCM_SYSTEM_GLONASS;
+        else if (name.compare(0, 3, "GAL") == 0) systems |= RTCM_SYSTEM_GALILEO;
+        else if (name.compare(0, 2, "BD") == 0 || name.compare(0, 3, "BEI") == 0 || name == "CMP") systems |= RTCM_SYSTEM_BEIDOU;
+        else if (name.compare(0, 3, "QZS") == 0) systems |= RTCM_SYSTEM_QZSS;
+        else if (name == "SBAS") systems |= RTCM_SYSTEM_SBAS;
+        else if (name == "IRS" || name == "IRNSS" || name == "NAVIC") systems |= RTCM_SYSTEM_NAVIC;
+        start = end + 1;
+    }
+    // "1004(1),1077(1)": the message numbers are the digits before each parenthesis or comma
+    int type = 0;
+    for (char c : formatDetails) {
+        if (c >= '0' && c <= '9') {
+            if (type >= 0) type = type * 10 + (c - '0');
+        } else if (c != ' ') {
+            if (type > 0) systems |= rtcmObservationSystem(type);
+            type = c == ',' ? 0 : -1;    // Skip the rate in parentheses
+        }
+    }
+    if (type > 0) systems |= rtcmObservationSystem(type);
+    return systems;
+}
+
+double rtcmQualityScore(const RtcmQualityResult& result, double distanceKm)
+{
+    if (!result.usable()) return -1;
+    double score = 100.0 * result.completeness
+                 - DISTANCE_PENALTY_PER_KM * distanceKm
+                 - DELAY_PENALTY_PER_MS * result.firstByteMs
+                 - JITTER_PENALTY_PER_MS * result.jitterMs
+                 - CRC_PENALTY * result.crcErrorRate;
+    return std::max(score, 0.0);
+}
+
+void RtcmStreamQuality::begin(int64_t requestNs, unsigned expectedSystems)
+{
+    *this = RtcmStreamQuality();
+    _requestNs = requestNs;
+    if (expectedSystems) _expectedSystems = expectedSystems;
+}
+
+void RtcmStreamQuality::addData(const unsigned char* data, size_t size, int64_t nowNs)
+{
+    if (size == 0) return;
+    if (_firstByteNs < 0) _firstByteNs = nowNs;
+    _buffer.insert(_buffer.end(), data, data + size);
+    size_t consumed = rtcmExtractFrames(_buffer.data(), _buffer.size(),
+        [this, nowNs](const unsigned char* frame, size_t length, int type) { addFrame(frame, length, type, nowNs); }, &_stats);
+    _buffer.erase(_buffer.begin(), _buffer.begin() + static_cast<std::ptrdiff_t>(consumed));
+}
+
+void RtcmStreamQuality::addFrame(const unsigned char* frame, size_t length, int type, int64_t nowNs)
+{
+    if (type == 1005 || type == 1006) _stationPosition = true;
+    unsigned system = rtcmObservationSystem(type);
+    if (!system) return;
+    _systems |= system;
+    // Multiple message bit of MSM and legacy GPS, synchronous GNSS bit of legacy GLONASS
+    size_t bit = (type >= 1009 && type <= 1012) ? 51 : 54;
+    if (length < 3 + 8 || rtcmGetUnsigned<1>(frame + 3, bit)) return;
+    if (_lastEpochNs >= 0) _intervals.push_back((nowNs - _lastEpochNs) / 1e6);
+    _lastEpochNs = nowNs;
+    ++_epochs;
+}
+
+RtcmQualityResult RtcmStreamQuality::result() const
+{
+    RtcmQualityResult r;
+    r.firstByteMs = _firstByteNs >= 0 ? (_firstByteNs - _requestNs) / 1e6 : -1;
+    r.epochs = _epochs;
+    if (!_intervals.empty()) {
+        std::vector<double> sorted = _intervals;
+        std::nth_element(sorted.begin(), sorted.begin() + sorted.size() / 2, sorted.end());
+        r.intervalMs = sorted[sorted.size() / 2];
+        double deviation = 0;
+        for (double interval : _intervals) deviation += std::fabs(interval - r.intervalMs);
+        r.jitterMs = deviation / _intervals.size();
+    }
+    r.frames = _stats.frames;
+    r.crcFailures = _stats.crcFailures;
+    if (_stats.frames + _stats.crcFailures > 0) {
+        r.crcErrorRate = static_cast<double>(_stats.crcFailures) / (_stats.frames + _stats.crcFailures);
+    }
+    r.systems = _systems;
+    r.expectedSystems = _expectedSystems;
+    int expected = 0, received = 0;
+    for (unsigned bit = 1; bit <= RTCM_SYSTEM_NAVIC; bit <<= 1) {
+        if (!(_expectedSystems & bit)) continue;
+        ++expected;
+        if (_systems & bit) ++received;
+    }
+    r.completeness = expected ? static_cast<double>(received) / expected : 0;
+    r.stationPosition = _stationPosition;
+    return r;
+}
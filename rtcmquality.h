@@ -0,0 +1,79 @@
+#ifndef RTCMQUALITY_H
+#define RTCMQUALITY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include "rtcmframer.h"
+
+/**
+ * Quality of a short RTCM 3 session, used to compare candidate mount points.
+ *
+ * The stream is fed as received (after the NTRIP response) with the
+ * monotonic time of each read. The end of an epoch is the observation message
+ * whose multiple message (synchronous GNSS) bit is clear; the intervals
+ * between these arrivals give the regularity of the base.
+ */
+
+// Constellation bits
+enum RtcmSystem : unsigned {
+    RTCM_SYSTEM_GPS = 1,
+    RTCM_SYSTEM_GLONASS = 2,
+    RTCM_SYSTEM_GALILEO = 4,
+    RTCM_SYSTEM_BEIDOU = 8,
+    RTCM_SYSTEM_QZSS = 16,
+    RTCM_SYSTEM_SBAS = 32,
+    RTCM_SYSTEM_NAVIC = 64
+};
+
+// Constellation of a legacy or MSM observation message, 0 for the other types
+unsigned rtcmObservationSystem(int type);
+// Constellations of a sourcetable STR record: navigation system field ("GPS+GLO+GAL+BDS") and
+// the observation messages of the format details ("1004(1),1005(10),1077(1)")
+unsigned rtcmSystemsFromSourcetable(std::string_view navSystem, std::string_view formatDetails);
+
+struct RtcmQualityResult {
+    double firstByteMs = -1;    // From the request to the first byte of data, -1 if none
+    int epochs = 0;
+    double intervalMs = 0;      // Median epoch interval
+    double jitterMs = 0;        // Mean absolute deviation of the intervals from the median
+    uint64_t frames = 0;
+    uint64_t crcFailures = 0;
+    double crcErrorRate = 0;    // Share of the frames with an invalid CRC
+    unsigned systems = 0;       // Constellations with observations
+    unsigned expectedSystems = 0;
+    double completeness = 0;    // Share of the expected constellations received
+    bool stationPosition = false; // 1005/1006 received (sent every 10 s or more, not scored)
+
+    bool usable() const { return epochs >= 2; }
+};
+
+// Higher is better: the missing constellations, the baseline length, the delay, the jitter and
+// the CRC errors are penalties. Negative for a stream without epochs.
+double rtcmQualityScore(const RtcmQualityResult& result, double distanceKm);
+
+class RtcmStreamQuality
+{
+public:
+    // expectedSystems: constellations announced by the sourcetable, GPS if 0
+    void begin(int64_t requestNs, unsigned expectedSystems);
+    void addData(const unsigned char* data, size_t size, int64_t nowNs);
+    RtcmQualityResult result() const;
+
+private:
+    void addFrame(const unsigned char* frame, size_t length, int type, int64_t nowNs);
+
+    int64_t _requestNs = 0;
+    int64_t _firstByteNs = -1;
+    int64_t _lastEpochNs = -1;
+    unsigned _expectedSystems = RTCM_SYSTEM_GPS;
+    unsigned _systems = 0;
+    bool _stationPosition = false;
+    int _epochs = 0;
+    std::vector<double> _intervals;     // ms
+    std::vector<unsigned char> _buffer; // Incomplete frame
+    RtcmFrameStats _stats;
+};
+
+#endif // RTCMQUALITY_H
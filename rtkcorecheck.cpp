@@ -0,0 +1,366 @@
+// rtkcore_check: accuracy and consistency checks of the Qt-free rtkcore library.
+//
+// Run by ctest. Prints one line per failed check and exits with the number
+// of failures.
+//
+//     rtkcore_check
+
+#include "crc24q.h"
+#include "geodesy.h"
+#include "nmeaparser.h"
+#include "rtcmbits.h"
+#include "rtcmmonitor.h"
+#include "rtcmquality.h"
+#include <cmath>
+#include <cstdio>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+static int failures = 0;
+static int checks = 0;
+
+static void check(bool ok, const char* what, double value, double expected, double tolerance)
+{
+    ++checks;
+    if (!ok || !(std::abs(value - expected) <= tolerance)) {
+        ++failures;
+        fprintf(stderr, "FAIL %s: %.9f, expected %.9f (tolerance %g)\n", what, value, expected, tolerance);
+    }
+}
+
+static void check(const char* what, double value, double expected, double tolerance)
+{
+    check(true, what, value, expected, tolerance);
+}
+
+// Reference UTM coordinates from PROJ 9.5 (extended transverse Mercator, accurate to
+// well below a millimeter at these distances from the central meridian). 33.3N 44.4E
+// is the example of the GeographicLib GeoConvert documentation.
+struct UtmPoint {
+    double lat, lon;
+    int zone;
+    double easting, northing;
+};
+
+static const UtmPoint utmPoints[] = {
+    {0.0, 3.0, 31, 500000.000000, 0.000000},
+    {0.0, 0.0, 31, 166021.443081, 0.000000},
+    {48.8566, 2.3522, 31, 452482.532703, 5411717.176869},
+    {-33.8688, 151.2093, 56, 334368.633648, 6250948.345385},
+    {33.3, 44.4, 38, 444140.544918, 3684706.355550},
+    // Zone edges: 6E is the west edge of zone 32, just below it is the east edge of zone 31
+    {47.0, 6.0, 32, 271930.434936, 5209532.848132},
+    {47.0, 5.999999, 31, 728069.489046, 5209532.845218},
+    {-12.5, -179.999, 1, 174009.792085, 8616308.533267},
+    {60.0, 179.999, 60, 667239.081671, 6655202.954237},
+    {-1e-06, -3.0, 30, 500000.000000, 9999999.889470},
+    // UTM latitude limits and poles (the north pole northing is k0 times the quarter meridian)
+    {84.0, -0.5, 30, 529166.196134, 9328726.755105},
+    {-80.0, -177.0, 1, 500000.000000, 1118414.184012},
+    {89.9999, 45.0, 38, 500000.000000, 9997953.778091},
+    {90.0, 0.0, 31, 500000.000000, 9997964.943021},
+    {-90.0, 0.0, 31, 500000.000000, 2035.056979},
+};
+
+// Points of zone 32 (central meridian 9E) projected 9 degrees away from it
+struct ZonePoint {
+    double lat, lon;
+    double easting, northing;
+};
+
+static const ZonePoint zone32Points[] = {
+    {50.0, 0.0, -144535.629000, 5577555.960877},
+    {50.0, 18.0, 1144535.629000, 5577555.960877},
+    {-45.0, 0.0, -209331.587385, 4977492.507722},
+};
+
+// Reference ECEF coordinates from PROJ 9.5
+struct EcefPoint {
+    double lat, lon, height;
+    double x, y, z;
+};
+
+static const EcefPoint ecefPoints[] = {
+    {0.0, 0.0, 0.0, 6378137.000000, 0.000000, 0.000000},
+    {90.0, 0.0, 0.0, 0.000000, 0.000000, 6356752.314245},
+    {-33.8688, 151.2093, 58.0, -4646093.477288, 2553229.535817, -3534404.710910},
+    {48.8566, 2.3522, 35.0, 4200937.804351, 172560.721433, 4780107.699250},
+    {45.0, -120.0, -100.0, -2258760.084085, -3912287.227744, 4487277.698188},
+};
+
+static void checkUtmReference()
+{
+    const double tolerance = 1e-5;
+    for (const UtmPoint& p : utmPoints) {
+        double easting, northing;
+        int zone;
+        Geodesy::latLonToUtm(p.lat, p.lon, easting, northing, zone);
+        char what[96];
+        snprintf(what, sizeof(what), "UTM easting of %.6f %.6f", p.lat, p.lon);
+        check(zone == p.zone, what, easting, p.easting, tolerance);
+        snprintf(what, sizeof(what), "UTM northing of %.6f %.6f", p.lat, p.lon);
+        check(what, northing, p.northing, tolerance);
+    }
+    for (const ZonePoint& p : zone32Points) {
+        double easting, northing;
+        Geodesy::latLonToUtmZone(&p.lat, &p.lon, 1, 32, &easting, &northing);
+        char what[96];
+        snprintf(what, sizeof(what), "zone 32 easting of %.6f %.6f", p.lat, p.lon);
+        check(what, easting, p.easting, tolerance);
+        snprintf(what, sizeof(what), "zone 32 northing of %.6f %.6f", p.lat, p.lon);
+        check(what, northing, p.northing, tolerance);
+    }
+}
+
+// Forward then inverse projection over the UTM latitude range, with the zone edges
+static void checkUtmRoundTrip()
+{
+    const double metersPerDegree = 111320.0;
+    const double tolerance = 1e-6; // meters
+    for (double lat = -80.0; lat <= 84.0; lat += 0.5) {
+        for (double dlon : {-3.0, -2.999999, -1.7, 0.0, 0.3, 2.5, 2.999999}) {
+            const double lon = 141.0 + dlon; // zone 54
+            double easting, northing, rlat, rlon;
+            int zone;
+            Geodesy::latLonToUtm(lat, lon, easting, northing, zone);
+            Geodesy::utmToLatLon(easting, northing, zone, lat >= 0, rlat, rlon);
+            char what[96];
+            snprintf(what, sizeof(what), "UTM round trip latitude of %.6f %.6f", lat, lon);
+            check(what, rlat * metersPerDegree, lat * metersPerDegree, tolerance);
+            snprintf(what, sizeof(what), "UTM round trip longitude of %.6f %.6f", lat, lon);
+            check(what, rlon * metersPerDegree * std::cos(lat * M_PI / 180),
+                  lon * metersPerDegree * std::cos(lat * M_PI / 180), tolerance);
+        }
+    }
+    // Poles: only the latitude is defined
+    for (double lat : {90.0, -90.0}) {
+        double easting, northing, rlat, rlon;
+        int zone;
+        Geodesy::latLonToUtm(lat, 10.0, easting, northing, zone);
+        Geodesy::utmToLatLon(easting, northing, zone, lat >= 0, rlat, rlon);
+        check("UTM round trip latitude of a pole", rlat * metersPerDegree, lat * metersPerDegree, tolerance);
+    }
+}
+
+static void checkEcef()
+{
+    for (const EcefPoint& p : ecefPoints) {
+        double x, y, z;
+        Geodesy::geodeticToEcef(&p.lat, &p.lon, &p.height, 1, &x, &y, &z);
+        char what[96];
+        snprintf(what, sizeof(what), "ECEF of %.6f %.6f %.1f", p.lat, p.lon, p.height);
+        check(what, std::sqrt((x - p.x) * (x - p.x) + (y - p.y) * (y - p.y) + (z - p.z) * (z - p.z)), 0.0, 1e-6);
+    }
+}
+
+// ENU of points up to 100 km around bases at several latitudes, then back to geodetic
+static void checkEnuRoundTrip()
+{
+    const double metersPerDegree = 111320.0;
+    for (double baseLat : {-89.0, -45.0, 0.0, 37.5, 60.0, 89.0}) {
+        const Geodesy::EnuFrame frame(baseLat, 7.25, 120.0);
+        for (double offset : {-0.9, -0.01, 0.0, 0.01, 0.9}) {
+            const double lat = baseLat + offset;
+            const double lon = 7.25 - offset;
+            const double height = 120.0 + offset * 1000;
+            double east, north, up, rlat, rlon, rheight;
+            frame.toEnu(lat, lon, height, east, north, up);
+            frame.toGeodetic(east, north, up, rlat, rlon, rheight);
+            char what[96];
+            snprintf(what, sizeof(what), "ENU round trip latitude of %.6f %.6f", lat, lon);
+            check(what, rlat * metersPerDegree, lat * metersPerDegree, 1e-4);
+            snprintf(what, sizeof(what), "ENU round trip longitude of %.6f %.6f", lat, lon);
+            check(what, rlon * metersPerDegree * std::cos(lat * M_PI / 180),
+                  lon * metersPerDegree * std::cos(lat * M_PI / 180), 1e-4);
+            snprintf(what, sizeof(what), "ENU round trip height of %.6f %.6f", lat, lon);
+            check(what, rheight, height, 1e-4);
+        }
+    }
+}
+
+// Appends the checksum to "$...*"
+static std::string sentence(const char* body)
+{
+    unsigned char checksum = 0;
+    for (const char* p = body + 1; *p && *p != '*'; ++p)
+        checksum ^= static_cast<unsigned char>(*p);
+    char hex[4];
+    snprintf(hex, sizeof(hex), "%02X", checksum);
+    return std::string(body) + hex;
+}
+
+// UTC time of the GGA and RMC sentences, and the date carried over midnight
+static void checkNmeaTime()
+{
+    NmeaParser parser;
+    parser.parse(sentence("$GNRMC,235959.00,A,4717.11399,N,00833.91590,E,0.004,77.52,311224,,,A*"));
+    check("RMC UTC time", static_cast<double>(parser.fix().utcMsecs()), 1735689599000.0, 0.0);
+    parser.parse(sentence("$GNGGA,000000.10,4717.11399,N,00833.91590,E,4,12,0.7,499.6,M,48.0,M,1.0,0000*"));
+    check("GGA UTC time after midnight", static_cast<double>(parser.fix().utcMsecs()), 1735689600100.0, 0.0);
+    parser.parse(sentence("$GNRMC,000000.10,A,4717.11399,N,00833.91590,E,0.004,77.52,010125,,,A*"));
+    check("RMC UTC time after midnight", static_cast<double>(parser.fix().utcMsecs()), 1735689600100.0, 0.0);
+    parser.parse(sentence("$GNGGA,000000.20,4717.11399,N,00833.91590,E,4,12,0.7,499.6,M,48.0,M,1.0,0000*"));
+    check("GGA UTC time", static_cast<double>(parser.fix().utcMsecs()), 1735689600200.0, 0.0);
+}
+
+// The RMC speed only belongs to the epoch of its RMC
+static void checkNmeaVelocity()
+{
+    NmeaParser parser;
+    parser.parse(sentence("$GNGGA,120000.00,4717.11399,N,00833.91590,E,4,12,0.7,499.6,M,48.0,M,1.0,0000*"));
+    check(!parser.fix().hasVelocity(), "no velocity before an RMC", 0, 0, 0);
+    parser.parse(sentence("$GNRMC,120000.00,A,4717.11399,N,00833.91590,E,10.0,90.0,311224,,,A*"));
+    check(parser.fix().hasVelocity(), "velocity of the RMC epoch", parser.fix().speedMs, 5.144, 1e-9);
+    parser.parse(sentence("$GNGGA,120000.10,4717.11399,N,00833.91590,E,4,12,0.7,499.6,M,48.0,M,1.0,0000*"));
+    check(!parser.fix().hasVelocity(), "no velocity in a GGA-only epoch", 0, 0, 0);
+}
+
+// Time of the sentences that carry one, the epoch of the others is given by their neighbors
+static void checkNmeaTimeOfDay()
+{
+    const double expected = 12 * 3600 + 34 * 60 + 56.2;
+    check("GGA time of day", NmeaParser::timeOfDay("$GNGGA,123456.20,4717.11399,N,00833.91590,E,4,12,0.7,499.6,M,48.0,M,1.0,0000*4F"), expected, 1e-9);
+    check("RMC time of day", NmeaParser::timeOfDay("$GNRMC,123456.20,A,4717.11399,N,00833.91590,E,0.004,77.52,311224,,,A*5F"), expected, 1e-9);
+    check("GLL time of day", NmeaParser::timeOfDay("$GNGLL,4717.11399,N,00833.91590,E,123456.20,A,A*7A"), expected, 1e-9);
+    check("GST time of day", NmeaParser::timeOfDay("$GNGST,123456.20,0.5,0.01,0.01,0.0,0.008,0.009,0.015*4B"), expected, 1e-9);
+    check("GSA without time", NmeaParser::timeOfDay("$GNGSA,A,3,01,02,03,,,,,,,,,,1.2,0.7,1.0,1*33"), -1, 0);
+    check("VTG without time", NmeaParser::timeOfDay("$GNVTG,77.52,T,,M,0.004,N,0.008,K,A*3D"), -1, 0);
+    check("GGA with an empty time", NmeaParser::timeOfDay("$GNGGA,,,,,,0,00,99.99,,,,,,*56"), -1, 0);
+}
+
+// Observation message of the given epoch (GPS time of week, ms), without satellites. The GLONASS
+// messages carry the time of day in Moscow time.
+static std::vector<unsigned char> observationFrame(int type, int64_t towMs, bool more)
+{
+    std::vector<unsigned char> frame(3 + 20 + 3, 0);
+    unsigned char* payload = frame.data() + 3;
+    bool legacyGlonass = type >= 1009 && type <= 1012;
+    int64_t glonassTod = (towMs - 18000 + 3 * 3600000) % 86400000;
+    rtcmSetUnsigned(payload, 0, 12, type);
+    if (legacyGlonass) {
+        rtcmSetUnsigned(payload, 24, 27, glonassTod);
+        rtcmSetUnsigned(payload, 51, 1, more);
+    } else {
+        if (type / 10 == 108) rtcmSetUnsigned(payload, 27, 27, glonassTod);
+        else rtcmSetUnsigned(payload, 24, 30, towMs);
+        rtcmSetUnsigned(payload, 54, 1, more);
+    }
+    frame[0] = 0xD3;
+    frame[2] = 20;
+    uint32_t crc = rtcm_crc(frame.data(), 3 + 20);
+    frame[23] = static_cast<unsigned char>(crc >> 16);
+    frame[24] = static_cast<unsigned char>(crc >> 8);
+    frame[25] = static_cast<unsigned char>(crc);
+    return frame;
+}
+
+static void addObservation(RtcmStreamMonitor& monitor, int type, int64_t towMs, bool more, int64_t nowNs)
+{
+    std::vector<unsigned char> frame = observationFrame(type, towMs, more);
+    monitor.addFrame(frame.data(), frame.size(), type, nowNs);
+}
+
+// Constellations of the observation messages, NavIC MSM included
+static void checkObservationSystems()
+{
+    check("system of 1004", rtcmObservationSystem(1004), RTCM_SYSTEM_GPS, 0);
+    check("system of 1012", rtcmObservationSystem(1012), RTCM_SYSTEM_GLONASS, 0);
+    check("system of 1127", rtcmObservationSystem(1127), RTCM_SYSTEM_BEIDOU, 0);
+    check("system of 1131", rtcmObservationSystem(1131), RTCM_SYSTEM_NAVIC, 0);
+    check("system of 1137", rtcmObservationSystem(1137), RTCM_SYSTEM_NAVIC, 0);
+    check("system of 1138", rtcmObservationSystem(1138), 0, 0);
+    check("system of 1130", rtcmObservationSystem(1130), 0, 0);
+    check("systems of a GPS+IRS sourcetable record", rtcmSystemsFromSourcetable("GPS+IRS", ""),
+          RTCM_SYSTEM_GPS | RTCM_SYSTEM_NAVIC, 0);
+}
+
+// A 1 Hz base sending the legacy and the MSM observations, each group with its last message: one
+// epoch each
+static void checkMonitorEpochs()
+{
+    const int64_t second = 1000000000;
+    const int64_t ms = 1000000;
+    const int64_t tow = 388800000;
+    RtcmStreamMonitor monitor;
+    monitor.reset(0);
+    for (int i = 0; i < 30; ++i) {
+        if (i == 20) continue;                      // Lost epoch
+        int64_t now = (i + 1) * second;
+        addObservation(monitor, 1004, tow + i * 1000, true, now + 1 * ms);
+        addObservation(monitor, 1012, tow + i * 1000, false, now + 2 * ms);
+        addObservation(monitor, 1077, tow + i * 1000, true, now + 3 * ms);
+        if (i != 10) addObservation(monitor, 1087, tow + i * 1000, true, now + 4 * ms);    // Lost message
+        addObservation(monitor, 1097, tow + i * 1000, true, now + 5 * ms);
+        addObservation(monitor, 1127, tow + i * 1000, false, now + 6 * ms);
+        monitor.tick(now + 500 * ms);
+    }
+    RtcmStreamMonitor::Stats stats = monitor.stats(31 * second);
+    check("epochs of a legacy and MSM base", static_cast<double>(stats.epochs), 29, 0);
+    check("incomplete epochs of a legacy and MSM base", static_cast<double>(stats.incompleteEpochs), 1, 0);
+    // The lost epoch, and the gap of the lost 1087
+    check("missing epochs of a legacy and MSM base", static_cast<double>(stats.missingEpochs), 2, 0);
+    check("duplicate epochs of a legacy and MSM base", static_cast<double>(stats.duplicateEpochs), 0, 0);
+
+    // 10 Hz, one message per epoch and no tick: each epoch ends at the next one
+    monitor.reset(0);
+    for (int i = 0; i < 50; ++i) {
+        addObservation(monitor, 1077, tow + i * 100, false, second + i * 100 * ms);
+    }
+    stats = monitor.stats(second + 5 * second);
+    check("epochs of a 10 Hz base", static_cast<double>(stats.epochs), 49, 0);
+}
+
+// Week rollover and base restart: no missing epochs. Stale station position only.
+static void checkMonitorResync()
+{
+    const int64_t second = 1000000000;
+    RtcmStreamMonitor monitor;
+    monitor.reset(0);
+    int64_t tow = 604800000 - 5000;
+    for (int i = 0; i < 20; ++i) {
+        if (i == 10) tow -= 3600000;                // Restart an hour back
+        addObservation(monitor, 1077, tow % 604800000, false, (i + 1) * second);
+        tow += 1000;
+    }
+    monitor.tick(21 * second);
+    RtcmStreamMonitor::Stats stats = monitor.stats(21 * second);
+    check("missing epochs over a week rollover and a restart", static_cast<double>(stats.missingEpochs), 0, 0);
+    check("epochs over a week rollover and a restart", static_cast<double>(stats.epochs), 20, 0);
+
+    // 1005 every 10 s and a single ephemeris at the start
+    monitor.reset(0);
+    bool stale = false;
+    monitor.setEventHandler([&stale](const RtcmStreamMonitor::Event& event) {
+        if (event.condition == RtcmStreamMonitor::StaleStatic) stale = event.active;
+    });
+    addObservation(monitor, 1019, 0, false, second);
+    for (int i = 1; i <= 120; ++i) {
+        if (i % 10 == 0) addObservation(monitor, 1005, 0, false, i * second);
+        monitor.tick(i * second);
+    }
+    check("stale station position with an old ephemeris", stale, 0, 0);
+    for (int i = 121; i <= 200; ++i) monitor.tick(i * second);
+    check("stale station position after 80 s", stale, 1, 0);
+}
+
+int main()
+{
+    checkUtmReference();
+    checkUtmRoundTrip();
+    checkEcef();
+    checkEnuRoundTrip();
+    checkNmeaTime();
+    checkNmeaVelocity();
+    checkNmeaTimeOfDay();
+    checkObservationSystems();
+    checkMonitorEpochs();
+    checkMonitorResync();
+
+    printf("%d checks, %d failures\n", checks, failures);
+    return failures;
+}
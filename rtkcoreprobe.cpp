@@ -0,0 +1,144 @@
+// rtkcore_probe: example of the Qt-free rtkcore library and measure of its footprint.
+//
+// Reads a raw receiver or caster capture (NMEA text and RTCM frames, as written
+// by the serial port or an NTRIP stream), frames the RTCM messages, parses the
+// NMEA sentences and converts the last fix to UTM. It then prints the counts,
+// the time from process start to the first parsed fix and to the end, the heap
+// allocations and the peak resident memory.
+//
+//     rtkcore_probe capture.bin
+
+#include "geodesy.h"
+#include "nmeaparser.h"
+#include "rtcmframer.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+#include <sys/resource.h>
+
+static std::atomic<unsigned long> allocations{0};
+
+void* operator new(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+// Process start, approximated by the initialization of this object
+static const auto startTime = std::chrono::steady_clock::now();
+
+static double elapsedMs()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s capture\n", argv[0]);
+        return 1;
+    }
+    FILE* file = fopen(argv[1], "rb");
+    if (!file) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    NmeaParser parser;
+    RtcmFrameStats stats;
+    unsigned long framesPerType[4096] = {};
+    unsigned long sentences = 0, rejected = 0, fixes = 0;
+    double firstFixMs = -1.0;
+    unsigned long allocationsAtStart = allocations.load();
+
+    // Same buffering as a serial reader: fixed buffer, the incomplete tail is kept for the next read
+    std::vector<unsigned char> buffer(64 * 1024);
+    size_t used = 0;
+    size_t lineStart = 0;
+    size_t frameStart = 0;
+    size_t bytes = 0;
+    for (;;) {
+        size_t n = fread(buffer.data() + used, 1, buffer.size() - used, file);
+        if (n == 0) break;
+        bytes += n;
+        size_t end = used + n;
+
+        // NMEA sentences: the complete lines starting with '$'
+        const char* text = reinterpret_cast<const char*>(buffer.data());
+        size_t pos = lineStart;
+        for (;;) {
+            const void* newline = memchr(text + pos, '\n', end - pos);
+            if (!newline) break;
+            size_t lineEnd = static_cast<const char*>(newline) - text;
+            // The last '$' of the line, binary RTCM bytes before the sentence may contain one
+            const char* dollar = nullptr;
+            for (const char* c = text + lineEnd; c > text + pos;) {
+                if (*--c == '$') {
+                    dollar = c;
+                    break;
+                }
+            }
+            if (dollar) {
+                size_t length = text + lineEnd - dollar;
+                if (length > 0 && dollar[length - 1] == '\r') --length;
+                ++sentences;
+                if (!parser.parse(std::string_view(dollar, length))) {
+                    ++rejected;
+                } else if (length > 6 && memcmp(dollar + 3, "GGA", 3) == 0 && parser.fix().hasFix()) {
+                    ++fixes;
+                    if (firstFixMs < 0) firstFixMs = elapsedMs();
+                }
+            }
+            pos = lineEnd + 1;
+        }
+
+        // RTCM frames, the text in between is skipped by the resynchronization
+        size_t frameEnd = frameStart + rtcmExtractFrames(buffer.data() + frameStart, end - frameStart,
+            [&framesPerType](const unsigned char*, size_t, int type) { ++framesPerType[type]; }, &stats);
+
+        // Keep the bytes still needed by either parser
+        size_t keep = pos < frameEnd ? pos : frameEnd;
+        if (keep == 0 && end == buffer.size()) {
+            keep = end; // No progress on a full buffer: drop it
+        }
+        memmove(buffer.data(), buffer.data() + keep, end - keep);
+        used = end - keep;
+        lineStart = pos > keep ? pos - keep : 0;
+        frameStart = frameEnd > keep ? frameEnd - keep : 0;
+    }
+    fclose(file);
+    double totalMs = elapsedMs();
+
+    printf("bytes %zu\n", bytes);
+    printf("nmea_sentences %lu (rejected %lu), fixes %lu\n", sentences, rejected, fixes);
+    printf("rtcm_frames %llu, crc_failures %llu, resync_bytes %llu\n",
+           static_cast<unsigned long long>(stats.frames), static_cast<unsigned long long>(stats.crcFailures),
+           static_cast<unsigned long long>(stats.resyncBytes));
+    for (int type = 0; type < 4096; ++type) {
+        if (framesPerType[type]) printf("  rtcm %d: %lu\n", type, framesPerType[type]);
+    }
+
+    const NmeaFix& fix = parser.fix();
+    if (fix.hasFix()) {
+        double easting, northing;
+        int zone;
+        Geodesy::latLonToUtm(fix.latitude, fix.longitude, easting, northing, zone);
+        printf("last fix %.9f %.9f %.3f (quality %d), UTM %d%c %.3f %.3f\n", fix.latitude, fix.longitude, fix.altitude,
+               fix.fixQuality, zone, fix.latitude < 0 ? 'S' : 'N', easting, northing);
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    printf("first_fix_ms %.3f, total_ms %.1f (%.0f MB/s)\n", firstFixMs, totalMs, bytes / 1e3 / totalMs);
+    printf("heap_allocations %lu (parsing: %lu)\n", allocations.load(), allocations.load() - allocationsAtStart);
+    printf("peak_rss_kb %ld\n", usage.ru_maxrss);
+    return 0;
+}
@@ -0,0 +1,70 @@
+/*
+ * rtkfix.h - Binary fix record produced by rtkrover (output_type = binary)
+ *
+ * Every record is a fixed-size little-endian structure, sent without any
+ * separator. Consumers on little-endian hosts can decode a record with a
+ * single memcpy (see rtk_fix_decode).
+ *
+ * This header is plain C and has no dependencies, it can be copied into
+ * consumer projects.
+ */
+#ifndef RTKFIX_H
+#define RTKFIX_H
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RTK_FIX_MAGIC   0x464B5452u  /* "RTKF" in little-endian byte order */
+#define RTK_FIX_VERSION 1
+
+/* Flags */
+#define RTK_FIX_PREDICTED 0x1u  /* Extrapolated by the predictor: utc_time_ms is the predicted time,
+                                   std_lat/std_lon/std_alt are the north/east/up standard deviations
+                                   of the prediction and hdop is NaN */
+
+/* Unknown values: utc_time_ms is -1, floating point fields are NaN. */
+typedef struct rtk_fix_record {
+    uint32_t magic;         /*  0: RTK_FIX_MAGIC */
+    uint16_t version;       /*  4: RTK_FIX_VERSION */
+    uint16_t size;          /*  6: sizeof(rtk_fix_record) */
+    uint32_t sequence;      /*  8: incremented for every record, wraps around */
+    uint32_t flags;         /* 12: RTK_FIX_* flags */
+    uint64_t recv_time_ns;  /* 16: monotonic clock (CLOCK_MONOTONIC) when the epoch was received */
+    int64_t  utc_time_ms;   /* 24: UTC time of the fix, milliseconds since 1970-01-01 */
+    double   latitude;      /* 32: degrees, positive north */
+    double   longitude;     /* 40: degrees, positive east */
+    double   altitude;      /* 48: meters above mean sea level */
+    float    speed_ms;      /* 56: ground speed, m/s */
+    float    heading_deg;   /* 60: course over ground, degrees */
+    float    hdop;          /* 64 */
+    float    std_lat;       /* 68: latitude standard deviation (GST), meters */
+    float    std_lon;       /* 72: longitude standard deviation (GST), meters */
+    float    std_alt;       /* 76: altitude standard deviation (GST), meters */
+    uint8_t  fix_quality;   /* 80: GGA fix quality (0 no fix, 1 GPS, 2 DGPS, 4 RTK fix, 5 RTK float) */
+    uint8_t  fix_mode;      /* 81: GSA fix mode (1 no fix, 2 2D, 3 3D) */
+    uint8_t  satellites;    /* 82: satellites used */
+    uint8_t  reserved1[5];  /* 83 */
+} rtk_fix_record;
+
+typedef char rtk_fix_record_size_check[sizeof(rtk_fix_record) == 88 ? 1 : -1];
+
+/* Decodes one record. Returns 0 on success, -1 if the buffer does not hold a valid record. */
+static inline int rtk_fix_decode(const void *buffer, size_t length, rtk_fix_record *record)
+{
+    if (length < sizeof(rtk_fix_record))
+        return -1;
+    memcpy(record, buffer, sizeof(rtk_fix_record));
+    if (record->magic != RTK_FIX_MAGIC || record->version != RTK_FIX_VERSION || record->size != sizeof(rtk_fix_record))
+        return -1;
+    return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RTKFIX_H */
@@ -0,0 +1,348 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QHash>
+#include <QLoggingCategory>
+#include <QPair>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+#include "casterreader.h"
+#include "crc24q.h"
+#include "logger.h"
+#include "metrics.h"
+
+// Reconnection latency of the caster connection: plain TCP, TLS with a full
+// handshake, TLS resuming the previous session, and the stream requested on
+// the connection of the sourcetable.
+//
+// The CasterReader of the rover connects through a proxy adding the round
+// trip time of a cellular link (TCP handshake included) to a local stand-in
+// caster. TLS needs a terminator in front of the stand-in which shares its
+// session keys between the connections, such as stunnel (see the README):
+// the Qt server sockets have a TLS context each and never resume a session.
+
+static const char* STANDIN_MOUNTPOINT = "BENCH";
+
+static QByteArray rtcmFrame(int type, int payloadSize)
+{
+    QByteArray frame(payloadSize + 6, '\0');
+    unsigned char* p = reinterpret_cast<unsigned char*>(frame.data());
+    p[0] = 0xD3;
+    p[1] = (payloadSize >> 8) & 0x03;
+    p[2] = payloadSize & 0xFF;
+    p[3] = static_cast<unsigned char>(type >> 4);
+    p[4] = static_cast<unsigned char>((type & 0x0F) << 4);
+    uint32_t crc = rtcm_crc(p, payloadSize + 3);
+    p[payloadSize + 3] = (crc >> 16) & 0xFF;
+    p[payloadSize + 4] = (crc >> 8) & 0xFF;
+    p[payloadSize + 5] = crc & 0xFF;
+    return frame;
+}
+
+// NTRIP 2.0 caster with a single mount point sending a station message every second. The
+// sourcetable connection is kept open when the client asks for keep-alive.
+class StandInCaster : public QTcpServer
+{
+public:
+    explicit StandInCaster(QObject* parent = nullptr) : QTcpServer(parent)
+    {
+        connect(this, &QTcpServer::newConnection, this, [this]() {
+            while (QTcpSocket* socket = nextPendingConnection()) {
+                connect(socket, &QTcpSocket::readyRead, this, [this, socket]() { onReadyRead(socket); });
+                connect(socket, &QTcpSocket::disconnected, this, [this, socket]() {
+                    _requests.remove(socket);
+                    socket->deleteLater();
+                });
+            }
+        });
+    }
+
+private:
+    void onReadyRead(QTcpSocket* socket)
+    {
+        QByteArray& buffer = _requests[socket];
+        buffer += socket->readAll();
+        int end;
+        while ((end = buffer.indexOf("\r\n\r\n")) >= 0) {
+            QByteArray header = buffer.left(end);
+            buffer.remove(0, end + 4);
+            QByteArray path = header.split(' ').value(1);
+            if (path == "/") {
+                bool keepAlive = header.toLower().contains("connection: keep-alive");
+                QByteArray body = QByteArray("STR;") + STANDIN_MOUNTPOINT
+                                + ";Bench;RTCM 3.3;1005(1);2;GPS;BENCH;FRA;48.85;2.35;0;0;rtkntrip_bench;none;B;N;9600;\r\n"
+                                  "ENDSOURCETABLE\r\n";
+                socket->write("HTTP/1.1 200 OK\r\nNtrip-Version: Ntrip/2.0\r\nContent-Type: gnss/sourcetable\r\n"
+                              "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+                              + (keepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n") + body);
+                if (!keepAlive) socket->disconnectFromHost();
+            } else {
+                static const QByteArray frame = rtcmFrame(1005, 19);
+                socket->write("HTTP/1.1 200 OK\r\nNtrip-Version: Ntrip/2.0\r\nContent-Type: gnss/data\r\n\r\n" + frame);
+                QTimer* timer = new QTimer(socket);
+                connect(timer, &QTimer::timeout, socket, [socket]() { socket->write(frame); });
+                timer->start(1000);
+            }
+        }
+    }
+
+    QHash<QTcpSocket*, QByteArray> _requests;
+};
+
+// Forwards the connections to the target, each direction delayed by half the round trip time. The
+// data of the client is held one more round trip after the connection, the time of the TCP handshake.
+class LatencyProxy : public QTcpServer
+{
+public:
+    LatencyProxy(const QString& host, int port, int rttMs, QObject* parent = nullptr)
+        : QTcpServer(parent), _host(host), _port(port), _rttMs(rttMs)
+    {
+        _clock.start();
+        connect(this, &QTcpServer::newConnection, this, [this]() {
+            while (QTcpSocket* client = nextPendingConnection()) {
+                link(client);
+            }
+        });
+    }
+
+private:
+    struct Direction {
+        qint64 earliestMs = 0;      // Release time of the data sent so far
+    };
+
+    void link(QTcpSocket* client)
+    {
+        QTcpSocket* upstream = new QTcpSocket(client);
+        Direction* out = new Direction;
+        Direction* in = new Direction;
+        out->earliestMs = _clock.elapsed() + _rttMs;
+        connect(client, &QObject::destroyed, [out, in]() {
+            delete out;
+            delete in;
+        });
+        connect(client, &QTcpSocket::readyRead, upstream, [this, client, upstream, out]() {
+            deliver(out, upstream, client->readAll(), false);
+        });
+        connect(upstream, &QTcpSocket::readyRead, client, [this, client, upstream, in]() {
+            deliver(in, client, upstream->readAll(), false);
+        });
+        connect(client, &QTcpSocket::disconnected, upstream, [this, upstream, out]() {
+            deliver(out, upstream, QByteArray(), true);
+        });
+        connect(upstream, &QTcpSocket::disconnected, client, [this, client, in]() {
+            deliver(in, client, QByteArray(), true);
+        });
+        connect(client, &QTcpSocket::disconnected, client, [this, client]() {
+            QTimer::singleShot(_rttMs, client, &QObject::deleteLater);
+        });
+        upstream->connectToHost(_host, _port);
+    }
+
+    void deliver(Direction* direction, QTcpSocket* target, const QByteArray& data, bool close)
+    {
+        qint64 now = _clock.elapsed();
+        direction->earliestMs = std::max(direction->earliestMs, now + _rttMs / 2);
+        QTimer::singleShot(direction->earliestMs - now, target, [target, data, close]() {
+            if (close) {
+                target->disconnectFromHost();
+            } else {
+                target->write(data);
+            }
+        });
+    }
+
+    QString _host;
+    int _port;
+    int _rttMs;
+    QElapsedTimer _clock;
+};
+
+template <typename Signal>
+static bool waitFor(const CasterReader* reader, Signal signal, int timeoutMs)
+{
+    QEventLoop loop;
+    bool received = false;
+    QObject::connect(reader, signal, &loop, [&received, &loop]() {
+        received = true;
+        loop.quit();
+    });
+    QTimer::singleShot(timeoutMs, &loop, &QEventLoop::quit);
+    loop.exec();
+    return received;
+}
+
+struct Case {
+    const char* name;
+    bool tls;
+    bool resume;                // Session ticket of the previous connection offered
+    bool sourcetable;           // Sourcetable fetched before the stream
+    bool reuse;                 // Stream requested on the connection of the sourcetable
+};
+
+struct Timing {
+    std::vector<double> connectMs;      // TCP connection and TLS handshake of the stream
+    std::vector<double> totalMs;        // To the first frame, from the sourcetable request if any
+    int failures = 0;
+    quint64 resumed = 0;                // TLS sessions resumed by the caster
+    quint64 fallbacks = 0;              // Reused connections closed by the caster
+};
+
+static double percentile(std::vector<double> values, double p)
+{
+    if (values.empty()) return 0;
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, static_cast<size_t>(p * values.size()))];
+}
+
+// The first connection is not counted: it fetches the first ticket for the resumed cases
+static Timing run(CasterReader& reader, const Case& c, const QString& mountpoint, int count, int timeoutMs)
+{
+    Timing timing;
+    const Metrics::Registry& metrics = Metrics::registry();
+    reader.tls()->setEnabled(c.tls);
+    reader.setConnectionReuse(c.reuse);
+    const quint64 resumedBefore = metrics.ntripTlsResumptions.value();
+    const quint64 fallbacksBefore = metrics.ntripReuseFallbacks.value();
+    for (int i = 0; i <= count; ++i) {
+        if (!c.resume) reader.tls()->clear();
+        QElapsedTimer clock;
+        clock.start();
+        bool ok = true;
+        if (c.sourcetable) {
+            reader.requestSourcetable();
+            ok = waitFor(&reader, &CasterReader::sourcetableReady, timeoutMs);
+        }
+        if (ok) {
+            reader.start(mountpoint);
+            ok = waitFor(&reader, &CasterReader::rtcmPacketReady, timeoutMs);
+        }
+        double totalMs = clock.nsecsElapsed() / 1e6;
+        reader.stop();
+        if (!ok) {
+            ++timing.failures;
+            continue;
+        }
+        if (i == 0) continue;
+        timing.connectMs.push_back(metrics.ntripConnectUs.value() / 1e3);
+        timing.totalMs.push_back(totalMs);
+    }
+    timing.resumed = metrics.ntripTlsResumptions.value() - resumedBefore;
+    timing.fallbacks = metrics.ntripReuseFallbacks.value() - fallbacksBefore;
+    return timing;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("rtkntrip_bench");
+    QCoreApplication::setApplicationVersion("1.0");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Reconnection latency of the caster connection, plain TCP and TLS.");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    QCommandLineOption rttOption("rtt", "Round trip time added by the proxy (default 100 ms, 0 with --host).", "ms");
+    QCommandLineOption countOption("count", "Connections measured per case.", "n", "20");
+    QCommandLineOption casterPortOption("caster-port", "Port of the stand-in caster.", "port", "12101");
+    QCommandLineOption tlsPortOption("tls-port", "Port of the TLS terminator in front of the caster (TLS cases).", "port");
+    QCommandLineOption hostOption("host", "Real caster to measure instead of the stand-in.", "host");
+    QCommandLineOption portOption("port", "Plain TCP port of the real caster.", "port", "2101");
+    QCommandLineOption mountpointOption("mountpoint", "Mount point of the real caster.", "name");
+    QCommandLineOption userOption("user", "User name of the real caster.", "name", "centipede");
+    QCommandLineOption passwordOption("password", "Password of the real caster.", "password", "centipede");
+    for (const QCommandLineOption& option : {rttOption, countOption, casterPortOption, tlsPortOption, hostOption,
+                                             portOption, mountpointOption, userOption, passwordOption}) {
+        parser.addOption(option);
+    }
+    parser.process(a);
+
+    QLoggingCategory::setFilterRules("*.debug=false");
+    Log::configure(Log::Warning, Log::Mode::Text);
+
+    const bool standIn = !parser.isSet(hostOption);
+    const QString host = standIn ? QString("127.0.0.1") : parser.value(hostOption);
+    const int port = standIn ? parser.value(casterPortOption).toInt() : parser.value(portOption).toInt();
+    const int tlsPort = parser.value(tlsPortOption).toInt();
+    const int rttMs = parser.isSet(rttOption) ? parser.value(rttOption).toInt() : (standIn ? 100 : 0);
+    const int count = qMax(1, parser.value(countOption).toInt());
+    const QString mountpoint = standIn ? QString(STANDIN_MOUNTPOINT) : parser.value(mountpointOption);
+    if (mountpoint.isEmpty()) {
+        fprintf(stderr, "--mountpoint is needed with --host\n");
+        return 1;
+    }
+
+    if (standIn) {
+        StandInCaster* caster = new StandInCaster(&a);
+        if (!caster->listen(QHostAddress::LocalHost, port)) {
+            fprintf(stderr, "Can't listen on port %d: %s\n", port, qPrintable(caster->errorString()));
+            return 1;
+        }
+    }
+    // Without added latency the client connects directly, with the name of the caster for TLS (SNI)
+    auto endpoint = [&](int targetPort) -> QPair<QString, int> {
+        if (rttMs <= 0) return {host, targetPort};
+        LatencyProxy* proxy = new LatencyProxy(host, targetPort, rttMs, &a);
+        if (!proxy->listen(QHostAddress::LocalHost)) {
+            fprintf(stderr, "Can't start the proxy: %s\n", qPrintable(proxy->errorString()));
+            return {QString(), 0};
+        }
+        return {QString("127.0.0.1"), proxy->serverPort()};
+    };
+    QPair<QString, int> plain = endpoint(port);
+    QPair<QString, int> tls = tlsPort > 0 ? endpoint(tlsPort) : QPair<QString, int>();
+    if (plain.second == 0 || (tlsPort > 0 && tls.second == 0)) return 1;
+
+    CasterReader reader;
+    // The stand-in certificate is self-signed, and a proxied caster is not reached under its name
+    reader.tls()->setVerifyPeer(!standIn && rttMs <= 0);
+    const int timeoutMs = 10000 + 10 * rttMs;
+    printf("%s, %d ms round trip, %d connections per case\n",
+           standIn ? "Stand-in caster" : qPrintable("Caster " + host), rttMs, count);
+    printf("%-22s %14s %14s %14s %9s %9s %9s\n", "case", "connect (ms)", "total (ms)", "total p90", "failures",
+           "resumed", "fallbacks");
+
+    static const Case cases[] = {
+        {"tcp", false, false, false, false},
+        {"tcp_sourcetable", false, false, true, false},
+        {"tcp_sourcetable_reuse", false, false, true, true},
+        {"tls_full", true, false, false, false},
+        {"tls_resumed", true, true, false, false},
+        {"tls_sourcetable", true, true, true, false},
+        {"tls_sourcetable_reuse", true, true, true, true},
+    };
+    QHash<QString, double> medians;
+    for (const Case& c : cases) {
+        if (c.tls && tlsPort <= 0) continue;
+        QPair<QString, int> target = c.tls ? tls : plain;
+        reader.init(target.first, target.second, parser.value(userOption), parser.value(passwordOption));
+        Timing timing = run(reader, c, mountpoint, count, timeoutMs);
+        double total = percentile(timing.totalMs, 0.5);
+        medians.insert(c.name, total);
+        printf("%-22s %14.1f %14.1f %14.1f %9d %9llu %9llu\n", c.name, percentile(timing.connectMs, 0.5), total,
+               percentile(timing.totalMs, 0.9), timing.failures, static_cast<unsigned long long>(timing.resumed),
+               static_cast<unsigned long long>(timing.fallbacks));
+        fflush(stdout);
+    }
+
+    // Differences of the median total times
+    auto compare = [&medians](const char* label, const char* from, const char* to) {
+        if (!medians.value(from) || !medians.value(to)) return;
+        double difference = medians.value(to) - medians.value(from);
+        printf("%-34s %+8.1f ms (%+.0f%%)\n", label, difference, difference / medians.value(from) * 100);
+    };
+    printf("\n");
+    compare("TLS full handshake vs TCP", "tcp", "tls_full");
+    compare("TLS resumed vs full handshake", "tls_full", "tls_resumed");
+    compare("TLS resumed vs TCP", "tcp", "tls_resumed");
+    compare("Reused connection vs two (TCP)", "tcp_sourcetable", "tcp_sourcetable_reuse");
+    compare("Reused connection vs two (TLS)", "tls_sourcetable", "tls_sourcetable_reuse");
+    if (tlsPort <= 0) {
+        printf("TLS cases skipped: --tls-port is not set\n");
+    }
+    return 0;
+}
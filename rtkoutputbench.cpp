@@ -0,0 +1,297 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QEventLoop>
+#include <QLoggingCategory>
+#include <QTimer>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "fixrecord.h"
+#include "logger.h"
+#include "metrics.h"
+#include "outputhandler.h"
+#include "rtkshm.h"
+#include "shmpublisher.h"
+
+// Fan-out of the socket output to many local clients.
+//
+// One OutputHandler socket output (binary records) broadcasts the epochs at a
+// fixed rate to local TCP clients served by a separate thread. Some clients
+// never read: their records must be dropped at the high-water mark while the
+// others keep receiving every epoch. Measures the time of an epoch broadcast
+// on the rover thread, the delivery latency (receive time in the record to
+// the read by the client), the records lost by the reading clients, the
+// records dropped for the stalled ones and the peak memory.
+//
+// Then compares the latency of the shared memory segment with the one of the
+// TCP socket output, for one reader on the same machine.
+
+struct ClientStats {
+    std::vector<double> latencyUs;  // Of the reading clients
+    quint64 records = 0;
+    quint64 lost = 0;               // Sequence gaps seen by the reading clients
+    int connected = 0;
+};
+
+static double percentile(std::vector<double> values, double p)
+{
+    if (values.empty()) return 0;
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, static_cast<size_t>(p * values.size()))];
+}
+
+// Connects the clients, then reads until stop. The stalled clients have a small receive buffer and never read.
+static void runClients(int port, int count, int stalled, const std::atomic<bool>& stop, ClientStats& stats)
+{
+    struct Client {
+        int fd;
+        std::vector<char> buffer;
+        quint32 nextSequence;
+        bool synced;
+    };
+    std::vector<Client> clients;
+    std::vector<pollfd> polled;
+    std::vector<size_t> byPoll;     // Index in clients of each polled socket
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    for (int i = 0; i < count; ++i) {
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (i < stalled) {
+            int size = 4096;
+            setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+        }
+        if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+            ::close(fd);
+            continue;
+        }
+        ++stats.connected;
+        if (i >= stalled) {
+            byPoll.push_back(clients.size());
+            polled.push_back({fd, POLLIN, 0});
+        }
+        clients.push_back({fd, {}, 0, false});
+    }
+
+    char chunk[64 * 1024];
+    while (!stop.load(std::memory_order_relaxed)) {
+        if (::poll(polled.data(), polled.size(), 50) <= 0) continue;
+        for (size_t i = 0; i < polled.size(); ++i) {
+            if (!(polled[i].revents & POLLIN)) continue;
+            Client& client = clients[byPoll[i]];
+            ssize_t n = ::read(client.fd, chunk, sizeof(chunk));
+            if (n <= 0) continue;
+            quint64 now = monotonicNsecs();
+            client.buffer.insert(client.buffer.end(), chunk, chunk + n);
+            size_t offset = 0;
+            rtk_fix_record record;
+            while (client.buffer.size() - offset >= sizeof(rtk_fix_record)) {
+                if (rtk_fix_decode(client.buffer.data() + offset, sizeof(rtk_fix_record), &record) == 0) {
+                    stats.latencyUs.push_back((now - record.recv_time_ns) / 1e3);
+                    ++stats.records;
+                    if (client.synced && record.sequence != client.nextSequence) {
+                        stats.lost += record.sequence - client.nextSequence;
+                    }
+                    client.nextSequence = record.sequence + 1;
+                    client.synced = true;
+                }
+                offset += sizeof(rtk_fix_record);
+            }
+            client.buffer.erase(client.buffer.begin(), client.buffer.begin() + offset);
+        }
+    }
+    for (const Client& client : clients) {
+        ::close(client.fd);
+    }
+}
+
+// Polls the shared memory segment until stop, like a control loop would, and reads every new fix
+static void runShmReader(const char* name, const std::atomic<bool>& stop, ClientStats& stats)
+{
+    RtkShmReader reader;
+    while (!reader.open(name)) {
+        if (stop.load(std::memory_order_relaxed)) return;
+        std::this_thread::yield();
+    }
+    stats.connected = 1;
+    uint64_t last = reader.published();
+    rtk_fix_record record;
+    while (!stop.load(std::memory_order_relaxed)) {
+        uint64_t published = reader.published();
+        if (published == last) continue;
+        if (reader.latest(record)) {
+            stats.latencyUs.push_back((monotonicNsecs() - record.recv_time_ns) / 1e3);
+            ++stats.records;
+            stats.lost += published - last - 1;
+        }
+        last = published;
+    }
+}
+
+static void wait(int ms)
+{
+    QEventLoop loop;
+    QTimer::singleShot(ms, &loop, &QEventLoop::quit);
+    loop.exec();
+}
+
+static long peakRssKb()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("rtkoutput_bench");
+    QCoreApplication::setApplicationVersion("1.0");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Fan-out of the socket output to many local clients, and latency of the shared memory.");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    QCommandLineOption clientsOption("clients", "Numbers of clients, one run each.", "list", "1,100,500");
+    QCommandLineOption stalledOption("stalled", "Percentage of clients that never read.", "percent", "10");
+    QCommandLineOption rateOption("rate", "Epochs per second.", "hz", "100");
+    QCommandLineOption durationOption("duration", "Seconds per run.", "s", "5");
+    QCommandLineOption portOption("port", "Port of the socket output.", "port", "12103");
+    QCommandLineOption bufferOption("client-buffer", "High-water mark per client, in KB.", "kb", "64");
+    for (const QCommandLineOption& option : {clientsOption, stalledOption, rateOption, durationOption, portOption,
+                                             bufferOption}) {
+        parser.addOption(option);
+    }
+    parser.process(a);
+
+    QLoggingCategory::setFilterRules("*.debug=false\n*.warning=false");
+    Log::configure(Log::Error, Log::Mode::Text);
+
+    const int port = parser.value(portOption).toInt();
+    const int rate = qMax(1, parser.value(rateOption).toInt());
+    const int durationMs = qMax(1, parser.value(durationOption).toInt()) * 1000;
+
+    // The same fix for every epoch, only the sequence and the receive time change
+    GpsData gpsData;
+    gpsData.parse_NMEA(QString("$GNRMC,120000.00,A,4851.00000,N,00221.00000,E,0.004,77.52,150625,,,A*4C"));
+    gpsData.parse_NMEA(QString("$GNGGA,120000.00,4851.00000,N,00221.00000,E,4,12,0.7,35.0,M,48.0,M,1.0,0000*6C"));
+
+    printf("Socket output, binary records, %d epochs/s, %d s per run, %s%% stalled clients\n",
+           rate, durationMs / 1000, qPrintable(parser.value(stalledOption)));
+    printf("%8s %8s %14s %14s %14s %14s %10s %10s %12s\n", "clients", "stalled", "broadcast (us)", "p99 (us)",
+           "latency (us)", "p99 (us)", "lost", "dropped", "peak RSS (MB)");
+
+    const Metrics::Registry& metrics = Metrics::registry();
+    for (const QString& value : parser.value(clientsOption).split(',', Qt::SkipEmptyParts)) {
+        const int count = qMax(1, value.toInt());
+        const int stalled = count * parser.value(stalledOption).toInt() / 100;
+
+        OutputHandler::Options options;
+        options.method = OutputHandler::OutputMethod::Socket;
+        options.type = OutputHandler::OutputType::Binary;
+        options.socket.port = port;
+        options.socket.highWaterMark = parser.value(bufferOption).toLongLong() * 1024;
+        OutputHandler* output = new OutputHandler(options);
+
+        const qint64 clientsBefore = metrics.outputClients.value();
+        const quint64 droppedBefore = metrics.droppedRecords.value();
+        std::atomic<bool> stop{false};
+        ClientStats stats;
+        std::thread clients(runClients, port, count, stalled, std::cref(stop), std::ref(stats));
+        for (int i = 0; i < 500 && metrics.outputClients.value() - clientsBefore < count; ++i) {
+            wait(10);
+        }
+
+        std::vector<double> broadcastUs;
+        QTimer epochs;
+        QObject::connect(&epochs, &QTimer::timeout, [&]() {
+            quint64 start = monotonicNsecs();
+            output->processEpoch(gpsData, start);
+            broadcastUs.push_back((monotonicNsecs() - start) / 1e3);
+        });
+        epochs.setTimerType(Qt::PreciseTimer);
+        epochs.start(1000 / rate);
+        wait(durationMs);
+        epochs.stop();
+        wait(200);  // Delivery of the last epochs
+
+        stop = true;
+        clients.join();
+        delete output;
+        wait(100);  // Disconnections
+
+        printf("%8d %8d %14.1f %14.1f %14.1f %14.1f %10llu %10llu %12.1f\n", stats.connected, stalled,
+               percentile(broadcastUs, 0.5), percentile(broadcastUs, 0.99),
+               percentile(stats.latencyUs, 0.5), percentile(stats.latencyUs, 0.99),
+               static_cast<unsigned long long>(stats.lost),
+               static_cast<unsigned long long>(metrics.droppedRecords.value() - droppedBefore),
+               peakRssKb() / 1024.0);
+        fflush(stdout);
+    }
+
+    // Latency of one local reader: shared memory (the reader spins on the segment) and TCP (blocking reads)
+    printf("\nOne local reader, %d epochs/s, %d s per run\n", rate, durationMs / 1000);
+    printf("%-14s %14s %14s %14s %10s\n", "transport", "latency (us)", "p99 (us)", "max (us)", "lost");
+    for (bool shm : {true, false}) {
+        ShmPublisher publisher;
+        OutputHandler* output = nullptr;
+        const char* shmName = "/rtkoutput_bench";
+        if (shm) {
+            if (!publisher.open(shmName, 64)) {
+                printf("%-14s %14s\n", "shm", "unavailable");
+                continue;
+            }
+        } else {
+            OutputHandler::Options options;
+            options.method = OutputHandler::OutputMethod::Socket;
+            options.type = OutputHandler::OutputType::Binary;
+            options.socket.port = port;
+            output = new OutputHandler(options);
+        }
+
+        const qint64 clientsBefore = metrics.outputClients.value();
+        std::atomic<bool> stop{false};
+        ClientStats stats;
+        std::thread reader = shm ? std::thread(runShmReader, shmName, std::cref(stop), std::ref(stats))
+                                 : std::thread(runClients, port, 1, 0, std::cref(stop), std::ref(stats));
+        for (int i = 0; i < 500 && !shm && metrics.outputClients.value() == clientsBefore; ++i) {
+            wait(10);
+        }
+
+        QTimer epochs;
+        QObject::connect(&epochs, &QTimer::timeout, [&]() {
+            quint64 now = monotonicNsecs();
+            if (shm) {
+                publisher.publish(gpsData, now);
+            } else {
+                output->processEpoch(gpsData, now);
+            }
+        });
+        epochs.setTimerType(Qt::PreciseTimer);
+        epochs.start(1000 / rate);
+        wait(durationMs);
+        epochs.stop();
+        wait(200);
+
+        stop = true;
+        reader.join();
+        delete output;
+        publisher.close();
+        wait(100);
+
+        printf("%-14s %14.2f %14.2f %14.2f %10llu\n", shm ? "shm" : "tcp",
+               percentile(stats.latencyUs, 0.5), percentile(stats.latencyUs, 0.99),
+               percentile(stats.latencyUs, 1.0), static_cast<unsigned long long>(stats.lost));
+        fflush(stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,429 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QSemaphore>
+#include <QThread>
+#include <QThreadPool>
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <vector>
+#include "gpsdataparser.h"
+#include "fixformatter.h"
+#include "geodesy.h"
+#include "predictor.h"
+
+// Offline post-processing of recorded NMEA or raw serial logs into CSV, JSON or UTM tracks.
+//
+// The log is memory-mapped and split into chunks at sentence boundaries. The chunks are
+// parsed in parallel and written in file order. Each chunk starts parsing a little before
+// its own range (the warm-up) so that the epoch state (date from RMC, DOP from GSA, GST)
+// is the same as in a sequential run: a chunk writes the epochs whose GGA sentence starts
+// in its range, exactly like the daemon which writes one record per epoch with a GGA sentence.
+
+static const qint64 WARMUP_BYTES = 64 * 1024;
+
+enum class Format {
+    CSV,
+    JSON,
+    UTM     // CSV with the UTM easting, northing and zone of each fix
+};
+
+struct Settings {
+    Format format = Format::CSV;
+    quint32 fields = FixFormatter::AllFields;
+    QList<int> fixQualities;    // Empty for any fix
+};
+
+struct Chunk {
+    qint64 warmupBegin = 0;     // Parsing starts here
+    qint64 begin = 0;           // Range of the GGA sentences written by this chunk
+    qint64 end = 0;
+    QByteArray output;
+    qint64 fixes = 0;
+    QSemaphore done;
+};
+
+// Offset of the first line starting at or after pos
+static qint64 lineStart(const char* data, qint64 size, qint64 pos)
+{
+    if (pos <= 0) return 0;
+    if (pos >= size) return size;
+    const void* newline = memchr(data + pos - 1, '\n', size - pos + 1);
+    return newline ? static_cast<const char*>(newline) - data + 1 : size;
+}
+
+// Only the sentences used by the records are parsed
+static bool isParsedType(const char* type)
+{
+    return memcmp(type, "GGA", 3) == 0 || memcmp(type, "RMC", 3) == 0
+        || memcmp(type, "GSA", 3) == 0 || memcmp(type, "GST", 3) == 0;
+}
+
+static void appendUtm(QByteArray& out, const QByteArray& lines, const std::vector<int>& lineEnds,
+                      const std::vector<double>& lat, const std::vector<double>& lon)
+{
+    size_t count = lineEnds.size();
+    std::vector<double> easting(count), northing(count);
+    std::vector<int> zone(count);
+    Geodesy::latLonToUtm(lat.data(), lon.data(), count, easting.data(), northing.data(), zone.data());
+
+    out.reserve(lines.size() + count * 32);
+    int lineBegin = 0;
+    for (size_t i = 0; i < count; ++i) {
+        out.append(lines.constData() + lineBegin, lineEnds[i] - lineBegin - 1); // Without the '\n'
+        out.append(',').append(QByteArray::number(easting[i], 'f', 3))
+           .append(',').append(QByteArray::number(northing[i], 'f', 3))
+           .append(',').append(QByteArray::number(zone[i])).append('\n');
+        lineBegin = lineEnds[i];
+    }
+}
+
+static bool isAccepted(const GpsData& gpsData, const Settings& settings)
+{
+    return settings.fixQualities.isEmpty() ? gpsData.hasFix() : settings.fixQualities.contains(gpsData.fixQualityCode());
+}
+
+// Parses the lines from `from` and calls onEpoch once per epoch whose GGA sentence starts in [begin, end).
+// Like the daemon, an epoch is closed by the next sentence with another UTC time (or the end of the
+// log), so that it keeps the GSA and GST sentences following its GGA, past end if needed.
+template <typename Callback>
+static void forEachEpoch(const char* data, qint64 size, qint64 from, qint64 begin, qint64 end,
+                         GpsData& gpsData, Callback onEpoch)
+{
+    double epochTime = -1;
+    bool epochHasGga = false;
+    qint64 pos = from;
+    while (pos < size && (pos < end || epochHasGga)) {
+        const char* line = data + pos;
+        const char* newline = static_cast<const char*>(memchr(line, '\n', size - pos));
+        qint64 length = newline ? newline - line : size - pos;
+        qint64 next = pos + length + 1;
+        if (length > 0 && line[length - 1] == '\r') --length;
+
+        // Raw serial logs may have binary UBX/RTCM data before the sentence
+        const char* sentence = static_cast<const char*>(memchr(line, '$', length));
+        if (sentence) {
+            qint64 sentenceLength = line + length - sentence;
+            if (sentenceLength > 6 && isParsedType(sentence + 3)) {
+                double time = NmeaParser::timeOfDay(std::string_view(sentence, sentenceLength));
+                if (time >= 0 && time != epochTime) {
+                    if (epochHasGga) onEpoch();
+                    epochHasGga = false;
+                    epochTime = time;
+                    if (pos >= end) break;
+                }
+                if (gpsData.parse_NMEA(sentence, sentenceLength)
+                    && memcmp(sentence + 3, "GGA", 3) == 0 && pos >= begin && pos < end) {
+                    epochHasGga = true;
+                }
+            }
+        }
+        pos = next;
+    }
+    if (epochHasGga) onEpoch();
+}
+
+static void processChunk(const char* data, qint64 size, Chunk& chunk, const Settings& settings)
+{
+    GpsData gpsData;
+    FixFormatter formatter;
+    QByteArray lines;
+    std::vector<int> lineEnds;
+    std::vector<double> lat, lon;
+
+    forEachEpoch(data, size, chunk.warmupBegin, chunk.begin, chunk.end, gpsData, [&]() {
+        if (!isAccepted(gpsData, settings)) return;
+        if (settings.format == Format::JSON) {
+            chunk.output.append(formatter.json(gpsData, settings.fields));
+        } else {
+            lines.append(formatter.csv(gpsData, false, settings.fields));
+            lineEnds.push_back(lines.size());
+            lat.push_back(gpsData.latitude());
+            lon.push_back(gpsData.longitude());
+        }
+        ++chunk.fixes;
+    });
+
+    if (settings.format == Format::UTM) {
+        appendUtm(chunk.output, lines, lineEnds, lat, lon);
+    } else if (settings.format == Format::CSV) {
+        chunk.output = lines;
+    }
+}
+
+// Prediction error: the logs are replayed through the predictor and the fixes predicted for each horizon
+// are compared with the fix received at that time (horizons are multiples of the receiver period)
+struct HorizonError {
+    qint64 horizonMs;
+    std::vector<double> horizontal;     // m
+    double sumVertical2 = 0.0;
+    double sumHold2 = 0.0;              // Horizontal error of the last fix held until the horizon
+};
+
+struct PendingPrediction {
+    size_t horizon;
+    double latitude, longitude, altitude;
+    double heldLatitude, heldLongitude;
+};
+
+static bool reportPredictionError(const QStringList& files, const QList<int>& horizons,
+                                  const PositionPredictor::Options& options, const Settings& settings)
+{
+    PositionPredictor predictor(options);
+    GpsData gpsData;
+    std::vector<HorizonError> errors;
+    for (int horizon : horizons) {
+        errors.push_back({horizon, {}, 0.0, 0.0});
+    }
+    std::multimap<qint64, PendingPrediction> pending; // By target time
+
+    for (const QString& fileName : files) {
+        QFile file(fileName);
+        if (!file.open(QIODevice::ReadOnly)) {
+            qCritical() << "Cannot open" << fileName << ":" << file.errorString();
+            return false;
+        }
+        qint64 size = file.size();
+        if (size == 0) continue;
+        const char* data = reinterpret_cast<const char*>(file.map(0, size));
+        if (!data) {
+            qCritical() << "Cannot map" << fileName << ":" << file.errorString();
+            return false;
+        }
+
+        forEachEpoch(data, size, 0, 0, size, gpsData, [&]() {
+            qint64 timeMs = gpsData.utcMsecs();
+            if (!gpsData.hasFix() || timeMs < 0) return;
+
+            // Predictions made for this epoch, the older ones had no epoch at their time
+            pending.erase(pending.begin(), pending.lower_bound(timeMs - 1));
+            auto last = pending.upper_bound(timeMs + 1);
+            if (isAccepted(gpsData, settings)) {
+                Geodesy::EnuFrame truth(gpsData.latitude(), gpsData.longitude(), gpsData.altitude());
+                for (auto it = pending.begin(); it != last; ++it) {
+                    const PendingPrediction& p = it->second;
+                    double east, north, up;
+                    truth.toEnu(p.latitude, p.longitude, p.altitude, east, north, up);
+                    errors[p.horizon].horizontal.push_back(std::hypot(east, north));
+                    errors[p.horizon].sumVertical2 += up * up;
+                    truth.toEnu(p.heldLatitude, p.heldLongitude, gpsData.altitude(), east, north, up);
+                    errors[p.horizon].sumHold2 += east * east + north * north;
+                }
+            }
+            pending.erase(pending.begin(), last);
+
+            predictor.update(gpsData);
+            for (size_t i = 0; i < errors.size(); ++i) {
+                Prediction prediction;
+                if (predictor.predict(timeMs + errors[i].horizonMs, prediction)) {
+                    pending.insert({prediction.utcMs, {i, prediction.latitude, prediction.longitude, prediction.altitude,
+                                                       gpsData.latitude(), gpsData.longitude()}});
+                }
+            }
+        });
+    }
+
+    printf("horizon_ms,count,rms_horizontal_m,p95_horizontal_m,max_horizontal_m,rms_vertical_m,held_rms_horizontal_m\n");
+    for (HorizonError& error : errors) {
+        std::vector<double>& h = error.horizontal;
+        if (h.empty()) {
+            printf("%lld,0,,,,,\n", static_cast<long long>(error.horizonMs));
+            continue;
+        }
+        std::sort(h.begin(), h.end());
+        double sum2 = 0.0;
+        for (double e : h) sum2 += e * e;
+        double n = static_cast<double>(h.size());
+        printf("%lld,%zu,%.4f,%.4f,%.4f,%.4f,%.4f\n", static_cast<long long>(error.horizonMs), h.size(),
+               std::sqrt(sum2 / n), h[static_cast<size_t>(0.95 * (n - 1))], h.back(),
+               std::sqrt(error.sumVertical2 / n), std::sqrt(error.sumHold2 / n));
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("rtkpost");
+    QCoreApplication::setApplicationVersion("1.0");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Convert recorded NMEA or serial logs to CSV, JSON or UTM tracks.");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addPositionalArgument("files", "NMEA or raw serial log files, processed in order.", "files...");
+    QCommandLineOption formatOption("format", "Output format: csv (default), json or utm (CSV with UTM coordinates).", "format", "csv");
+    QCommandLineOption fieldsOption("fields", "Comma-separated CSV/JSON fields (default: all).", "fields");
+    QCommandLineOption qualityOption("fix-quality", "Comma-separated accepted GGA fix qualities (default: any fix).", "qualities");
+    QCommandLineOption outputOption({"o", "output"}, "Output file (default: stdout).", "file");
+    QCommandLineOption threadsOption({"j", "threads"}, "Number of threads (default: all the cores).", "count");
+    QCommandLineOption chunkOption("chunk-size", "Chunk size in MB (default: 4).", "MB", "4");
+    QCommandLineOption predictionOption("prediction-error",
+        "Replay the logs through the predictor and print its error for these horizons instead of converting "
+        "(multiples of the receiver period). The fix quality filter selects the reference fixes.", "ms,...");
+    QCommandLineOption modelOption("model", "Predictor model: ca (constant acceleration, default) or cv.", "model", "ca");
+    QCommandLineOption noiseOption("process-noise", "Predictor process noise (default: 1.0).", "value", "1.0");
+    parser.addOption(formatOption);
+    parser.addOption(fieldsOption);
+    parser.addOption(qualityOption);
+    parser.addOption(outputOption);
+    parser.addOption(threadsOption);
+    parser.addOption(chunkOption);
+    parser.addOption(predictionOption);
+    parser.addOption(modelOption);
+    parser.addOption(noiseOption);
+    parser.process(a);
+
+    if (parser.positionalArguments().isEmpty()) {
+        parser.showHelp(1);
+    }
+
+    Settings settings;
+    QString format = parser.value(formatOption).toLower();
+    if (format == "csv") {
+        settings.format = Format::CSV;
+    } else if (format == "json") {
+        settings.format = Format::JSON;
+    } else if (format == "utm") {
+        settings.format = Format::UTM;
+    } else {
+        qCritical() << "Invalid format:" << format;
+        return 1;
+    }
+    if (parser.isSet(fieldsOption)) {
+        settings.fields = FixFormatter::fieldsFromString(parser.value(fieldsOption));
+    }
+    for (const QString& quality : parser.value(qualityOption).split(',', Qt::SkipEmptyParts)) {
+        bool ok;
+        settings.fixQualities.append(quality.trimmed().toInt(&ok));
+        if (!ok) {
+            qCritical() << "Invalid fix quality:" << quality;
+            return 1;
+        }
+    }
+    int threads = parser.isSet(threadsOption) ? parser.value(threadsOption).toInt() : QThread::idealThreadCount();
+    qint64 chunkSize = parser.value(chunkOption).toDouble() * 1024 * 1024;
+    if (threads < 1 || chunkSize < 1024) {
+        qCritical() << "Invalid thread count or chunk size";
+        return 1;
+    }
+
+    if (parser.isSet(predictionOption)) {
+        QList<int> horizons;
+        for (const QString& horizon : parser.value(predictionOption).split(',', Qt::SkipEmptyParts)) {
+            bool ok;
+            horizons.append(horizon.trimmed().toInt(&ok));
+            if (!ok || horizons.last() <= 0) {
+                qCritical() << "Invalid horizon:" << horizon;
+                return 1;
+            }
+        }
+        PositionPredictor::Options options;
+        options.model = PositionPredictor::modelFromString(parser.value(modelOption));
+        options.processNoise = parser.value(noiseOption).toDouble();
+        return reportPredictionError(parser.positionalArguments(), horizons, options, settings) ? 0 : 1;
+    }
+
+    QFile out;
+    if (parser.isSet(outputOption)) {
+        out.setFileName(parser.value(outputOption));
+        if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            qCritical() << "Cannot open" << out.fileName() << ":" << out.errorString();
+            return 1;
+        }
+    } else if (!out.open(stdout, QIODevice::WriteOnly)) {
+        qCritical() << "Cannot write to stdout";
+        return 1;
+    }
+    if (settings.format != Format::JSON) {
+        QByteArray header = FixFormatter::csvHeader(settings.fields);
+        if (settings.format == Format::UTM) {
+            header.insert(header.size() - 1, ",easting,northing,zone");
+        }
+        out.write(header);
+    }
+
+    const size_t inFlight = threads * 2; // Chunks parsed ahead of the one being written
+
+    QElapsedTimer totalTimer;
+    totalTimer.start();
+    qint64 totalBytes = 0;
+    qint64 totalFixes = 0;
+
+    for (const QString& fileName : parser.positionalArguments()) {
+        QElapsedTimer timer;
+        timer.start();
+
+        QFile file(fileName);
+        if (!file.open(QIODevice::ReadOnly)) {
+            qCritical() << "Cannot open" << fileName << ":" << file.errorString();
+            return 1;
+        }
+        qint64 size = file.size();
+        if (size == 0) continue;
+        const char* data = reinterpret_cast<const char*>(file.map(0, size));
+        if (!data) {
+            qCritical() << "Cannot map" << fileName << ":" << file.errorString();
+            return 1;
+        }
+
+        // Split at line boundaries
+        std::vector<std::unique_ptr<Chunk>> chunks;
+        qint64 begin = 0;
+        while (begin < size) {
+            auto chunk = std::make_unique<Chunk>();
+            chunk->begin = begin;
+            chunk->end = lineStart(data, size, begin + chunkSize);
+            chunk->warmupBegin = lineStart(data, size, begin - WARMUP_BYTES);
+            begin = chunk->end;
+            chunks.push_back(std::move(chunk));
+        }
+
+        // Parse in parallel, write in order. The pool is declared after the mapping and the chunks used by
+        // its tasks: it waits for them when it is destroyed, on the early returns too.
+        QThreadPool pool;
+        pool.setMaxThreadCount(threads);
+        size_t submitted = 0;
+        qint64 fixes = 0;
+        for (size_t i = 0; i < chunks.size(); ++i) {
+            while (submitted < chunks.size() && submitted < i + inFlight) {
+                Chunk* chunk = chunks[submitted++].get();
+                pool.start([data, size, chunk, &settings]() {
+                    processChunk(data, size, *chunk, settings);
+                    chunk->done.release();
+                });
+            }
+            Chunk& chunk = *chunks[i];
+            chunk.done.acquire();
+            if (out.write(chunk.output) != chunk.output.size()) {
+                qCritical() << "Write error:" << out.errorString();
+                pool.clear();   // The queued chunks are not parsed
+                return 1;
+            }
+            fixes += chunk.fixes;
+            chunk.output = QByteArray();
+        }
+        out.flush();
+
+        double seconds = timer.nsecsElapsed() / 1e9;
+        fprintf(stderr, "%s: %.1f MB, %lld fixes in %.2f s, %.1f MB/s, %.0f fixes/s (%zu chunks, %d threads)\n",
+                qPrintable(fileName), size / 1e6, static_cast<long long>(fixes), seconds,
+                size / 1e6 / seconds, fixes / seconds, chunks.size(), threads);
+        totalBytes += size;
+        totalFixes += fixes;
+    }
+
+    if (parser.positionalArguments().size() > 1) {
+        double seconds = totalTimer.nsecsElapsed() / 1e9;
+        fprintf(stderr, "Total: %.1f MB, %lld fixes in %.2f s, %.1f MB/s, %.0f fixes/s\n",
+                totalBytes / 1e6, static_cast<long long>(totalFixes), seconds,
+                totalBytes / 1e6 / seconds, totalFixes / seconds);
+    }
+    return 0;
+}
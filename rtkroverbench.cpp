@@ -0,0 +1,706 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSysInfo>
+#include <QDateTime>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <vector>
+#include "crc24q.h"
+#include "rtcmframer.h"
+#include "rtcmbits.h"
+#include "rtcmdecoder.h"
+#include "rinexwriter.h"
+#include "rtcmcompress.h"
+#include "gpsdataparser.h"
+#include "geodesy.h"
+#include "fixformatter.h"
+#include "fixrecord.h"
+
+// Microbenchmarks of the hot paths, without network or serial port.
+//
+// The corpora are either recorded captures (--nmea, --rtcm) or generated
+// deterministically so that two runs on the same machine are comparable.
+// Results can be written as JSON (--json) and compared with a previous run
+// (--baseline).
+
+// --- Allocation counting ---
+
+static std::atomic<quint64> allocations{0};
+
+void* operator new(std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size ? size : 1);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept
+{
+    return operator new(size, tag);
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+// --- Corpora ---
+
+static QString nmeaChecksum(const QByteArray& body)
+{
+    unsigned char checksum = 0;
+    for (char c : body) checksum ^= static_cast<unsigned char>(c);
+    return QString::fromLatin1("$" + body + "*" + QByteArray::number(checksum, 16).toUpper().rightJustified(2, '0'));
+}
+
+static QByteArray nmeaAngle(double degrees, int degreeDigits)
+{
+    double value = std::fabs(degrees);
+    int d = static_cast<int>(value);
+    double minutes = (value - d) * 60.0;
+    return QByteArray::number(d).rightJustified(degreeDigits, '0')
+           + QByteArray::number(minutes, 'f', 7).rightJustified(10, '0');
+}
+
+// One hour of a 10 Hz u-blox F9P output moving around Paris, with the usual sentence mix
+static QList<QString> generateNmea()
+{
+    std::mt19937 random(12345);
+    auto uniform = [&random]() { return random() / 4294967296.0; };
+
+    QList<QString> sentences;
+    double lat = 48.8566, lon = 2.3522, alt = 35.0;
+    for (int epoch = 0; epoch < 36000; ++epoch) {
+        lat += (uniform() - 0.5) * 1e-6;
+        lon += (uniform() - 0.5) * 1e-6;
+        alt += (uniform() - 0.5) * 1e-2;
+        int centiseconds = epoch * 10;
+        QByteArray time = QByteArray::number(10 + centiseconds / 360000).rightJustified(2, '0')
+                          + QByteArray::number(centiseconds / 6000 % 60).rightJustified(2, '0')
+                          + QByteArray::number(centiseconds / 100 % 60).rightJustified(2, '0') + "."
+                          + QByteArray::number(centiseconds % 100).rightJustified(2, '0');
+        QByteArray latText = nmeaAngle(lat, 2) + ",N";
+        QByteArray lonText = nmeaAngle(lon, 3) + ",E";
+        int quality = uniform() < 0.9 ? 4 : 5;
+        QByteArray speed = QByteArray::number(uniform() * 2.0, 'f', 3);
+        QByteArray course = QByteArray::number(uniform() * 360.0, 'f', 2);
+
+        sentences << nmeaChecksum("GNRMC," + time + ",A," + latText + "," + lonText + "," + speed + "," + course + ",120825,,,R,V");
+        sentences << nmeaChecksum("GNVTG," + course + ",T,,M," + speed + ",N," + speed + ",K,R");
+        sentences << nmeaChecksum("GNGGA," + time + "," + latText + "," + lonText + "," + QByteArray::number(quality)
+                                  + ",31,0.52," + QByteArray::number(alt, 'f', 3) + ",M,46.5,M,1.0,0000");
+        for (int system = 1; system <= 4; ++system) {
+            sentences << nmeaChecksum("GNGSA,A,3,05,07,13,14,15,17,19,24,30,,,,0.98,0.52,0.83," + QByteArray::number(system));
+        }
+        for (int i = 0; i < 3; ++i) {
+            sentences << nmeaChecksum("GPGSV,3," + QByteArray::number(i + 1)
+                                      + ",12,05,41,295,47,07,18,047,43,13,68,225,50,14,28,146,45,1");
+        }
+        for (int i = 0; i < 2; ++i) {
+            sentences << nmeaChecksum("GAGSV,2," + QByteArray::number(i + 1) + ",08,02,35,302,45,08,44,072,47,13,13,181,41,15,41,262,46,7");
+        }
+        sentences << nmeaChecksum("GNGST," + time + ",11,0.010,0.008,88.5,0.009,0.007,0.014");
+        sentences << nmeaChecksum("GNGLL," + latText + "," + lonText + "," + time + ",A,R");
+    }
+    return sentences;
+}
+
+static void appendRtcmFrame(QByteArray& stream, int type, int payloadSize, std::mt19937& random)
+{
+    QByteArray frame(3 + payloadSize, Qt::Uninitialized);
+    frame[0] = static_cast<char>(0xD3);
+    frame[1] = static_cast<char>((payloadSize >> 8) & 0x03);
+    frame[2] = static_cast<char>(payloadSize & 0xFF);
+    for (int i = 3; i < frame.size(); ++i) frame[i] = static_cast<char>(random());
+    frame[3] = static_cast<char>(type >> 4);
+    frame[4] = static_cast<char>(((type & 0x0F) << 4) | (frame[4] & 0x0F));
+    uint32_t crc = rtcm_crc(reinterpret_cast<const unsigned char*>(frame.constData()), frame.size());
+    frame.append(static_cast<char>(crc >> 16));
+    frame.append(static_cast<char>(crc >> 8));
+    frame.append(static_cast<char>(crc));
+    stream.append(frame);
+}
+
+// One hour of a 1 Hz MSM4 multi-constellation stream with the static messages every 10 s,
+// plus a few corrupted frames and line noise to exercise the resynchronization
+static QByteArray generateRtcm()
+{
+    std::mt19937 random(67890);
+    QByteArray stream;
+    for (int epoch = 0; epoch < 3600; ++epoch) {
+        if (epoch % 10 == 0) {
+            appendRtcmFrame(stream, 1005, 19, random);
+            appendRtcmFrame(stream, 1033, 72, random);
+            appendRtcmFrame(stream, 1230, 8, random);
+        }
+        appendRtcmFrame(stream, 1074, 180 + random() % 40, random);
+        appendRtcmFrame(stream, 1084, 150 + random() % 40, random);
+        appendRtcmFrame(stream, 1094, 160 + random() % 40, random);
+        appendRtcmFrame(stream, 1124, 170 + random() % 40, random);
+        if (epoch % 100 == 50) {
+            stream[stream.size() - 20] = static_cast<char>(stream[stream.size() - 20] ^ 0x55); // Bad CRC
+            for (int i = 0; i < 16; ++i) stream.append(static_cast<char>(random()));     // Noise
+        }
+    }
+    return stream;
+}
+
+// Payload of a frame, with the header and the CRC
+static void appendRtcmPayload(QByteArray& stream, const unsigned char* payload, int size)
+{
+    QByteArray frame(3, Qt::Uninitialized);
+    frame[0] = static_cast<char>(0xD3);
+    frame[1] = static_cast<char>((size >> 8) & 0x03);
+    frame[2] = static_cast<char>(size & 0xFF);
+    frame.append(reinterpret_cast<const char*>(payload), size);
+    uint32_t crc = rtcm_crc(reinterpret_cast<const unsigned char*>(frame.constData()), frame.size());
+    frame.append(static_cast<char>(crc >> 16));
+    frame.append(static_cast<char>(crc >> 8));
+    frame.append(static_cast<char>(crc));
+    stream.append(frame);
+}
+
+struct SimulatedSatellite {
+    int prn;
+    int glonassChannel;
+    double range;           // m, at the start
+    double rate;            // m/s, at the start
+    double acceleration;    // m/s2
+    double phaseOffset;     // m
+    QList<int> signalIds;    // MSM signal IDs
+};
+
+// Measurement noise (m, m/s) and receiver clock (m, m/s) of the simulated base
+struct SimulatedReceiver {
+    std::mt19937 random{13579};
+    std::normal_distribution<double> gauss{0.0, 1.0};
+    double codeNoise = 0.3;
+    double phaseNoise = 0.0015;
+    double rateNoise = 0.02;
+    double clock = 0.0;
+    double drift = 0.0;
+    double noise(double sigma) { return sigma * gauss(random); }
+};
+
+// MSM7 message of the satellites of one constellation at time t (s)
+static void appendMsm7(QByteArray& stream, int type, uint32_t epochTime, bool more,
+                       const QList<SimulatedSatellite>& satellites, double t, SimulatedReceiver& receiver)
+{
+    const double rangeMs = RTCM_SPEED_OF_LIGHT / 1000.0;
+    unsigned char payload[1024] = {};
+    RtcmBitWriter bits(payload);
+    bits.u<12>(type);
+    bits.u<12>(1);
+    bits.u<30>(epochTime);
+    bits.u<1>(more);
+    bits.u<18>(0);          // IODS, reserved, clock steering, external clock, smoothing
+    uint64_t satelliteMask = 0;
+    uint32_t signalMask = 0;
+    for (const SimulatedSatellite& sat : satellites) {
+        satelliteMask |= uint64_t(1) << (64 - sat.prn);
+        for (int signal : sat.signalIds) signalMask |= 1u << (32 - signal);
+    }
+    bits.u<64>(satelliteMask);
+    bits.u<32>(signalMask);
+    QList<int> signalIds;
+    for (int signal = 1; signal <= 32; ++signal) {
+        if ((signalMask >> (32 - signal)) & 1u) signalIds << signal;
+    }
+    QList<QPair<int, int>> cells;   // Satellite index, signal
+    for (int i = 0; i < satellites.size(); ++i) {
+        for (int signal : std::as_const(signalIds)) {
+            bool present = satellites[i].signalIds.contains(signal);
+            bits.u(present, 1);
+            if (present) cells.append({i, signal});
+        }
+    }
+
+    QList<double> rough, range, rate;
+    for (const SimulatedSatellite& sat : satellites) {
+        range << (sat.range + sat.rate * t + 0.5 * sat.acceleration * t * t + receiver.clock) / rangeMs;
+        rough << std::round(range.last() * 1024) / 1024;   // Nearest: the noisy fine pseudorange stays in its range
+        rate << sat.rate + sat.acceleration * t + receiver.drift;
+    }
+    for (double r : std::as_const(rough)) bits.u<8>(static_cast<uint64_t>(r));
+    for (const SimulatedSatellite& sat : satellites) bits.u<4>(sat.glonassChannel + 7);
+    for (double r : std::as_const(rough)) bits.u<10>(static_cast<uint64_t>((r - std::floor(r)) * 1024));
+    for (double r : std::as_const(rate)) bits.s<14>(std::lround(r));
+    for (const auto& cell : std::as_const(cells)) {
+        double pseudorange = range[cell.first] + receiver.noise(receiver.codeNoise) / rangeMs;
+        bits.s<20>(std::lround((pseudorange - rough[cell.first]) * std::ldexp(1.0, 29)));
+    }
+    for (const auto& cell : std::as_const(cells)) {
+        double offset = satellites[cell.first].phaseOffset + cell.second * 0.37 + receiver.noise(receiver.phaseNoise);
+        bits.s<24>(std::lround((range[cell.first] + offset / rangeMs - rough[cell.first]) * std::ldexp(1.0, 31)));
+    }
+    for (int i = 0; i < cells.size(); ++i) bits.u<10>(qMin(704, static_cast<int>(t)));
+    for (int i = 0; i < cells.size(); ++i) bits.u<1>(0);
+    for (const auto& cell : std::as_const(cells)) {
+        bits.u<10>((38 + cell.second % 9) * 16 + static_cast<int>(receiver.noise(4.0)) + 8);
+    }
+    for (const auto& cell : std::as_const(cells)) {
+        double r = rate[cell.first] + receiver.noise(receiver.rateNoise);
+        bits.s<15>(std::lround((r - std::lround(rate[cell.first])) / 0.0001));
+    }
+    appendRtcmPayload(stream, payload, static_cast<int>((bits.position() + 7) / 8));
+}
+
+// GPS time of the first generated MSM epoch (a Wednesday, 12:00)
+static const qint64 MSM_START_GPS_MS = (2390LL * 604800 + 3 * 86400 + 12 * 3600) * 1000;
+
+// One hour of a 1 Hz MSM7 stream of a multi-frequency base (12 GPS, 8 GLONASS, 10 Galileo and
+// 12 BeiDou satellites, 2 or 3 signals each) with the station position every 10 s
+
+static QByteArray generateMsm()
+{
+    std::mt19937 random(24680);
+    auto uniform = [&random]() { return random() / 4294967296.0; };
+    const int types[4] = {1077, 1087, 1097, 1127};
+    const int counts[4] = {12, 8, 10, 12};
+    const QList<int> signalIds[4] = {{2, 10, 16}, {2, 8}, {2, 15, 23}, {2, 14, 22}};
+    QList<SimulatedSatellite> constellations[4];
+    for (int k = 0; k < 4; ++k) {
+        for (int i = 0; i < counts[k]; ++i) {
+            constellations[k] << SimulatedSatellite{1 + 2 * i, k == 1 ? i % 14 - 7 : 0, 20e6 + uniform() * 6e6,
+                                                    (uniform() - 0.5) * 1600, (uniform() - 0.5) * 0.3,
+                                                    (uniform() - 0.5) * 200, signalIds[k]};
+        }
+    }
+
+    SimulatedReceiver receiver;
+    QByteArray stream;
+    for (int epoch = 0; epoch < 3600; ++epoch) {
+        // Free-running receiver clock: random walk of the frequency
+        receiver.drift += receiver.noise(0.05);
+        receiver.clock += receiver.drift;
+        qint64 tow = (MSM_START_GPS_MS + epoch * 1000LL) % (604800LL * 1000);
+        if (epoch % 10 == 0) {
+            unsigned char payload[19] = {};
+            RtcmBitWriter bits(payload);
+            bits.u<12>(1005);
+            bits.u<12>(1);
+            bits.u<10>(0x0F);
+            bits.s<38>(42000000000LL);
+            bits.u<2>(0);
+            bits.s<38>(1700000000LL);
+            bits.u<2>(0);
+            bits.s<38>(47000000000LL);
+            appendRtcmPayload(stream, payload, sizeof(payload));
+        }
+        for (int k = 0; k < 4; ++k) {
+            uint32_t epochTime = static_cast<uint32_t>(tow);
+            if (types[k] == 1087) {
+                // Day of week and time of day, GLONASS time
+                qint64 glonass = (tow - 18000 + 3 * 3600000 + 604800000) % 604800000;
+                epochTime = static_cast<uint32_t>((glonass / 86400000) << 27 | (glonass % 86400000));
+            } else if (types[k] == 1127) {
+                epochTime = static_cast<uint32_t>(tow - 14000);
+            }
+            appendMsm7(stream, types[k], epochTime, k < 3, constellations[k], epoch, receiver);
+        }
+    }
+    return stream;
+}
+
+static bool loadNmea(const QString& fileName, QList<QString>& sentences)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) return false;
+    for (const QByteArray& line : file.readAll().split('\n')) {
+        QByteArray trimmed = line.trimmed();
+        if (trimmed.startsWith('$')) sentences << QString::fromLatin1(trimmed);
+    }
+    return true;
+}
+
+static bool loadRaw(const QString& fileName, QByteArray& data)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) return false;
+    data = file.readAll();
+    return true;
+}
+
+// --- Harness ---
+
+struct Result {
+    QString name;
+    quint64 items;          // Items per pass
+    quint64 bytes;          // Bytes per pass, 0 if not meaningful
+    double nsPerItem;
+    double itemsPerSecond;
+    double mbPerSecond;
+    double allocsPerItem;
+};
+
+static volatile double sink;
+
+// Runs pass() once to warm up, once to count the allocations, then repeatedly
+// for at least minTimeMs and reports the median pass time.
+template<typename Pass>
+static Result measure(const QString& name, quint64 items, quint64 bytes, int minTimeMs, Pass pass)
+{
+    pass();
+
+    quint64 before = allocations.load(std::memory_order_relaxed);
+    pass();
+    quint64 allocs = allocations.load(std::memory_order_relaxed) - before;
+
+    std::vector<qint64> times;
+    QElapsedTimer total;
+    total.start();
+    do {
+        QElapsedTimer timer;
+        timer.start();
+        pass();
+        times.push_back(timer.nsecsElapsed());
+    } while (total.elapsed() < minTimeMs || times.size() < 5);
+    std::sort(times.begin(), times.end());
+    double passNs = times[times.size() / 2];
+
+    Result r;
+    r.name = name;
+    r.items = items;
+    r.bytes = bytes;
+    r.nsPerItem = passNs / items;
+    r.itemsPerSecond = items * 1e9 / passNs;
+    r.mbPerSecond = bytes ? bytes * 1e3 / passNs : 0.0;
+    r.allocsPerItem = static_cast<double>(allocs) / items;
+    printf("%-16s %12.1f ns/item %14.0f items/s %10.1f MB/s %8.2f allocs/item\n",
+           qPrintable(name), r.nsPerItem, r.itemsPerSecond, r.mbPerSecond, r.allocsPerItem);
+    fflush(stdout);
+    return r;
+}
+
+static QJsonObject toJson(const Result& r)
+{
+    return QJsonObject{
+        {"name", r.name},
+        {"items", static_cast<double>(r.items)},
+        {"bytes", static_cast<double>(r.bytes)},
+        {"ns_per_item", r.nsPerItem},
+        {"items_per_second", r.itemsPerSecond},
+        {"mb_per_second", r.mbPerSecond},
+        {"allocs_per_item", r.allocsPerItem}
+    };
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("rtkrover_bench");
+    QCoreApplication::setApplicationVersion("1.0");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Microbenchmarks of the rtkrover hot paths.");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    QCommandLineOption nmeaOption("nmea", "Recorded NMEA log (one sentence per line).", "file");
+    QCommandLineOption rtcmOption("rtcm", "Recorded raw RTCM 3 stream.", "file");
+    QCommandLineOption jsonOption("json", "Write the results as JSON.", "file");
+    QCommandLineOption baselineOption("baseline", "Compare with the JSON results of a previous run.", "file");
+    QCommandLineOption filterOption("filter", "Only run the benchmarks whose name contains this text.", "text");
+    QCommandLineOption minTimeOption("min-time", "Minimum time per benchmark in milliseconds.", "ms", "500");
+    parser.addOption(nmeaOption);
+    parser.addOption(rtcmOption);
+    parser.addOption(jsonOption);
+    parser.addOption(baselineOption);
+    parser.addOption(filterOption);
+    parser.addOption(minTimeOption);
+    parser.process(a);
+
+    const int minTimeMs = parser.value(minTimeOption).toInt();
+    const QString filter = parser.value(filterOption);
+
+    QList<QString> sentences;
+    if (!parser.isSet(nmeaOption)) {
+        sentences = generateNmea();
+    } else if (!loadNmea(parser.value(nmeaOption), sentences)) {
+        fprintf(stderr, "Can't read %s\n", qPrintable(parser.value(nmeaOption)));
+        return 1;
+    }
+    QByteArray rtcm;
+    if (!parser.isSet(rtcmOption)) {
+        rtcm = generateRtcm();
+    } else if (!loadRaw(parser.value(rtcmOption), rtcm)) {
+        fprintf(stderr, "Can't read %s\n", qPrintable(parser.value(rtcmOption)));
+        return 1;
+    }
+    quint64 nmeaBytes = 0;
+    for (const QString& s : std::as_const(sentences)) nmeaBytes += s.size() + 2;
+
+    // Frames and fixes of the corpora, used as input by the later benchmarks
+    std::vector<std::pair<const unsigned char*, size_t>> frames;
+    quint64 frameBytes = 0;
+    const unsigned char* rtcmData = reinterpret_cast<const unsigned char*>(rtcm.constData());
+    rtcmExtractFrames(rtcmData, rtcm.size(), [&frames, &frameBytes](const unsigned char* frame, size_t length, int) {
+        frames.emplace_back(frame, length);
+        frameBytes += length;
+    });
+    QList<GpsData> fixes;
+    {
+        GpsData gpsData;
+        for (const QString& s : std::as_const(sentences)) {
+            gpsData.parse_NMEA(s);
+            if (s.mid(3, 3) == "GGA" && gpsData.hasFix()) fixes << gpsData;
+        }
+    }
+    std::vector<double> latitudes, longitudes;
+    for (const GpsData& fix : std::as_const(fixes)) {
+        latitudes.push_back(fix.latitude());
+        longitudes.push_back(fix.longitude());
+    }
+    printf("Corpus: %lld NMEA sentences (%lld bytes, %lld fixes), %lld RTCM bytes (%lld frames)\n",
+           static_cast<long long>(sentences.size()), static_cast<long long>(nmeaBytes),
+           static_cast<long long>(fixes.size()), static_cast<long long>(rtcm.size()),
+           static_cast<long long>(frames.size()));
+    if (frames.empty() || fixes.isEmpty()) {
+        fprintf(stderr, "The corpus must contain RTCM frames and NMEA fixes\n");
+        return 1;
+    }
+
+    QList<Result> results;
+    auto selected = [&filter](const char* name) { return filter.isEmpty() || QString(name).contains(filter); };
+
+    if (selected("rtcm_crc")) {
+        results << measure("rtcm_crc", frames.size(), frameBytes, minTimeMs, [&frames]() {
+            uint32_t x = 0;
+            for (const auto& frame : frames) x ^= rtcm_crc(frame.first, frame.second - 3);
+            sink = x;
+        });
+    }
+
+    if (selected("rtcm_framing")) {
+        // Same buffering as CasterReader: socket reads of one TCP segment, one QByteArray per frame
+        results << measure("rtcm_framing", frames.size(), rtcm.size(), minTimeMs, [&rtcm]() {
+            QByteArray buffer;
+            buffer.reserve(4096);
+            quint64 count = 0;
+            for (qsizetype offset = 0; offset < rtcm.size(); offset += 1460) {
+                buffer.append(rtcm.constData() + offset, qMin<qsizetype>(1460, rtcm.size() - offset));
+                size_t consumed = rtcmExtractFrames(reinterpret_cast<const unsigned char*>(buffer.constData()), buffer.size(),
+                    [&count](const unsigned char* frame, size_t length, int) {
+                        QByteArray packet(reinterpret_cast<const char*>(frame), length);
+                        count += packet.size();
+                    });
+                buffer.remove(0, consumed);
+            }
+            sink = count;
+        });
+    }
+
+    if (selected("nmea_parse")) {
+        results << measure("nmea_parse", sentences.size(), nmeaBytes, minTimeMs, [&sentences]() {
+            GpsData gpsData;
+            int accepted = 0;
+            for (const QString& s : sentences) accepted += gpsData.parse_NMEA(s);
+            sink = accepted + gpsData.latitude();
+        });
+    }
+
+    if (selected("convert_to_utm")) {
+        results << measure("convert_to_utm", fixes.size(), 0, minTimeMs, [&fixes]() {
+            double x = 0;
+            for (const GpsData& fix : fixes) x += fix.convertToUtm().easting;
+            sink = x;
+        });
+    }
+
+    if (selected("utm_batch")) {
+        std::vector<double> easting(latitudes.size()), northing(latitudes.size());
+        std::vector<int> zone(latitudes.size());
+        results << measure("utm_batch", latitudes.size(), 0, minTimeMs, [&]() {
+            Geodesy::latLonToUtm(latitudes.data(), longitudes.data(), latitudes.size(),
+                                 easting.data(), northing.data(), zone.data());
+            sink = easting.back();
+        });
+    }
+
+    if (selected("format_csv")) {
+        FixFormatter formatter;
+        results << measure("format_csv", fixes.size(), 0, minTimeMs, [&fixes, &formatter]() {
+            qsizetype size = 0;
+            for (const GpsData& fix : fixes) size += formatter.csv(fix).size();
+            sink = size;
+        });
+    }
+
+    if (selected("format_json")) {
+        FixFormatter formatter;
+        results << measure("format_json", fixes.size(), 0, minTimeMs, [&fixes, &formatter]() {
+            qsizetype size = 0;
+            for (const GpsData& fix : fixes) size += formatter.json(fix).size();
+            sink = size;
+        });
+    }
+
+    if (selected("binary_record")) {
+        char record[sizeof(rtk_fix_record)];
+        results << measure("binary_record", fixes.size(), 0, minTimeMs, [&fixes, &record]() {
+            quint32 sequence = 0;
+            for (const GpsData& fix : fixes) encodeFixRecord(fix, sequence++, 0, record);
+            sink = record[40];
+        });
+    }
+
+    // MSM observations: the generated stream, or the MSM frames of the recorded capture
+    QByteArray msm = parser.isSet(rtcmOption) ? rtcm : generateMsm();
+    std::vector<std::pair<const unsigned char*, size_t>> msmFrames;
+    int msmEpochs = 0;
+    rtcmExtractFrames(reinterpret_cast<const unsigned char*>(msm.constData()), msm.size(),
+        [&msmFrames, &msmEpochs](const unsigned char* frame, size_t length, int type) {
+            RtcmMsm message;
+            if (type == 1005 || type == 1006 || message.parse(frame, length)) msmFrames.emplace_back(frame, length);
+            if (message.type() && !message.multipleMessage()) ++msmEpochs;
+        });
+    // A stream with one message per second and constellation at 1 Hz: CPU share of one core
+    auto reportLoad = [](const Result& r) {
+        printf("%-16s %12.4f %% of one core at 1 Hz\n", "", r.nsPerItem / 1e7);
+    };
+
+    if (msmEpochs > 0 && selected("msm_header")) {
+        results << measure("msm_header", msmEpochs, 0, minTimeMs, [&msmFrames]() {
+            int cells = 0;
+            for (const auto& frame : msmFrames) {
+                RtcmMsm message;
+                if (message.parse(frame.first, frame.second)) cells += message.cellCount();
+            }
+            sink = cells;
+        });
+    }
+
+    if (msmEpochs > 0 && selected("msm_decode")) {
+        RtcmMsmCell cells[RTCM_MSM_MAX_CELLS];
+        results << measure("msm_decode", msmEpochs, 0, minTimeMs, [&msmFrames, &cells]() {
+            double x = 0;
+            for (const auto& frame : msmFrames) {
+                RtcmMsm message;
+                if (!message.parse(frame.first, frame.second)) continue;
+                int count = message.decode(cells);
+                if (count) x += cells[count - 1].pseudorange;
+            }
+            sink = x;
+        });
+        reportLoad(results.last());
+    }
+
+    if (msmEpochs > 0 && selected("rinex_write")) {
+        // The reception time only resolves the week, the same one is used for all the frames
+        qint64 receivedUnixMs = MSM_START_GPS_MS + 315964800000LL - 18000;
+        results << measure("rinex_write", msmEpochs, 0, minTimeMs, [&msmFrames, receivedUnixMs]() {
+            quint64 size = 0;
+            RinexObsWriter writer(RinexObsWriter::Options(), [&size](const char*, size_t length) { size += length; });
+            for (const auto& frame : msmFrames) writer.addFrame(frame.first, frame.second, receivedUnixMs);
+            writer.flush();
+            sink = size;
+        });
+        reportLoad(results.last());
+    }
+
+    if (msmEpochs > 0 && (selected("relay_encode") || selected("relay_decode"))) {
+        // Compressed relay stream, encoded once to check the round trip and for the decoder
+        RtcmCompression method = rtcmDeflateAvailable() ? RtcmCompression::DeltaDeflate : RtcmCompression::Delta;
+        auto encode = [&msmFrames, method](std::vector<unsigned char>& stream) {
+            RtcmStreamEncoder encoder(method);
+            bool keyframe;
+            for (const auto& frame : msmFrames) {
+                if (encoder.addFrame(frame.first, frame.second)) encoder.flush(stream, keyframe);
+            }
+            encoder.flush(stream, keyframe);
+        };
+        std::vector<unsigned char> compressed;
+        encode(compressed);
+        std::vector<unsigned char> original, decoded;
+        for (const auto& frame : msmFrames) original.insert(original.end(), frame.first, frame.first + frame.second);
+        RtcmStreamDecoder decoder(method);
+        decoder.addData(compressed.data(), compressed.size(), [&decoded](const unsigned char* frame, size_t length, int) {
+            decoded.insert(decoded.end(), frame, frame + length);
+        });
+        printf("%-16s %s: %zu -> %zu bytes, ratio %.2f, %s\n", "relay", rtcmCompressionName(method),
+               original.size(), compressed.size(), static_cast<double>(original.size()) / compressed.size(),
+               decoded == original ? "round trip exact" : "ROUND TRIP MISMATCH");
+
+        if (selected("relay_encode")) {
+            std::vector<unsigned char> stream;
+            stream.reserve(compressed.size());
+            results << measure("relay_encode", msmEpochs, original.size(), minTimeMs, [&encode, &stream]() {
+                stream.clear();
+                encode(stream);
+                sink = stream.size();
+            });
+            reportLoad(results.last());
+        }
+        if (selected("relay_decode")) {
+            results << measure("relay_decode", msmEpochs, compressed.size(), minTimeMs, [&compressed, method]() {
+                size_t size = 0;
+                RtcmStreamDecoder decoder(method);
+                decoder.addData(compressed.data(), compressed.size(), [&size](const unsigned char*, size_t length, int) {
+                    size += length;
+                });
+                sink = size;
+            });
+            reportLoad(results.last());
+        }
+    }
+
+    if (parser.isSet(baselineOption)) {
+        QFile file(parser.value(baselineOption));
+        if (file.open(QIODevice::ReadOnly)) {
+            QJsonArray baseline = QJsonDocument::fromJson(file.readAll()).object().value("results").toArray();
+            printf("\nCompared with %s:\n", qPrintable(parser.value(baselineOption)));
+            for (const Result& r : std::as_const(results)) {
+                for (const QJsonValue& value : baseline) {
+                    QJsonObject old = value.toObject();
+                    if (old.value("name").toString() != r.name) continue;
+                    double before = old.value("ns_per_item").toDouble();
+                    printf("%-16s %12.1f -> %10.1f ns/item (%+6.1f%%), allocs/item %.2f -> %.2f\n",
+                           qPrintable(r.name), before, r.nsPerItem, (r.nsPerItem / before - 1.0) * 100.0,
+                           old.value("allocs_per_item").toDouble(), r.allocsPerItem);
+                }
+            }
+        } else {
+            fprintf(stderr, "Can't read %s\n", qPrintable(parser.value(baselineOption)));
+        }
+    }
+
+    if (parser.isSet(jsonOption)) {
+        QJsonArray array;
+        for (const Result& r : std::as_const(results)) array.append(toJson(r));
+        QJsonObject root{
+            {"date", QDateTime::currentDateTimeUtc().toString(Qt::ISODate)},
+            {"host", QSysInfo::machineHostName()},
+            {"cpu", QSysInfo::currentCpuArchitecture()},
+            {"nmea_corpus", parser.isSet(nmeaOption) ? parser.value(nmeaOption) : QString("generated")},
+            {"rtcm_corpus", parser.isSet(rtcmOption) ? parser.value(rtcmOption) : QString("generated")},
+            {"results", array}
+        };
+        QFile file(parser.value(jsonOption));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            fprintf(stderr, "Can't write %s\n", qPrintable(parser.value(jsonOption)));
+            return 1;
+        }
+        file.write(QJsonDocument(root).toJson());
+    }
+    return 0;
+}
@@ -0,0 +1,162 @@
+/*
+ * rtkshm.h - Header-only reader for the rtkrover shared memory segment
+ *
+ * When [shm] is enabled, rtkrover publishes the latest fix and a ring of
+ * the previous ones in a POSIX shared memory segment (default "/rtkrover").
+ * Each slot is protected by a sequence lock: readers never block the rover
+ * and never make a system call once the segment is mapped.
+ *
+ *     RtkShmReader reader;
+ *     if (reader.open("/rtkrover")) {
+ *         rtk_fix_record fix;
+ *         if (reader.latest(fix)) ...
+ *     }
+ *
+ * Records use the layout of rtkfix.h. Link with -lrt on older glibc.
+ */
+#ifndef RTKSHM_H
+#define RTKSHM_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "rtkfix.h"
+
+#define RTK_SHM_MAGIC   0x4D485352u  /* "RSHM" */
+#define RTK_SHM_VERSION 1
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "shared memory needs lock-free atomics");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared memory needs lock-free atomics");
+
+struct rtk_shm_slot {
+    std::atomic<uint32_t> seq;  // Odd while the writer updates the slot
+    uint32_t reserved;
+    rtk_fix_record record;
+};
+
+struct rtk_shm_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t slot_size;
+    uint32_t history_capacity;
+    uint32_t writer_pid;              // Process of the rover, to tell a segment left by a crash from a live one
+    std::atomic<uint64_t> published;  // Number of fixes published since the rover started
+    rtk_shm_slot latest;
+    // Followed by history_capacity slots, fix n is in slot n % history_capacity
+};
+
+inline size_t rtk_shm_size(uint32_t historyCapacity)
+{
+    return sizeof(rtk_shm_header) + historyCapacity * sizeof(rtk_shm_slot);
+}
+
+inline rtk_shm_slot* rtk_shm_history(rtk_shm_header* header)
+{
+    return reinterpret_cast<rtk_shm_slot*>(header + 1);
+}
+
+inline const rtk_shm_slot* rtk_shm_history(const rtk_shm_header* header)
+{
+    return reinterpret_cast<const rtk_shm_slot*>(header + 1);
+}
+
+// Writer side of the sequence lock
+inline void rtk_shm_write_slot(rtk_shm_slot* slot, const void* record)
+{
+    uint32_t seq = slot->seq.load(std::memory_order_relaxed);
+    slot->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(&slot->record, record, sizeof(rtk_fix_record));
+    slot->seq.store(seq + 2, std::memory_order_release);
+}
+
+// Reader side of the sequence lock, returns the slot sequence (0 if the slot was never written)
+inline uint32_t rtk_shm_read_slot(const rtk_shm_slot* slot, rtk_fix_record* record)
+{
+    for (;;) {
+        uint32_t before = slot->seq.load(std::memory_order_acquire);
+        if (before & 1) continue;
+        std::memcpy(record, &slot->record, sizeof(rtk_fix_record));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot->seq.load(std::memory_order_relaxed) == before) return before;
+    }
+}
+
+class RtkShmReader
+{
+public:
+    RtkShmReader() : _header(nullptr), _size(0) {}
+    ~RtkShmReader() { close(); }
+    RtkShmReader(const RtkShmReader&) = delete;
+    RtkShmReader& operator=(const RtkShmReader&) = delete;
+
+    bool open(const char* name = "/rtkrover")
+    {
+        close();
+        int fd = shm_open(name, O_RDONLY, 0);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(rtk_shm_header)) {
+            ::close(fd);
+            return false;
+        }
+        void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (map == MAP_FAILED) return false;
+        _header = static_cast<const rtk_shm_header*>(map);
+        _size = st.st_size;
+        if (_header->magic != RTK_SHM_MAGIC || _header->version != RTK_SHM_VERSION
+            || _header->slot_size != sizeof(rtk_shm_slot) || _size < rtk_shm_size(_header->history_capacity)) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close()
+    {
+        if (_header) munmap(const_cast<rtk_shm_header*>(_header), _size);
+        _header = nullptr;
+        _size = 0;
+    }
+
+    bool isOpen() const { return _header != nullptr; }
+
+    // Number of fixes published so far
+    uint64_t published() const { return _header->published.load(std::memory_order_acquire); }
+
+    // Latest fix, false if nothing was published yet
+    bool latest(rtk_fix_record& record) const
+    {
+        return rtk_shm_read_slot(&_header->latest, &record) != 0;
+    }
+
+    // Copies up to maxCount of the newest fixes, oldest first. Returns the number copied.
+    size_t history(rtk_fix_record* records, size_t maxCount) const
+    {
+        const uint64_t capacity = _header->history_capacity;
+        uint64_t end = published();
+        uint64_t count = end < capacity ? end : capacity;
+        // Keep a spare slot, the writer may be updating the oldest one
+        if (count == capacity && count > 0) --count;
+        if (count > maxCount) count = maxCount;
+        const rtk_shm_slot* slots = rtk_shm_history(_header);
+        size_t copied = 0;
+        for (uint64_t n = end - count; n < end; ++n) {
+            rtk_shm_read_slot(&slots[n % capacity], &records[copied]);
+            if (records[copied].magic == RTK_FIX_MAGIC) ++copied;
+        }
+        return copied;
+    }
+
+private:
+    const rtk_shm_header* _header;
+    size_t _size;
+};
+
+#endif // RTKSHM_H
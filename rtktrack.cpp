@@ -0,0 +1,97 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <QTextStream>
+#include <QTimeZone>
+#include <QDebug>
+#include <cstdio>
+#include "trackstore.h"
+
+// Query tool for the track store written by the "track" output
+static bool parseTime(const QString& text, qint64& ms)
+{
+    QDateTime time = QDateTime::fromString(text, Qt::ISODateWithMs);
+    if (!time.isValid()) return false;
+    if (time.timeSpec() == Qt::LocalTime) {
+        time.setTimeZone(QTimeZone::utc()); // Times without offset are UTC, like the NMEA times
+    }
+    ms = time.toMSecsSinceEpoch();
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("rtktrack");
+    QCoreApplication::setApplicationVersion("1.0");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Query a track store written by rtkrover.");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addPositionalArgument("file", "Track store file (e.g. track.rtrk).");
+    QCommandLineOption fromOption("from", "Start time, ISO 8601 (UTC if no offset).", "time");
+    QCommandLineOption toOption("to", "End time, ISO 8601 (UTC if no offset).", "time");
+    QCommandLineOption bboxOption("bbox", "Bounding box in degrees.", "minLat,minLon,maxLat,maxLon");
+    QCommandLineOption statsOption("stats", "Print the number of blocks read on stderr.");
+    parser.addOption(fromOption);
+    parser.addOption(toOption);
+    parser.addOption(bboxOption);
+    parser.addOption(statsOption);
+    parser.process(a);
+
+    if (parser.positionalArguments().size() != 1) {
+        parser.showHelp(1);
+    }
+
+    TrackStore::Query query;
+    if (parser.isSet(fromOption) && !parseTime(parser.value(fromOption), query.fromMs)) {
+        qCritical() << "Invalid time:" << parser.value(fromOption);
+        return 1;
+    }
+    if (parser.isSet(toOption) && !parseTime(parser.value(toOption), query.toMs)) {
+        qCritical() << "Invalid time:" << parser.value(toOption);
+        return 1;
+    }
+    if (parser.isSet(bboxOption)) {
+        QStringList values = parser.value(bboxOption).split(',');
+        bool ok = values.size() == 4;
+        double box[4] = {0, 0, 0, 0};
+        for (int i = 0; ok && i < 4; ++i) {
+            box[i] = values[i].trimmed().toDouble(&ok);
+        }
+        if (!ok) {
+            qCritical() << "Invalid bounding box:" << parser.value(bboxOption);
+            return 1;
+        }
+        query.hasBox = true;
+        query.minLat = box[0];
+        query.minLon = box[1];
+        query.maxLat = box[2];
+        query.maxLon = box[3];
+    }
+
+    TrackStore::Reader reader;
+    if (!reader.open(parser.positionalArguments().first())) {
+        return 1;
+    }
+
+    QTextStream out(stdout);
+    out << "timestamp,latitude,longitude,altitude,fix_quality\n";
+    qint64 points = 0;
+    int decoded = reader.query(query, [&out, &points](const TrackStore::Point& p) {
+        out << QDateTime::fromMSecsSinceEpoch(p.timeMs, QTimeZone::utc()).toString(Qt::ISODateWithMs) << ','
+            << QString::number(p.latitude, 'f', 9) << ','
+            << QString::number(p.longitude, 'f', 9) << ','
+            << QString::number(p.altitude, 'f', 3) << ','
+            << p.fixQuality << '\n';
+        ++points;
+    });
+    out.flush();
+
+    if (parser.isSet(statsOption)) {
+        fprintf(stderr, "%lld points, %d of %lld blocks decoded\n",
+                static_cast<long long>(points), decoded, static_cast<long long>(reader.blocks().size()));
+    }
+    return 0;
+}
@@ -1,6 +1,8 @@
 #include "serialcom.h"
 #include <QDebug>
 #include <QSerialPortInfo>
+#include "metrics.h"
+#include "trace.h"
 
 SerialCom::SerialCom(QObject *parent)
     : QObject{parent},
@@ -21,6 +23,8 @@ void SerialCom::init(const QString &portName, int baudRate, int gpsRate)
     m_baudRate = baudRate;
     m_gpsRate = gpsRate;
 
+    // A reconfigured port replaces the previous one
+    delete m_serial;
     m_serial = new QSerialPort(this);
     m_serial->setPortName(m_portName);
     m_serial->setBaudRate(m_baudRate);
@@ -61,8 +65,11 @@ QString SerialCom::autodetect()
 
 void SerialCom::start()
 {
-    connect(m_serial, &QSerialPort::readyRead, this, &SerialCom::handleReadyRead);
-    connect(m_serial, &QSerialPort::errorOccurred, this, &SerialCom::handleError);
+    connect(m_serial, &QSerialPort::readyRead, this, &SerialCom::handleReadyRead, Qt::UniqueConnection);
+    connect(m_serial, &QSerialPort::errorOccurred, this, &SerialCom::handleError, Qt::UniqueConnection);
+    if (m_serial->isOpen()) {
+        emit receiverLinkEstablished();
+    }
 }
 
 void SerialCom::stop()
@@ -74,21 +81,30 @@ void SerialCom::stop()
 
 void SerialCom::writeRtcmPacket(const Packet& packet)
 {
+    RTK_TRACE_SCOPE("SerialCom::writeRtcmPacket");
     if (m_serial && m_serial->isOpen()) {
-        m_serial->write(packet);
+        qint64 written = m_serial->write(packet);
+        if (written > 0) Metrics::registry().serialBytesOut.add(written);
         //qDebug() << "Serial: Wrote" << packet.size() << "bytes to GPS.";
     }
 }
 
 void SerialCom::handleReadyRead()
 {
+    RTK_TRACE_SCOPE("SerialCom::handleReadyRead");
     if (!m_serial || !m_serial->isOpen()) return;
 
     QByteArray data = m_serial->readAll();
+    Metrics::registry().serialBytesIn.add(data.size());
     QString nmeaString(data);
 
     for(const QString& line : nmeaString.split("\r\n", Qt::SkipEmptyParts)) {
         if (line.startsWith('$')) {
+            // u-blox receivers print their banner in TXT sentences when they (re)start
+            if (line.mid(3, 3) == "TXT" && line.contains("u-blox AG")) {
+                qDebug() << "Serial: Receiver restarted";
+                emit receiverLinkEstablished();
+            }
             emit got_NMEA(line);
         }
     }
@@ -27,6 +27,8 @@ public slots:
 
 signals:
     void got_NMEA(const QString& nmea);
+    // The port was opened or the receiver restarted: it has lost the static RTCM messages
+    void receiverLinkEstablished();
 
 private slots:
     void handleReadyRead();
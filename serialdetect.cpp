@@ -0,0 +1,106 @@
+#include "serialdetect.h"
+#include "crc24q.h"
+#include "nmeaparser.h"
+#include <string_view>
+
+static const size_t NMEA_MAX_LENGTH = 100;     // 82 in the standard, some receivers send more
+static const size_t UBX_MAX_PAYLOAD = 1024;
+static const unsigned char UBX_CLASS_MON = 0x0A;
+static const unsigned char UBX_ID_MON_VER = 0x04;
+
+const unsigned char SerialTrafficDetector::MON_VER_POLL[8] = {0xB5, 0x62, 0x0A, 0x04, 0x00, 0x00, 0x0E, 0x34};
+
+void SerialTrafficDetector::addData(const unsigned char* data, size_t size)
+{
+    _bytes += size;
+    _buffer.insert(_buffer.end(), data, data + size);
+    const unsigned char* p = _buffer.data();
+    size_t offset = 0;
+    while (offset < _buffer.size()) {
+        long length = -1;
+        switch (p[offset]) {
+        case '$': length = nmeaMessage(p + offset, _buffer.size() - offset); break;
+        case 0xB5: length = ubxMessage(p + offset, _buffer.size() - offset); break;
+        case 0xD3: length = rtcmMessage(p + offset, _buffer.size() - offset); break;
+        default: break;
+        }
+        if (length == 0) break;     // Kept for the next read
+        offset += length > 0 ? static_cast<size_t>(length) : 1;
+    }
+    _buffer.erase(_buffer.begin(), _buffer.begin() + static_cast<std::ptrdiff_t>(offset));
+}
+
+long SerialTrafficDetector::nmeaMessage(const unsigned char* data, size_t size)
+{
+    for (size_t i = 1; i < size && i < NMEA_MAX_LENGTH; ++i) {
+        if (data[i] == '$') return -1;
+        if (data[i] != '\r' && data[i] != '\n') continue;
+        if (!NmeaParser::validateChecksum(std::string_view(reinterpret_cast<const char*>(data), i))) return -1;
+        ++_nmea;
+        return static_cast<long>(i);
+    }
+    return size < NMEA_MAX_LENGTH ? 0 : -1;
+}
+
+long SerialTrafficDetector::ubxMessage(const unsigned char* data, size_t size)
+{
+    if (size < 6) return 0;
+    if (data[1] != 0x62) return -1;
+    size_t length = data[4] | (data[5] << 8);
+    if (length > UBX_MAX_PAYLOAD) return -1;
+    if (size < length + 8) return 0;
+    // Fletcher checksum of the class, id, length and payload
+    unsigned char a = 0, b = 0;
+    for (size_t i = 2; i < length + 6; ++i) {
+        a = static_cast<unsigned char>(a + data[i]);
+        b = static_cast<unsigned char>(b + a);
+    }
+    if (a != data[length + 6] || b != data[length + 7]) return -1;
+    ++_ubx;
+    if (data[2] == UBX_CLASS_MON && data[3] == UBX_ID_MON_VER && length >= 40) {
+        parseMonVer(data + 6, length);
+    }
+    return static_cast<long>(length + 8);
+}
+
+long SerialTrafficDetector::rtcmMessage(const unsigned char* data, size_t size)
+{
+    if (size < 3) return 0;
+    size_t length = ((data[1] & 0x03) << 8) | data[2];
+    if (data[1] & 0xFC) return -1;      // Reserved bits
+    if (size < length + 6) return 0;
+    uint32_t received = (data[length + 3] << 16) | (data[length + 4] << 8) | data[length + 5];
+    if (received != rtcm_crc(data, length + 3)) return -1;
+    ++_rtcm;
+    return static_cast<long>(length + 6);
+}
+
+// Zero-terminated strings: software version (30), hardware version (10), extensions (30 each)
+void SerialTrafficDetector::parseMonVer(const unsigned char* payload, size_t size)
+{
+    auto field = [payload](size_t offset, size_t width) {
+        const char* text = reinterpret_cast<const char*>(payload + offset);
+        size_t length = 0;
+        while (length < width && text[length]) ++length;
+        return std::string(text, length);
+    };
+    _monVer = true;
+    _softwareVersion = field(0, 30);
+    _hardwareVersion = field(30, 10);
+    for (size_t offset = 40; offset + 30 <= size; offset += 30) {
+        std::string extension = field(offset, 30);
+        if (extension.compare(0, 4, "MOD=") == 0) _module = extension.substr(4);
+    }
+}
+
+int SerialTrafficDetector::score() const
+{
+    int score = 0;
+    if (_monVer) score += 1000;
+    if (_nmea > 0) score += 500;
+    if (_ubx > 0) score += 200;
+    if (_rtcm > 0) score += 100;
+    // Then the amount of valid traffic
+    int messages = _nmea + _ubx + _rtcm;
+    return score + (messages < 99 ? messages : 99);
+}
@@ -0,0 +1,60 @@
+#ifndef SERIALDETECT_H
+#define SERIALDETECT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Identifies the traffic of a serial port read at a guessed baud rate.
+ *
+ * NMEA sentences (checksum), UBX frames (Fletcher checksum) and RTCM 3
+ * frames (CRC-24Q) are counted; only valid ones count, so the bytes read at
+ * a wrong baud rate give nothing. The answer to the UBX-MON-VER poll gives
+ * the software and hardware versions and the module name of a u-blox
+ * receiver.
+ */
+class SerialTrafficDetector
+{
+public:
+    // UBX-MON-VER poll, with its checksum
+    static const unsigned char MON_VER_POLL[8];
+
+    void addData(const unsigned char* data, size_t size);
+    void reset() { *this = SerialTrafficDetector(); }
+
+    int nmeaSentences() const { return _nmea; }
+    int ubxFrames() const { return _ubx; }
+    int rtcmFrames() const { return _rtcm; }
+    uint64_t bytes() const { return _bytes; }
+
+    bool hasMonVer() const { return _monVer; }
+    const std::string& softwareVersion() const { return _softwareVersion; }
+    const std::string& hardwareVersion() const { return _hardwareVersion; }
+    const std::string& module() const { return _module; }     // "ZED-F9P", from the MOD= extension
+
+    // A GNSS receiver talks NMEA or UBX, RTCM alone is a correction link
+    bool isReceiver() const { return _nmea > 0 || _ubx > 0; }
+    // Higher for a more certain receiver: MON-VER answer, then NMEA, then UBX, then RTCM
+    int score() const;
+
+private:
+    // Length of the message at the start of data: > 0 valid, 0 incomplete, < 0 not a message
+    long nmeaMessage(const unsigned char* data, size_t size);
+    long ubxMessage(const unsigned char* data, size_t size);
+    long rtcmMessage(const unsigned char* data, size_t size);
+    void parseMonVer(const unsigned char* payload, size_t size);
+
+    std::vector<unsigned char> _buffer;     // Incomplete message
+    uint64_t _bytes = 0;
+    int _nmea = 0;
+    int _ubx = 0;
+    int _rtcm = 0;
+    bool _monVer = false;
+    std::string _softwareVersion;
+    std::string _hardwareVersion;
+    std::string _module;
+};
+
+#endif // SERIALDETECT_H
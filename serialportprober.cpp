@@ -0,0 +1,184 @@
+#include "serialportprober.h"
+#include "logger.h"
+#include <QDebug>
+
+// Score of SerialTrafficDetector from which the port is a receiver (NMEA, UBX or MON-VER)
+static const int MIN_RECEIVER_SCORE = 200;
+
+SerialPortProber::SerialPortProber(QObject *parent)
+    : QObject{parent}
+{
+    _timeout.setSingleShot(true);
+    connect(&_timeout, &QTimer::timeout, this, &SerialPortProber::finish);
+}
+
+SerialPortProber::~SerialPortProber()
+{
+    closePorts();
+}
+
+void SerialPortProber::start(const QStringList& portNames, const QList<int>& baudRates, int timeoutMs, int dwellMs)
+{
+    stop();
+    _baudRates = baudRates;
+    _dwellMs = dwellMs;
+    _clock.start();
+
+    QStringList names;
+    for (const QSerialPortInfo& info : QSerialPortInfo::availablePorts()) {
+        bool named = portNames.contains(info.portName()) || portNames.contains(info.systemLocation());
+        if (!portNames.isEmpty() && !named) continue;
+        Port* port = new Port;
+        port->info = info;
+        port->pollable = named || info.hasVendorIdentifier() || !info.description().isEmpty();
+        port->serial = new QSerialPort(info, this);
+        port->serial->setDataBits(QSerialPort::Data8);
+        port->serial->setParity(QSerialPort::NoParity);
+        port->serial->setStopBits(QSerialPort::OneStop);
+        port->serial->setFlowControl(QSerialPort::NoFlowControl);
+        port->dwell = new QTimer(this);
+        port->dwell->setSingleShot(true);
+        connect(port->serial, &QSerialPort::readyRead, this, [this, port]() { onReadyRead(port); });
+        connect(port->dwell, &QTimer::timeout, this, [this, port]() { onDwellEnd(port); });
+        _ports.append(port);
+        names.append(port->pollable ? info.portName() : info.portName() + " (listen only)");
+    }
+    if (_ports.isEmpty()) {
+        qWarning() << "Serial: no serial port to probe";
+        _timeout.start(0);
+        return;
+    }
+    qDebug() << "Serial: probing" << names.join(", ");
+
+    bool pending = false;
+    for (Port* port : std::as_const(_ports)) {
+        if (!port->serial->open(QIODevice::ReadWrite)) {
+            qDebug() << "Serial: can't probe" << port->info.portName() << ":" << port->serial->errorString();
+            port->done = true;
+            continue;
+        }
+        pending = true;
+        tryBaudRate(port);
+    }
+    // The end is always reported from the event loop, after start() returned
+    _timeout.start(pending ? timeoutMs : 0);
+}
+
+void SerialPortProber::stop()
+{
+    _timeout.stop();
+    closePorts();
+}
+
+// The signals of the ports are disconnected first: a port may be closed from its own readyRead()
+void SerialPortProber::closePorts()
+{
+    for (Port* port : std::as_const(_ports)) {
+        port->serial->disconnect(this);
+        port->dwell->disconnect(this);
+        port->dwell->stop();
+        if (port->serial->isOpen()) port->serial->close();
+        port->serial->deleteLater();
+        port->dwell->deleteLater();
+    }
+    qDeleteAll(_ports);
+    _ports.clear();
+}
+
+QString SerialPortProber::portOfSerialNumber(const QString& serialNumber)
+{
+    if (serialNumber.isEmpty()) return QString();
+    for (const QSerialPortInfo& info : QSerialPortInfo::availablePorts()) {
+        if (info.serialNumber() == serialNumber) return info.portName();
+    }
+    return QString();
+}
+
+void SerialPortProber::finish()
+{
+    _timeout.stop();
+    Result best;
+    for (Port* port : std::as_const(_ports)) {
+        if (port->result.score >= MIN_RECEIVER_SCORE && port->result.score > best.score) {
+            best = port->result;
+        }
+    }
+    closePorts();
+    if (best.found()) {
+        RTK_LOG_INFO("serial", "Receiver detected", {"port", best.portName}, {"baud", best.baudRate},
+                     {"receiver", best.receiver}, {"serial_number", best.serialNumber}, {"ms", _clock.elapsed()});
+    } else {
+        qWarning() << "Serial: no receiver found after" << _clock.elapsed() << "ms";
+    }
+    emit finished(best);
+}
+
+// Listens for the first half of the dwell time, the poll (if allowed) is sent in the second one
+void SerialPortProber::tryBaudRate(Port* port)
+{
+    if (port->baudIndex >= _baudRates.size()) {
+        finishPort(port, false);
+        return;
+    }
+    port->serial->setBaudRate(_baudRates[port->baudIndex]);
+    port->serial->clear();
+    port->detector.reset();
+    port->polled = false;
+    port->dwell->start(port->pollable ? _dwellMs / 2 : _dwellMs);
+}
+
+void SerialPortProber::onReadyRead(Port* port)
+{
+    QByteArray data = port->serial->readAll();
+    if (port->done) return;
+    port->detector.addData(reinterpret_cast<const unsigned char*>(data.constData()), data.size());
+    // A u-blox receiver sending NMEA: nothing better to wait for
+    if (port->detector.hasMonVer() && port->detector.nmeaSentences() > 0) {
+        finishPort(port, true);
+        if (isProbing()) finish();
+    }
+}
+
+void SerialPortProber::onDwellEnd(Port* port)
+{
+    if (port->detector.score() > 0) {
+        finishPort(port, true);
+    } else if (port->pollable && !port->polled) {
+        port->polled = true;
+        port->serial->write(reinterpret_cast<const char*>(SerialTrafficDetector::MON_VER_POLL),
+                            sizeof(SerialTrafficDetector::MON_VER_POLL));
+        port->dwell->start(_dwellMs - _dwellMs / 2);
+    } else {
+        ++port->baudIndex;
+        tryBaudRate(port);
+    }
+}
+
+void SerialPortProber::finishPort(Port* port, bool identified)
+{
+    port->done = true;
+    port->dwell->stop();
+    port->serial->close();
+    if (identified) {
+        const SerialTrafficDetector& d = port->detector;
+        Result& r = port->result;
+        r.portName = port->info.portName();
+        r.baudRate = _baudRates[port->baudIndex];
+        r.serialNumber = port->info.serialNumber();
+        r.score = d.score();
+        if (d.hasMonVer()) {
+            r.receiver = QString("u-blox %1 (%2, hardware %3)").arg(QString::fromStdString(d.module()),
+                QString::fromStdString(d.softwareVersion()), QString::fromStdString(d.hardwareVersion()));
+        } else {
+            r.receiver = QString("%1 NMEA, %2 UBX, %3 RTCM messages")
+                             .arg(d.nmeaSentences()).arg(d.ubxFrames()).arg(d.rtcmFrames());
+        }
+        RTK_LOG_INFO("serial", "Serial port probed", {"port", r.portName}, {"baud", r.baudRate},
+                     {"receiver", r.receiver}, {"score", r.score});
+    }
+
+    for (Port* other : std::as_const(_ports)) {
+        if (!other->done) return;
+    }
+    finish();
+}
@@ -0,0 +1,85 @@
+#ifndef SERIALPORTPROBER_H
+#define SERIALPORTPROBER_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QList>
+#include <QSerialPortInfo>
+#include <QStringList>
+#include <QtSerialPort/QSerialPort>
+#include <QTimer>
+#include "serialdetect.h"
+
+/**
+ * Finds the GNSS receiver among the serial ports, with its baud rate.
+ *
+ * All the ports are opened at the same time. Each one is read at the baud
+ * rates in turn, for a dwell time; the valid NMEA, UBX and RTCM messages tell
+ * the baud rate (see SerialTrafficDetector). The first half of the dwell is
+ * passive listening: a UBX-MON-VER poll is only sent after it when nothing
+ * valid was read, and only to the ports given by name, USB devices and ports
+ * with a description. The other ones (on-board UARTs, consoles, modems) are
+ * never written. A port that answers MON-VER and sends NMEA ends the detection
+ * at once, otherwise it ends when every port was tried or after the timeout,
+ * and the port with the best traffic is chosen. Ports with RTCM only
+ * (correction radios) are not receivers. finished() is emitted at the end.
+ */
+class SerialPortProber : public QObject
+{
+    Q_OBJECT
+public:
+    struct Result {
+        QString portName;
+        int baudRate = 0;
+        QString serialNumber;       // USB serial number, empty for the other ports
+        QString receiver;           // Module and firmware from MON-VER, or the traffic seen
+        int score = 0;
+        bool found() const { return !portName.isEmpty(); }
+    };
+
+    // Most common first: u-blox UART default, USB and configured rates, older receivers
+    static QList<int> defaultBaudRates() { return {38400, 115200, 9600, 230400, 460800, 57600}; }
+
+    explicit SerialPortProber(QObject *parent = nullptr);
+    ~SerialPortProber();
+
+    // Probes the ports (all the available ones if empty) for at most timeoutMs. A probe in progress is dropped.
+    void start(const QStringList& portNames, const QList<int>& baudRates, int timeoutMs, int dwellMs = 1200);
+    // Drops the probe in progress, without finished()
+    void stop();
+    bool isProbing() const { return !_ports.isEmpty(); }
+
+    // Port of the USB device with this serial number, empty if it is not connected
+    static QString portOfSerialNumber(const QString& serialNumber);
+
+signals:
+    void finished(const SerialPortProber::Result& result);
+
+private:
+    struct Port {
+        QSerialPortInfo info;
+        QSerialPort* serial = nullptr;
+        QTimer* dwell = nullptr;
+        int baudIndex = 0;
+        bool pollable = false;      // MON-VER may be sent
+        bool polled = false;        // At the current baud rate
+        bool done = false;
+        SerialTrafficDetector detector;
+        Result result;
+    };
+
+    void tryBaudRate(Port* port);
+    void onReadyRead(Port* port);
+    void onDwellEnd(Port* port);
+    void finishPort(Port* port, bool identified);
+    void finish();
+    void closePorts();
+
+    QList<Port*> _ports;
+    QList<int> _baudRates;
+    int _dwellMs = 1200;
+    QTimer _timeout;
+    QElapsedTimer _clock;
+};
+
+#endif // SERIALPORTPROBER_H
@@ -0,0 +1,122 @@
+#include "shmpublisher.h"
+#include "fixrecord.h"
+#include "rtkshm.h"
+#include <QDebug>
+#include <QFile>
+#include <cerrno>
+#include <csignal>
+#include <new>
+
+ShmPublisher::ShmPublisher()
+    : _header(nullptr),
+      _size(0),
+      _published(0)
+{
+}
+
+ShmPublisher::~ShmPublisher()
+{
+    close();
+}
+
+// A segment of the same name left by a rover that exited without closing it can be replaced. One of a
+// running rover, or of another program, is kept.
+static bool isStaleSegment(const char* name)
+{
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) return errno == ENOENT;
+    struct stat st;
+    const rtk_shm_header* header = nullptr;
+    if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(rtk_shm_header)) {
+        void* map = mmap(nullptr, sizeof(rtk_shm_header), PROT_READ, MAP_SHARED, fd, 0);
+        if (map != MAP_FAILED) header = static_cast<const rtk_shm_header*>(map);
+    }
+    ::close(fd);
+    if (!header) return false;
+    bool stale = header->magic == RTK_SHM_MAGIC && header->version == RTK_SHM_VERSION
+                 && header->writer_pid != 0 && kill(static_cast<pid_t>(header->writer_pid), 0) != 0 && errno == ESRCH;
+    munmap(const_cast<rtk_shm_header*>(header), sizeof(rtk_shm_header));
+    return stale;
+}
+
+bool ShmPublisher::open(const QString& name, int historyCapacity)
+{
+    close();
+    if (historyCapacity < 1) historyCapacity = 1;
+
+    // Created exclusively, so that the segment of another process is never reused
+    QByteArray shmName = QFile::encodeName(name);
+    int fd = shm_open(shmName.constData(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0 && errno == EEXIST && isStaleSegment(shmName.constData())) {
+        qDebug() << "Shared memory: replacing" << name << "left by a previous run";
+        shm_unlink(shmName.constData());
+        fd = shm_open(shmName.constData(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    }
+    if (fd < 0) {
+        if (errno == EEXIST) {
+            qWarning() << "Shared memory:" << name << "is used by a running rover or another program, set [shm] name";
+        } else {
+            qWarning() << "Shared memory: failed to create" << name << ":" << strerror(errno);
+        }
+        return false;
+    }
+    size_t size = rtk_shm_size(historyCapacity);
+    if (ftruncate(fd, size) != 0) {
+        qWarning() << "Shared memory: failed to resize" << name << ":" << strerror(errno);
+        ::close(fd);
+        shm_unlink(shmName.constData());
+        return false;
+    }
+    void* map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        qWarning() << "Shared memory: failed to map" << name << ":" << strerror(errno);
+        shm_unlink(shmName.constData());
+        return false;
+    }
+
+    // Readers check the magic last, so it is written after the rest of the header
+    memset(map, 0, size);
+    _header = new (map) rtk_shm_header;
+    _header->version = RTK_SHM_VERSION;
+    _header->slot_size = sizeof(rtk_shm_slot);
+    _header->history_capacity = static_cast<uint32_t>(historyCapacity);
+    _header->writer_pid = static_cast<uint32_t>(getpid());
+    _header->published.store(0, std::memory_order_relaxed);
+    _header->latest.seq.store(0, std::memory_order_relaxed);
+    rtk_shm_slot* slots = rtk_shm_history(_header);
+    for (int i = 0; i < historyCapacity; ++i) {
+        new (&slots[i]) rtk_shm_slot;
+        slots[i].seq.store(0, std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    _header->magic = RTK_SHM_MAGIC;
+
+    _name = name;
+    _size = size;
+    _published = 0;
+    qDebug() << "Shared memory: publishing fixes in" << name << "with" << historyCapacity << "history slots";
+    return true;
+}
+
+void ShmPublisher::close()
+{
+    if (!_header) return;
+    munmap(_header, _size);
+    shm_unlink(QFile::encodeName(_name).constData());
+    _header = nullptr;
+    _size = 0;
+}
+
+void ShmPublisher::publish(const GpsData& gpsData, quint64 receiveTimeNs)
+{
+    if (!_header) return;
+
+    char record[sizeof(rtk_fix_record)];
+    encodeFixRecord(gpsData, static_cast<quint32>(_published), receiveTimeNs, record);
+
+    rtk_shm_slot* slots = rtk_shm_history(_header);
+    rtk_shm_write_slot(&slots[_published % _header->history_capacity], record);
+    rtk_shm_write_slot(&_header->latest, record);
+    _header->published.store(++_published, std::memory_order_release);
+}
@@ -0,0 +1,33 @@
+#ifndef SHMPUBLISHER_H
+#define SHMPUBLISHER_H
+
+#include <QString>
+#include "gpsdataparser.h"
+
+struct rtk_shm_header;
+
+/**
+ * Publishes the latest fix and a small history in a POSIX shared memory
+ * segment, for the processes running on the same machine. The layout and
+ * a header-only reader are in rtkshm.h.
+ */
+class ShmPublisher
+{
+public:
+    ShmPublisher();
+    ~ShmPublisher();
+
+    bool open(const QString& name, int historyCapacity);
+    void close();
+    bool isOpen() const { return _header != nullptr; }
+
+    void publish(const GpsData& gpsData, quint64 receiveTimeNs);
+
+private:
+    QString _name;
+    rtk_shm_header* _header;
+    size_t _size;
+    quint64 _published;
+};
+
+#endif // SHMPUBLISHER_H
@@ -0,0 +1,95 @@
+#include "trace.h"
+#include <QCoreApplication>
+#include <QDebug>
+#include <QFile>
+#include <QMutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace Trace {
+
+struct Event {
+    const char* name;
+    quint64 startNs;
+    quint64 endNs;
+};
+
+// Single writer (the owning thread), read by dump()
+struct ThreadBuffer {
+    int tid;
+    std::atomic<quint64> head{0};
+    Event events[BUFFER_EVENTS];
+};
+
+static QMutex buffersMutex;
+static std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+
+// Buffers outlive their threads, so that dump() still sees their events
+static ThreadBuffer* threadBuffer()
+{
+    thread_local ThreadBuffer* buffer = nullptr;
+    if (!buffer) {
+        QMutexLocker locker(&buffersMutex);
+        buffers.push_back(std::make_unique<ThreadBuffer>());
+        buffer = buffers.back().get();
+        buffer->tid = static_cast<int>(buffers.size());
+    }
+    return buffer;
+}
+
+void record(const char* name, quint64 startNs, quint64 endNs)
+{
+    ThreadBuffer* buffer = threadBuffer();
+    quint64 head = buffer->head.load(std::memory_order_relaxed);
+    buffer->events[head % BUFFER_EVENTS] = {name, startNs, endNs};
+    buffer->head.store(head + 1, std::memory_order_release);
+}
+
+bool dump(const QString& fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Trace: failed to open" << fileName << file.errorString();
+        return false;
+    }
+
+    const qint64 pid = QCoreApplication::applicationPid();
+    QByteArray out = "{\"traceEvents\":[\n";
+    int count = 0;
+    QMutexLocker locker(&buffersMutex);
+    for (const std::unique_ptr<ThreadBuffer>& buffer : buffers) {
+        quint64 end = buffer->head.load(std::memory_order_acquire);
+        quint64 begin = end > BUFFER_EVENTS ? end - BUFFER_EVENTS : 0;
+        std::vector<Event> events;
+        events.reserve(end - begin);
+        for (quint64 i = begin; i < end; ++i) {
+            events.push_back(buffer->events[i % BUFFER_EVENTS]);
+        }
+        // Drop the events the thread overwrote while they were copied
+        quint64 overwritten = buffer->head.load(std::memory_order_acquire) - end;
+        size_t first = overwritten < events.size() ? overwritten : events.size();
+
+        for (size_t i = first; i < events.size(); ++i) {
+            const Event& e = events[i];
+            if (count++ > 0) out.append(",\n");
+            out.append("{\"name\":\"").append(e.name)
+               .append("\",\"ph\":\"X\",\"pid\":").append(QByteArray::number(pid))
+               .append(",\"tid\":").append(QByteArray::number(buffer->tid))
+               .append(",\"ts\":").append(QByteArray::number(e.startNs / 1000.0, 'f', 3))
+               .append(",\"dur\":").append(QByteArray::number((e.endNs - e.startNs) / 1000.0, 'f', 3))
+               .append('}');
+        }
+        if (out.size() > (1 << 20)) {
+            file.write(out);
+            out.clear();
+        }
+    }
+    out.append("\n]}\n");
+    file.write(out);
+    file.close();
+    qDebug() << "Trace:" << count << "events written to" << fileName;
+    return true;
+}
+
+} // namespace Trace
@@ -0,0 +1,59 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QString>
+#include <chrono>
+
+/**
+ * Hot-path tracing in the Chrome trace event format.
+ *
+ * RTK_TRACE_SCOPE("name") records the duration of the enclosing scope in a
+ * ring buffer owned by the calling thread (no lock, no allocation once the
+ * buffer exists). Trace::dump() writes the events of all the threads as a
+ * JSON file that can be opened in chrome://tracing or ui.perfetto.dev.
+ *
+ * Tracing is compiled in with -DRTKROVER_TRACING=ON; otherwise the scopes
+ * compile to nothing.
+ */
+namespace Trace {
+
+// Events kept per thread, the oldest ones are overwritten
+const int BUFFER_EVENTS = 1 << 16;
+
+inline quint64 nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Records a complete event, name must be a string literal
+void record(const char* name, quint64 startNs, quint64 endNs);
+
+// Writes the recorded events, returns false if the file can't be written
+bool dump(const QString& fileName);
+
+class Scope
+{
+public:
+    explicit Scope(const char* name) : _name(name), _start(nowNs()) {}
+    ~Scope() { record(_name, _start, nowNs()); }
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+private:
+    const char* _name;
+    quint64 _start;
+};
+
+} // namespace Trace
+
+#define RTK_TRACE_CONCAT2(a, b) a##b
+#define RTK_TRACE_CONCAT(a, b) RTK_TRACE_CONCAT2(a, b)
+
+#ifdef RTKROVER_TRACE
+#define RTK_TRACE_SCOPE(name) Trace::Scope RTK_TRACE_CONCAT(_traceScope, __LINE__)(name)
+#else
+#define RTK_TRACE_SCOPE(name) do {} while (0)
+#endif
+
+#endif // TRACE_H
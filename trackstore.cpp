@@ -0,0 +1,467 @@
+#include "trackstore.h"
+#include <QDebug>
+#include <QtEndian>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace TrackStore {
+
+static const char DATA_MAGIC[4] = {'R', 'T', 'R', 'K'};
+static const char INDEX_MAGIC[4] = {'R', 'T', 'K', 'I'};
+static const quint32 BLOCK_MAGIC = 0x424B5452; // "RTKB"
+static const quint32 FORMAT_VERSION = 1;
+static const int FILE_HEADER_SIZE = 8;
+static const int BLOCK_HEADER_SIZE = 76;
+static const int INDEX_ENTRY_SIZE = 64;
+static const int COLUMNS = 5;
+
+// --- Column encoding ---
+
+static inline quint64 zigzag(qint64 value)
+{
+    return (static_cast<quint64>(value) << 1) ^ static_cast<quint64>(value >> 63);
+}
+
+static inline qint64 unzigzag(quint64 value)
+{
+    return static_cast<qint64>(value >> 1) ^ -static_cast<qint64>(value & 1);
+}
+
+static void putVarint(QByteArray& out, qint64 value)
+{
+    quint64 v = zigzag(value);
+    while (v >= 0x80) {
+        out.append(static_cast<char>(v | 0x80));
+        v >>= 7;
+    }
+    out.append(static_cast<char>(v));
+}
+
+static bool getVarint(const uchar*& p, const uchar* end, qint64& value)
+{
+    quint64 v = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        uchar byte = *p++;
+        v |= static_cast<quint64>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            value = unzigzag(v);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Decodes a delta-encoded column of count values
+static bool decodeColumn(const uchar* p, const uchar* end, int count, qint64 start, QVector<qint64>& values)
+{
+    values.resize(count);
+    qint64 v = start;
+    for (int i = 0; i < count; ++i) {
+        qint64 delta;
+        if (!getVarint(p, end, delta)) return false;
+        v += delta;
+        values[i] = v;
+    }
+    return true;
+}
+
+static void writeIndexEntry(char* out, const BlockIndex& b)
+{
+    qToLittleEndian<qint64>(b.firstTimeMs, out);
+    qToLittleEndian<qint64>(b.lastTimeMs, out + 8);
+    qToLittleEndian<qint64>(b.minLat, out + 16);
+    qToLittleEndian<qint64>(b.maxLat, out + 24);
+    qToLittleEndian<qint64>(b.minLon, out + 32);
+    qToLittleEndian<qint64>(b.maxLon, out + 40);
+    qToLittleEndian<quint64>(b.offset, out + 48);
+    qToLittleEndian<quint32>(b.size, out + 56);
+    qToLittleEndian<quint32>(b.count, out + 60);
+}
+
+static BlockIndex readIndexEntry(const uchar* in)
+{
+    BlockIndex b;
+    b.firstTimeMs = qFromLittleEndian<qint64>(in);
+    b.lastTimeMs = qFromLittleEndian<qint64>(in + 8);
+    b.minLat = qFromLittleEndian<qint64>(in + 16);
+    b.maxLat = qFromLittleEndian<qint64>(in + 24);
+    b.minLon = qFromLittleEndian<qint64>(in + 32);
+    b.maxLon = qFromLittleEndian<qint64>(in + 40);
+    b.offset = qFromLittleEndian<quint64>(in + 48);
+    b.size = qFromLittleEndian<quint32>(in + 56);
+    b.count = qFromLittleEndian<quint32>(in + 60);
+    return b;
+}
+
+// Reads the block headers from the start of the data file. Returns the end of the last complete block:
+// a block torn by a crash (partial header or columns) ends the scan.
+static qint64 scanBlocks(const uchar* map, qint64 size, QVector<BlockIndex>& blocks)
+{
+    blocks.clear();
+    qint64 offset = FILE_HEADER_SIZE;
+    while (offset + BLOCK_HEADER_SIZE <= size) {
+        const uchar* h = map + offset;
+        if (qFromLittleEndian<quint32>(h) != BLOCK_MAGIC) break;
+        BlockIndex b;
+        b.count = qFromLittleEndian<quint32>(h + 4);
+        b.firstTimeMs = qFromLittleEndian<qint64>(h + 8);
+        b.lastTimeMs = qFromLittleEndian<qint64>(h + 16);
+        b.minLat = qFromLittleEndian<qint64>(h + 24);
+        b.maxLat = qFromLittleEndian<qint64>(h + 32);
+        b.minLon = qFromLittleEndian<qint64>(h + 40);
+        b.maxLon = qFromLittleEndian<qint64>(h + 48);
+        qint64 blockSize = BLOCK_HEADER_SIZE;
+        for (int c = 0; c < COLUMNS; ++c) {
+            blockSize += qFromLittleEndian<quint32>(h + 56 + 4 * c);
+        }
+        if (offset + blockSize > size) break; // Truncated block
+        b.size = blockSize;
+        b.offset = offset;
+        blocks.append(b);
+        offset += blockSize;
+    }
+    return offset;
+}
+
+// --- Writer ---
+
+Writer::Writer()
+    : _lastTimeMs(std::numeric_limits<qint64>::min()),
+      _outOfOrder(0)
+{
+    _pending.reserve(BLOCK_POINTS);
+}
+
+Writer::~Writer()
+{
+    close();
+}
+
+bool Writer::open(const QString& fileName)
+{
+    close();
+    _outOfOrder = 0;
+
+    _data.setFileName(fileName);
+    if (!_data.open(QIODevice::ReadWrite)) {
+        qWarning() << "Track store: failed to open" << fileName << _data.errorString();
+        return false;
+    }
+    if (_data.size() == 0) {
+        char header[FILE_HEADER_SIZE];
+        memcpy(header, DATA_MAGIC, 4);
+        qToLittleEndian<quint32>(FORMAT_VERSION, header + 4);
+        _data.write(header, FILE_HEADER_SIZE);
+    } else {
+        QByteArray header = _data.read(FILE_HEADER_SIZE);
+        if (header.size() != FILE_HEADER_SIZE || memcmp(header.constData(), DATA_MAGIC, 4) != 0) {
+            qWarning() << "Track store:" << fileName << "is not a track file";
+            _data.close();
+            return false;
+        }
+    }
+    _index.setFileName(fileName + ".idx");
+    if (!recover(fileName)) {
+        _data.close();
+        return false;
+    }
+    _data.seek(_data.size());
+    return true;
+}
+
+// Truncates a block torn by a crash, rewrites the index if it does not match the blocks and
+// takes the time of the last stored point, so that the new points are appended after it
+bool Writer::recover(const QString& fileName)
+{
+    QVector<BlockIndex> blocks;
+    qint64 size = _data.size();
+    if (size > FILE_HEADER_SIZE) {
+        uchar* map = _data.map(0, size);
+        if (!map) {
+            qWarning() << "Track store: failed to map" << fileName << _data.errorString();
+            return false;
+        }
+        qint64 end = scanBlocks(map, size, blocks);
+        _data.unmap(map);
+        if (end < size) {
+            qWarning() << "Track store: truncating" << size - end << "bytes of a torn block at the end of" << fileName;
+            if (!_data.resize(end)) {
+                qWarning() << "Track store: failed to truncate" << fileName << _data.errorString();
+                return false;
+            }
+        }
+    }
+    _lastTimeMs = blocks.isEmpty() ? std::numeric_limits<qint64>::min() : blocks.last().lastTimeMs;
+
+    const qint64 indexSize = FILE_HEADER_SIZE + static_cast<qint64>(blocks.size()) * INDEX_ENTRY_SIZE;
+    bool indexValid = false;
+    QFile index(_index.fileName());
+    if (index.size() == indexSize && index.open(QIODevice::ReadOnly)) {
+        QByteArray content = index.readAll();
+        indexValid = content.size() == indexSize && memcmp(content.constData(), INDEX_MAGIC, 4) == 0;
+        const uchar* p = reinterpret_cast<const uchar*>(content.constData()) + FILE_HEADER_SIZE;
+        for (int i = 0; indexValid && i < blocks.size(); ++i) {
+            indexValid = readIndexEntry(p + i * INDEX_ENTRY_SIZE).offset == blocks[i].offset;
+        }
+    }
+
+    if (indexValid) {
+        if (!_index.open(QIODevice::WriteOnly | QIODevice::Append)) {
+            qWarning() << "Track store: failed to open" << _index.fileName() << _index.errorString();
+            return false;
+        }
+        return true;
+    }
+    if (!_index.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Track store: failed to open" << _index.fileName() << _index.errorString();
+        return false;
+    }
+    if (!blocks.isEmpty()) {
+        qWarning() << "Track store: rebuilding the index of" << fileName;
+    }
+    QByteArray content(indexSize, Qt::Uninitialized);
+    memcpy(content.data(), INDEX_MAGIC, 4);
+    qToLittleEndian<quint32>(FORMAT_VERSION, content.data() + 4);
+    for (int i = 0; i < blocks.size(); ++i) {
+        writeIndexEntry(content.data() + FILE_HEADER_SIZE + i * INDEX_ENTRY_SIZE, blocks[i]);
+    }
+    _index.write(content);
+    _index.flush();
+    return true;
+}
+
+void Writer::close()
+{
+    if (!_data.isOpen()) return;
+    flush();
+    _data.close();
+    _index.close();
+    if (_outOfOrder > 0) {
+        qWarning() << "Track store:" << _outOfOrder << "points out of time order were dropped";
+    }
+}
+
+void Writer::append(const Point& point)
+{
+    if (!_data.isOpen()) return;
+    if (point.timeMs < _lastTimeMs) {
+        // Out of order, the blocks must stay sorted by time
+        if (++_outOfOrder == 1 || _outOfOrder % 1000 == 0) {
+            qWarning() << "Track store: dropped a point of" << point.timeMs << "ms older than the last one of"
+                       << _lastTimeMs << "ms (" << _outOfOrder << "so far)";
+        }
+        return;
+    }
+    _lastTimeMs = point.timeMs;
+    if (!_pending.isEmpty()) {
+        if (_pending.size() >= BLOCK_POINTS || point.timeMs - _pending.first().timeMs >= BLOCK_SPAN_MS) {
+            flush();
+        }
+    }
+    _pending.append(point);
+}
+
+void Writer::flush()
+{
+    if (_pending.isEmpty() || !_data.isOpen()) return;
+
+    const int count = _pending.size();
+    QVector<qint64> lat(count), lon(count);
+    BlockIndex b;
+    b.firstTimeMs = _pending.first().timeMs;
+    b.lastTimeMs = _pending.last().timeMs;
+    for (int i = 0; i < count; ++i) {
+        lat[i] = std::llround(_pending[i].latitude * DEGREE_SCALE);
+        lon[i] = std::llround(_pending[i].longitude * DEGREE_SCALE);
+    }
+    b.minLat = *std::min_element(lat.begin(), lat.end());
+    b.maxLat = *std::max_element(lat.begin(), lat.end());
+    b.minLon = *std::min_element(lon.begin(), lon.end());
+    b.maxLon = *std::max_element(lon.begin(), lon.end());
+
+    // Columns, each delta-encoded from a known start value
+    QByteArray columns[COLUMNS];
+    qint64 prevTime = b.firstTimeMs, prevLat = b.minLat, prevLon = b.minLon, prevAlt = 0;
+    for (int i = 0; i < count; ++i) {
+        const Point& p = _pending[i];
+        qint64 alt = std::llround(p.altitude * ALTITUDE_SCALE);
+        putVarint(columns[0], p.timeMs - prevTime);
+        putVarint(columns[1], lat[i] - prevLat);
+        putVarint(columns[2], lon[i] - prevLon);
+        putVarint(columns[3], alt - prevAlt);
+        columns[4].append(static_cast<char>(p.fixQuality));
+        prevTime = p.timeMs;
+        prevLat = lat[i];
+        prevLon = lon[i];
+        prevAlt = alt;
+    }
+
+    char header[BLOCK_HEADER_SIZE];
+    qToLittleEndian<quint32>(BLOCK_MAGIC, header);
+    qToLittleEndian<quint32>(count, header + 4);
+    qToLittleEndian<qint64>(b.firstTimeMs, header + 8);
+    qToLittleEndian<qint64>(b.lastTimeMs, header + 16);
+    qToLittleEndian<qint64>(b.minLat, header + 24);
+    qToLittleEndian<qint64>(b.maxLat, header + 32);
+    qToLittleEndian<qint64>(b.minLon, header + 40);
+    qToLittleEndian<qint64>(b.maxLon, header + 48);
+    quint32 size = BLOCK_HEADER_SIZE;
+    for (int c = 0; c < COLUMNS; ++c) {
+        qToLittleEndian<quint32>(columns[c].size(), header + 56 + 4 * c);
+        size += columns[c].size();
+    }
+
+    b.offset = _data.pos();
+    b.size = size;
+    b.count = count;
+    _data.write(header, BLOCK_HEADER_SIZE);
+    for (int c = 0; c < COLUMNS; ++c) {
+        _data.write(columns[c]);
+    }
+    _data.flush();
+
+    // The index entry is written after the block, a reader rebuilds a stale index
+    char entry[INDEX_ENTRY_SIZE];
+    writeIndexEntry(entry, b);
+    _index.write(entry, INDEX_ENTRY_SIZE);
+    _index.flush();
+
+    _pending.clear();
+}
+
+// --- Reader ---
+
+Reader::Reader()
+    : _map(nullptr),
+      _size(0)
+{
+}
+
+Reader::~Reader()
+{
+    close();
+}
+
+bool Reader::open(const QString& fileName)
+{
+    close();
+
+    _data.setFileName(fileName);
+    if (!_data.open(QIODevice::ReadOnly)) {
+        qWarning() << "Track store: failed to open" << fileName << _data.errorString();
+        return false;
+    }
+    _size = _data.size();
+    _map = _size > 0 ? _data.map(0, _size) : nullptr;
+    if (!_map || _size < FILE_HEADER_SIZE || memcmp(_map, DATA_MAGIC, 4) != 0) {
+        qWarning() << "Track store:" << fileName << "is not a track file";
+        close();
+        return false;
+    }
+
+    if (!loadIndex(fileName + ".idx")) {
+        qWarning() << "Track store: rebuilding the index of" << fileName;
+        rebuildIndex();
+    }
+    return true;
+}
+
+void Reader::close()
+{
+    if (_map) _data.unmap(const_cast<uchar*>(_map));
+    _map = nullptr;
+    _size = 0;
+    _data.close();
+    _blocks.clear();
+}
+
+bool Reader::loadIndex(const QString& indexName)
+{
+    QFile index(indexName);
+    if (!index.open(QIODevice::ReadOnly)) return false;
+    QByteArray content = index.readAll();
+    if (content.size() < FILE_HEADER_SIZE || memcmp(content.constData(), INDEX_MAGIC, 4) != 0) return false;
+
+    const uchar* p = reinterpret_cast<const uchar*>(content.constData()) + FILE_HEADER_SIZE;
+    int entries = (content.size() - FILE_HEADER_SIZE) / INDEX_ENTRY_SIZE;
+    _blocks.resize(entries);
+    quint64 expected = FILE_HEADER_SIZE;
+    for (int i = 0; i < entries; ++i) {
+        _blocks[i] = readIndexEntry(p + i * INDEX_ENTRY_SIZE);
+        if (_blocks[i].offset != expected) return false;
+        expected += _blocks[i].size;
+    }
+    // The index must cover the whole data file
+    return expected == static_cast<quint64>(_size);
+}
+
+void Reader::rebuildIndex()
+{
+    // A torn block at the end is ignored, the writer truncates it when it opens the file
+    if (scanBlocks(_map, _size, _blocks) < _size) {
+        qWarning() << "Track store: ignoring a torn block at the end of" << _data.fileName();
+    }
+}
+
+int Reader::query(const Query& query, const std::function<void(const Point&)>& callback) const
+{
+    const qint64 minLat = std::llround(query.minLat * DEGREE_SCALE);
+    const qint64 maxLat = std::llround(query.maxLat * DEGREE_SCALE);
+    const qint64 minLon = std::llround(query.minLon * DEGREE_SCALE);
+    const qint64 maxLon = std::llround(query.maxLon * DEGREE_SCALE);
+
+    // Blocks are sorted by time: skip directly to the first block ending after the start of the query
+    auto first = std::lower_bound(_blocks.begin(), _blocks.end(), query.fromMs,
+                                  [](const BlockIndex& b, qint64 t) { return b.lastTimeMs < t; });
+
+    int decoded = 0;
+    QVector<qint64> time, lat, lon, alt;
+    for (auto it = first; it != _blocks.end() && it->firstTimeMs <= query.toMs; ++it) {
+        const BlockIndex& b = *it;
+        if (query.hasBox && (b.maxLat < minLat || b.minLat > maxLat || b.maxLon < minLon || b.minLon > maxLon)) {
+            continue;
+        }
+
+        const uchar* h = _map + b.offset;
+        const uchar* end = h + b.size;
+        quint32 sizes[COLUMNS];
+        const uchar* column[COLUMNS];
+        const uchar* p = h + BLOCK_HEADER_SIZE;
+        for (int c = 0; c < COLUMNS; ++c) {
+            sizes[c] = qFromLittleEndian<quint32>(h + 56 + 4 * c);
+            column[c] = p;
+            p += sizes[c];
+        }
+        if (p > end) continue;
+        const int count = b.count;
+        ++decoded;
+
+        // Time first, the other columns are only decoded if some points are in the range
+        if (!decodeColumn(column[0], column[0] + sizes[0], count, b.firstTimeMs, time)) continue;
+        int begin = std::lower_bound(time.begin(), time.end(), query.fromMs) - time.begin();
+        int stop = std::upper_bound(time.begin(), time.end(), query.toMs) - time.begin();
+        if (begin >= stop) continue;
+
+        if (!decodeColumn(column[1], column[1] + sizes[1], stop, b.minLat, lat)) continue;
+        if (!decodeColumn(column[2], column[2] + sizes[2], stop, b.minLon, lon)) continue;
+        if (!decodeColumn(column[3], column[3] + sizes[3], stop, 0, alt)) continue;
+        if (sizes[4] < static_cast<quint32>(stop)) continue;
+
+        for (int i = begin; i < stop; ++i) {
+            if (query.hasBox && (lat[i] < minLat || lat[i] > maxLat || lon[i] < minLon || lon[i] > maxLon)) {
+                continue;
+            }
+            Point point;
+            point.timeMs = time[i];
+            point.latitude = lat[i] / DEGREE_SCALE;
+            point.longitude = lon[i] / DEGREE_SCALE;
+            point.altitude = alt[i] / ALTITUDE_SCALE;
+            point.fixQuality = column[4][i];
+            callback(point);
+        }
+    }
+    return decoded;
+}
+
+} // namespace TrackStore
@@ -0,0 +1,115 @@
+#ifndef TRACKSTORE_H
+#define TRACKSTORE_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include <QVector>
+#include <functional>
+#include <limits>
+
+/**
+ * Append-only columnar store for the fix history.
+ *
+ * Points are grouped in blocks (up to BLOCK_POINTS points or BLOCK_SPAN_MS
+ * of data), written as soon as they are complete: a crash loses at most the
+ * last BLOCK_SPAN_MS of points. Each block holds one column per field: delta-encoded time,
+ * latitude/longitude as delta-encoded integers of 1e-9 degree, altitude in
+ * millimeters and the fix quality. Deltas are zigzag varints.
+ *
+ * Next to the data file (e.g. track.rtrk) a sparse index (track.rtrk.idx)
+ * stores the time range, bounding box and offset of every block, so that a
+ * query only decodes the blocks it overlaps. Blocks are self-describing and
+ * the index is rebuilt from the data file if it is missing. A block torn by a
+ * crash is ignored by the readers and truncated when the writer opens the file.
+ */
+
+namespace TrackStore {
+
+const int BLOCK_POINTS = 1024;
+const qint64 BLOCK_SPAN_MS = 30 * 1000;
+const double DEGREE_SCALE = 1e9;     // Latitude/longitude unit: 1e-9 degree
+const double ALTITUDE_SCALE = 1e3;   // Altitude unit: millimeter
+
+struct Point {
+    qint64 timeMs;      // UTC, milliseconds since 1970-01-01
+    double latitude;
+    double longitude;
+    double altitude;
+    int fixQuality;
+};
+
+// One entry of the sparse index (fixed size, little-endian on disk)
+struct BlockIndex {
+    qint64 firstTimeMs;
+    qint64 lastTimeMs;
+    qint64 minLat, maxLat;  // 1e-9 degree
+    qint64 minLon, maxLon;
+    quint64 offset;         // Offset of the block in the data file
+    quint32 size;           // Size of the block, header included
+    quint32 count;          // Number of points
+};
+
+struct Query {
+    qint64 fromMs = std::numeric_limits<qint64>::min();
+    qint64 toMs = std::numeric_limits<qint64>::max();
+    bool hasBox = false;
+    double minLat = 0.0, minLon = 0.0, maxLat = 0.0, maxLon = 0.0;
+};
+
+class Writer
+{
+public:
+    Writer();
+    ~Writer();
+
+    bool open(const QString& fileName);
+    void close();
+    bool isOpen() const { return _data.isOpen(); }
+
+    // Points must be appended in time order, after the points already stored: the others are dropped
+    void append(const Point& point);
+    // Writes the pending points as a block
+    void flush();
+
+    // Points dropped because they were older than the last appended one
+    quint64 outOfOrder() const { return _outOfOrder; }
+
+private:
+    bool recover(const QString& fileName);
+
+    QFile _data;
+    QFile _index;
+    QVector<Point> _pending;
+    qint64 _lastTimeMs;
+    quint64 _outOfOrder;
+};
+
+class Reader
+{
+public:
+    Reader();
+    ~Reader();
+
+    bool open(const QString& fileName);
+    void close();
+
+    const QVector<BlockIndex>& blocks() const { return _blocks; }
+
+    // Calls callback for every point matching the query, in time order.
+    // Returns the number of decoded blocks.
+    int query(const Query& query, const std::function<void(const Point&)>& callback) const;
+
+private:
+    bool loadIndex(const QString& indexName);
+    void rebuildIndex();
+
+    QFile _data;
+    const uchar* _map;
+    qint64 _size;
+    QVector<BlockIndex> _blocks;
+};
+
+} // namespace TrackStore
+
+#endif // TRACKSTORE_H
@@ -0,0 +1,62 @@
+#include "unixsignal.h"
+#include <QCoreApplication>
+#include <QDebug>
+#include <QSocketNotifier>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static int signalFds[2] = {-1, -1};
+
+UnixSignalNotifier* UnixSignalNotifier::instance()
+{
+    static UnixSignalNotifier* notifier = new UnixSignalNotifier(QCoreApplication::instance());
+    return notifier;
+}
+
+UnixSignalNotifier::UnixSignalNotifier(QObject *parent)
+    : QObject(parent),
+      _notifier(nullptr)
+{
+    if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, signalFds) != 0) {
+        qWarning() << "Signals: socketpair failed:" << strerror(errno);
+        return;
+    }
+    _notifier = new QSocketNotifier(signalFds[1], QSocketNotifier::Read, this);
+    connect(_notifier, &QSocketNotifier::activated, this, &UnixSignalNotifier::onReadable);
+}
+
+bool UnixSignalNotifier::watch(int signal)
+{
+    if (!_notifier) return false;
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = &UnixSignalNotifier::handler;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    if (::sigaction(signal, &action, nullptr) != 0) {
+        qWarning() << "Signals: can't catch signal" << signal << strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+// Only async-signal-safe calls here
+void UnixSignalNotifier::handler(int signal)
+{
+    int savedErrno = errno;
+    unsigned char number = static_cast<unsigned char>(signal);
+    ssize_t ignored = ::write(signalFds[0], &number, 1);
+    (void)ignored;
+    errno = savedErrno;
+}
+
+void UnixSignalNotifier::onReadable()
+{
+    unsigned char number;
+    if (::read(signalFds[1], &number, 1) == 1) {
+        emit activated(number);
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef UNIXSIGNAL_H
+#define UNIXSIGNAL_H
+
+#include <QObject>
+
+class QSocketNotifier;
+
+/**
+ * Delivers Unix signals (SIGUSR1, SIGTERM...) to the event loop.
+ *
+ * The signal handler only writes the signal number to a socket pair, the
+ * activated() signal is then emitted from the thread of the notifier, where
+ * any work can be done safely.
+ */
+class UnixSignalNotifier : public QObject
+{
+    Q_OBJECT
+public:
+    static UnixSignalNotifier* instance();
+
+    // Starts catching the signal, returns false if the handler can't be installed
+    bool watch(int signal);
+
+signals:
+    void activated(int signal);
+
+private slots:
+    void onReadable();
+
+private:
+    explicit UnixSignalNotifier(QObject *parent = nullptr);
+    static void handler(int signal);
+
+    QSocketNotifier* _notifier;
+};
+
+#endif // UNIXSIGNAL_H